@@ -0,0 +1,144 @@
+/* layermesh/bench/bench_bounds.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <array>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <bounds.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// How many of the points which get past an atom's bounds are not in the atom
+// after all (the false positives of culling, each of which costs a wasted
+// contains()), for the sphere about the centroid which Tetrahedron used to
+// give, the minimal sphere it gives now, the box, and the sphere and box
+// together. The tetrahedra are random, and many are skinny, which is where
+// the centroid does worst. The counters are per query point.
+
+namespace {
+
+  const size_t ATOMS = 1024;
+  const size_t QUERY_POINTS = 4096;
+
+  enum culling { CENTROID_SPHERE, MINIMAL_SPHERE, BOX, SPHERE_AND_BOX };
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  // (stretched along a random axis by up to 20 times.)
+  vector<shared_ptr<Tetrahedron> > scene() {
+    vector<shared_ptr<Tetrahedron> > atoms;
+    srand(2);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < ATOMS; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      gvec scale(0.02, 0.02, 0.02);
+      scale[rand() % 3] *= 1.0 + 19.0 * uniform();
+      array<gvec, 4> points;
+      for (v = 0; v < 4; ++v) {
+        gvec p(uniform() - 0.5, uniform() - 0.5, uniform() - 0.5);
+        points[v] = centre + gvec(p[0] * scale[0], p[1] * scale[1],
+                                  p[2] * scale[2]);
+      }
+      atoms.push_back(make_shared<Tetrahedron>(points));
+    }
+    return atoms;
+  }
+
+  gsphere centroid_sphere(const Atom& atom) {
+    gvec_view points = atom.point_cloud_view();
+    gvec centroid;
+    unsigned i;
+    for (i = 0; i < 4; ++i) {
+      centroid = centroid + points[i];
+    }
+    gsphere ret;
+    ret.centre = centroid / 4.0;
+    ret.radius = 0.0;
+    for (i = 0; i < 4; ++i) {
+      double d = layermesh::modulus(points[i] - ret.centre);
+      if (d > ret.radius) ret.radius = d;
+    }
+    return ret;
+  }
+
+}
+
+static void BM_culling(benchmark::State& state) {
+  vector<shared_ptr<Tetrahedron> > atoms = scene();
+  culling method = static_cast<culling>(state.range(0));
+  vector<gsphere> spheres(atoms.size());
+  vector<gbox> boxes(atoms.size());
+  size_t i, j;
+  for (i = 0; i < atoms.size(); ++i) {
+    spheres[i] = method == CENTROID_SPHERE
+      ? centroid_sphere(*atoms[i]) : atoms[i]->get_boundary();
+    boxes[i] = atoms[i]->get_aabb();
+  }
+  gvec_list points;
+  for (i = 0; i < QUERY_POINTS; ++i) {
+    points.push_back(gvec(uniform(), uniform(), uniform()));
+  }
+
+  unsigned long long passed = 0, inside = 0;
+  while (state.KeepRunning()) {
+    passed = inside = 0;
+    for (i = 0; i < points.size(); ++i) {
+      for (j = 0; j < atoms.size(); ++j) {
+        bool pass = method == BOX
+          ? box_contains(boxes[j], points[i])
+          : sphere_contains(spheres[j], points[i]) &&
+            (method != SPHERE_AND_BOX || box_contains(boxes[j], points[i]));
+        if (pass) {
+          ++passed;
+          inside += atoms[j]->contains(points[i]);
+        }
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * points.size() * atoms.size());
+  state.counters["passed"] = double(passed) / points.size();
+  state.counters["false_positives"] = double(passed - inside) / points.size();
+}
+BENCHMARK(BM_culling)->ArgNames({"bounds"})
+  ->Arg(CENTROID_SPHERE)->Arg(MINIMAL_SPHERE)->Arg(BOX)->Arg(SPHERE_AND_BOX);
+
+static void BM_minimal_sphere(benchmark::State& state) {
+  gvec_list points;
+  srand(3);
+  size_t i;
+  for (i = 0; i < size_t(state.range(0)); ++i) {
+    points.push_back(gvec(uniform(), uniform(), uniform()));
+  }
+
+  while (state.KeepRunning()) {
+    gsphere s = minimal_sphere(points);
+    benchmark::DoNotOptimize(s.radius);
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_minimal_sphere)->ArgNames({"points"})
+  ->Arg(4)->Arg(1 << 10)->Arg(1 << 16);
+
+BENCHMARK_MAIN();
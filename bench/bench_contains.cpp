@@ -0,0 +1,238 @@
+/* layermesh/bench/bench_contains.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <cmath>
+#include <benchmark/benchmark.h>
+#include <tetrahedron.hpp>
+#include <hull.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+namespace {
+
+  Tetrahedron corner_tetrahedron() {
+    gvec_list points;
+    points.push_back(gvec(0.0, 0.0, 0.0));
+    points.push_back(gvec(1.0, 0.0, 0.0));
+    points.push_back(gvec(0.0, 1.0, 0.0));
+    points.push_back(gvec(0.0, 0.0, 1.0));
+    return Tetrahedron(points);
+  }
+
+  // points uniformly distributed over the bounding cube of the tetrahedron,
+  // so roughly one in six is contained.
+  void random_points(size_t count,
+                     vector<double>& x,
+                     vector<double>& y,
+                     vector<double>& z) {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    srand(1);
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      x[i] = static_cast<double>(rand()) / RAND_MAX;
+      y[i] = static_cast<double>(rand()) / RAND_MAX;
+      z[i] = static_cast<double>(rand()) / RAND_MAX;
+    }
+  }
+
+  // an atom which is just its points, so contains() is the hull based default.
+  class CloudAtom : public Atom {
+    private:
+      memsafe_gvec_list points;
+    public:
+      CloudAtom(const gvec_list& points)
+        : points(make_shared<gvec_list>(points)) {};
+      virtual memsafe_gvec_list point_cloud() const { return points; };
+      virtual unsigned internal_points_start_index() const {
+        return points->size();
+      };
+      virtual gsphere get_boundary() const { return gsphere(); };
+      virtual void save_stl(std::string, bool) {};
+  };
+
+  // the corner tetrahedron's points for n == 4, otherwise n points over the
+  // sphere inscribed in the unit cube.
+  gvec_list atom_points(unsigned n) {
+    gvec_list points;
+    if (n == 4) {
+      points.push_back(gvec(0.0, 0.0, 0.0));
+      points.push_back(gvec(1.0, 0.0, 0.0));
+      points.push_back(gvec(0.0, 1.0, 0.0));
+      points.push_back(gvec(0.0, 0.0, 1.0));
+      return points;
+    }
+    const double golden_angle = M_PI * (3.0 - sqrt(5.0));
+    unsigned i;
+    for (i = 0; i < n; ++i) {
+      double z = 1.0 - (2.0 * i + 1.0) / n;
+      double r = sqrt(1.0 - z * z);
+      points.push_back(gvec(0.5, 0.5, 0.5) +
+                       gvec(r * cos(golden_angle * i),
+                            r * sin(golden_angle * i),
+                            z) * 0.5);
+    }
+    return points;
+  }
+
+}
+
+static void BM_contains_per_point(benchmark::State& state) {
+  Tetrahedron t = corner_tetrahedron();
+  Atom& atom = t;
+  size_t count = state.range(0);
+  vector<double> x, y, z;
+  random_points(count, x, y, z);
+  vector<unsigned char> mask(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      mask[i] = atom.contains(gvec(x[i], y[i], z[i]));
+    }
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_contains_per_point)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_contains_batch(benchmark::State& state) {
+  Tetrahedron t = corner_tetrahedron();
+  Atom& atom = t;
+  size_t count = state.range(0);
+  vector<double> x, y, z;
+  random_points(count, x, y, z);
+  vector<unsigned char> mask(count);
+
+  while (state.KeepRunning()) {
+    atom.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_contains_batch)->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_contains_batch_single_precision(benchmark::State& state) {
+  gvec32_list points;
+  points.push_back(gvec32(0.0f, 0.0f, 0.0f));
+  points.push_back(gvec32(1.0f, 0.0f, 0.0f));
+  points.push_back(gvec32(0.0f, 1.0f, 0.0f));
+  points.push_back(gvec32(0.0f, 0.0f, 1.0f));
+  Tetrahedron32 t(points);
+  Atom& atom = t;
+
+  size_t count = state.range(0);
+  vector<double> x, y, z;
+  random_points(count, x, y, z);
+  vector<float> fx(x.begin(), x.end());
+  vector<float> fy(y.begin(), y.end());
+  vector<float> fz(z.begin(), z.end());
+  vector<unsigned char> mask(count);
+
+  while (state.KeepRunning()) {
+    atom.contains_batch(&fx[0], &fy[0], &fz[0], count, &mask[0]);
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_contains_batch_single_precision)->Arg(1 << 10)->Arg(1 << 16);
+
+// the default Atom::contains, on the planes of the hull of the points:
+static void BM_contains_default(benchmark::State& state) {
+  CloudAtom atom(atom_points(state.range(0)));
+  size_t count = 1 << 16;
+  vector<double> x, y, z;
+  random_points(count, x, y, z);
+  vector<unsigned char> mask(count);
+  atom.contains(gvec());
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      mask[i] = atom.contains(gvec(x[i], y[i], z[i]));
+    }
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_contains_default)->ArgName("points")->Arg(4)->Arg(64)->Arg(512);
+
+// the same planes in the order the hull produced them, to show what
+// order_by_rejection gains:
+static void BM_contains_hull_order(benchmark::State& state) {
+  gvec_list points = atom_points(state.range(0));
+  facet_triples facets = convex_hull(&points[0], points.size());
+  gplane_list planes = hull_planes(&points[0], facets);
+  size_t count = 1 << 16;
+  vector<double> x, y, z;
+  random_points(count, x, y, z);
+  vector<unsigned char> mask(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      mask[i] = halfspaces_contain(&planes[0], planes.size(),
+                                   gvec(x[i], y[i], z[i]));
+    }
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_contains_hull_order)
+  ->ArgName("points")->Arg(4)->Arg(64)->Arg(512);
+
+static void BM_get_boundary(benchmark::State& state) {
+  Tetrahedron t = corner_tetrahedron();
+  const Atom& atom = t;
+
+  while (state.KeepRunning()) {
+    gsphere boundary = atom.get_boundary();
+    benchmark::DoNotOptimize(boundary.radius);
+  }
+}
+BENCHMARK(BM_get_boundary);
+
+// The pattern of a get_boundary() which reads the points each time it is
+// called: through the memsafe shim, and through the view.
+static void BM_point_cloud(benchmark::State& state) {
+  Tetrahedron t = corner_tetrahedron();
+  Atom& atom = t;
+
+  while (state.KeepRunning()) {
+    memsafe_gvec_list cloud = atom.point_cloud();
+    benchmark::DoNotOptimize((*cloud)[3][2]);
+  }
+}
+BENCHMARK(BM_point_cloud);
+
+static void BM_point_cloud_view(benchmark::State& state) {
+  Tetrahedron t = corner_tetrahedron();
+  Atom& atom = t;
+
+  while (state.KeepRunning()) {
+    gvec_view cloud = atom.point_cloud_view();
+    benchmark::DoNotOptimize(cloud[3][2]);
+  }
+}
+BENCHMARK(BM_point_cloud_view);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,71 @@
+/* layermesh/bench/bench_contour.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <contour.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// Meshing a union of small tetrahedra by dual contouring, on one thread and
+// on one per hardware thread.
+// (Timed by the clock, since the slabs are meshed on other threads.)
+
+namespace {
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  shared_ptr<Union> scene(size_t count) {
+    shared_ptr<Union> u = make_shared<Union>();
+    srand(1);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < count; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      array<gvec, 4> points;
+      for (v = 0; v < 4; ++v) {
+        points[v] = centre + gvec(uniform(), uniform(), uniform()) * 0.1;
+      }
+      u->add(make_shared<Tetrahedron>(points));
+    }
+    return u;
+  }
+
+}
+
+static void BM_contour(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 10);
+  voxel_grid grid = grid_covering(u->get_aabb(), 1.0 / 64);
+  size_t facets = 0;
+  while (state.KeepRunning()) {
+    IndexedMesh mesh = contour(*u, grid, state.range(0));
+    facets = mesh.facets.size();
+  }
+  state.counters["facets"] = facets;
+  state.SetItemsProcessed(state.iterations() * facets);
+}
+BENCHMARK(BM_contour)->ArgNames({"threads"})->Arg(1)->Arg(0)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,153 @@
+/* layermesh/bench/bench_csg.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <benchmark/benchmark.h>
+#include <csg.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// A union of many small tetrahedra, queried point by point and in batches,
+// against testing every atom for every point. Few of the points fall inside
+// any tetrahedron, so the naive loop tests them all; the union finds the few
+// near each point through its Bvh.
+
+namespace {
+
+  const size_t QUERY_POINTS = 256;
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  vector<shared_ptr<Tetrahedron> > scene(size_t count) {
+    vector<shared_ptr<Tetrahedron> > atoms;
+    srand(1);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < count; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      array<gvec, 4> points;
+      for (v = 0; v < 4; ++v) {
+        points[v] = centre + gvec(uniform(), uniform(), uniform()) * 0.02;
+      }
+      atoms.push_back(make_shared<Tetrahedron>(points));
+    }
+    return atoms;
+  }
+
+  void query_points(vector<double>& x, vector<double>& y, vector<double>& z) {
+    x.resize(QUERY_POINTS);
+    y.resize(QUERY_POINTS);
+    z.resize(QUERY_POINTS);
+    size_t i;
+    for (i = 0; i < QUERY_POINTS; ++i) {
+      x[i] = uniform();
+      y[i] = uniform();
+      z[i] = uniform();
+    }
+  }
+
+}
+
+static void BM_every_atom(benchmark::State& state) {
+  vector<shared_ptr<Tetrahedron> > atoms = scene(state.range(0));
+  vector<double> x, y, z;
+  query_points(x, y, z);
+  vector<unsigned char> mask(QUERY_POINTS);
+  size_t i, j;
+
+  while (state.KeepRunning()) {
+    for (i = 0; i < QUERY_POINTS; ++i) {
+      gvec p(x[i], y[i], z[i]);
+      mask[i] = 0;
+      for (j = 0; j < atoms.size() && !mask[i]; ++j) {
+        mask[i] = atoms[j]->contains(p);
+      }
+    }
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * QUERY_POINTS);
+}
+BENCHMARK(BM_every_atom)->ArgName("atoms")->Arg(1 << 10)->Arg(1 << 13);
+
+static void BM_union_contains(benchmark::State& state) {
+  vector<shared_ptr<Tetrahedron> > atoms = scene(state.range(0));
+  Union u;
+  size_t i;
+  for (i = 0; i < atoms.size(); ++i) {
+    u.add(atoms[i]);
+  }
+  vector<double> x, y, z;
+  query_points(x, y, z);
+  vector<unsigned char> mask(QUERY_POINTS);
+
+  while (state.KeepRunning()) {
+    for (i = 0; i < QUERY_POINTS; ++i) {
+      mask[i] = u.contains(gvec(x[i], y[i], z[i]));
+    }
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * QUERY_POINTS);
+}
+BENCHMARK(BM_union_contains)->ArgName("atoms")
+  ->Arg(1 << 10)->Arg(1 << 13)->Arg(1 << 17);
+
+static void BM_union_contains_batch(benchmark::State& state) {
+  vector<shared_ptr<Tetrahedron> > atoms = scene(state.range(0));
+  Union u;
+  size_t i;
+  for (i = 0; i < atoms.size(); ++i) {
+    u.add(atoms[i]);
+  }
+  vector<double> x, y, z;
+  query_points(x, y, z);
+  vector<unsigned char> mask(QUERY_POINTS);
+
+  while (state.KeepRunning()) {
+    u.contains_batch(&x[0], &y[0], &z[0], QUERY_POINTS, &mask[0]);
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * QUERY_POINTS);
+}
+BENCHMARK(BM_union_contains_batch)->ArgName("atoms")
+  ->Arg(1 << 10)->Arg(1 << 13)->Arg(1 << 17);
+
+// building the hierarchy over a union's children (which happens on the first
+// query after they change.)
+static void BM_bvh_build(benchmark::State& state) {
+  vector<shared_ptr<Tetrahedron> > atoms = scene(state.range(0));
+  vector<gbox> boxes(atoms.size());
+  size_t i;
+  for (i = 0; i < atoms.size(); ++i) {
+    boxes[i] = atoms[i]->get_aabb();
+  }
+
+  while (state.KeepRunning()) {
+    Bvh bvh(boxes, state.range(1));
+    benchmark::DoNotOptimize(bvh.node_count());
+  }
+  state.SetItemsProcessed(state.iterations() * boxes.size());
+}
+BENCHMARK(BM_bvh_build)->ArgNames({"atoms", "threads"})
+  ->Args({1 << 17, 1})->Args({1 << 17, 0});
+
+BENCHMARK_MAIN();
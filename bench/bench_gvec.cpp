@@ -0,0 +1,185 @@
+/* layermesh/bench/bench_gvec.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <benchmark/benchmark.h>
+#include <gvec.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// The out-of-line operators as they were before gvec became header-only,
+// kept here (and kept out of line) as the baseline to compare against.
+namespace outofline {
+
+  __attribute__((noinline)) gvec sub(const gvec& l, const gvec& r) {
+    gvec t;
+    t[0] = l[0] - r[0];
+    t[1] = l[1] - r[1];
+    t[2] = l[2] - r[2];
+    return t;
+  }
+
+  __attribute__((noinline)) gvec cross(const gvec& l, const gvec& r) {
+    gvec t;
+    t[0] = l[1] * r[2] - l[2] * r[1];
+    t[1] = l[2] * r[0] - l[0] * r[2];
+    t[2] = l[0] * r[1] - l[1] * r[0];
+    return t;
+  }
+
+  __attribute__((noinline)) gvec div(const gvec& l, double r) {
+    gvec t;
+    t[0] = l[0] / r;
+    t[1] = l[1] / r;
+    t[2] = l[2] / r;
+    return t;
+  }
+
+  __attribute__((noinline)) double dot(const gvec& l, const gvec& r) {
+    return l[0] * r[0] + l[1] * r[1] + l[2] * r[2];
+  }
+
+  __attribute__((noinline)) double modulus(const gvec& v) {
+    return sqrt(dot(v, v));
+  }
+
+}
+
+namespace {
+
+  gvec_list random_triangles(size_t count) {
+    gvec_list points(3 * count);
+    srand(1);
+    size_t i;
+    for (i = 0; i < points.size(); ++i) {
+      points[i] = gvec(static_cast<double>(rand()) / RAND_MAX,
+                       static_cast<double>(rand()) / RAND_MAX,
+                       static_cast<double>(rand()) / RAND_MAX);
+    }
+    return points;
+  }
+
+}
+
+// unit normal of each triangle, as computed in Mesh::save_binary_stl:
+static void BM_normal_out_of_line(benchmark::State& state) {
+  size_t count = state.range(0);
+  gvec_list points = random_triangles(count);
+  gvec_list normals(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      const gvec& o = points[3 * i];
+      gvec n = outofline::cross(outofline::sub(points[3 * i + 1], o),
+                                outofline::sub(points[3 * i + 2], o));
+      normals[i] = outofline::div(n, outofline::modulus(n));
+    }
+    benchmark::DoNotOptimize(&normals[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_normal_out_of_line)->Arg(1 << 16);
+
+static void BM_normal_inline(benchmark::State& state) {
+  size_t count = state.range(0);
+  gvec_list points = random_triangles(count);
+  gvec_list normals(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      const gvec& o = points[3 * i];
+      gvec n = (points[3 * i + 1] - o) ^ (points[3 * i + 2] - o);
+      normals[i] = n / layermesh::modulus(n);
+    }
+    benchmark::DoNotOptimize(&normals[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_normal_inline)->Arg(1 << 16);
+
+// The operators one at a time, each over consecutive pairs of points:
+
+static void BM_gvec_add_scale(benchmark::State& state) {
+  size_t count = state.range(0);
+  gvec_list points = random_triangles(count);
+  gvec_list out(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      out[i] = (points[2 * i] + points[2 * i + 1]) * 0.5;
+    }
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_gvec_add_scale)->Arg(1 << 16);
+
+static void BM_gvec_dot(benchmark::State& state) {
+  size_t count = state.range(0);
+  gvec_list points = random_triangles(count);
+  vector<double> out(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      out[i] = points[2 * i] * points[2 * i + 1];
+    }
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_gvec_dot)->Arg(1 << 16);
+
+static void BM_gvec_cross(benchmark::State& state) {
+  size_t count = state.range(0);
+  gvec_list points = random_triangles(count);
+  gvec_list out(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      out[i] = points[2 * i] ^ points[2 * i + 1];
+    }
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_gvec_cross)->Arg(1 << 16);
+
+static void BM_gvec_modulus(benchmark::State& state) {
+  size_t count = state.range(0);
+  gvec_list points = random_triangles(count);
+  vector<double> out(count);
+
+  while (state.KeepRunning()) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      out[i] = layermesh::modulus(points[i]);
+    }
+    benchmark::DoNotOptimize(&out[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_gvec_modulus)->Arg(1 << 16);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,95 @@
+/* layermesh/bench/bench_hull.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <cmath>
+#include <benchmark/benchmark.h>
+#include <hull.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+namespace {
+
+  // n points over the unit sphere, every one of them a hull vertex (like the
+  // boundary points of a scanned feature):
+  gvec_list sphere_points(unsigned n) {
+    gvec_list points;
+    points.reserve(n);
+    const double golden_angle = M_PI * (3.0 - sqrt(5.0));
+    unsigned i;
+    for (i = 0; i < n; ++i) {
+      double z = 1.0 - (2.0 * i + 1.0) / n;
+      double r = sqrt(1.0 - z * z);
+      points.push_back(gvec(r * cos(golden_angle * i),
+                            r * sin(golden_angle * i),
+                            z));
+    }
+    return points;
+  }
+
+  // n points uniformly distributed in the unit ball, most of them interior:
+  gvec_list ball_points(unsigned n) {
+    gvec_list points;
+    points.reserve(n);
+    srand(1);
+    while (points.size() < n) {
+      gvec p(2.0 * rand() / RAND_MAX - 1.0,
+             2.0 * rand() / RAND_MAX - 1.0,
+             2.0 * rand() / RAND_MAX - 1.0);
+      if (p * p <= 1.0) {
+        points.push_back(p);
+      }
+    }
+    return points;
+  }
+
+}
+
+static void BM_hull_sphere(benchmark::State& state) {
+  gvec_list points = sphere_points(state.range(0));
+  unsigned threads = state.range(1);
+  while (state.KeepRunning()) {
+    facet_triples facets = convex_hull(&points[0], points.size(), threads);
+    benchmark::DoNotOptimize(facets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_hull_sphere)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime()
+  ->ArgNames({"points", "threads"})
+  ->ArgsProduct({{10000, 100000, 1000000}, {1, 2, 4}});
+
+static void BM_hull_ball(benchmark::State& state) {
+  gvec_list points = ball_points(state.range(0));
+  unsigned threads = state.range(1);
+  while (state.KeepRunning()) {
+    facet_triples facets = convex_hull(&points[0], points.size(), threads);
+    benchmark::DoNotOptimize(facets.data());
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_hull_ball)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime()
+  ->ArgNames({"points", "threads"})
+  ->ArgsProduct({{100000, 1000000}, {1, 2, 4}});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,146 @@
+/* layermesh/bench/bench_octree.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <array>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <octree.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// Building an octree of a union of small tetrahedra, and then slicing,
+// querying and editing it, against rendering the same slices from the union
+// itself.
+// (Building is timed by the clock, since the octants are built on other
+// threads.)
+
+namespace {
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  shared_ptr<Union> scene(size_t count) {
+    shared_ptr<Union> u = make_shared<Union>();
+    srand(1);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < count; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      array<gvec, 4> points;
+      for (v = 0; v < 4; ++v) {
+        points[v] = centre + gvec(uniform(), uniform(), uniform()) * 0.05;
+      }
+      u->add(make_shared<Tetrahedron>(points));
+    }
+    return u;
+  }
+
+}
+
+static void BM_build_octree(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 13);
+  voxel_grid grid = grid_covering(u->get_aabb(), 1.0 / 128);
+  size_t memory = 0;
+  while (state.KeepRunning()) {
+    VoxelOctree octree(*u, grid, state.range(0));
+    memory = octree.memory();
+  }
+  state.counters["bytes"] = memory;
+  state.counters["bytes_per_voxel"] =
+    double(memory) / (size_t(grid.width) * grid.height * grid.layers);
+}
+BENCHMARK(BM_build_octree)->ArgNames({"threads"})->Arg(1)->Arg(0)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// every layer, from the octree (at level 0) or rendered (by spans):
+static void BM_slices(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 13);
+  voxel_grid grid = grid_covering(u->get_aabb(), 1.0 / 128);
+  VoxelOctree octree(*u, grid);
+  vector<unsigned char> pixels(size_t(grid.width) * grid.height);
+  unsigned layer;
+  while (state.KeepRunning()) {
+    for (layer = 0; layer < grid.layers; ++layer) {
+      if (state.range(0)) {
+        octree.slice(layer, &pixels[0]);
+      } else {
+        render_slice(*u, grid, layer, &pixels[0]);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * size_t(grid.width) *
+                          grid.height * grid.layers);
+}
+BENCHMARK(BM_slices)->ArgNames({"octree"})->Arg(0)->Arg(1)
+  ->Unit(benchmark::kMillisecond);
+
+static void BM_point_queries(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 13);
+  VoxelOctree octree(*u, grid_covering(u->get_aabb(), 1.0 / 128));
+  vector<gvec> points(4096);
+  size_t i;
+  for (i = 0; i < points.size(); ++i) {
+    points[i] = gvec(uniform(), uniform(), uniform());
+  }
+  size_t inside = 0;
+  while (state.KeepRunning()) {
+    for (i = 0; i < points.size(); ++i) {
+      inside += state.range(0) ? octree.contains(points[i])
+                               : u->contains(points[i]);
+    }
+  }
+  benchmark::DoNotOptimize(inside);
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_point_queries)->ArgNames({"octree"})->Arg(0)->Arg(1);
+
+// moving one tetrahedron of the union, then bringing the octree up to date
+// by building it again, or by updating the part which changed:
+static void BM_edit(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 13);
+  voxel_grid grid = grid_covering(u->get_aabb(), 1.0 / 128);
+  VoxelOctree octree(*u, grid);
+  vector<gbox> changed;
+  size_t edits = 0;
+  unsigned v;
+  while (state.KeepRunning()) {
+    size_t i = (edits++ * 2654435761u) % u->size();
+    gvec centre(0.1 + 0.8 * uniform(), 0.1 + 0.8 * uniform(),
+                0.1 + 0.8 * uniform());
+    array<gvec, 4> points;
+    for (v = 0; v < 4; ++v) {
+      points[v] = centre + gvec(uniform(), uniform(), uniform()) * 0.05;
+    }
+    changed.clear();
+    u->replace(i, make_shared<Tetrahedron>(points), changed);
+    if (state.range(0)) {
+      octree.update(*u, changed);
+    } else {
+      octree = VoxelOctree(*u, grid);
+    }
+  }
+}
+BENCHMARK(BM_edit)->ArgNames({"update"})->Arg(0)->Arg(1)
+  ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,79 @@
+/* layermesh/bench/bench_render.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <render.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// Rendering a union of small tetrahedra into a stack of slices, by thread
+// count, compression, and method (sampling every voxel, or filling spans.)
+// The TIFF is written to the working directory and removed afterwards.
+// (Timed by the clock, since the workers are other threads.)
+
+namespace {
+
+  const char* const FILENAME = "bench_render.tiff";
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  shared_ptr<Union> scene(size_t count) {
+    shared_ptr<Union> u = make_shared<Union>();
+    srand(1);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < count; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      array<gvec, 4> points;
+      for (v = 0; v < 4; ++v) {
+        points[v] = centre + gvec(uniform(), uniform(), uniform()) * 0.05;
+      }
+      u->add(make_shared<Tetrahedron>(points));
+    }
+    return u;
+  }
+
+}
+
+static void BM_render_tiff(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 13);
+  voxel_grid grid = grid_covering(u->get_aabb(), 1.0 / 128);
+  tiff_compression compression =
+    state.range(1) ? tiff_packbits : tiff_uncompressed;
+
+  while (state.KeepRunning()) {
+    render_tiff(FILENAME, *u, grid, compression, state.range(0),
+                static_cast<render_method>(state.range(2)));
+  }
+  state.SetItemsProcessed(state.iterations() * size_t(grid.width) *
+                          grid.height * grid.layers);
+  remove(FILENAME);
+}
+BENCHMARK(BM_render_tiff)->ArgNames({"threads", "packbits", "spans"})
+  ->Args({1, 0, 0})->Args({1, 1, 0})->Args({1, 1, 1})->Args({0, 1, 1})
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,74 @@
+/* layermesh/bench/bench_slice.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <slice.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// Slicing a union of small tetrahedra into layers of loops, on one thread
+// and on one per hardware thread.
+// (Timed by the clock, since the layers are sliced on other threads.)
+
+namespace {
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  shared_ptr<Union> scene(size_t count) {
+    shared_ptr<Union> u = make_shared<Union>();
+    srand(1);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < count; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      array<gvec, 4> points;
+      for (v = 0; v < 4; ++v) {
+        points[v] = centre + gvec(uniform(), uniform(), uniform()) * 0.1;
+      }
+      u->add(make_shared<Tetrahedron>(points));
+    }
+    return u;
+  }
+
+}
+
+static void BM_slice_layers(benchmark::State& state) {
+  shared_ptr<Union> u = scene(1 << 10);
+  vector<double> heights = layer_heights(u->get_aabb(), 0.005);
+  size_t loops = 0;
+  while (state.KeepRunning()) {
+    vector<layer_contours> layers = slice_layers(*u, heights, state.range(0));
+    loops = 0;
+    size_t k;
+    for (k = 0; k < layers.size(); ++k) loops += layers[k].loops.size();
+  }
+  state.counters["layers"] = heights.size();
+  state.counters["loops"] = loops;
+  state.SetItemsProcessed(state.iterations() * heights.size());
+}
+BENCHMARK(BM_slice_layers)->ArgNames({"threads"})->Arg(1)->Arg(0)
+  ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
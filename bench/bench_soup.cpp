@@ -0,0 +1,143 @@
+/* layermesh/bench/bench_soup.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <benchmark/benchmark.h>
+#include <tetrahedron.hpp>
+#include <tetrahedron_soup.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// Many small tetrahedra as a vector of Tetrahedron atoms and as a
+// TetrahedronSoup: the memory each costs (the bytes_per_tet counter), and how
+// fast a batch of points can be tested against all of them. Few of the points
+// fall inside any tetrahedron, so most queries scan the whole scene.
+
+namespace {
+
+  const size_t QUERY_POINTS = 256;
+
+  double uniform() {
+    return static_cast<double>(rand()) / RAND_MAX;
+  }
+
+  vector<array<gvec, 4> > scene(size_t count) {
+    vector<array<gvec, 4> > tetrahedra(count);
+    srand(1);
+    size_t i;
+    unsigned v;
+    for (i = 0; i < count; ++i) {
+      gvec centre(uniform(), uniform(), uniform());
+      for (v = 0; v < 4; ++v) {
+        tetrahedra[i][v] = centre + gvec(uniform(), uniform(), uniform()) * 0.02;
+      }
+    }
+    return tetrahedra;
+  }
+
+  void query_points(vector<double>& x, vector<double>& y, vector<double>& z) {
+    x.resize(QUERY_POINTS);
+    y.resize(QUERY_POINTS);
+    z.resize(QUERY_POINTS);
+    size_t i;
+    for (i = 0; i < QUERY_POINTS; ++i) {
+      x[i] = uniform();
+      y[i] = uniform();
+      z[i] = uniform();
+    }
+  }
+
+}
+
+static void BM_vector_of_tetrahedra(benchmark::State& state) {
+  vector<array<gvec, 4> > tetrahedra = scene(state.range(0));
+  vector<Tetrahedron> atoms;
+  atoms.reserve(tetrahedra.size());
+  size_t i, j;
+  for (i = 0; i < tetrahedra.size(); ++i) {
+    atoms.push_back(Tetrahedron(tetrahedra[i]));
+  }
+  vector<double> x, y, z;
+  query_points(x, y, z);
+  vector<unsigned char> mask(QUERY_POINTS);
+
+  while (state.KeepRunning()) {
+    for (i = 0; i < QUERY_POINTS; ++i) {
+      gvec p(x[i], y[i], z[i]);
+      mask[i] = 0;
+      for (j = 0; j < atoms.size(); ++j) {
+        if (atoms[j].contains(p)) {
+          mask[i] = 1;
+          break;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * QUERY_POINTS * atoms.size());
+  state.counters["bytes_per_tet"] = sizeof(Tetrahedron);
+}
+BENCHMARK(BM_vector_of_tetrahedra)->ArgName("tets")->Arg(1 << 10)->Arg(1 << 16);
+
+template <typename T>
+static void BM_soup(benchmark::State& state) {
+  vector<array<gvec, 4> > tetrahedra = scene(state.range(0));
+  BasicTetrahedronSoup<T> soup;
+  soup.reserve(tetrahedra.size());
+  size_t i;
+  unsigned v;
+  for (i = 0; i < tetrahedra.size(); ++i) {
+    array<basic_gvec<T>, 4> points;
+    for (v = 0; v < 4; ++v) {
+      points[v] = basic_gvec<T>(tetrahedra[i][v]);
+    }
+    soup.push_back(points);
+  }
+  vector<double> x, y, z;
+  query_points(x, y, z);
+  vector<unsigned char> mask(QUERY_POINTS);
+
+  while (state.KeepRunning()) {
+    soup.contains_batch(&x[0], &y[0], &z[0], QUERY_POINTS, &mask[0]);
+    benchmark::DoNotOptimize(&mask[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * QUERY_POINTS * soup.size());
+  state.counters["bytes_per_tet"] =
+    static_cast<double>(soup.arena_bytes()) / soup.size();
+}
+BENCHMARK_TEMPLATE(BM_soup, double)->ArgName("tets")->Arg(1 << 10)->Arg(1 << 16);
+BENCHMARK_TEMPLATE(BM_soup, float)->ArgName("tets")->Arg(1 << 10)->Arg(1 << 16);
+
+static void BM_soup_build(benchmark::State& state) {
+  vector<array<gvec, 4> > tetrahedra = scene(state.range(0));
+
+  while (state.KeepRunning()) {
+    TetrahedronSoup soup;
+    size_t i;
+    for (i = 0; i < tetrahedra.size(); ++i) {
+      soup.push_back(tetrahedra[i]);
+    }
+    benchmark::DoNotOptimize(soup.size());
+  }
+  state.SetItemsProcessed(state.iterations() * tetrahedra.size());
+}
+BENCHMARK(BM_soup_build)->ArgName("tets")->Arg(1 << 16);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,360 @@
+/* layermesh/bench/bench_stl.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <benchmark/benchmark.h>
+#include <stl.hpp>
+#include <normals.hpp>
+#include <stl_reader.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+#define FILENAME "bench.stl"
+
+namespace {
+
+  // a zig-zag strip of triangles; every facet is distinct and non-degenerate.
+  void generate_strip(size_t num_facets,
+                      gvec_list& points,
+                      facet_triples& facets) {
+    points.clear();
+    facets.clear();
+    points.reserve(num_facets + 4);
+    facets.reserve(num_facets);
+    size_t i;
+    for (i = 0; i < num_facets / 2 + 2; ++i) {
+      points.push_back(gvec(0.5 * i, 0.0, 0.0));
+      points.push_back(gvec(0.5 * i, 1.0, 0.25 * i));
+    }
+    for (i = 0; i < num_facets; ++i) {
+      unsigned base = 2 * (i / 2);
+      if (i % 2 == 0) {
+        facets.push_back({{base, base + 2, base + 1}});
+      } else {
+        facets.push_back({{base + 1, base + 2, base + 3}});
+      }
+    }
+  }
+
+  // the binary writer as it was before stl.cpp: five ofstream::write calls
+  // per facet, with the gvecs copied by value.
+  void gvec_binary(char* buffer, gvec v) {
+    unsigned i;
+    float r;
+    for (i = 0; i < 3; ++i) {
+      r = static_cast<float>(v[i]);
+      memcpy(buffer + 4 * i, &r, 4);
+    }
+  }
+
+  void legacy_save_binary_stl(string filename,
+                              const gvec_list& points,
+                              const facet_triples& facets) {
+    ofstream f(filename.c_str(), ios::out | ios::binary);
+    char a[81] = {'l', 'a', 'y', 'e', 'r', 'm', 'e', 's', 'h'};
+    f.write(a, 80);
+
+    uint32_t num_facets = facets.size();
+    f.write(reinterpret_cast<char*>(&num_facets), 4);
+
+    uint16_t attributes = 0;
+
+    facet_triples::const_iterator fit = facets.begin();
+    char b[13];
+    for (; fit != facets.end(); ++fit) {
+      gvec o = points[(*fit)[0]];
+      gvec i = points[(*fit)[1]];
+      gvec j = points[(*fit)[2]];
+
+      gvec n = (i - o) ^ (j - o);
+      n = n / layermesh::modulus(n);
+
+      gvec_binary(b, n);
+      f.write(b, 12);
+      gvec_binary(b, o);
+      f.write(b, 12);
+      gvec_binary(b, i);
+      f.write(b, 12);
+      gvec_binary(b, j);
+      f.write(b, 12);
+
+      f.write(reinterpret_cast<char*>(&attributes), 2);
+    }
+    f.close();
+  }
+
+  // and the ASCII writer as it was: an ostringstream per vector, and endl.
+  string gvec_ascii(gvec v) {
+    ostringstream s;
+    s << static_cast<float>(v[0]) << " ";
+    s << static_cast<float>(v[1]) << " ";
+    s << static_cast<float>(v[2]);
+    return s.str();
+  }
+
+  void legacy_save_ascii_stl(string filename,
+                             const gvec_list& points,
+                             const facet_triples& facets) {
+    ofstream f(filename.c_str());
+    f << "solid layermesh" << endl;
+    facet_triples::const_iterator fit = facets.begin();
+    for (; fit != facets.end(); ++fit) {
+      gvec o = points[(*fit)[0]];
+      gvec i = points[(*fit)[1]];
+      gvec j = points[(*fit)[2]];
+
+      gvec n = (i - o) ^ (j - o);
+      n = n / layermesh::modulus(n);
+
+      f << "  facet normal " << gvec_ascii(n) << endl;
+      f << "    outer loop" << endl;
+      f << "      vertex " << gvec_ascii(o) << endl;
+      f << "      vertex " << gvec_ascii(i) << endl;
+      f << "      vertex " << gvec_ascii(j) << endl;
+      f << "    endloop" << endl;
+      f << "  endfacet" << endl;
+    }
+    f << "endsolid layermesh" << endl;
+    f.close();
+  }
+
+  // the meshes are large, so the most recent one is kept between benchmarks:
+  gvec_list points;
+  facet_triples facets;
+
+  void prepare(size_t num_facets) {
+    if (facets.size() != num_facets) {
+      generate_strip(num_facets, points, facets);
+    }
+  }
+
+}
+
+static void BM_binary_stl_legacy(benchmark::State& state) {
+  prepare(state.range(0));
+  while (state.KeepRunning()) {
+    legacy_save_binary_stl(FILENAME, points, facets);
+  }
+  state.SetBytesProcessed(state.iterations() * binary_stl_size(facets.size()));
+  remove(FILENAME);
+}
+
+static void BM_binary_stl(benchmark::State& state) {
+  prepare(state.range(0));
+  stl_write_mode mode = static_cast<stl_write_mode>(state.range(1));
+  while (state.KeepRunning()) {
+    write_binary_stl(FILENAME, points, facets, mode);
+  }
+  state.SetBytesProcessed(state.iterations() * binary_stl_size(facets.size()));
+  remove(FILENAME);
+}
+
+// parallel encoding straight into the mapped file:
+static void BM_binary_stl_threads(benchmark::State& state) {
+  prepare(state.range(0));
+  unsigned threads = state.range(1);
+  while (state.KeepRunning()) {
+    write_binary_stl(FILENAME, points, facets, stl_mapped, threads);
+  }
+  state.SetBytesProcessed(state.iterations() * binary_stl_size(facets.size()));
+  remove(FILENAME);
+}
+
+// the normals alone: one division by the modulus per facet, as before
+// normals.cpp, against the batched cross products and normalisation.
+static void BM_normals_scalar(benchmark::State& state) {
+  prepare(state.range(0));
+  vector<double> x(facets.size()), y(facets.size()), z(facets.size());
+  while (state.KeepRunning()) {
+    size_t f;
+    for (f = 0; f < facets.size(); ++f) {
+      const gvec& o = points[facets[f][0]];
+      gvec n = (points[facets[f][1]] - o) ^ (points[facets[f][2]] - o);
+      n = n / layermesh::modulus(n);
+      x[f] = n[0];
+      y[f] = n[1];
+      z[f] = n[2];
+    }
+    benchmark::DoNotOptimize(&x[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * facets.size());
+}
+
+static void BM_normals_batch(benchmark::State& state) {
+  prepare(state.range(0));
+  vector<double> x(facets.size()), y(facets.size()), z(facets.size());
+  while (state.KeepRunning()) {
+    facet_normals_batch(points, facets, 0, facets.size(), &x[0], &y[0], &z[0]);
+    benchmark::DoNotOptimize(&x[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * facets.size());
+}
+
+// export with the normals already known, as a Tetrahedron does:
+static void BM_binary_stl_cached_normals(benchmark::State& state) {
+  prepare(state.range(0));
+  vector<double> x(facets.size()), y(facets.size()), z(facets.size());
+  facet_normals_batch(points, facets, 0, facets.size(), &x[0], &y[0], &z[0]);
+  gvec_list normals;
+  normals.reserve(facets.size());
+  size_t f;
+  for (f = 0; f < facets.size(); ++f) {
+    normals.push_back(gvec(x[f], y[f], z[f]));
+  }
+  while (state.KeepRunning()) {
+    write_binary_stl(FILENAME, points, facets, stl_buffered, 1, &normals);
+  }
+  state.SetBytesProcessed(state.iterations() * binary_stl_size(facets.size()));
+  remove(FILENAME);
+}
+
+static void BM_ascii_stl_legacy(benchmark::State& state) {
+  prepare(state.range(0));
+  while (state.KeepRunning()) {
+    legacy_save_ascii_stl(FILENAME, points, facets);
+  }
+  state.SetItemsProcessed(state.iterations() * facets.size());
+  remove(FILENAME);
+}
+
+static void BM_ascii_stl(benchmark::State& state) {
+  prepare(state.range(0));
+  while (state.KeepRunning()) {
+    write_ascii_stl(FILENAME, points, facets);
+  }
+  state.SetItemsProcessed(state.iterations() * facets.size());
+  remove(FILENAME);
+}
+
+// Through the public interface, as an atom or mesh saves itself (with the
+// default write mode, and normals computed on the fly):
+static void BM_mesh_save_stl(benchmark::State& state) {
+  prepare(state.range(0));
+  bool binary = state.range(1);
+  IndexedMesh mesh(points, facets);
+  while (state.KeepRunning()) {
+    mesh.save_stl(FILENAME, binary);
+  }
+  state.SetItemsProcessed(state.iterations() * facets.size());
+  remove(FILENAME);
+}
+
+// The floor for reading: just read() the file (from the page cache, after
+// the first iteration) into a buffer, without looking at it.
+static void BM_read_file(benchmark::State& state) {
+  prepare(state.range(0));
+  write_binary_stl(FILENAME, points, facets);
+  size_t size = binary_stl_size(facets.size());
+  vector<char> buffer(size);
+  while (state.KeepRunning()) {
+    int fd = open(FILENAME, O_RDONLY);
+    size_t done = 0;
+    while (done < size) {
+      ssize_t got = read(fd, &buffer[done], size - done);
+      if (got <= 0) break;
+      done += got;
+    }
+    close(fd);
+    benchmark::DoNotOptimize(&buffer[0]);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  remove(FILENAME);
+}
+
+static void BM_read_stl(benchmark::State& state) {
+  prepare(state.range(0));
+  write_binary_stl(FILENAME, points, facets);
+  unsigned threads = state.range(1);
+  gvec_list read_points;
+  facet_triples read_facets;
+  while (state.KeepRunning()) {
+    read_stl(FILENAME, read_points, read_facets, threads);
+  }
+  state.SetBytesProcessed(state.iterations() * binary_stl_size(facets.size()));
+  remove(FILENAME);
+}
+
+static void BM_read_ascii_stl(benchmark::State& state) {
+  prepare(state.range(0));
+  write_ascii_stl(FILENAME, points, facets);
+  gvec_list read_points;
+  facet_triples read_facets;
+  while (state.KeepRunning()) {
+    read_stl(FILENAME, read_points, read_facets);
+  }
+  state.SetItemsProcessed(state.iterations() * facets.size());
+  remove(FILENAME);
+}
+
+BENCHMARK(BM_binary_stl_legacy)
+  ->Unit(benchmark::kMillisecond)
+  ->Arg(1000)->Arg(1000000)->Arg(10000000);
+BENCHMARK(BM_binary_stl)
+  ->Unit(benchmark::kMillisecond)
+  ->ArgNames({"facets", "mode"})
+  ->ArgsProduct({{1000, 1000000, 10000000},
+                 {stl_buffered, stl_mapped, stl_streamed}});
+BENCHMARK(BM_binary_stl_threads)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime()
+  ->ArgNames({"facets", "threads"})
+  ->ArgsProduct({{1000000, 10000000}, {1, 2, 4, 8}});
+
+BENCHMARK(BM_normals_scalar)
+  ->Unit(benchmark::kMicrosecond)
+  ->Arg(1000)->Arg(1000000);
+BENCHMARK(BM_normals_batch)
+  ->Unit(benchmark::kMicrosecond)
+  ->Arg(1000)->Arg(1000000);
+BENCHMARK(BM_binary_stl_cached_normals)
+  ->Unit(benchmark::kMillisecond)
+  ->Arg(1000)->Arg(1000000);
+
+BENCHMARK(BM_read_file)
+  ->Unit(benchmark::kMillisecond)
+  ->Arg(1000000)->Arg(10000000);
+BENCHMARK(BM_read_stl)
+  ->Unit(benchmark::kMillisecond)
+  ->UseRealTime()
+  ->ArgNames({"facets", "threads"})
+  ->ArgsProduct({{1000000, 10000000}, {1, 2, 4, 8}});
+BENCHMARK(BM_read_ascii_stl)
+  ->Unit(benchmark::kMillisecond)
+  ->Arg(1000)->Arg(1000000);
+
+BENCHMARK(BM_ascii_stl_legacy)
+  ->Unit(benchmark::kMillisecond)
+  ->Arg(1000)->Arg(1000000);
+BENCHMARK(BM_ascii_stl)
+  ->Unit(benchmark::kMillisecond)
+  ->Arg(1000)->Arg(1000000);
+
+BENCHMARK(BM_mesh_save_stl)
+  ->Unit(benchmark::kMillisecond)
+  ->ArgNames({"facets", "binary"})
+  ->ArgsProduct({{1000, 1000000, 10000000}, {1, 0}});
+
+BENCHMARK_MAIN();
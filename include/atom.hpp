@@ -17,11 +17,16 @@
  * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef __LAYERMESH_HULL_HPP__
-#define __LAYERMESH_HULL_HPP__
+#ifndef __LAYERMESH_ATOM_HPP__
+#define __LAYERMESH_ATOM_HPP__
 
 #include <gvec.hpp>
+#include <bounds.hpp>
 #include <mesh.hpp>
+#include <halfspace.hpp>
+#include <parallel.hpp>
+#include <cstddef>
+#include <limits>
 
 namespace layermesh {
 
@@ -29,33 +34,122 @@ namespace layermesh {
   // you wish to use in layered meshes. Note that you do not need to compute
   // the convex hull; this type contains a routine that will compute the facets
   // of the convex hull for you.
+  //
+  // The queries (everything const below) may be called concurrently from
+  // any number of threads, so a scene can be rendered by a pool of workers.
+  // The defaults fill their caches through once_values (see parallel.hpp),
+  // and derived classes must make their own overrides just as safe: the
+  // simplest way is to compute everything in the constructor, as Tetrahedron
+  // does.
   class Atom : public Mesh {
+    private:
+      unsigned hull_threads;
+      once_value<memsafe_gvec_list> _point_cloud;
+      once_value<memsafe_gvec_list> _point_cloud_copy;
+      once_value<std::shared_ptr<const facet_triples> > _hull_facets;
+      once_value<memsafe_gplane_list> _hull_planes;
+      once_value<memsafe_gplane_list> _half_spaces;
+      once_value<std::shared_ptr<const gvec_list> > _hull_normals;
+      once_value<gsphere> _boundary;
+      once_value<gbox> _aabb;
     public:
+      Atom() : hull_threads(1) {};
       virtual ~Atom() {};
       // It is assumed that point_cloud() returns all boundary points
       // continguously at the start of the vector. If additional internal
       // points are specified (sometimes necessary to avoid triangulation
       // symmetry errors) these should be at the end of the vector.
+      // Derived classes must override at least one of point_cloud() and
+      // point_cloud_view(); each has a default in terms of the other.
+      // point_cloud_view() is a non-owning view of the points, which the
+      // default hull, half-space and STL paths read, so an atom which keeps
+      // its points in a container of its own should override it to view them
+      // without allocating. The view must stay valid while the atom lives.
+      // The default calls point_cloud() once, and views the cached result.
+      virtual gvec_view point_cloud_view() const;
       // Return is a shared_ptr: if there is any computation to be done to
       // obtain the vector, it should be done once and the result cached on
-      // the instance for future accesses by the same method.
-      virtual memsafe_gvec_list point_cloud() = 0;
+      // the instance for future accesses by the same method. The default
+      // copies point_cloud_view() on first use, and returns that copy.
+      virtual memsafe_gvec_list point_cloud() const;
       // The starting index of the optional internal points. If no internal
       // points were required, should return == point_cloud().size().
       virtual unsigned internal_points_start_index() const = 0;
       // In order to efficiently compare points within hulls, we must know the
       // approximate position and size of the hull. get_boundary() should
       // return a gsphere which completely contains the hull, (ideally as small
-      // as possible, but an approximation is fine.)
-      virtual gsphere get_boundary() = 0;
+      // as possible, but an approximation is fine.) The default is the
+      // minimal_sphere() of the boundary points, computed on first use and
+      // cached.
+      virtual gsphere get_boundary() const;
+      // The same, as an axis-aligned box, for culling by box (e.g. in a Bvh.)
+      // The default is the bounding_box() of the boundary points, again
+      // computed once.
+      virtual gbox get_aabb() const;
+      // The facets of the convex hull of the boundary points (as indices into
+      // point_cloud()), computed on first use and cached.
+      std::shared_ptr<const facet_triples> hull_facets() const;
+      // how many threads compute the hull (default 1; 0 means one per
+      // hardware thread.) Worthwhile for clouds of 10^5 points or more. Set
+      // it before the first query.
+      void set_hull_threads(unsigned threads) { hull_threads = threads; };
+      // The atom as an intersection of half-spaces. The default computes the
+      // convex hull of the boundary points on first use, and caches one plane
+      // per distinct hull face, ordered so that points near the atom are
+      // rejected by as few planes as possible (see order_by_rejection.)
+      // Derived classes which already know their planes may override it.
+      virtual memsafe_gplane_list half_spaces() const;
       // For rendering TIFFs, if the derived class has a simple geometrical
       // test for whether it contains a particular point, it is best to
-      // implement it here. Otherwise, the default implementation will be
-      // included (which is slow, because it uses the convex hull calculation.)
-      virtual bool contains(gvec point);
+      // implement it here. Otherwise, the default implementation tests the
+      // point against the planes of half_spaces(), stopping at the first
+      // which rejects it.
+      virtual bool contains(gvec point) const;
+      // Batched form of contains(), for rendering many points at once. The
+      // points are given as three contiguous coordinate arrays, and mask[i] is
+      // set to 1 if point i is contained, 0 otherwise. The default calls
+      // contains() once per point; atoms with a plane representation should
+      // override it with a vectorised test (see halfspace.hpp.)
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      // The same, for single-precision point clouds (see gvec32.)
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      // For rendering by scanline: the part of the line through (0, y, z)
+      // parallel to the x axis which the atom contains (a single interval,
+      // since atoms are convex), or false if the line misses it. The default
+      // clips the line by the planes of half_spaces(); atoms which keep
+      // planes of their own should override it with them.
+      virtual bool scanline_span(double y, double z, span& s) const;
+      // The relative precision of contains(): points nearer the surface than
+      // about this much of their coordinates' magnitude may be answered
+      // differently than exact arithmetic (or scanline_span()) would, and
+      // render_spans checks them with contains() (see render.hpp.) The
+      // default is that of a double.
+      virtual double relative_precision() const {
+        return std::numeric_limits<double>::epsilon();
+      };
+      // For building voxel octrees: whether the box is wholly inside the
+      // atom, wholly outside it, or neither (see box_relation.) The default
+      // tests the box against the planes of half_spaces(); again, atoms
+      // which keep planes of their own should override it.
+      virtual box_relation classify(const gbox& box) const;
+      // For meshing (see contour.hpp): a signed distance bound for the atom
+      // (negative inside), with the unit normal of the surface nearest the
+      // point, as halfspaces_distance() gives them for the planes of
+      // half_spaces(). Again, atoms which keep planes of their own should
+      // override it.
+      virtual double surface_distance(const gvec& point, gvec& normal) const;
       // This method also has a default implementation which uses the convex
-      // hull calculation. Again, if you can provide the facets for your Atom
-      // in format required by layermesh::Mesh, then override this method.
+      // hull calculation (the facets of hull_facets(), whose normals are
+      // cached alongside them.) Again, if you can provide the facets for your
+      // Atom in format required by layermesh::Mesh, then override this method.
       virtual void save_stl(std::string filename, bool binary);
   };
 
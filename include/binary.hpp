@@ -0,0 +1,54 @@
+/* layermesh/include/binary.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_BINARY_HPP__
+#define __LAYERMESH_BINARY_HPP__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// The little-endian numbers and whole-file reads and writes of the library's
+// own binary formats (octree.cpp's encoded octrees and slice.cpp's layers.)
+
+namespace layermesh {
+
+  // (appended to out little-endian, whatever the host.)
+  void put32(std::vector<unsigned char>& out, uint32_t v);
+  void put64(std::vector<unsigned char>& out, uint64_t v);
+  void put_float(std::vector<unsigned char>& out, float v);
+  void put_double(std::vector<unsigned char>& out, double v);
+
+  // the little-endian unsigned number in the bytes (at most 8) from p.
+  uint64_t get_uint(const unsigned char* p, int bytes);
+  float get_float(const unsigned char* p);
+  double get_double(const unsigned char* p);
+
+  // Writes or reads the whole of a file, counting the time as I/O (see
+  // stats.hpp.) Throw std::runtime_error if the file can't be written or
+  // read.
+  void write_file(const std::string& filename,
+                  const void* data,
+                  std::size_t size);
+  std::vector<unsigned char> read_file(const std::string& filename);
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+/* layermesh/include/bounds.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_BOUNDS_HPP__
+#define __LAYERMESH_BOUNDS_HPP__
+
+#include <gvec.hpp>
+
+namespace layermesh {
+
+  // The smallest sphere containing all the points, by Welzl's algorithm (in
+  // expected time linear in their number: the points are visited in a
+  // shuffled order, which is the same on every run.) The centre is only as
+  // good as floating point allows, so the radius is the distance from it to
+  // the furthest point, rounded up by a relative 1e-12: sphere_contains()
+  // is true of every point. The sphere of no points has radius -1.
+  gsphere minimal_sphere(gvec_view points);
+
+  // the smallest axis-aligned box containing all the points (the box of no
+  // points has low > high.)
+  gbox bounding_box(gvec_view points);
+
+  // whether the sphere or the box contains the point.
+  inline bool sphere_contains(const gsphere& s, const gvec& point) {
+    gvec offset = point - s.centre;
+    return offset * offset <= s.radius * s.radius;
+  }
+
+  inline bool box_contains(const gbox& b, const gvec& point) {
+    return point[0] >= b.low[0] && point[0] <= b.high[0] &&
+           point[1] >= b.low[1] && point[1] <= b.high[1] &&
+           point[2] >= b.low[2] && point[2] <= b.high[2];
+  }
+
+  // whether the boxes overlap or touch.
+  inline bool boxes_meet(const gbox& a, const gbox& b) {
+    return a.low[0] <= b.high[0] && a.high[0] >= b.low[0] &&
+           a.low[1] <= b.high[1] && a.high[1] >= b.low[1] &&
+           a.low[2] <= b.high[2] && a.high[2] >= b.low[2];
+  }
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+/* layermesh/include/brep.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_BREP_HPP__
+#define __LAYERMESH_BREP_HPP__
+
+#include <gvec.hpp>
+#include <atom.hpp>
+#include <csg.hpp>
+#include <mesh.hpp>
+
+// Meshing a solid exactly from its atoms' facets (its boundary
+// representation), rather than sampling it as contour.hpp does.
+
+namespace layermesh {
+
+  // The surface of the solid, as the parts of its atoms' faces which lie on
+  // it. Each face of each atom (the polygons of its half_spaces()) is cut
+  // by the planes of the other atoms whose boxes meet it, into convex
+  // pieces which each lie wholly inside or outside every other atom, so
+  // each piece is either all on the surface or none of it; which is
+  // decided by testing the solid just either side of it. Faces shared by
+  // two atoms are kept once. The pieces are then joined at their corners,
+  // with the corners of neighbouring pieces added along their edges where
+  // the pieces were cut differently, and cut into triangles, giving a
+  // closed mesh with facets ordered as facet_triples require. The edges,
+  // corners and faces are where the planes put them, up to rounding (and
+  // corners nearer each other than a ten-billionth of the size of the
+  // atoms' box are taken as one, so slivers thinner than that, which
+  // single-precision STL couldn't keep apart anyway, may be pinched.)
+  //
+  // Atoms whose boxes don't meet are never compared, and the atoms' faces
+  // are cut on threads threads (0 meaning one per hardware thread.) Where
+  // atoms only touch along an edge or at a corner, the mesh is closed but
+  // not a manifold there.
+  IndexedMesh brep_mesh(const Solid& solid, unsigned threads = 1);
+
+}
+
+#endif
@@ -0,0 +1,228 @@
+/* layermesh/include/bvh.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_BVH_HPP__
+#define __LAYERMESH_BVH_HPP__
+
+#include <gvec.hpp>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+namespace layermesh {
+
+  // A node of a Bvh: a box, and either the index of its second child (the
+  // first is the next node) or, for a leaf, the range of primitives it
+  // holds. The box is rounded outwards to single precision, so that two
+  // nodes fit in a cache line.
+  struct bvh_node {
+    float low[3];
+    // the second child, or (in a leaf) the first of its primitives:
+    uint32_t offset;
+    float high[3];
+    // the number of primitives (0 for an internal node):
+    uint32_t count;
+  };
+
+  // A bounding volume hierarchy over a list of boxes (the primitives, e.g.
+  // the boxes of the atoms of a scene), for finding those which contain a
+  // point, cross a ray, or overlap a box, in time logarithmic in their
+  // number. It is built by binned surface area heuristic, into one array of
+  // nodes in depth first order, and answers queries concurrently. Only
+  // refit() changes it.
+  class Bvh {
+    private:
+      std::vector<bvh_node> nodes;
+      // the primitives, grouped by leaf (in their original order within a
+      // leaf):
+      std::vector<uint32_t> indices;
+    public:
+      // the hierarchy of no boxes.
+      Bvh() {};
+      // builds the hierarchy of the boxes, on up to threads threads (where
+      // 0 means one per hardware thread.)
+      Bvh(const std::vector<gbox>& boxes, unsigned threads = 1);
+
+      // the number of primitives:
+      std::size_t size() const { return indices.size(); };
+      std::size_t node_count() const { return nodes.size(); };
+      const bvh_node& node(std::size_t i) const { return nodes[i]; };
+
+      // Updates the boxes of the nodes for primitives which have moved,
+      // keeping the structure of the tree (so queries stay correct, but slow
+      // down if the primitives move far.) boxes must be the same length as
+      // when built.
+      void refit(const std::vector<gbox>& boxes);
+
+      // Each query calls found(i) for every primitive i whose box meets the
+      // point, box or ray, until found returns true, and returns whether it
+      // did. They are the broad phase of a test: the primitives are found
+      // by leaf, so found may also be called for others which share a leaf
+      // with one that meets, and must test the primitive itself. Primitives
+      // of the same leaf are visited in order of index.
+      template <typename F>
+      bool containing(const gvec& point, F found) const;
+      template <typename F>
+      bool overlapping(const gbox& box, F found) const;
+      // the ray is origin + t * direction, for t in [0, t_max]. Nearer nodes
+      // are visited first, so primitives come roughly in order of distance.
+      template <typename F>
+      bool along_ray(const gvec& origin,
+                     const gvec& direction,
+                     double t_max,
+                     F found) const;
+
+      // (in the same way, but collecting every primitive found, so again
+      // including some whose boxes miss.)
+      std::vector<std::size_t> containing(const gvec& point) const;
+      std::vector<std::size_t> overlapping(const gbox& box) const;
+  };
+
+  // The queries are templates, so that the visitor is inlined:
+
+  // (deep enough for any tree built by halving the primitives, which SAH
+  // builds needn't do; the builder limits the depth to this.)
+  const unsigned BVH_MAX_DEPTH = 64;
+
+  template <typename F>
+  bool Bvh::containing(const gvec& point, F found) const {
+    if (nodes.empty()) return false;
+    uint32_t stack[BVH_MAX_DEPTH];
+    unsigned top = 0;
+    uint32_t current = 0;
+    uint32_t i;
+    while (true) {
+      const bvh_node& n = nodes[current];
+      if (point[0] >= n.low[0] && point[0] <= n.high[0] &&
+          point[1] >= n.low[1] && point[1] <= n.high[1] &&
+          point[2] >= n.low[2] && point[2] <= n.high[2]) {
+        if (n.count == 0) {
+          stack[top++] = n.offset;
+          current = current + 1;
+          continue;
+        }
+        for (i = n.offset; i < n.offset + n.count; ++i) {
+          if (found(std::size_t(indices[i]))) return true;
+        }
+      }
+      if (top == 0) return false;
+      current = stack[--top];
+    }
+  }
+
+  template <typename F>
+  bool Bvh::overlapping(const gbox& box, F found) const {
+    if (nodes.empty()) return false;
+    uint32_t stack[BVH_MAX_DEPTH];
+    unsigned top = 0;
+    uint32_t current = 0;
+    uint32_t i;
+    while (true) {
+      const bvh_node& n = nodes[current];
+      if (box.low[0] <= n.high[0] && box.high[0] >= n.low[0] &&
+          box.low[1] <= n.high[1] && box.high[1] >= n.low[1] &&
+          box.low[2] <= n.high[2] && box.high[2] >= n.low[2]) {
+        if (n.count == 0) {
+          stack[top++] = n.offset;
+          current = current + 1;
+          continue;
+        }
+        for (i = n.offset; i < n.offset + n.count; ++i) {
+          if (found(std::size_t(indices[i]))) return true;
+        }
+      }
+      if (top == 0) return false;
+      current = stack[--top];
+    }
+  }
+
+  // the parameter t at which the ray enters the node's box, or a negative
+  // number if it misses it (slab test; inverse holds 1 / direction.)
+  inline double bvh_ray_entry(const bvh_node& n,
+                              const gvec& origin,
+                              const gvec& inverse,
+                              double t_max) {
+    double near = 0.0, far = t_max;
+    int a;
+    for (a = 0; a < 3; ++a) {
+      double t0 = (n.low[a] - origin[a]) * inverse[a];
+      double t1 = (n.high[a] - origin[a]) * inverse[a];
+      if (t0 > t1) {
+        double swap = t0;
+        t0 = t1;
+        t1 = swap;
+      }
+      // (NaN, from 0 * infinity where the ray lies in a slab's plane, is
+      // treated as inside that slab.)
+      if (t0 > near) near = t0;
+      if (t1 < far) far = t1;
+      if (near > far) return -1.0;
+    }
+    return near;
+  }
+
+  template <typename F>
+  bool Bvh::along_ray(const gvec& origin,
+                      const gvec& direction,
+                      double t_max,
+                      F found) const {
+    if (nodes.empty()) return false;
+    gvec inverse(1.0 / direction[0], 1.0 / direction[1], 1.0 / direction[2]);
+    uint32_t stack[BVH_MAX_DEPTH];
+    unsigned top = 0;
+    uint32_t current = 0;
+    uint32_t i;
+    if (bvh_ray_entry(nodes[0], origin, inverse, t_max) < 0.0) return false;
+    while (true) {
+      const bvh_node& n = nodes[current];
+      if (n.count == 0) {
+        uint32_t first = current + 1, second = n.offset;
+        double t_first = bvh_ray_entry(nodes[first], origin, inverse, t_max);
+        double t_second = bvh_ray_entry(nodes[second], origin, inverse, t_max);
+        if (t_first >= 0.0 && t_second >= 0.0) {
+          if (t_second < t_first) {
+            uint32_t swap = first;
+            first = second;
+            second = swap;
+          }
+          stack[top++] = second;
+          current = first;
+          continue;
+        }
+        if (t_first >= 0.0) {
+          current = first;
+          continue;
+        }
+        if (t_second >= 0.0) {
+          current = second;
+          continue;
+        }
+      } else {
+        for (i = n.offset; i < n.offset + n.count; ++i) {
+          if (found(std::size_t(indices[i]))) return true;
+        }
+      }
+      if (top == 0) return false;
+      current = stack[--top];
+    }
+  }
+
+}
+
+#endif
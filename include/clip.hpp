@@ -0,0 +1,140 @@
+/* layermesh/include/clip.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_CLIP_HPP__
+#define __LAYERMESH_CLIP_HPP__
+
+#include <atom.hpp>
+#include <gvec.hpp>
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Cutting atoms' faces and edges by each other's planes, and welding the
+// pieces' corners back together, to the same tolerances everywhere: the
+// common part of brep.cpp, which does it to faces, and slice.cpp, which
+// does it to the edges of the atoms' sections.
+
+namespace layermesh {
+
+  // The tolerances of the cutting, for a scene within the box: corners
+  // nearer a plane than on_plane are on it, corners nearer each other (or
+  // an edge) than weld are on them, and the solid is tested probe either
+  // side of a piece, at most (all as fractions of the size of the box, and
+  // its distance from the origin.)
+  struct clip_tolerances {
+    double on_plane, weld, probe;
+
+    clip_tolerances() : on_plane(0.0), weld(0.0), probe(0.0) {};
+    explicit clip_tolerances(const gbox& box);
+    // how far either side of a piece to test the solid, where the nearest
+    // plane the piece doesn't lie in is clearance away (not so far that the
+    // test points cross it, nor so near that rounding could put them on
+    // the piece.)
+    double step(double clearance) const;
+  };
+
+  // a plane with a unit normal, so that its distances are true ones.
+  struct unit_plane {
+    gvec normal;
+    double offset;
+  };
+
+  typedef std::vector<unit_plane> unit_planes;
+
+  // the atom's half_spaces(), with unit normals (leaving out any without a
+  // normal.)
+  unit_planes planes_of(const Atom& atom);
+
+  // the distance of the point in front of the plane.
+  inline double distance(const gvec& point, const unit_plane& p) {
+    return point * p.normal - p.offset;
+  }
+
+  // the least and greatest distances of the corners from the plane.
+  std::pair<double, double> extent(const gvec_list& corners,
+                                   const unit_plane& p);
+
+  // Splits a piece (a convex polygon, or a segment given by its two ends)
+  // by the plane into the parts behind it and in front of it. Corners
+  // within tolerance of the plane go to both, and a side left with fewer
+  // corners than a piece needs is left empty. The corners keep their
+  // order.
+  void split(const gvec_list& piece,
+             const unit_plane& p,
+             double tolerance,
+             gvec_list& back,
+             gvec_list& front);
+
+  // Appends the piece to out if it is wholly in front of one of the planes
+  // by (so outside the convex atom they bound), and otherwise its parts in
+  // front of each of those planes in turn, then the rest (which is inside
+  // the atom, or on its boundary.) Each part is then wholly inside or
+  // outside the atom.
+  void cut_by(const gvec_list& piece,
+              const unit_planes& by,
+              double tolerance,
+              std::vector<gvec_list>& out);
+
+  // whether the convex atom with the planes by has a face in the plane
+  // through point with the given normal (facing either way), with point
+  // on it.
+  bool shares_face(const unit_planes& by,
+                   const gvec& point,
+                   const gvec& normal,
+                   double tolerance);
+
+  // the distance from point to the nearest of the planes which it doesn't
+  // lie in (or least, if that is nearer.)
+  double clearance(const gvec& point,
+                   const unit_planes& planes,
+                   double tolerance,
+                   double least);
+
+  // the box of the corners, grown by margin.
+  gbox box_of(const gvec_list& corners, double margin);
+
+  // Numbers points as they are added, taking those within weld of one
+  // added before as that one (the earliest, if there are several), through
+  // a hash of cells weld wide.
+  class point_welder {
+    private:
+      struct cell_hash {
+        std::size_t operator()(const std::array<long long, 3>& c) const {
+          return std::size_t(c[0] * 73856093LL) ^
+                 std::size_t(c[1] * 19349663LL) ^
+                 std::size_t(c[2] * 83492791LL);
+        }
+      };
+      double weld;
+      gvec_list _points;
+      std::unordered_map<std::array<long long, 3>,
+                         std::vector<unsigned>, cell_hash> cells;
+    public:
+      explicit point_welder(double weld) : weld(weld) {};
+      // the number of the point.
+      unsigned add(const gvec& point);
+      const gvec_list& points() const { return _points; };
+  };
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+/* layermesh/include/contour.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_CONTOUR_HPP__
+#define __LAYERMESH_CONTOUR_HPP__
+
+#include <gvec.hpp>
+#include <atom.hpp>
+#include <csg.hpp>
+#include <mesh.hpp>
+#include <render.hpp>
+#include <functional>
+
+// Meshing the surface of a solid (or of a single atom, or of a signed
+// distance function), so that composites which aren't convex can be saved
+// as STL files too.
+
+namespace layermesh {
+
+  // Contours the surface of the solid by dual contouring over the centres of
+  // a voxel grid (see render.hpp): the grid's lattice of centres is cut into
+  // tetrahedra (six to each cube of eight centres, around its diagonal), and
+  // every tetrahedron whose corners are partly inside the solid gets one
+  // vertex of the mesh. Where the edges between its corners cross the
+  // surface (found by bisecting them with contains()), the solid's
+  // surface_distance() gives the normal there, and the vertex is placed
+  // where it best fits the planes through those crossings, so the flat
+  // facets, edges and corners of the atoms are kept sharp rather than
+  // rounded off by the grid. Each edge of the lattice which crosses the
+  // surface then becomes a polygon joining the vertices of the tetrahedra
+  // around it, and is cut into triangles.
+  //
+  // Since a tetrahedron's corners can only be split one way, unlike a
+  // cube's, the result is always a closed manifold, with facets ordered as
+  // facet_triples require (the centres beyond the grid count as outside, so
+  // a solid the grid doesn't cover is closed off at its edge.) Vertices
+  // are kept strictly inside their tetrahedra, so none coincide.
+  //
+  // The layers of cubes are split into slabs, one per thread (0 meaning one
+  // per hardware thread), which place their own vertices and then join
+  // those across the boundaries of the slabs when making the facets, so no
+  // vertex is made twice; the mesh is the same however many threads are
+  // used. Throws std::invalid_argument if the grid has no voxels, and
+  // std::runtime_error if the mesh would have more vertices than an
+  // unsigned can index.
+  IndexedMesh contour(const Solid& solid,
+                      const voxel_grid& grid,
+                      unsigned threads = 1);
+  IndexedMesh contour(const Atom& atom,
+                      const voxel_grid& grid,
+                      unsigned threads = 1);
+  // The same, for the solid where distance(point) < 0. Normals are taken
+  // from the differences of distance across a thousandth of a voxel, so
+  // it should be smooth near the surface, as a signed distance is.
+  IndexedMesh contour(const std::function<double(const gvec&)>& distance,
+                      const voxel_grid& grid,
+                      unsigned threads = 1);
+
+}
+
+#endif
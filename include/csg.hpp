@@ -0,0 +1,414 @@
+/* layermesh/include/csg.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_CSG_HPP__
+#define __LAYERMESH_CSG_HPP__
+
+#include <gvec.hpp>
+#include <atom.hpp>
+#include <bvh.hpp>
+#include <parallel.hpp>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace layermesh {
+
+  // A solid built from atoms by set operations: a tree of Union, Intersection
+  // and Difference nodes whose leaves are atoms. The queries answer whether
+  // points are inside the whole solid, without ever evaluating the children
+  // which can't change the answer: a point outside a child's bounding sphere
+  // is never given to it, a union stops at the first child which contains
+  // the point, and an intersection at the first which doesn't.
+  //
+  // As for atoms, the queries (everything const below) may be called
+  // concurrently from any number of threads. Building the tree (add() and
+  // reorder()) must not race with them.
+  class Solid {
+    public:
+      virtual ~Solid() {};
+      virtual bool contains(gvec point) const = 0;
+      // Batched forms of contains(), as for Atom::contains_batch(). The
+      // defaults call contains() once per point.
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      // a gsphere which contains the whole solid, as for Atom::get_boundary().
+      virtual gsphere get_boundary() const = 0;
+      // a box which contains the whole solid, as for Atom::get_aabb(). The
+      // default is the box of get_boundary().
+      virtual gbox get_aabb() const;
+      // how many atoms the solid is built from.
+      virtual std::size_t leaves() const = 0;
+      // appends the atoms the solid is built from (as many as leaves()),
+      // depth first.
+      virtual void atoms(std::vector<std::shared_ptr<const Atom> >& out)
+        const = 0;
+      // For rendering by scanline: appends to spans the parts of the line
+      // through (0, y, z) parallel to the x axis, between low and high, which
+      // the solid contains, in order, disjoint and not touching. They are
+      // composed from the atoms' scanline_span()s, so their ends are as
+      // exact as those are.
+      virtual void scanline_spans(double y,
+                                  double z,
+                                  double low,
+                                  double high,
+                                  span_list& spans) const = 0;
+      // the coarsest Atom::relative_precision() of the atoms, to which
+      // contains() is therefore only good.
+      virtual double relative_precision() const = 0;
+      // For building voxel octrees: whether the box is wholly inside the
+      // solid, wholly outside it, or neither, composed from the atoms'
+      // classify() (so box_crossing where those can't tell, or where the
+      // set operation can't without looking closer.) The default only
+      // knows that boxes which miss get_aabb() are outside.
+      virtual box_relation classify(const gbox& box) const;
+      // For meshing (see contour.hpp): a signed distance bound for the solid
+      // (negative inside), with the unit normal of the surface nearest the
+      // point, composed from the atoms' surface_distance() as the least of
+      // the children's for unions and the greatest for intersections (a
+      // difference being the intersection of its base with the cuts turned
+      // inside out.) Only the children whose boxes come within reach of the
+      // point are measured, so the answer is only meaningful where it is
+      // nearer zero than reach: further out it may be any value at least
+      // reach from zero, and normal may be left alone.
+      virtual double surface_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const = 0;
+  };
+
+  // A single atom, as a solid.
+  class Leaf : public Solid {
+    private:
+      std::shared_ptr<const Atom> _atom;
+      gsphere boundary;
+      gbox aabb;
+    public:
+      // (the atom's boundary and box are read once, here.)
+      Leaf(std::shared_ptr<const Atom> atom);
+      const Atom& atom() const { return *_atom; };
+      virtual bool contains(gvec point) const;
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual gsphere get_boundary() const { return boundary; };
+      virtual gbox get_aabb() const { return aabb; };
+      virtual std::size_t leaves() const { return 1; };
+      virtual void atoms(std::vector<std::shared_ptr<const Atom> >& out)
+        const {
+        out.push_back(_atom);
+      };
+      virtual void scanline_spans(double y,
+                                  double z,
+                                  double low,
+                                  double high,
+                                  span_list& spans) const;
+      virtual double relative_precision() const {
+        return _atom->relative_precision();
+      };
+      virtual box_relation classify(const gbox& box) const;
+      virtual double surface_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const;
+  };
+
+  // How often a child of a Composite has been evaluated, how often its answer
+  // settled the query, and how long it took. (Copyable, for the sake of the
+  // child lists which hold them.)
+  struct child_stats {
+    std::atomic<unsigned long long> tested;
+    std::atomic<unsigned long long> decided;
+    std::atomic<unsigned long long> timed;
+    std::atomic<unsigned long long> nanoseconds;
+
+    child_stats() : tested(0), decided(0), timed(0), nanoseconds(0) {};
+    child_stats(const child_stats& other) { *this = other; };
+    child_stats& operator=(const child_stats& other);
+    void record(unsigned long long tested,
+                unsigned long long decided,
+                unsigned long long timed,
+                unsigned long long nanoseconds);
+    void clear();
+  };
+
+  // The common part of the set operations: a list of child solids, kept in
+  // the order they are evaluated, with their bounding spheres alongside in
+  // flat arrays so that a query can run through them quickly. Unions and
+  // Differences of many children find those near a point through a Bvh over
+  // the children's boxes (see bvh.hpp) instead, which is built on the first
+  // query after the children change; its leaves keep their children in
+  // order.
+  //
+  // A child is worth evaluating early if it is cheap and likely to settle the
+  // query (to accept the point, in a union.) The composite samples the cost
+  // and outcome of its children as it is queried, and reorder() sorts them by
+  // expected cost per decision, so that after a representative run of
+  // queries the order suits the scene. Until then they are evaluated in the
+  // order they were added (or, after a reorder() with nothing yet observed,
+  // in the order of a guess from their sizes and bounding spheres.)
+  class Composite : public Solid {
+    protected:
+      struct child {
+        std::shared_ptr<const Solid> solid;
+        gsphere boundary;
+        gbox box;
+        std::size_t leaves;
+        double precision;
+        mutable child_stats stats;
+      };
+      std::vector<child> children;
+      // the children's bounding spheres, in the same order:
+      std::vector<double> centre_x, centre_y, centre_z, radius_squared;
+      gsphere boundary;
+      gbox aabb;
+      std::size_t leaf_count;
+      double precision;
+      // a hierarchy over the children's boxes, built on first use:
+      once_value<std::shared_ptr<const Bvh> > _hierarchy;
+
+      void add_child(std::shared_ptr<const Solid> solid);
+      // evaluates child i on a point, sampling its statistics if asked.
+      bool evaluate(std::size_t i, const gvec& point, bool sampled) const;
+      // expected cost per decision of child i, by what has been observed of
+      // it, or by guesses where too little has been.
+      double rank(std::size_t i, double nanoseconds_per_leaf) const;
+      void sync_spheres();
+      // recomputes the boundary, box, leaf count and precision of the whole
+      // from the children, as if they had been added in their present order.
+      void recompute_bounds();
+      // (the boundary and box of a composite with no children.)
+      virtual void reset_bounds();
+      // refits the hierarchy, if there is one, to the children's boxes.
+      void refit_hierarchy();
+      // the hierarchy over the children (ordered as they are), or NULL if
+      // there are too few for it to be worthwhile.
+      const Bvh* hierarchy() const;
+      bool in_child_boundary(std::size_t i, const gvec& point) const {
+        double dx = point[0] - centre_x[i];
+        double dy = point[1] - centre_y[i];
+        double dz = point[2] - centre_z[i];
+        return dx * dx + dy * dy + dz * dz <= radius_squared[i];
+      };
+      // whether the answer of a child settles the query when it accepts the
+      // point (as in unions), or when it rejects it (as in intersections.)
+      virtual bool decided_by_acceptance() const = 0;
+      // the probability that a child with this boundary settles a query,
+      // before anything has been observed.
+      double prior_decision_rate(const gsphere& child_boundary) const;
+      // the boundary of the whole, once a child with this boundary has been
+      // added (as the last of children.)
+      virtual gsphere extend_boundary(const gsphere& child) const = 0;
+      // (and likewise for the box.)
+      virtual gbox extend_aabb(const gbox& child) const = 0;
+      // (whether this query should be timed, for the statistics.)
+      static bool sample_query();
+      // appends the scanline_spans() of every child whose box the line
+      // meets, as they come (so unsorted, and perhaps overlapping.)
+      void child_spans(double y,
+                       double z,
+                       double low,
+                       double high,
+                       span_list& spans) const;
+      // the box against the union of the children: inside if it is inside
+      // any of them, outside if it is outside all of them.
+      box_relation children_classify(const gbox& box) const;
+      // the least surface_distance() of the children within reach of the
+      // point (or reach, if none is nearer.)
+      double children_distance(const gvec& point,
+                               double reach,
+                               gvec& normal) const;
+
+    public:
+      Composite();
+      virtual ~Composite() {};
+      void add(std::shared_ptr<const Solid> solid) { add_child(solid); };
+      void add(std::shared_ptr<const Atom> atom);
+      // Editing: adds a child, replaces child i (which keeps its place in
+      // the order, but not its statistics), or removes it. Each appends to
+      // changed the boxes of the space whose contents may have changed (the
+      // old child's box, and the new one's; in an Intersection, which a new
+      // child may cut anywhere and the loss of one may grow anywhere, the
+      // whole's box too), for updating what was rendered of the solid
+      // without starting again (see VoxelOctree::update.) The hierarchy over
+      // the children is refitted after a replace(), rather than rebuilt, so
+      // it may slow down after many far-reaching edits, until reorder() or
+      // remove() rebuilds it. Throws std::out_of_range for a bad index.
+      void add(std::shared_ptr<const Solid> solid, std::vector<gbox>& changed);
+      void add(std::shared_ptr<const Atom> atom, std::vector<gbox>& changed);
+      void replace(std::size_t i,
+                   std::shared_ptr<const Solid> solid,
+                   std::vector<gbox>& changed);
+      void replace(std::size_t i,
+                   std::shared_ptr<const Atom> atom,
+                   std::vector<gbox>& changed);
+      void remove(std::size_t i, std::vector<gbox>& changed);
+      // Reads the children's boundaries and boxes again, for when a solid
+      // below this one has been edited through another pointer (a composite
+      // keeps its children's bounds, so after editing a Union inside a
+      // Difference, say, the Difference must be refreshed too.)
+      void refresh_bounds();
+      // the number of children (not of leaves; see leaves().)
+      std::size_t size() const { return children.size(); };
+      // the children, in the order they are evaluated.
+      const Solid& operator[](std::size_t i) const {
+        return *children[i].solid;
+      };
+      const child_stats& stats(std::size_t i) const {
+        return children[i].stats;
+      };
+      // Sorts the children by their observed cost per decision, and forgets
+      // the statistics. Children which have not yet been evaluated often are
+      // placed by estimates from their sizes and bounding spheres. (Only
+      // this node is sorted: Composites below it have their own reorder().)
+      void reorder();
+      virtual gsphere get_boundary() const { return boundary; };
+      virtual gbox get_aabb() const { return aabb; };
+      virtual std::size_t leaves() const { return leaf_count; };
+      virtual void atoms(std::vector<std::shared_ptr<const Atom> >& out)
+        const;
+      virtual double relative_precision() const { return precision; };
+  };
+
+  // the points inside any child.
+  class Union : public Composite {
+    protected:
+      virtual bool decided_by_acceptance() const { return true; };
+      virtual gsphere extend_boundary(const gsphere& child) const;
+      virtual gbox extend_aabb(const gbox& child) const;
+      template <typename T>
+      void contains_batch_of(const T* x, const T* y, const T* z,
+                             std::size_t count, unsigned char* mask) const;
+    public:
+      virtual bool contains(gvec point) const;
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void scanline_spans(double y,
+                                  double z,
+                                  double low,
+                                  double high,
+                                  span_list& spans) const;
+      virtual box_relation classify(const gbox& box) const;
+      virtual double surface_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const;
+  };
+
+  // the points inside every child (and no points, if it has no children.)
+  class Intersection : public Composite {
+    protected:
+      virtual bool decided_by_acceptance() const { return false; };
+      virtual gsphere extend_boundary(const gsphere& child) const;
+      virtual gbox extend_aabb(const gbox& child) const;
+      template <typename T>
+      void contains_batch_of(const T* x, const T* y, const T* z,
+                             std::size_t count, unsigned char* mask) const;
+    public:
+      virtual bool contains(gvec point) const;
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void scanline_spans(double y,
+                                  double z,
+                                  double low,
+                                  double high,
+                                  span_list& spans) const;
+      virtual box_relation classify(const gbox& box) const;
+      virtual double surface_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const;
+  };
+
+  // the points inside the base, but inside none of the children (which are
+  // the solids taken away from it, and may be given in any order.)
+  class Difference : public Composite {
+    private:
+      std::shared_ptr<const Solid> _base;
+    protected:
+      virtual bool decided_by_acceptance() const { return true; };
+      virtual gsphere extend_boundary(const gsphere& child) const;
+      virtual gbox extend_aabb(const gbox& child) const;
+      virtual void reset_bounds();
+      template <typename T>
+      void contains_batch_of(const T* x, const T* y, const T* z,
+                             std::size_t count, unsigned char* mask) const;
+    public:
+      Difference(std::shared_ptr<const Solid> base);
+      Difference(std::shared_ptr<const Atom> base);
+      const Solid& base() const { return *_base; };
+      virtual bool contains(gvec point) const;
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void scanline_spans(double y,
+                                  double z,
+                                  double low,
+                                  double high,
+                                  span_list& spans) const;
+      virtual box_relation classify(const gbox& box) const;
+      virtual double surface_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const;
+      virtual std::size_t leaves() const {
+        return leaf_count + _base->leaves();
+      };
+      // (the base's, then the children's.)
+      virtual void atoms(std::vector<std::shared_ptr<const Atom> >& out)
+        const;
+  };
+
+}
+
+#endif
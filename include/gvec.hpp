@@ -21,53 +21,192 @@
 #define __LAYERMESH_GVEC_HPP__
 
 #include <vector>
+#include <array>
 #include <memory>
+#include <cmath>
+#include <cstddef>
+
+// gvec arithmetic sits in the inner loop of everything else in layermesh, so
+// it is defined entirely in this header and forced inline where the compiler
+// allows, so that compound expressions compile to straight-line arithmetic
+// without relying on link-time optimisation.
+#if defined(__GNUC__) || defined(__clang__)
+#define LAYERMESH_INLINE inline __attribute__((always_inline))
+#else
+#define LAYERMESH_INLINE inline
+#endif
 
 namespace layermesh {
 
-  // gvec = Geometrical Vector (as opposed to std::vector).
-  class gvec {
+  // gvec = Geometrical Vector (as opposed to std::vector). The scalar type is
+  // a template parameter so that large point clouds can be held in single
+  // precision; almost all code uses the double-precision alias gvec below.
+  template <typename T>
+  class basic_gvec {
     private:
-      double r[3];
+      T r[3];
     public:
-      gvec();
-      gvec(double x, double y, double z);
+      typedef T value_type;
+
+      constexpr basic_gvec() : r{T(0), T(0), T(0)} {}
+      constexpr basic_gvec(T x, T y, T z) : r{x, y, z} {}
+      // conversion between precisions must be asked for explicitly:
+      template <typename U>
+      constexpr explicit basic_gvec(const basic_gvec<U>& o)
+        : r{static_cast<T>(o[0]), static_cast<T>(o[1]), static_cast<T>(o[2])} {}
 
       // component access:
-      double operator[](int index) const;
-      double& operator[](int index);
+      constexpr T operator[](int index) const { return r[index]; }
+      LAYERMESH_INLINE T& operator[](int index) { return r[index]; }
   };
 
+  typedef basic_gvec<double> gvec;
+  typedef basic_gvec<float> gvec32;
+
+  // (scalars are taken as basic_gvec<T>::value_type, which is not deduced, so
+  // that e.g. gvec * 5 still works.)
+
   // addition and subtraction:
-  gvec operator+(const gvec& l, const gvec& r);
-  gvec operator-(const gvec& l, const gvec& r);
+  template <typename T>
+  constexpr basic_gvec<T> operator+(const basic_gvec<T>& l,
+                                    const basic_gvec<T>& r) {
+    return basic_gvec<T>(l[0] + r[0], l[1] + r[1], l[2] + r[2]);
+  }
+
+  template <typename T>
+  constexpr basic_gvec<T> operator-(const basic_gvec<T>& l,
+                                    const basic_gvec<T>& r) {
+    return basic_gvec<T>(l[0] - r[0], l[1] - r[1], l[2] - r[2]);
+  }
 
   // negation:
-  gvec operator-(const gvec&r);
+  template <typename T>
+  constexpr basic_gvec<T> operator-(const basic_gvec<T>& r) {
+    return basic_gvec<T>(T(0) - r[0], T(0) - r[1], T(0) - r[2]);
+  }
 
   // scaling:
-  gvec operator*(double l, const gvec& r);
-  gvec operator*(const gvec& l, double r);
-  gvec operator/(const gvec& l, double r);
+  template <typename T>
+  constexpr basic_gvec<T> operator*(typename basic_gvec<T>::value_type l,
+                                    const basic_gvec<T>& r) {
+    return basic_gvec<T>(l * r[0], l * r[1], l * r[2]);
+  }
+
+  template <typename T>
+  constexpr basic_gvec<T> operator*(const basic_gvec<T>& l,
+                                    typename basic_gvec<T>::value_type r) {
+    return basic_gvec<T>(r * l[0], r * l[1], r * l[2]);
+  }
+
+  template <typename T>
+  constexpr basic_gvec<T> operator/(const basic_gvec<T>& l,
+                                    typename basic_gvec<T>::value_type r) {
+    return basic_gvec<T>(l[0] / r, l[1] / r, l[2] / r);
+  }
 
   // dot product:
-  double operator*(const gvec& l, const gvec& r);
+  template <typename T>
+  constexpr T operator*(const basic_gvec<T>& l, const basic_gvec<T>& r) {
+    return l[0] * r[0] + l[1] * r[1] + l[2] * r[2];
+  }
 
   // cross product:
-  gvec operator^(const gvec& l, const gvec& r);
+  template <typename T>
+  constexpr basic_gvec<T> operator^(const basic_gvec<T>& l,
+                                    const basic_gvec<T>& r) {
+    return basic_gvec<T>(l[1] * r[2] - l[2] * r[1],
+                         l[2] * r[0] - l[0] * r[2],
+                         l[0] * r[1] - l[1] * r[0]);
+  }
 
-  double modulus(const gvec& v);
+  template <typename T>
+  LAYERMESH_INLINE T modulus(const basic_gvec<T>& v) {
+    return std::sqrt(v * v);
+  }
 
   // aliases for collections of gvec's:
-  typedef std::vector<gvec> gvec_list;
-  typedef std::shared_ptr<std::vector<gvec> > memsafe_gvec_list;
+  template <typename T>
+  using basic_gvec_list = std::vector<basic_gvec<T> >;
+  template <typename T>
+  using basic_memsafe_gvec_list = std::shared_ptr<basic_gvec_list<T> >;
+
+  typedef basic_gvec_list<double> gvec_list;
+  typedef basic_memsafe_gvec_list<double> memsafe_gvec_list;
+  typedef basic_gvec_list<float> gvec32_list;
+  typedef basic_memsafe_gvec_list<float> memsafe_gvec32_list;
+
+  // A read-only view of gvecs stored contiguously somewhere else (a gvec_list,
+  // a std::array, or a plain pointer and length), for passing point clouds
+  // around without copying or allocating. It is only valid for as long as
+  // the storage it views is alive and unresized.
+  template <typename T>
+  class basic_gvec_view {
+    private:
+      const basic_gvec<T>* _data;
+      std::size_t _size;
+    public:
+      typedef basic_gvec<T> value_type;
+      typedef const basic_gvec<T>* const_iterator;
+
+      constexpr basic_gvec_view() : _data(nullptr), _size(0) {}
+      constexpr basic_gvec_view(const basic_gvec<T>* data, std::size_t size)
+        : _data(data), _size(size) {}
+      // (implicit, so that lists and arrays can be passed where views are
+      // expected.)
+      basic_gvec_view(const basic_gvec_list<T>& list)
+        : _data(list.data()), _size(list.size()) {}
+      template <std::size_t N>
+      constexpr basic_gvec_view(const std::array<basic_gvec<T>, N>& a)
+        : _data(a.data()), _size(N) {}
+
+      LAYERMESH_INLINE constexpr const basic_gvec<T>&
+      operator[](std::size_t i) const {
+        return _data[i];
+      }
+      constexpr const basic_gvec<T>* data() const { return _data; }
+      constexpr std::size_t size() const { return _size; }
+      constexpr bool empty() const { return _size == 0; }
+      constexpr const_iterator begin() const { return _data; }
+      constexpr const_iterator end() const { return _data + _size; }
+      // the first n gvecs (e.g. the boundary points of a point cloud):
+      constexpr basic_gvec_view first(std::size_t n) const {
+        return basic_gvec_view(_data, n < _size ? n : _size);
+      }
+  };
+
+  typedef basic_gvec_view<double> gvec_view;
+  typedef basic_gvec_view<float> gvec32_view;
 
   // gsphere
-  typedef struct {
-    gvec centre;
-    double radius;
-  } gsphere;
+  template <typename T>
+  struct basic_gsphere {
+    basic_gvec<T> centre;
+    T radius;
+  };
+
+  typedef basic_gsphere<double> gsphere;
+  typedef basic_gsphere<float> gsphere32;
+
+  // gbox = an axis-aligned box, from its lowest corner to its highest.
+  template <typename T>
+  struct basic_gbox {
+    basic_gvec<T> low;
+    basic_gvec<T> high;
+  };
+
+  typedef basic_gbox<double> gbox;
+  typedef basic_gbox<float> gbox32;
+
+  // the smallest box containing a sphere:
+  template <typename T>
+  constexpr basic_gbox<T> box_of(const basic_gsphere<T>& s) {
+    return basic_gbox<T>{
+      basic_gvec<T>(s.centre[0] - s.radius, s.centre[1] - s.radius,
+                    s.centre[2] - s.radius),
+      basic_gvec<T>(s.centre[0] + s.radius, s.centre[1] + s.radius,
+                    s.centre[2] + s.radius)
+    };
+  }
 }
 
 #endif
-
@@ -0,0 +1,135 @@
+/* layermesh/include/halfspace.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_HALFSPACE_HPP__
+#define __LAYERMESH_HALFSPACE_HPP__
+
+#include <gvec.hpp>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+namespace layermesh {
+
+  // gplane = the half-space {p : normal * p <= offset}. The normal points from
+  // the solid phase to the void, as for facet_triples, so a convex object is
+  // exactly the intersection of the gplanes of its facets.
+  template <typename T>
+  struct basic_gplane {
+    basic_gvec<T> normal;
+    T offset;
+  };
+
+  typedef basic_gplane<double> gplane;
+  typedef basic_gplane<float> gplane32;
+
+  template <typename T>
+  using basic_gplane_list = std::vector<basic_gplane<T> >;
+
+  typedef basic_gplane_list<double> gplane_list;
+  typedef basic_gplane_list<float> gplane32_list;
+
+  // (const, since these are shared between callers once they are cached.)
+  typedef std::shared_ptr<const gplane_list> memsafe_gplane_list;
+
+  // (the functions below are instantiated for float and double only.)
+
+  // the plane through origin with the given (outward) normal:
+  template <typename T>
+  basic_gplane<T> plane_through(const basic_gvec<T>& origin,
+                                const basic_gvec<T>& normal);
+
+  // true iff point lies inside (or on) every one of the num_planes planes.
+  template <typename T>
+  bool halfspaces_contain(const basic_gplane<T>* planes,
+                          unsigned num_planes,
+                          const basic_gvec<T>& point);
+
+  // Batched form of halfspaces_contain, for points given as three contiguous
+  // coordinate arrays (structure-of-arrays.) Sets mask[i] to 1 if point i is
+  // contained and to 0 otherwise. Uses AVX2 or SSE2 when the compiler targets
+  // them (four doubles or eight floats per instruction with AVX2), and agrees
+  // exactly with halfspaces_contain in either case.
+  template <typename T>
+  void halfspaces_contain_batch(const basic_gplane<T>* planes,
+                                unsigned num_planes,
+                                const T* x,
+                                const T* y,
+                                const T* z,
+                                std::size_t count,
+                                unsigned char* mask);
+
+  // An interval [enter, exit] of a line, e.g. the part of a scanline inside
+  // a solid.
+  struct span {
+    double enter;
+    double exit;
+  };
+
+  typedef std::vector<span> span_list;
+
+  // Clips the line through (0, y, z) parallel to the x axis to the planes:
+  // returns false if it misses their intersection, and otherwise sets s to
+  // the interval of x inside (which may be unbounded, if the planes are.)
+  // The interval is exact up to rounding, so points within an ulp or so of
+  // its ends may be classified differently by halfspaces_contain.
+  template <typename T>
+  bool halfspaces_clip_x(const basic_gplane<T>* planes,
+                         unsigned num_planes,
+                         double y,
+                         double z,
+                         span& s);
+
+  // How a box lies against a solid: wholly outside it, wholly inside it, or
+  // neither (or too near its surface to tell, so box_crossing is always a
+  // safe answer.)
+  enum box_relation {
+    box_outside,
+    box_inside,
+    box_crossing
+  };
+
+  // classifies the box against the intersection of the planes, with a
+  // margin of a few rounding errors of T so that no point of a box called
+  // inside or outside can be answered otherwise by halfspaces_contain.
+  template <typename T>
+  box_relation halfspaces_classify(const basic_gplane<T>* planes,
+                                   unsigned num_planes,
+                                   const gbox& box);
+
+  // A signed distance bound for the intersection of the planes: the greatest
+  // signed distance of the point from any of them (negative inside), which is
+  // exact inside and beside the facets, and an underestimate beyond their
+  // edges and corners. Sets normal to the unit normal of that plane, and
+  // returns infinity (leaving normal alone) if there are no planes.
+  template <typename T>
+  double halfspaces_distance(const basic_gplane<T>* planes,
+                             unsigned num_planes,
+                             const gvec& point,
+                             gvec& normal);
+
+  // Reorders planes so that testing points like the samples against them in
+  // order rejects those outside as early as possible: greedily, each plane is
+  // the one which rejects the most samples that no earlier plane rejected.
+  // Planes which reject no more keep their original order at the end.
+  void order_by_rejection(gplane_list& planes, const gvec_list& samples);
+
+}
+
+#endif
@@ -0,0 +1,53 @@
+/* layermesh/include/hull.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_HULL_HPP__
+#define __LAYERMESH_HULL_HPP__
+
+#include <gvec.hpp>
+#include <mesh.hpp>
+#include <halfspace.hpp>
+#include <cstddef>
+
+namespace layermesh {
+
+  // The convex hull of points[0, count), by quickhull. The facets index into
+  // points and are wound by the facet_triple convention (see mesh.hpp), so
+  // the normal of each points out of the hull. Points on or within a small
+  // tolerance of the hull (relative to the extent of the cloud) are not made
+  // vertices, and flat regions of the hull are triangulated arbitrarily.
+  // Throws std::invalid_argument if the points don't span any volume.
+  //
+  // Each step of quickhull partitions the points outside the faces it
+  // removes between the faces it adds; with threads > 1 (0 meaning one per
+  // hardware thread), large partitions (including the first, of every point)
+  // are split between that many threads. The result doesn't depend on the
+  // number of threads. The working lists are reused from step to step, so
+  // there is no allocation per point.
+  facet_triples convex_hull(const gvec* points,
+                            std::size_t count,
+                            unsigned threads = 1);
+
+  // The half-spaces whose intersection is the hull given by facets (one per
+  // facet, except that coplanar facets share one.)
+  gplane_list hull_planes(const gvec* points, const facet_triples& facets);
+
+}
+
+#endif
@@ -35,25 +35,78 @@ namespace layermesh {
   typedef std::array<unsigned,3> facet_triple;
   typedef std::vector<facet_triple> facet_triples;
 
+  // How the binary writer gets the encoded bytes into the file:
+  enum stl_write_mode {
+    // pick one of the below based on the size of the file;
+    stl_auto,
+    // encode the whole file into one buffer, and write() it once;
+    stl_buffered,
+    // size the file, mmap() it, and encode directly into the mapping;
+    stl_mapped,
+    // encode into a few fixed size chunks at a time, and hand them to the
+    // kernel together with writev(), so memory use doesn't grow with the mesh.
+    stl_streamed
+  };
+
   class Mesh {
     private:
+      stl_write_mode binary_mode;
+      unsigned export_threads;
+      template <typename T>
       void save_ascii_stl(std::string filename,
-                          const gvec_list& points,
-                          const facet_triples& facets);
+                          basic_gvec_view<T> points,
+                          const facet_triples& facets,
+                          basic_gvec_view<T> normals);
+      template <typename T>
       void save_binary_stl(std::string filename,
-                          const gvec_list& points,
-                          const facet_triples& facets);
+                          basic_gvec_view<T> points,
+                          const facet_triples& facets,
+                          basic_gvec_view<T> normals);
     protected:
+      // The points are taken as a view, so lists, arrays and point clouds
+      // can all be saved without being copied. normals, if not empty, must
+      // hold the unit normal of each facet in order; subclasses which already
+      // know them (e.g. from their facet planes) save recomputing them on
+      // every export.
+      virtual void save_stl_inner(std::string filename,
+                                  bool binary,
+                                  gvec_view points,
+                                  const facet_triples& facets,
+                                  gvec_view normals = gvec_view());
+      // STL stores float32 anyway, so single-precision meshes are written
+      // without any conversion through double:
       virtual void save_stl_inner(std::string filename,
                                   bool binary,
-                                  const gvec_list& points,
-                                  const facet_triples& facets);
+                                  gvec32_view points,
+                                  const facet_triples& facets,
+                                  gvec32_view normals = gvec32_view());
     public:
+      Mesh() : binary_mode(stl_auto), export_threads(1) {};
       virtual ~Mesh() {};
+      // how binary STL files are written (see stl.hpp); the default, stl_auto,
+      // buffers small meshes and streams large ones.
+      void set_binary_stl_mode(stl_write_mode mode) { binary_mode = mode; };
+      // how many threads encode binary STL files (default 1; 0 means one per
+      // hardware thread.) With more than one, stl_auto maps the output file
+      // and each thread encodes its own range of facets directly into it.
+      void set_export_threads(unsigned threads) { export_threads = threads; };
       /* subclasses should implement this method by calling save_stl_inner. */
       virtual void save_stl(std::string filename, bool binary = true) = 0;
   };
 
+  // A mesh which is just its points and facets, e.g. as loaded by read_stl
+  // (see stl_reader.hpp.)
+  class IndexedMesh : public Mesh {
+    public:
+      gvec_list points;
+      facet_triples facets;
+      IndexedMesh() {};
+      IndexedMesh(const gvec_list& points, const facet_triples& facets)
+        : points(points), facets(facets) {};
+      virtual ~IndexedMesh() {};
+      virtual void save_stl(std::string filename, bool binary = true);
+  };
+
 }
 
 #endif
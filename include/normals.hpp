@@ -0,0 +1,66 @@
+/* layermesh/include/normals.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_NORMALS_HPP__
+#define __LAYERMESH_NORMALS_HPP__
+
+#include <gvec.hpp>
+#include <mesh.hpp>
+#include <cstddef>
+
+namespace layermesh {
+
+  // Batched facet normals for the STL writers. These are computed in two
+  // passes over structure-of-arrays buffers: the cross products first, and
+  // then the normalisation, which is vectorised (AVX2 or SSE2) using the
+  // hardware reciprocal square root refined by two Newton steps in double
+  // precision, which is accurate to well beyond the float32 that STL stores.
+
+  // normalises the count vectors (x[i], y[i], z[i]) in place. Zero vectors
+  // become NaN, as they would by dividing by their modulus.
+  void normalise_batch(double* x, double* y, double* z, std::size_t count);
+
+  // the unit normals of facets[first, last), by the facet_triple convention
+  // normal = (v1 - v0) ^ (v2 - v0), into x, y and z (which must have room
+  // for last - first values each.)
+  template <typename T>
+  void facet_normals_batch(basic_gvec_view<T> points,
+                           const facet_triples& facets,
+                           std::size_t first,
+                           std::size_t last,
+                           double* x,
+                           double* y,
+                           double* z);
+
+  // (lists don't convert to views during template argument deduction.)
+  template <typename T>
+  inline void facet_normals_batch(const basic_gvec_list<T>& points,
+                                  const facet_triples& facets,
+                                  std::size_t first,
+                                  std::size_t last,
+                                  double* x,
+                                  double* y,
+                                  double* z) {
+    facet_normals_batch(basic_gvec_view<T>(points), facets, first, last,
+                        x, y, z);
+  }
+
+}
+
+#endif
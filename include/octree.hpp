@@ -0,0 +1,177 @@
+/* layermesh/include/octree.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_OCTREE_HPP__
+#define __LAYERMESH_OCTREE_HPP__
+
+#include <gvec.hpp>
+#include <atom.hpp>
+#include <csg.hpp>
+#include <render.hpp>
+#include <tiff.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace layermesh {
+
+  // The voxels along each side of a brick (the leaves of a VoxelOctree), and
+  // so the bits of one brick's layer, which fit a uint64_t:
+  const unsigned OCTREE_BRICK = 8;
+
+  // A bit per voxel for an 8x8x8 block: voxel (i, j, k) of the brick is bit
+  // i + 8 * j of layers[k].
+  struct octree_brick {
+    uint64_t layers[OCTREE_BRICK];
+  };
+
+  // The occupancy of a voxel grid (see render.hpp), rendered once from a
+  // solid and kept as a sparse octree, so that it can be sliced, queried and
+  // saved again and again without going back to the solid.
+  //
+  // The octree covers the grid with a cube of 2^depth voxels a side (those
+  // beyond the grid are empty.) It is built from the top down: each node is
+  // classified by the solid's classify() against the box of its voxels'
+  // centres, and one wholly inside or outside is kept as a single full or
+  // empty node. Nodes on the surface are split until they are bricks, whose
+  // voxels are rendered a row at a time by render_row() (so slices of the
+  // octree are the same as render_slice's) and kept a bit each. Nodes whose
+  // children all turn out the same are merged again, so the memory used
+  // grows with the area of the surface, not the volume of the grid.
+  //
+  // Queries (everything const) may be called concurrently.
+  class VoxelOctree {
+    private:
+      voxel_grid _grid;
+      unsigned depth;
+      // Each entry is one of the values below, or an internal node (the
+      // index of its eight children in nodes, times 4, plus 2) or a brick
+      // (its index in bricks, times 4, plus 3.) The children of a node are
+      // in the order of their lowest corners' offsets, x + 2y + 4z.
+      uint32_t root;
+      std::vector<uint32_t> nodes;
+      std::vector<octree_brick> bricks;
+      // (checks that the nodes and bricks form a tree, after decoding.)
+      void check_node(uint32_t entry, unsigned size, std::size_t& seen) const;
+    public:
+      static const uint32_t EMPTY = 0;
+      static const uint32_t FULL = 1;
+
+      // Builds the occupancy of the grid, on up to threads threads (where 0
+      // means one per hardware thread; the eight octants of the root are
+      // built separately.) Throws std::invalid_argument if the grid has no
+      // voxels, or is more than 2^20 voxels a side.
+      VoxelOctree(const Solid& solid,
+                  const voxel_grid& grid,
+                  unsigned threads = 1);
+      VoxelOctree(const Atom& atom,
+                  const voxel_grid& grid,
+                  unsigned threads = 1);
+      // Brings the octree up to date after the solid has been edited:
+      // the voxels with centres in any of the changed boxes (e.g. as
+      // returned by Composite::replace) are rendered again from the solid,
+      // and the rest of the tree is kept, so the work done grows with the
+      // size of the change rather than of the solid (but for copying the
+      // tree, which is cheap by comparison.) The grid stays the same, so
+      // anything the solid now has beyond it is left out.
+      void update(const Solid& solid,
+                  const std::vector<gbox>& changed,
+                  unsigned threads = 1);
+      // decodes an octree written by encode(), throwing
+      // std::invalid_argument if the data isn't one.
+      VoxelOctree(const unsigned char* data, std::size_t size);
+
+      const voxel_grid& grid() const { return _grid; };
+      // the grid of the slices at the given level of detail: voxels 2^level
+      // times larger, over (at least) the same space.
+      voxel_grid grid(unsigned level) const;
+
+      // whether voxel (i, j, k) of the grid is occupied (and false outside
+      // the grid.)
+      bool occupied(unsigned i, unsigned j, unsigned k) const;
+      // whether the point is in an occupied voxel.
+      bool contains(const gvec& point) const;
+
+      // Fills pixels (grid(level).width * grid(level).height bytes, row by
+      // row) with layer layer of grid(level). At level 0 these are the same
+      // as render_slice's, 255 for occupied voxels and 0 elsewhere; at
+      // coarser levels each pixel is the fraction of the voxels within it
+      // that are occupied, from 0 to 255 (so edges are antialiased, rather
+      // than sampled again.)
+      void slice(unsigned layer,
+                 unsigned char* pixels,
+                 unsigned level = 0) const;
+      // writes every layer of grid(level) into a multi-page TIFF, as
+      // render_tiff does, throwing std::runtime_error if it can't.
+      void write_tiff(const std::string& filename,
+                      unsigned level = 0,
+                      tiff_compression compression = tiff_packbits) const;
+
+      // Serialisation, in a little-endian binary format of the octree's own
+      // (the grid, then the nodes and bricks as they are held.) save() and
+      // load() throw std::runtime_error if the file can't be written or
+      // read, and load() std::invalid_argument if it isn't an octree.
+      void encode(std::vector<unsigned char>& out) const;
+      void save(const std::string& filename) const;
+      static VoxelOctree load(const std::string& filename);
+
+      std::size_t node_count() const { return nodes.size(); };
+      std::size_t brick_count() const { return bricks.size(); };
+      // the bytes held by the nodes and bricks.
+      std::size_t memory() const {
+        return nodes.size() * sizeof(uint32_t) +
+               bricks.size() * sizeof(octree_brick);
+      };
+  };
+
+  // The encoded pages of an octree's TIFF stack (see
+  // VoxelOctree::write_tiff), kept between writes so that, after an edit,
+  // only the pages holding changed voxels need slicing and encoding again
+  // before the file is rewritten.
+  class TiffStack {
+    private:
+      unsigned level;
+      tiff_compression compression;
+      // the grid of the pages held, which must match the octree's:
+      voxel_grid written;
+      std::vector<std::vector<unsigned char> > pages;
+      std::vector<bool> stale;
+      unsigned last_encoded;
+    public:
+      TiffStack(unsigned level = 0,
+                tiff_compression compression = tiff_packbits);
+      // marks the pages holding voxels with centres in any of the boxes
+      // (as for VoxelOctree::update) as stale.
+      void invalidate(const VoxelOctree& octree,
+                      const std::vector<gbox>& changed);
+      // encodes the stale pages of the octree (every page, the first time,
+      // or if the octree's grid isn't the one written before) on up to
+      // threads threads, and writes all of them into a multi-page TIFF,
+      // throwing std::runtime_error if it can't.
+      void write(const std::string& filename,
+                 const VoxelOctree& octree,
+                 unsigned threads = 1);
+      // how many pages the last write() encoded.
+      unsigned encoded() const { return last_encoded; };
+  };
+
+}
+
+#endif
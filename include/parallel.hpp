@@ -0,0 +1,108 @@
+/* layermesh/include/parallel.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_PARALLEL_HPP__
+#define __LAYERMESH_PARALLEL_HPP__
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace layermesh {
+
+  // the number of threads meant by a thread count option, where 0 means one
+  // per hardware thread.
+  inline unsigned resolve_threads(unsigned threads) {
+    if (threads == 0) {
+      threads = std::thread::hardware_concurrency();
+    }
+    return threads == 0 ? 1 : threads;
+  }
+
+  // Calls f(t, first, last) for each of parts consecutive ranges covering
+  // [0, count), each on its own thread (the calling thread takes range 0),
+  // and returns once they have all finished. f must not throw. If a thread
+  // can't be started, the std::system_error is rethrown once those which
+  // were have finished (and range 0 isn't done.)
+  template <typename F>
+  void split_range(std::size_t count, unsigned parts, F f) {
+    if (parts <= 1) {
+      f(0u, std::size_t(0), count);
+      return;
+    }
+    std::size_t per_part = (count + parts - 1) / parts;
+    std::vector<std::thread> workers;
+    workers.reserve(parts - 1);
+    std::vector<std::thread>::iterator it;
+    unsigned t;
+    try {
+      for (t = 1; t < parts; ++t) {
+        std::size_t first = t * per_part < count ? t * per_part : count;
+        std::size_t last = first + per_part < count ? first + per_part : count;
+        workers.push_back(std::thread(f, t, first, last));
+      }
+    } catch (...) {
+      for (it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+      }
+      throw;
+    }
+    f(0u, std::size_t(0), per_part < count ? per_part : count);
+
+    for (it = workers.begin(); it != workers.end(); ++it) {
+      it->join();
+    }
+  }
+
+  // A cached value which is computed on first use, exactly once however many
+  // threads ask for it at the same time (if computing it throws, the next use
+  // tries again.) Readable through a const owner, so that const queries can
+  // fill their caches safely. The value usually depends on the rest of the
+  // owner, so copies start out empty and compute their own, and assignment
+  // empties the cache (which must not race with readers, as for any other
+  // assignment.)
+  template <typename T>
+  class once_value {
+    private:
+      mutable std::once_flag flag;
+      mutable T value;
+    public:
+      once_value() {};
+      once_value(const once_value&) {};
+      once_value& operator=(const once_value&) {
+        // (a once_flag can't be reset, so a fresh one is made in its place.)
+        flag.~once_flag();
+        new (&flag) std::once_flag();
+        value = T();
+        return *this;
+      };
+      // the value, calling compute() to obtain it if nothing has yet.
+      // compute() may fill other once_values, but not this one.
+      template <typename F>
+      const T& get(F compute) const {
+        std::call_once(flag, [&]() { value = compute(); });
+        return value;
+      };
+  };
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/* layermesh/include/render.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_RENDER_HPP__
+#define __LAYERMESH_RENDER_HPP__
+
+#include <gvec.hpp>
+#include <atom.hpp>
+#include <csg.hpp>
+#include <tiff.hpp>
+#include <string>
+
+// Rendering solids (or single atoms) as stacks of slices for printing: each
+// layer of a voxel grid is rendered a row at a time, and written as a page of
+// a TIFF.
+
+namespace layermesh {
+
+  // A grid of cubic voxels: the voxel of column i, row j and layer k has its
+  // lowest corner at origin + voxel * (i, j, k), and is sampled at its
+  // centre.
+  struct voxel_grid {
+    gvec origin;
+    double voxel;
+    unsigned width, height, layers;
+  };
+
+  // How the rows of a slice are rendered: by sampling every voxel through
+  // contains_batch(), or by filling the spans of the row inside the solid
+  // (see Solid::scanline_spans), which costs in proportion to the number of
+  // spans rather than of voxels. Voxels whose centres lie near a span's end
+  // (within a ten-thousandth of a voxel, or further where the solid's
+  // relative_precision() of the coordinates is more) are checked with
+  // contains(), so the two methods agree. (Except where a row misses an atom
+  // only by rounding: with no span there to check, a voxel which contains()
+  // would put inside may be left out.)
+  enum render_method {
+    render_sampled,
+    render_spans
+  };
+
+  // the grid of voxels of the given size which covers the box, from its
+  // lowest corner (e.g. of a solid's get_aabb().) Throws
+  // std::invalid_argument if voxel isn't positive, or the box is empty.
+  voxel_grid grid_covering(const gbox& box, double voxel);
+
+  // Renders a layer of the grid into pixels (width * height bytes, row by row
+  // from row 0): 255 where the solid contains the voxel's centre, and 0
+  // elsewhere. Only the voxels within the solid's get_aabb() are tested.
+  void render_slice(const Solid& solid,
+                    const voxel_grid& grid,
+                    unsigned layer,
+                    unsigned char* pixels,
+                    render_method method = render_spans);
+  void render_slice(const Atom& atom,
+                    const voxel_grid& grid,
+                    unsigned layer,
+                    unsigned char* pixels,
+                    render_method method = render_spans);
+
+  // Renders voxels [i0, i1) of one row of a layer by spans, into out (i1 - i0
+  // bytes, as render_slice would fill them), for callers rendering parts of
+  // a grid at a time. spans is scratch space, which may be reused from call
+  // to call.
+  void render_row(const Solid& solid,
+                  const voxel_grid& grid,
+                  unsigned row,
+                  unsigned layer,
+                  unsigned i0,
+                  unsigned i1,
+                  unsigned char* out,
+                  span_list& spans);
+  void render_row(const Atom& atom,
+                  const voxel_grid& grid,
+                  unsigned row,
+                  unsigned layer,
+                  unsigned i0,
+                  unsigned i1,
+                  unsigned char* out,
+                  span_list& spans);
+
+  // Renders every layer of the grid into a multi-page TIFF, one page per
+  // layer from the bottom, throwing std::runtime_error if the file can't be
+  // written. Layers are rendered and encoded on threads threads (0 means one
+  // per hardware thread), and written in order as they complete, so no more
+  // than a couple of pages per thread are held in memory at once, however
+  // many layers there are.
+  void render_tiff(const std::string& filename,
+                   const Solid& solid,
+                   const voxel_grid& grid,
+                   tiff_compression compression = tiff_packbits,
+                   unsigned threads = 1,
+                   render_method method = render_spans);
+  void render_tiff(const std::string& filename,
+                   const Atom& atom,
+                   const voxel_grid& grid,
+                   tiff_compression compression = tiff_packbits,
+                   unsigned threads = 1,
+                   render_method method = render_spans);
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+/* layermesh/include/slice.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_SLICE_HPP__
+#define __LAYERMESH_SLICE_HPP__
+
+#include <gvec.hpp>
+#include <atom.hpp>
+#include <csg.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Slicing solids into layers of polygons for printing, exactly from their
+// atoms' planes (as brep.hpp meshes them), rather than into pixels as
+// render.hpp does.
+
+namespace layermesh {
+
+  // The section of a solid by the plane z = height: closed loops of corners
+  // (each with z = height, and the last joined back to the first), with the
+  // solid on the left of each, seen from above. So outlines run
+  // anticlockwise and the outlines of holes clockwise.
+  struct layer_contours {
+    double height;
+    std::vector<gvec_list> loops;
+  };
+
+  // the heights of the middles of the layers of the given thickness which
+  // cover the box, from its bottom (e.g. of a solid's get_aabb().) Throws
+  // std::invalid_argument if thickness isn't positive, or the box is empty.
+  std::vector<double> layer_heights(const gbox& box, double thickness);
+
+  // Slices the solid at each of the heights. Each atom's section is the
+  // convex polygon its half_spaces() cut from the plane; the edges of each
+  // are cut by the sections of the other atoms they cross, and the pieces
+  // on the solid's outline (found by testing the solid just either side of
+  // each) are joined into loops, with corners along straight edges left
+  // out. The corners are where the planes put them, up to rounding (those
+  // nearer each other than a ten-billionth of the size of the atoms' box
+  // are taken as one.) Where parts of the section only touch at a corner,
+  // they are kept as separate loops.
+  //
+  // Layers are sliced on threads threads (0 meaning one per hardware
+  // thread), and each only looks at the atoms whose boxes span its height,
+  // found through an index of the atoms' heights built once for them all.
+  std::vector<layer_contours> slice_layers(const Solid& solid,
+                                           const std::vector<double>& heights,
+                                           unsigned threads = 1);
+
+  // Writes a layer as an SVG drawing, seen from above (so with y turned
+  // upside down), its loops filled as one path. Throws std::runtime_error
+  // if the file can't be written.
+  void write_svg(const std::string& filename, const layer_contours& layer);
+
+  // A compact binary form of a stack of layers, in a little-endian format
+  // of its own: the layers in order, each its height and loops, and each
+  // loop its corners' x and y in single precision. save_layers() and
+  // load_layers() throw std::runtime_error if the file can't be written or
+  // read, and decode_layers() and load_layers() std::invalid_argument if
+  // the data isn't layers.
+  void encode_layers(const std::vector<layer_contours>& layers,
+                     std::vector<unsigned char>& out);
+  std::vector<layer_contours> decode_layers(const unsigned char* data,
+                                            std::size_t size);
+  void save_layers(const std::string& filename,
+                   const std::vector<layer_contours>& layers);
+  std::vector<layer_contours> load_layers(const std::string& filename);
+
+}
+
+#endif
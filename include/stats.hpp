@@ -0,0 +1,152 @@
+/* layermesh/include/stats.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_STATS_HPP__
+#define __LAYERMESH_STATS_HPP__
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+#include <stdint.h>
+
+// Counters and timers on the library's hot paths, for seeing where the time
+// goes in an export without a profiler. They are only recorded when the
+// library is compiled with LAYERMESH_STATS defined (`make STATS=1`);
+// otherwise the recording macros below expand to nothing, and get_stats()
+// returns zeros. Each thread accumulates into its own block, so recording
+// costs no more than an uncontended add, and get_stats() sums the blocks.
+
+namespace layermesh {
+
+  class Atom;
+
+  enum stat_counter {
+    // facet records encoded by the STL writers (binary or ASCII);
+    STAT_FACETS_ENCODED,
+    // bytes the STL writers wrote to files (or into file mappings);
+    STAT_BYTES_WRITTEN,
+    // points tested by contains() or contains_batch() of the library's
+    // atoms, and how many of those were inside;
+    STAT_CONTAINS_CALLS,
+    STAT_CONTAINS_HITS,
+    NUM_STAT_COUNTERS
+  };
+
+  enum stat_timer {
+    // the whole of Mesh::save_stl_inner;
+    STAT_TIME_SAVE_STL,
+    // of which computing facet normals;
+    STAT_TIME_NORMALS,
+    // and writing the file (for stl_mapped, unmapping it: the page faults
+    // while encoding into the mapping count as encoding.) The rest is
+    // encoding.
+    STAT_TIME_IO,
+    NUM_STAT_TIMERS
+  };
+
+  // How often one atom's contains() answered each way.
+  struct atom_stats {
+    const Atom* atom;
+    uint64_t hits;
+    uint64_t rejects;
+  };
+
+  struct stats_snapshot {
+    uint64_t counters[NUM_STAT_COUNTERS];
+    // total nanoseconds, summed over threads:
+    uint64_t nanoseconds[NUM_STAT_TIMERS];
+    // one entry per atom queried, in no particular order. Atoms are told
+    // apart by address, so one destroyed and another created in its place
+    // share an entry, and beyond STATS_ATOMS_PER_THREAD atoms per thread the
+    // rest are lumped together in an entry for the NULL atom.
+    std::vector<atom_stats> atoms;
+  };
+
+  const std::size_t STATS_ATOMS_PER_THREAD = 1024;
+
+  // whether the library was compiled with LAYERMESH_STATS.
+  bool stats_enabled();
+
+  // everything recorded since the last reset_stats(), by threads still
+  // running as well as those which have finished.
+  stats_snapshot get_stats();
+
+  // zeroes everything. Recording which races with this may be lost.
+  void reset_stats();
+
+  const char* stat_counter_name(stat_counter counter);
+  const char* stat_timer_name(stat_timer timer);
+
+  // one "name value" line per counter and timer (in milliseconds), then one
+  // line per atom with its hit ratio.
+  void write_stats(std::ostream& out, const stats_snapshot& stats);
+
+  namespace stats {
+
+    // (the recording functions behind the macros.)
+    void add(stat_counter counter, uint64_t amount);
+    void add_time(stat_timer timer, uint64_t nanoseconds);
+    void count_contains(const Atom* atom, uint64_t hits, uint64_t rejects);
+    void count_contains_batch(const Atom* atom,
+                              const unsigned char* mask,
+                              std::size_t count);
+
+    class scoped_timer {
+      private:
+        stat_timer timer;
+        std::chrono::steady_clock::time_point start;
+      public:
+        scoped_timer(stat_timer timer)
+          : timer(timer), start(std::chrono::steady_clock::now()) {};
+        ~scoped_timer() {
+          add_time(timer, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        };
+    };
+
+  }
+
+}
+
+#define LAYERMESH_STATS_JOIN_(a, b) a##b
+#define LAYERMESH_STATS_JOIN(a, b) LAYERMESH_STATS_JOIN_(a, b)
+
+#ifdef LAYERMESH_STATS
+// adds amount to a stat_counter.
+#define LAYERMESH_COUNT(counter, amount) \
+  ::layermesh::stats::add((counter), (amount))
+// times the rest of the enclosing scope into a stat_timer.
+#define LAYERMESH_TIME_SCOPE(timer) \
+  ::layermesh::stats::scoped_timer \
+    LAYERMESH_STATS_JOIN(layermesh_stats_timer_, __LINE__)(timer)
+// records hits and rejects by one atom's contains().
+#define LAYERMESH_COUNT_CONTAINS(atom, hits, rejects) \
+  ::layermesh::stats::count_contains((atom), (hits), (rejects))
+// the same, from the mask filled by a contains_batch().
+#define LAYERMESH_COUNT_CONTAINS_BATCH(atom, mask, count) \
+  ::layermesh::stats::count_contains_batch((atom), (mask), (count))
+#else
+#define LAYERMESH_COUNT(counter, amount) ((void)0)
+#define LAYERMESH_TIME_SCOPE(timer) ((void)0)
+#define LAYERMESH_COUNT_CONTAINS(atom, hits, rejects) ((void)0)
+#define LAYERMESH_COUNT_CONTAINS_BATCH(atom, mask, count) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,124 @@
+/* layermesh/include/stl.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_STL_HPP__
+#define __LAYERMESH_STL_HPP__
+
+#include <gvec.hpp>
+#include <mesh.hpp>
+#include <cstddef>
+#include <string>
+
+// Low level STL encoding, used by layermesh::Mesh. Binary STL is an 80 byte
+// header, a uint32 facet count, and then a fixed 50 byte record per facet
+// (normal and three vertices as float32, plus a uint16 attribute), so the
+// size and position of everything in the file is known before writing it.
+
+namespace layermesh {
+
+  const std::size_t STL_HEADER_BYTES = 84;
+  const std::size_t STL_FACET_BYTES = 50;
+
+  // (stl_write_mode is declared in mesh.hpp.)
+
+  std::size_t binary_stl_size(std::size_t num_facets);
+
+  // writes the STL_HEADER_BYTES header into buffer:
+  void encode_binary_stl_header(char* buffer, std::size_t num_facets);
+
+  // Every writer takes the points as a view (see gvec.hpp), and an optional
+  // view of unit facet normals (one per facet, e.g. cached by an Atom); if
+  // that is empty, they are computed in batches with facet_normals_batch
+  // (see normals.hpp.) Overloads taking lists are at the end of this file.
+
+  // writes the records for facets[first, last) into buffer, which must have
+  // room for (last - first) * STL_FACET_BYTES bytes.
+  template <typename T>
+  void encode_binary_stl_facets(char* buffer,
+                                basic_gvec_view<T> points,
+                                const facet_triples& facets,
+                                basic_gvec_view<T> normals,
+                                std::size_t first,
+                                std::size_t last);
+
+  // writes a complete binary STL file, throwing std::runtime_error if the
+  // file can't be written. Every facet record depends only on its own
+  // facet_triple, so with threads > 1 the facets are split into that many
+  // disjoint ranges and encoded concurrently (and stl_auto then prefers
+  // stl_mapped, so the workers write straight into the file.) threads == 0
+  // means one per hardware thread.
+  template <typename T>
+  void write_binary_stl(const std::string& filename,
+                        basic_gvec_view<T> points,
+                        const facet_triples& facets,
+                        stl_write_mode mode = stl_auto,
+                        unsigned threads = 1,
+                        basic_gvec_view<T> normals = basic_gvec_view<T>());
+
+  // The longest string format_stl_float can produce (e.g. -1.23456789e-38):
+  const std::size_t STL_FLOAT_CHARS = 16;
+
+  // Writes the shortest decimal which reads back as exactly v into buffer, in
+  // the same style as an ostream at its default precision (%g: fixed notation
+  // for exponents from -4 to 5, scientific otherwise, no trailing zeros), and
+  // returns the number of characters written. The output is identical to
+  // the ostream's for any normal float that can be written in 6 significant
+  // digits; others get up to 9 digits, which is what they need to round-trip
+  // (or fewer, for denormals.)
+  std::size_t format_stl_float(char* buffer, float v);
+
+  // writes a complete ASCII STL file, throwing std::runtime_error if the file
+  // can't be written.
+  template <typename T>
+  void write_ascii_stl(const std::string& filename,
+                       basic_gvec_view<T> points,
+                       const facet_triples& facets,
+                       basic_gvec_view<T> normals = basic_gvec_view<T>());
+
+  // (lists don't convert to views during template argument deduction, so
+  // these spare callers with lists from spelling the conversion out.)
+
+  template <typename T>
+  inline basic_gvec_view<T> view_or_empty(const basic_gvec_list<T>* list) {
+    return list ? basic_gvec_view<T>(*list) : basic_gvec_view<T>();
+  }
+
+  template <typename T>
+  inline void write_binary_stl(const std::string& filename,
+                               const basic_gvec_list<T>& points,
+                               const facet_triples& facets,
+                               stl_write_mode mode = stl_auto,
+                               unsigned threads = 1,
+                               const basic_gvec_list<T>* normals = NULL) {
+    write_binary_stl(filename, basic_gvec_view<T>(points), facets,
+                     mode, threads, view_or_empty(normals));
+  }
+
+  template <typename T>
+  inline void write_ascii_stl(const std::string& filename,
+                              const basic_gvec_list<T>& points,
+                              const facet_triples& facets,
+                              const basic_gvec_list<T>* normals = NULL) {
+    write_ascii_stl(filename, basic_gvec_view<T>(points), facets,
+                    view_or_empty(normals));
+  }
+
+}
+
+#endif
@@ -0,0 +1,53 @@
+/* layermesh/include/stl_reader.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_STL_READER_HPP__
+#define __LAYERMESH_STL_READER_HPP__
+
+#include <gvec.hpp>
+#include <mesh.hpp>
+#include <string>
+
+// Loading STL files back into the indexed form that Mesh::save_stl_inner
+// takes. STL repeats every vertex for each facet it belongs to, so vertices
+// with identical coordinates are welded back together into one point.
+
+namespace layermesh {
+
+  // Reads a binary or ASCII STL file (binary if its size matches the facet
+  // count in its header, otherwise ASCII if it starts with "solid"), replacing
+  // the contents of points and facets. Points are numbered in the order they
+  // first appear in the file, and two vertices are welded if their float32
+  // coordinates are bitwise equal (with -0 taken as 0.) Facet normals in the
+  // file are ignored, since the winding of each facet already implies them.
+  //
+  // The file is mmap()ed, and binary files are decoded and welded on
+  // threads threads (0 means one per hardware thread): the vertices are
+  // hash-partitioned, and each partition welded independently into a table
+  // small enough to stay in cache, which also helps a single thread.
+  // Throws std::runtime_error if the file can't be read or isn't an STL file.
+  template <typename T>
+  void read_stl(const std::string& filename,
+                basic_gvec_list<T>& points,
+                facet_triples& facets,
+                unsigned threads = 1);
+
+}
+
+#endif
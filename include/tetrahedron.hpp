@@ -17,35 +17,102 @@
  * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#ifndef __LAYERMESH_TETRAHEDRON_HPP__
+#define __LAYERMESH_TETRAHEDRON_HPP__
+
+#include <array>
+#include <cstddef>
+#include <limits>
 #include <stdexcept>
+#include <type_traits>
 #include <atom.hpp>
+#include <halfspace.hpp>
 
 namespace layermesh {
 
-  class Tetrahedron : public Atom {
+  // The facet planes of the tetrahedron with the given four vertices,
+  // oriented so that their normals point outwards, and the facet_triples of
+  // the vertices in the order the facet_triple convention requires. Facet i
+  // has vertex i first, which is also the origin of its plane. (Shared by
+  // BasicTetrahedron and BasicTetrahedronSoup, so that they agree exactly.)
+  template <typename T>
+  void tetrahedron_facets(const basic_gvec<T>* points,
+                          basic_gplane<T>* planes,
+                          facet_triple* triples);
+
+  // T is the scalar type used to store the points and facet planes; see the
+  // Tetrahedron and Tetrahedron32 aliases below. The geometry is held in
+  // fixed size arrays and computed on construction, so a tetrahedron makes no
+  // allocations of its own, and its queries only ever read it.
+  template <typename T>
+  class BasicTetrahedron : public Atom {
     private:
-      gvec_list points;
-      gvec centroid;
-      void compute_centroid();
-      gvec_list facet_normals;
-      void compute_normals_and_triples();
-      facet_triples _facet_triples;
+      std::array<basic_gvec<T>, 4> points;
+      gsphere boundary;
+      gbox aabb;
+      std::array<basic_gplane<T>, 4> facet_planes;
+      std::array<facet_triple, 4> _facet_triples;
+      // point_cloud_view() is of the points themselves when T is double;
+      // otherwise it is of a copy of them in double precision, kept here.
+      std::array<gvec, std::is_same<T, double>::value ? 0 : 4> cloud;
+      void init();
     public:
       // for the small number of points usually needed to initialise an atom,
       // a copy constructor for gvec_list would probably do.
-      Tetrahedron(gvec_list points) : points(points) {
+      BasicTetrahedron(const basic_gvec_list<T>& points) {
         if (points.size() != 4) {
           throw std::invalid_argument("A tetrahedron has four points.");
         }
-        compute_centroid();
+        unsigned i;
+        for (i = 0; i < 4; ++i) {
+          this->points[i] = points[i];
+        }
+        init();
+      };
+      BasicTetrahedron(const std::array<basic_gvec<T>, 4>& points)
+        : points(points) {
+        init();
       };
-      virtual ~Tetrahedron() {};
-      virtual memsafe_gvec_list point_cloud();
+      virtual ~BasicTetrahedron() {};
+      virtual gvec_view point_cloud_view() const;
       virtual unsigned internal_points_start_index() const;
-      virtual gsphere get_boundary();
-      virtual bool contains(gvec point);
+      // the minimal sphere and box of the four points.
+      virtual gsphere get_boundary() const;
+      virtual gbox get_aabb() const;
+      // the four facet planes (in double precision, whatever T is.)
+      virtual memsafe_gplane_list half_spaces() const;
+      virtual bool contains(gvec point) const;
+      // (clipped by, classified against and measured from the facet
+      // planes.)
+      virtual bool scanline_span(double y, double z, span& s) const;
+      // (that of T, to which queries are rounded.)
+      virtual double relative_precision() const {
+        return std::numeric_limits<T>::epsilon();
+      };
+      virtual box_relation classify(const gbox& box) const;
+      virtual double surface_distance(const gvec& point, gvec& normal) const;
+      virtual void contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
+      virtual void contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  std::size_t count,
+                                  unsigned char* mask) const;
       virtual void save_stl(std::string filename, bool binary);
   };
-}
 
+  typedef BasicTetrahedron<double> Tetrahedron;
+
+  // Tetrahedron32 stores its points and facet planes in single precision, and
+  // answers contains() by first rounding the query point to float. Both the
+  // vertices and the query are therefore only good to a relative precision of
+  // about 6e-8 of their magnitude, and points that close to a facet plane may
+  // be classified differently than by a Tetrahedron built from the same
+  // doubles. (Points that are clearly inside or outside are unaffected.)
+  typedef BasicTetrahedron<float> Tetrahedron32;
+}
 
+#endif
@@ -0,0 +1,90 @@
+/* layermesh/include/tetrahedron_soup.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_TETRAHEDRON_SOUP_HPP__
+#define __LAYERMESH_TETRAHEDRON_SOUP_HPP__
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include <gvec.hpp>
+#include <mesh.hpp>
+#include <halfspace.hpp>
+
+namespace layermesh {
+
+  // Many tetrahedra in one container, for scenes too large to hold as an
+  // Atom each. Each tetrahedron costs its four vertices and four facet planes
+  // (28 scalars) and nothing else: they are kept as structure-of-arrays in a
+  // single arena, so the bulk queries below test a run of tetrahedra per
+  // vector instruction. The planes are those a BasicTetrahedron<T> of the
+  // same points would have (see tetrahedron_facets), so the answers agree
+  // exactly with its contains().
+  template <typename T>
+  class BasicTetrahedronSoup : public Mesh {
+    private:
+      // component c of tetrahedron i is at arena[c * capacity + i].
+      std::vector<T> arena;
+      std::size_t _size;
+      std::size_t capacity;
+      void grow(std::size_t new_capacity);
+      const T* component(unsigned c) const { return &arena[c * capacity]; };
+      // the component arrays of the four planes' normals and offsets, in
+      // order (the soup must not be empty.)
+      void plane_arrays(const T** planes) const;
+    public:
+      BasicTetrahedronSoup() : _size(0), capacity(0) {};
+      virtual ~BasicTetrahedronSoup() {};
+      void reserve(std::size_t count);
+      // throws std::invalid_argument unless there are four points.
+      void push_back(const basic_gvec_list<T>& points);
+      void push_back(const std::array<basic_gvec<T>, 4>& points);
+      std::size_t size() const { return _size; };
+      // the bytes held by the arena (i.e. for capacity tetrahedra.)
+      std::size_t arena_bytes() const { return arena.size() * sizeof(T); };
+      basic_gvec<T> vertex(std::size_t tetrahedron, unsigned v) const;
+      basic_gplane<T> plane(std::size_t tetrahedron, unsigned f) const;
+      // whether the given tetrahedron contains point (after rounding it to T,
+      // as BasicTetrahedron<T> does.)
+      bool contains(std::size_t tetrahedron, gvec point) const;
+      // whether any tetrahedron in the soup contains point.
+      bool contains(gvec point) const;
+      // the same for each of count points, given as three coordinate arrays;
+      // mask[i] is set to 1 if some tetrahedron contains point i, 0 otherwise.
+      void contains_batch(const double* x,
+                          const double* y,
+                          const double* z,
+                          std::size_t count,
+                          unsigned char* mask) const;
+      void contains_batch(const float* x,
+                          const float* y,
+                          const float* z,
+                          std::size_t count,
+                          unsigned char* mask) const;
+      // every tetrahedron's four facets, as one STL file.
+      virtual void save_stl(std::string filename, bool binary = true);
+  };
+
+  typedef BasicTetrahedronSoup<double> TetrahedronSoup;
+  // (with the precision caveats of Tetrahedron32.)
+  typedef BasicTetrahedronSoup<float> TetrahedronSoup32;
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+/* layermesh/include/tiff.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LAYERMESH_TIFF_HPP__
+#define __LAYERMESH_TIFF_HPP__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Low level TIFF encoding, for writing stacks of slices. Each page is an 8
+// bit greyscale image (0 is black) held in a single strip, and is written as
+// its strip followed by its directory (IFD), so a file can be written a page
+// at a time without knowing how many pages there will be: only the link to
+// each new directory is patched in behind it. Files are little-endian, and
+// limited to 4GB by the format's 32 bit offsets.
+
+namespace layermesh {
+
+  // (the values are those of the Compression tag.)
+  enum tiff_compression {
+    tiff_uncompressed = 1,
+    // each row run-length encoded separately, as the TIFF spec requires:
+    tiff_packbits = 32773
+  };
+
+  // Appends the PackBits encoding of count bytes to out (runs of 3 or more
+  // equal bytes become two byte repeats, everything else literals of up to
+  // 128 bytes.)
+  void packbits_encode(const unsigned char* in,
+                       std::size_t count,
+                       std::vector<unsigned char>& out);
+
+  // Decodes PackBits from in until count bytes have been written to out, and
+  // returns the number of bytes of in consumed. Throws
+  // std::invalid_argument if in ends first, or decodes past count.
+  std::size_t packbits_decode(const unsigned char* in,
+                              std::size_t in_size,
+                              unsigned char* out,
+                              std::size_t count);
+
+  // Encodes width * height pixels (row by row, from the top) as the strip of
+  // a page, into out (which is cleared first.) This is the costly part of
+  // writing a page, so callers with pages to spare may encode them
+  // concurrently, and hand them to TiffWriter::write_encoded_page in order.
+  void encode_tiff_page(const unsigned char* pixels,
+                        unsigned width,
+                        unsigned height,
+                        tiff_compression compression,
+                        std::vector<unsigned char>& out);
+
+  // Writes a multi-page TIFF a page at a time, all of the same size, so that
+  // only one page need be held in memory. Throws std::runtime_error if the
+  // file can't be written. close() finishes the file; the destructor closes
+  // it too, but can't report errors.
+  class TiffWriter {
+    private:
+      int fd;
+      std::string filename;
+      unsigned width, height;
+      tiff_compression compression;
+      // where the file ends, and where the link to the next directory is:
+      uint64_t end;
+      uint64_t next_link;
+      unsigned page_count;
+      std::vector<unsigned char> buffer;
+      void write_at(const unsigned char* data, std::size_t size,
+                    uint64_t offset);
+    public:
+      TiffWriter(const std::string& filename,
+                 unsigned width,
+                 unsigned height,
+                 tiff_compression compression = tiff_packbits);
+      ~TiffWriter();
+      // appends a page of width * height pixels.
+      void write_page(const unsigned char* pixels);
+      // appends a page encoded by encode_tiff_page, with the same size and
+      // compression as this writer's.
+      void write_encoded_page(const std::vector<unsigned char>& strip);
+      void close();
+      unsigned pages() const { return page_count; };
+  };
+
+}
+
+#endif
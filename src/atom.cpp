@@ -18,12 +18,196 @@
  */
 
 #include <atom.hpp>
+#include <hull.hpp>
+#include <normals.hpp>
+#include <stats.hpp>
+#include <stdexcept>
+#include <vector>
+#include <stdint.h>
 
-bool layermesh::Atom::contains(layermesh::gvec point) {
-  return false;
+// The default half-spaces are ordered using this many points drawn from the
+// bounding box of the hull, enlarged by SAMPLE_BOX_SCALE about its centre
+// (since points near an atom are the ones which get past its bounding sphere
+// to be tested.)
+static const unsigned ORDERING_SAMPLES = 1024;
+static const double SAMPLE_BOX_SCALE = 1.5;
+
+// (a fixed sequence, so that the order is the same on every run.)
+static layermesh::gvec_list sample_box(const layermesh::gvec* points,
+                                       unsigned count) {
+  layermesh::gvec low = points[0], high = points[0];
+  unsigned i, a;
+  for (i = 1; i < count; ++i) {
+    for (a = 0; a < 3; ++a) {
+      if (points[i][a] < low[a]) low[a] = points[i][a];
+      if (points[i][a] > high[a]) high[a] = points[i][a];
+    }
+  }
+  layermesh::gvec centre = (low + high) / 2.0;
+  layermesh::gvec half = (high - low) * (SAMPLE_BOX_SCALE / 2.0);
+
+  layermesh::gvec_list samples;
+  samples.reserve(ORDERING_SAMPLES);
+  uint64_t state = 0x853C49E6748FEA9BULL;
+  for (i = 0; i < ORDERING_SAMPLES; ++i) {
+    layermesh::gvec p;
+    for (a = 0; a < 3; ++a) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      double unit = (state >> 11) * (1.0 / 9007199254740992.0);
+      p[a] = centre[a] + half[a] * (2.0 * unit - 1.0);
+    }
+    samples.push_back(p);
+  }
+  return samples;
 }
 
-void layermesh::Atom::save_stl(std::string filename, bool binary = true) {
+// The atom (if any) whose point_cloud_view() default is calling point_cloud()
+// on this thread, so that an atom which overrides neither fails, rather than
+// deadlocking on its own cache.
+static thread_local const layermesh::Atom* viewing_point_cloud = NULL;
+
+namespace {
+  struct viewing_guard {
+    const layermesh::Atom* previous;
+    viewing_guard(const layermesh::Atom* atom)
+      : previous(viewing_point_cloud) {
+      viewing_point_cloud = atom;
+    }
+    ~viewing_guard() {
+      viewing_point_cloud = previous;
+    }
+  };
+}
+
+layermesh::gvec_view layermesh::Atom::point_cloud_view() const {
+  return *_point_cloud.get([this]() {
+    viewing_guard guard(this);
+    return point_cloud();
+  });
+}
+
+layermesh::memsafe_gvec_list layermesh::Atom::point_cloud() const {
+  if (viewing_point_cloud == this) {
+    throw std::logic_error(
+      "Atoms must override point_cloud() or point_cloud_view().");
+  }
+  return _point_cloud_copy.get([this]() {
+    layermesh::gvec_view view = point_cloud_view();
+    return std::make_shared<layermesh::gvec_list>(view.begin(), view.end());
+  });
 }
 
+layermesh::gsphere layermesh::Atom::get_boundary() const {
+  return _boundary.get([this]() {
+    return layermesh::minimal_sphere(
+      point_cloud_view().first(internal_points_start_index()));
+  });
+}
+
+layermesh::gbox layermesh::Atom::get_aabb() const {
+  return _aabb.get([this]() {
+    return layermesh::bounding_box(
+      point_cloud_view().first(internal_points_start_index()));
+  });
+}
+
+std::shared_ptr<const layermesh::facet_triples>
+layermesh::Atom::hull_facets() const {
+  return _hull_facets.get([this]() {
+    layermesh::gvec_view cloud = point_cloud_view();
+    return std::make_shared<const layermesh::facet_triples>(
+      layermesh::convex_hull(cloud.data(),
+                             internal_points_start_index(),
+                             hull_threads));
+  });
+}
+
+layermesh::memsafe_gplane_list layermesh::Atom::half_spaces() const {
+  return _hull_planes.get([this]() {
+    unsigned count = internal_points_start_index();
+    const layermesh::gvec* points = point_cloud_view().data();
+    std::shared_ptr<layermesh::gplane_list> planes =
+      std::make_shared<layermesh::gplane_list>(
+        layermesh::hull_planes(points, *hull_facets()));
+    layermesh::order_by_rejection(*planes, sample_box(points, count));
+    return layermesh::memsafe_gplane_list(planes);
+  });
+}
 
+bool layermesh::Atom::contains(layermesh::gvec point) const {
+  // (derived classes may override half_spaces(), so its result is what is
+  // cached here.)
+  const layermesh::memsafe_gplane_list& planes =
+    _half_spaces.get([this]() { return half_spaces(); });
+  bool inside = layermesh::halfspaces_contain(planes->data(), planes->size(),
+                                              point);
+  LAYERMESH_COUNT_CONTAINS(this, inside, !inside);
+  return inside;
+}
+
+bool layermesh::Atom::scanline_span(double y, double z,
+                                    layermesh::span& s) const {
+  const layermesh::memsafe_gplane_list& planes =
+    _half_spaces.get([this]() { return half_spaces(); });
+  return layermesh::halfspaces_clip_x(planes->data(), planes->size(), y, z, s);
+}
+
+layermesh::box_relation
+layermesh::Atom::classify(const layermesh::gbox& box) const {
+  const layermesh::memsafe_gplane_list& planes =
+    _half_spaces.get([this]() { return half_spaces(); });
+  return layermesh::halfspaces_classify(planes->data(), planes->size(), box);
+}
+
+double layermesh::Atom::surface_distance(const layermesh::gvec& point,
+                                         layermesh::gvec& normal) const {
+  const layermesh::memsafe_gplane_list& planes =
+    _half_spaces.get([this]() { return half_spaces(); });
+  return layermesh::halfspaces_distance(planes->data(), planes->size(), point,
+                                        normal);
+}
+
+void layermesh::Atom::contains_batch(const double* x,
+                                     const double* y,
+                                     const double* z,
+                                     std::size_t count,
+                                     unsigned char* mask) const {
+  std::size_t i;
+  for (i = 0; i < count; ++i) {
+    mask[i] = contains(layermesh::gvec(x[i], y[i], z[i])) ? 1 : 0;
+  }
+}
+
+void layermesh::Atom::contains_batch(const float* x,
+                                     const float* y,
+                                     const float* z,
+                                     std::size_t count,
+                                     unsigned char* mask) const {
+  std::size_t i;
+  for (i = 0; i < count; ++i) {
+    mask[i] = contains(layermesh::gvec(x[i], y[i], z[i])) ? 1 : 0;
+  }
+}
+
+void layermesh::Atom::save_stl(std::string filename, bool binary = true) {
+  layermesh::gvec_view cloud = point_cloud_view();
+  std::shared_ptr<const layermesh::facet_triples> facets = hull_facets();
+
+  const std::shared_ptr<const layermesh::gvec_list>& normals =
+    _hull_normals.get([&]() {
+      std::size_t n = facets->size();
+      std::vector<double> x(n), y(n), z(n);
+      layermesh::facet_normals_batch(cloud, *facets, 0, n,
+                                     x.data(), y.data(), z.data());
+      std::shared_ptr<layermesh::gvec_list> list =
+        std::make_shared<layermesh::gvec_list>();
+      list->reserve(n);
+      std::size_t i;
+      for (i = 0; i < n; ++i) {
+        list->push_back(layermesh::gvec(x[i], y[i], z[i]));
+      }
+      return std::shared_ptr<const layermesh::gvec_list>(list);
+    });
+
+  save_stl_inner(filename, binary, cloud, *facets, *normals);
+}
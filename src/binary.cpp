@@ -0,0 +1,128 @@
+/* layermesh/src/binary.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <binary.hpp>
+#include <stats.hpp>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  static void fail(const string& what, const string& filename) {
+    throw runtime_error(what + " " + filename + ": " + strerror(errno));
+  }
+
+  void put32(vector<unsigned char>& out, uint32_t v) {
+    int b;
+    for (b = 0; b < 4; ++b) out.push_back((v >> (8 * b)) & 0xFF);
+  }
+
+  void put64(vector<unsigned char>& out, uint64_t v) {
+    int b;
+    for (b = 0; b < 8; ++b) out.push_back((v >> (8 * b)) & 0xFF);
+  }
+
+  void put_float(vector<unsigned char>& out, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, 4);
+    put32(out, bits);
+  }
+
+  void put_double(vector<unsigned char>& out, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, 8);
+    put64(out, bits);
+  }
+
+  uint64_t get_uint(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    int b;
+    for (b = bytes - 1; b >= 0; --b) v = (v << 8) | p[b];
+    return v;
+  }
+
+  float get_float(const unsigned char* p) {
+    uint32_t bits = get_uint(p, 4);
+    float v;
+    memcpy(&v, &bits, 4);
+    return v;
+  }
+
+  double get_double(const unsigned char* p) {
+    uint64_t bits = get_uint(p, 8);
+    double v;
+    memcpy(&v, &bits, 8);
+    return v;
+  }
+
+  void write_file(const string& filename, const void* data, size_t size) {
+    LAYERMESH_TIME_SCOPE(STAT_TIME_IO);
+    const char* bytes = static_cast<const char*>(data);
+    int fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    if (fd < 0) {
+      fail("couldn't open", filename);
+    }
+    size_t done = 0;
+    while (done < size) {
+      ssize_t written = ::write(fd, bytes + done, size - done);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        fail("couldn't write", filename);
+      }
+      LAYERMESH_COUNT(STAT_BYTES_WRITTEN, written);
+      done += written;
+    }
+    if (::close(fd) != 0) {
+      fail("couldn't close", filename);
+    }
+  }
+
+  vector<unsigned char> read_file(const string& filename) {
+    LAYERMESH_TIME_SCOPE(STAT_TIME_IO);
+    vector<unsigned char> data;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      fail("couldn't open", filename);
+    }
+    unsigned char buffer[65536];
+    while (true) {
+      ssize_t got = ::read(fd, buffer, sizeof(buffer));
+      if (got < 0) {
+        if (errno == EINTR) continue;
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        fail("couldn't read", filename);
+      }
+      if (got == 0) break;
+      data.insert(data.end(), buffer, buffer + got);
+    }
+    ::close(fd);
+    return data;
+  }
+
+}
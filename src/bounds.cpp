@@ -0,0 +1,179 @@
+/* layermesh/src/bounds.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bounds.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  namespace {
+
+    // points this close outside a candidate sphere (relative to its radius
+    // squared) are taken to be on it, so that rounding can't make the
+    // search go round in circles. The final radius covers them.
+    const double ON_SPHERE = 1e-10;
+    // triangles and tetrahedra flatter than this (by the sine of their
+    // smallest angle, roughly) have no circumsphere worth computing.
+    const double FLAT = 1e-12;
+
+    bool inside(const gsphere& s, const gvec& p) {
+      gvec offset = p - s.centre;
+      return offset * offset <= s.radius * s.radius * (1.0 + ON_SPHERE);
+    }
+
+    gsphere sphere_of(const gvec& a) {
+      gsphere s;
+      s.centre = a;
+      s.radius = 0.0;
+      return s;
+    }
+
+    gsphere sphere_of(const gvec& a, const gvec& b) {
+      gsphere s;
+      s.centre = (a + b) / 2.0;
+      s.radius = modulus(b - a) / 2.0;
+      return s;
+    }
+
+    // the smallest sphere with a, b and c on its surface (their
+    // circumcircle), or, if they are in a line, the sphere on the furthest
+    // apart two of them.
+    gsphere sphere_of(const gvec& a, const gvec& b, const gvec& c) {
+      gvec u = b - a, v = c - a;
+      gvec n = u ^ v;
+      double nn = n * n, uu = u * u, vv = v * v;
+      if (nn <= FLAT * FLAT * uu * vv) {
+        gsphere s = sphere_of(a, b), t = sphere_of(a, c),
+                w = sphere_of(b, c);
+        if (t.radius > s.radius) s = t;
+        if (w.radius > s.radius) s = w;
+        return s;
+      }
+      gvec offset = ((v ^ n) * uu + (n ^ u) * vv) / (2.0 * nn);
+      gsphere s;
+      s.centre = a + offset;
+      s.radius = modulus(offset);
+      return s;
+    }
+
+    // the sphere with a, b, c and d on its surface, or, if they are in a
+    // plane, the smallest sphere through d and two of the others which
+    // contains all four.
+    gsphere sphere_of(const gvec& a, const gvec& b, const gvec& c,
+                      const gvec& d) {
+      gvec u = b - a, v = c - a, w = d - a;
+      double volume = u * (v ^ w);
+      if (fabs(volume) <= FLAT * modulus(u) * modulus(v) * modulus(w)) {
+        gsphere candidates[3] = {
+          sphere_of(a, b, d), sphere_of(a, c, d), sphere_of(b, c, d)
+        };
+        gsphere best;
+        best.radius = numeric_limits<double>::infinity();
+        unsigned i;
+        for (i = 0; i < 3; ++i) {
+          const gsphere& s = candidates[i];
+          if (s.radius < best.radius && inside(s, a) && inside(s, b) &&
+              inside(s, c) && inside(s, d)) {
+            best = s;
+          }
+        }
+        if (best.radius < numeric_limits<double>::infinity()) return best;
+        // (which only rounding can bring about: take the largest.)
+        best = candidates[0];
+        for (i = 1; i < 3; ++i) {
+          if (candidates[i].radius > best.radius) best = candidates[i];
+        }
+        return best;
+      }
+      gvec offset = ((v ^ w) * (u * u) + (w ^ u) * (v * v) +
+                     (u ^ v) * (w * w)) / (2.0 * volume);
+      gsphere s;
+      s.centre = a + offset;
+      s.radius = modulus(offset);
+      return s;
+    }
+
+  }
+
+  gsphere minimal_sphere(gvec_view points) {
+    gsphere s;
+    if (points.empty()) {
+      s.radius = -1.0;
+      return s;
+    }
+
+    // (a fixed shuffle, so that the answer is the same on every run.)
+    vector<gvec> p(points.begin(), points.end());
+    uint64_t state = 0x853C49E6748FEA9BULL;
+    size_t i, j, k, l;
+    for (i = p.size(); i > 1; --i) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      swap(p[i - 1], p[(state >> 33) % i]);
+    }
+
+    // Each loop finds the smallest sphere of the points so far with the
+    // points of the loops outside it on its surface.
+    s = sphere_of(p[0]);
+    for (i = 1; i < p.size(); ++i) {
+      if (inside(s, p[i])) continue;
+      s = sphere_of(p[i]);
+      for (j = 0; j < i; ++j) {
+        if (inside(s, p[j])) continue;
+        s = sphere_of(p[i], p[j]);
+        for (k = 0; k < j; ++k) {
+          if (inside(s, p[k])) continue;
+          s = sphere_of(p[i], p[j], p[k]);
+          for (l = 0; l < k; ++l) {
+            if (inside(s, p[l])) continue;
+            s = sphere_of(p[i], p[j], p[k], p[l]);
+          }
+        }
+      }
+    }
+
+    double furthest = 0.0;
+    for (i = 0; i < p.size(); ++i) {
+      gvec offset = p[i] - s.centre;
+      furthest = max(furthest, offset * offset);
+    }
+    s.radius = sqrt(furthest) * (1.0 + 1e-12);
+    return s;
+  }
+
+  gbox bounding_box(gvec_view points) {
+    double inf = numeric_limits<double>::infinity();
+    gbox box{gvec(inf, inf, inf), gvec(-inf, -inf, -inf)};
+    size_t i;
+    int a;
+    for (i = 0; i < points.size(); ++i) {
+      for (a = 0; a < 3; ++a) {
+        box.low[a] = min(box.low[a], points[i][a]);
+        box.high[a] = max(box.high[a], points[i][a]);
+      }
+    }
+    return box;
+  }
+
+}
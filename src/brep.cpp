@@ -0,0 +1,290 @@
+/* layermesh/src/brep.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <brep.hpp>
+#include <bounds.hpp>
+#include <bvh.hpp>
+#include <clip.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace layermesh {
+
+  namespace {
+
+    // The face of the atom in plane i: a square in the plane, larger than
+    // the atom's box, cut by its other planes. Its corners run anticlockwise
+    // about the plane's normal.
+    gvec_list face_of(const unit_planes& planes,
+                      size_t i,
+                      const gbox& box,
+                      double tolerance) {
+      const unit_plane& p = planes[i];
+      gvec middle = 0.5 * (box.low + box.high);
+      double half = modulus(box.high - box.low) + tolerance;
+      middle = middle - (middle * p.normal - p.offset) * p.normal;
+      int axis = 0, a;
+      for (a = 1; a < 3; ++a) {
+        if (fabs(p.normal[a]) < fabs(p.normal[axis])) axis = a;
+      }
+      gvec other;
+      other[axis] = 1.0;
+      gvec u = p.normal ^ other;
+      u = u / modulus(u);
+      gvec v = p.normal ^ u;
+      gvec_list face = {middle - half * u - half * v,
+                        middle + half * u - half * v,
+                        middle + half * u + half * v,
+                        middle - half * u + half * v};
+      gvec_list back, front;
+      size_t j;
+      for (j = 0; j < planes.size() && !face.empty(); ++j) {
+        if (j == i) continue;
+        // (a repeat of this plane would leave nothing of it.)
+        if (planes[j].normal * p.normal > 1.0 - 1e-12 &&
+            fabs(planes[j].offset - p.offset) <= tolerance) {
+          if (j < i) return gvec_list();
+          continue;
+        }
+        split(face, planes[j], tolerance, back, front);
+        face.swap(back);
+      }
+      return face;
+    }
+
+    gvec centroid(const gvec_list& polygon) {
+      gvec sum;
+      size_t i;
+      for (i = 0; i < polygon.size(); ++i) sum = sum + polygon[i];
+      return sum / double(polygon.size());
+    }
+
+    class brep_builder {
+      private:
+        const Solid& solid;
+        vector<shared_ptr<const Atom> > atoms;
+        vector<unit_planes> planes;
+        vector<gbox> boxes;
+        Bvh hierarchy;
+        clip_tolerances tolerances;
+
+        void faces_of(size_t a, vector<gvec_list>& out) const;
+      public:
+        brep_builder(const Solid& solid, unsigned threads);
+        bool empty() const { return atoms.empty(); };
+        // the pieces of the atoms' faces on the solid's surface, facing out.
+        vector<gvec_list> pieces(unsigned threads) const;
+        IndexedMesh stitch(const vector<gvec_list>& pieces) const;
+    };
+
+    brep_builder::brep_builder(const Solid& solid, unsigned threads)
+      : solid(solid) {
+      solid.atoms(atoms);
+      if (atoms.empty()) return;
+      size_t i;
+      gbox all = atoms[0]->get_aabb();
+      for (i = 0; i < atoms.size(); ++i) {
+        planes.push_back(planes_of(*atoms[i]));
+        boxes.push_back(atoms[i]->get_aabb());
+        int a;
+        for (a = 0; a < 3; ++a) {
+          all.low[a] = min(all.low[a], boxes[i].low[a]);
+          all.high[a] = max(all.high[a], boxes[i].high[a]);
+        }
+      }
+      tolerances = clip_tolerances(all);
+      hierarchy = Bvh(boxes, threads);
+    }
+
+    void brep_builder::faces_of(size_t a, vector<gvec_list>& out) const {
+      const unit_planes& own = planes[a];
+      double tolerance = tolerances.on_plane;
+      vector<gvec_list> pieces, next;
+      size_t i, j, k;
+      for (i = 0; i < own.size(); ++i) {
+        gvec_list face = face_of(own, i, boxes[a], tolerance);
+        if (face.empty()) continue;
+        // (the other atoms whose boxes meet the face, in order.)
+        gbox box = box_of(face, tolerance);
+        vector<size_t> others;
+        hierarchy.overlapping(box, [&](size_t b) {
+          if (b != a && boxes_meet(boxes[b], box)) others.push_back(b);
+          return false;
+        });
+        sort(others.begin(), others.end());
+        pieces.assign(1, face);
+        for (j = 0; j < others.size(); ++j) {
+          next.clear();
+          for (k = 0; k < pieces.size(); ++k) {
+            cut_by(pieces[k], planes[others[j]], tolerance, next);
+          }
+          pieces.swap(next);
+        }
+        const gvec& normal = own[i].normal;
+        for (k = 0; k < pieces.size(); ++k) {
+          gvec middle = centroid(pieces[k]);
+          double least = clearance(middle, own, tolerance,
+                                   numeric_limits<double>::infinity());
+          for (j = 0; j < others.size(); ++j) {
+            least = clearance(middle, planes[others[j]], tolerance, least);
+          }
+          double step = tolerances.step(least);
+          bool in_front = solid.contains(middle + step * normal);
+          bool behind = solid.contains(middle - step * normal);
+          if (in_front == behind) continue;
+          // (where an earlier atom has a face here too, the solid is the
+          // same either side of both, so that atom's piece stands for both.)
+          bool shared = false;
+          for (j = 0; j < others.size() && others[j] < a && !shared; ++j) {
+            shared = shares_face(planes[others[j]], middle, normal, tolerance);
+          }
+          if (shared) continue;
+          out.push_back(pieces[k]);
+          // (facing into the atom, where the solid is in front.)
+          if (in_front) reverse(out.back().begin(), out.back().end());
+        }
+      }
+    }
+
+    vector<gvec_list> brep_builder::pieces(unsigned threads) const {
+      unsigned parts = resolve_threads(threads);
+      vector<vector<gvec_list> > found(parts);
+      vector<exception_ptr> errors(parts);
+      split_range(atoms.size(), parts,
+                  [&](unsigned t, size_t first, size_t last) {
+        try {
+          size_t a;
+          for (a = first; a < last; ++a) faces_of(a, found[t]);
+        } catch (...) {
+          errors[t] = current_exception();
+        }
+      });
+      vector<gvec_list> all;
+      unsigned t;
+      for (t = 0; t < parts; ++t) {
+        if (errors[t]) rethrow_exception(errors[t]);
+        all.insert(all.end(), found[t].begin(), found[t].end());
+      }
+      return all;
+    }
+
+    IndexedMesh brep_builder::stitch(const vector<gvec_list>& pieces) const {
+      IndexedMesh mesh;
+      // (corners within weld of one already seen are taken as that one.)
+      double weld = tolerances.weld;
+      point_welder welder(weld);
+      vector<vector<unsigned> > polygons(pieces.size());
+      size_t i, j;
+      for (i = 0; i < pieces.size(); ++i) {
+        vector<unsigned>& polygon = polygons[i];
+        for (j = 0; j < pieces[i].size(); ++j) {
+          unsigned found = welder.add(pieces[i][j]);
+          if (polygon.empty() || (polygon.back() != found &&
+                                  polygon.front() != found)) {
+            polygon.push_back(found);
+          }
+        }
+      }
+
+      mesh.points = welder.points();
+
+      // (the corners of neighbouring pieces which lie along each edge.)
+      vector<gbox> corners(mesh.points.size());
+      gvec w(weld, weld, weld);
+      for (i = 0; i < corners.size(); ++i) {
+        corners[i] = gbox{mesh.points[i] - w, mesh.points[i] + w};
+      }
+      Bvh near(corners);
+      for (i = 0; i < polygons.size(); ++i) {
+        const vector<unsigned>& polygon = polygons[i];
+        if (polygon.size() < 3) continue;
+        vector<unsigned> ring;
+        for (j = 0; j < polygon.size(); ++j) {
+          unsigned s = polygon[j], e = polygon[(j + 1) % polygon.size()];
+          const gvec& from = mesh.points[s];
+          gvec along = mesh.points[e] - from;
+          double length2 = along * along;
+          vector<pair<double, unsigned> > between;
+          gbox edge{from, from};
+          int a;
+          for (a = 0; a < 3; ++a) {
+            edge.low[a] = min(from[a], mesh.points[e][a]) - weld;
+            edge.high[a] = max(from[a], mesh.points[e][a]) + weld;
+          }
+          near.overlapping(edge, [&](size_t v) {
+            if (v == s || v == e) return false;
+            double t = ((mesh.points[v] - from) * along) / length2;
+            if (t <= 0.0 || t >= 1.0) return false;
+            if (modulus(from + t * along - mesh.points[v]) <= weld) {
+              between.push_back(make_pair(t, unsigned(v)));
+            }
+            return false;
+          });
+          sort(between.begin(), between.end());
+          ring.push_back(s);
+          for (a = 0; a < int(between.size()); ++a) {
+            ring.push_back(between[a].second);
+          }
+        }
+        // (dropping what welding left without area.)
+        gvec twice_area;
+        for (j = 0; j < ring.size(); ++j) {
+          twice_area = twice_area + (mesh.points[ring[j]] ^
+            mesh.points[ring[(j + 1) % ring.size()]]);
+        }
+        if (modulus(twice_area) <= weld * weld) continue;
+        if (ring.size() == 3) {
+          facet_triple f = {{ring[0], ring[1], ring[2]}};
+          mesh.facets.push_back(f);
+          continue;
+        }
+        // (a fan from the middle, since corners along an edge would make
+        // a fan from a corner degenerate.)
+        gvec middle;
+        for (j = 0; j < ring.size(); ++j) {
+          middle = middle + mesh.points[ring[j]];
+        }
+        unsigned centre = mesh.points.size();
+        mesh.points.push_back(middle / double(ring.size()));
+        for (j = 0; j < ring.size(); ++j) {
+          facet_triple f = {{centre, ring[j], ring[(j + 1) % ring.size()]}};
+          mesh.facets.push_back(f);
+        }
+      }
+      return mesh;
+    }
+
+  }
+
+  IndexedMesh brep_mesh(const Solid& solid, unsigned threads) {
+    brep_builder builder(solid, threads);
+    if (builder.empty()) return IndexedMesh();
+    return builder.stitch(builder.pieces(threads));
+  }
+
+}
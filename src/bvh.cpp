@@ -0,0 +1,323 @@
+/* layermesh/src/bvh.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <bvh.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+
+namespace layermesh {
+
+  // SAH bins per axis:
+  static const unsigned BINS = 16;
+  // leaves hold at most this many primitives, unless they can't be split:
+  static const size_t MAX_LEAF = 4;
+  // the cost of visiting a node, relative to testing one primitive:
+  static const double TRAVERSAL_COST = 1.0;
+  // subtrees of at least this many primitives are built on a thread of
+  // their own, while there are threads to spare:
+  static const size_t MIN_PARALLEL_PRIMITIVES = 4096;
+  // beyond this depth everything left is put in one leaf, so that the
+  // queries' stacks can't overflow:
+  static const unsigned MAX_BUILD_DEPTH = BVH_MAX_DEPTH - 2;
+
+  namespace {
+
+    // single precision bounds which contain the double precision ones:
+    float round_down(double v) {
+      float f = static_cast<float>(v);
+      return f > v ? nextafterf(f, -numeric_limits<float>::infinity()) : f;
+    }
+
+    float round_up(double v) {
+      float f = static_cast<float>(v);
+      return f < v ? nextafterf(f, numeric_limits<float>::infinity()) : f;
+    }
+
+    gbox empty_box() {
+      double inf = numeric_limits<double>::infinity();
+      return gbox{gvec(inf, inf, inf), gvec(-inf, -inf, -inf)};
+    }
+
+    void grow(gbox& box, const gbox& other) {
+      int a;
+      for (a = 0; a < 3; ++a) {
+        box.low[a] = min(box.low[a], other.low[a]);
+        box.high[a] = max(box.high[a], other.high[a]);
+      }
+    }
+
+    void grow(gbox& box, const gvec& point) {
+      int a;
+      for (a = 0; a < 3; ++a) {
+        box.low[a] = min(box.low[a], point[a]);
+        box.high[a] = max(box.high[a], point[a]);
+      }
+    }
+
+    double half_area(const gbox& box) {
+      gvec d = box.high - box.low;
+      if (d[0] < 0.0) return 0.0;
+      return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+
+    void set_box(bvh_node& n, const gbox& box) {
+      int a;
+      for (a = 0; a < 3; ++a) {
+        n.low[a] = round_down(box.low[a]);
+        n.high[a] = round_up(box.high[a]);
+      }
+    }
+
+    gbox node_box(const bvh_node& n) {
+      return gbox{gvec(n.low[0], n.low[1], n.low[2]),
+                  gvec(n.high[0], n.high[1], n.high[2])};
+    }
+
+    // a primitive as the builder sees it, moved around with its box so that
+    // each pass over a range reads memory in order:
+    struct build_primitive {
+      gbox box;
+      gvec centre;
+      uint32_t index;
+    };
+
+    struct builder {
+      vector<build_primitive> primitives;
+
+      builder(const vector<gbox>& boxes) : primitives(boxes.size()) {
+        size_t i;
+        for (i = 0; i < boxes.size(); ++i) {
+          primitives[i].box = boxes[i];
+          primitives[i].centre = (boxes[i].low + boxes[i].high) / 2.0;
+          primitives[i].index = i;
+          // (empty or unbounded boxes, e.g. of composites with no children,
+          // have no centre to speak of: they are binned as if at the origin.)
+          int a;
+          for (a = 0; a < 3; ++a) {
+            if (!std::isfinite(primitives[i].centre[a])) {
+              primitives[i].centre[a] = 0.0;
+            }
+          }
+        }
+      }
+
+      // Builds the subtree of primitives[first, last) onto the end of out,
+      // whose child offsets are relative to the start of out. The
+      // primitives are reordered in place; disjoint ranges may be built
+      // concurrently.
+      void build(size_t first, size_t last, vector<bvh_node>& out,
+                 unsigned depth, unsigned threads) {
+        size_t here = out.size();
+        out.push_back(bvh_node());
+        gbox bounds = empty_box(), centre_bounds = empty_box();
+        size_t i;
+        for (i = first; i < last; ++i) {
+          grow(bounds, primitives[i].box);
+          grow(centre_bounds, primitives[i].centre);
+        }
+        set_box(out[here], bounds);
+
+        size_t count = last - first;
+        size_t middle = count <= MAX_LEAF || depth >= MAX_BUILD_DEPTH
+          ? first : split(first, last, bounds, centre_bounds);
+        if (middle == first) {
+          out[here].offset = first;
+          out[here].count = count;
+          // (leaves list their primitives in order, which callers may rely
+          // on to evaluate them in order of priority.)
+          sort(primitives.begin() + first, primitives.begin() + last,
+               [](const build_primitive& a, const build_primitive& b) {
+                 return a.index < b.index;
+               });
+          return;
+        }
+
+        out[here].count = 0;
+        if (threads > 1 && count >= MIN_PARALLEL_PRIMITIVES) {
+          vector<bvh_node> second;
+          unsigned second_threads = threads / 2;
+          thread worker([&]() {
+            build(middle, last, second, depth + 1, second_threads);
+          });
+          build(first, middle, out, depth + 1, threads - second_threads);
+          worker.join();
+          size_t base = out.size();
+          for (i = 0; i < second.size(); ++i) {
+            if (second[i].count == 0) second[i].offset += base;
+          }
+          out[here].offset = base;
+          out.insert(out.end(), second.begin(), second.end());
+        } else {
+          build(first, middle, out, depth + 1, 1);
+          out[here].offset = out.size();
+          build(middle, last, out, depth + 1, 1);
+        }
+      }
+
+      // Chooses the cheapest split of primitives[first, last) by binned SAH
+      // over all three axes, and partitions them by it, returning the
+      // start of the second part (or first, if it is cheaper not to split.)
+      size_t split(size_t first, size_t last,
+                   const gbox& bounds, const gbox& centre_bounds) {
+        size_t count = last - first;
+        double best_cost = numeric_limits<double>::infinity();
+        int best_axis = -1;
+        unsigned best_bin = 0;
+        unsigned b;
+        int a;
+        size_t i;
+        for (a = 0; a < 3; ++a) {
+          double extent = centre_bounds.high[a] - centre_bounds.low[a];
+          if (extent <= 0.0) continue;
+          gbox bin_bounds[BINS];
+          size_t bin_counts[BINS];
+          for (b = 0; b < BINS; ++b) {
+            bin_bounds[b] = empty_box();
+            bin_counts[b] = 0;
+          }
+          for (i = first; i < last; ++i) {
+            b = bin_of(primitives[i].centre[a], centre_bounds.low[a],
+                       BINS / extent);
+            grow(bin_bounds[b], primitives[i].box);
+            ++bin_counts[b];
+          }
+          // the area and count of everything right of each boundary:
+          double right_area[BINS];
+          size_t right_count[BINS];
+          gbox sweep = empty_box();
+          size_t swept = 0;
+          for (b = BINS - 1; b > 0; --b) {
+            grow(sweep, bin_bounds[b]);
+            swept += bin_counts[b];
+            right_area[b] = half_area(sweep);
+            right_count[b] = swept;
+          }
+          sweep = empty_box();
+          swept = 0;
+          for (b = 1; b < BINS; ++b) {
+            grow(sweep, bin_bounds[b - 1]);
+            swept += bin_counts[b - 1];
+            if (swept == 0 || right_count[b] == 0) continue;
+            double cost = half_area(sweep) * swept +
+                          right_area[b] * right_count[b];
+            if (cost < best_cost) {
+              best_cost = cost;
+              best_axis = a;
+              best_bin = b;
+            }
+          }
+        }
+
+        double area = half_area(bounds);
+        double leaf_cost = count;
+        double split_cost = area > 0.0
+          ? TRAVERSAL_COST + best_cost / area
+          : numeric_limits<double>::infinity();
+        if (best_axis < 0) {
+          // (all the centres coincide: split in the middle, if too many.)
+          return count > MAX_LEAF * 4 ? first + count / 2 : first;
+        }
+        if (split_cost >= leaf_cost && count <= MAX_LEAF * 4) {
+          return first;
+        }
+
+        double low = centre_bounds.low[best_axis];
+        double extent = centre_bounds.high[best_axis] - low;
+        vector<build_primitive>::iterator middle = partition(
+          primitives.begin() + first, primitives.begin() + last,
+          [&](const build_primitive& p) {
+            return bin_of(p.centre[best_axis], low, BINS / extent) < best_bin;
+          });
+        return middle - primitives.begin();
+      }
+
+      // (scale is BINS / the extent of the centres.)
+      static unsigned bin_of(double centre, double low, double scale) {
+        double b = (centre - low) * scale;
+        // (NaN goes to the first bin, rather than through the cast.)
+        if (!(b > 0.0)) return 0;
+        return b < BINS ? static_cast<unsigned>(b) : BINS - 1;
+      }
+    };
+
+  }
+
+  Bvh::Bvh(const vector<gbox>& boxes, unsigned threads) {
+    if (boxes.size() > numeric_limits<uint32_t>::max()) {
+      throw invalid_argument("Bvh: too many primitives.");
+    }
+    if (boxes.empty()) return;
+    nodes.reserve(2 * boxes.size() / MAX_LEAF + 1);
+    builder b(boxes);
+    b.build(0, boxes.size(), nodes, 0, resolve_threads(threads));
+    indices.resize(boxes.size());
+    size_t i;
+    for (i = 0; i < indices.size(); ++i) {
+      indices[i] = b.primitives[i].index;
+    }
+  }
+
+  void Bvh::refit(const vector<gbox>& boxes) {
+    if (boxes.size() != indices.size()) {
+      throw invalid_argument("Bvh::refit: wrong number of boxes.");
+    }
+    // (children come after their parents, so a backwards pass sees every
+    // child before its parent.)
+    size_t n = nodes.size();
+    uint32_t i;
+    while (n-- > 0) {
+      bvh_node& node = nodes[n];
+      gbox bounds = empty_box();
+      if (node.count == 0) {
+        grow(bounds, node_box(nodes[n + 1]));
+        grow(bounds, node_box(nodes[node.offset]));
+      } else {
+        for (i = node.offset; i < node.offset + node.count; ++i) {
+          grow(bounds, boxes[indices[i]]);
+        }
+      }
+      set_box(node, bounds);
+    }
+  }
+
+  vector<size_t> Bvh::containing(const gvec& point) const {
+    vector<size_t> ret;
+    containing(point, [&](size_t i) {
+      ret.push_back(i);
+      return false;
+    });
+    return ret;
+  }
+
+  vector<size_t> Bvh::overlapping(const gbox& box) const {
+    vector<size_t> ret;
+    overlapping(box, [&](size_t i) {
+      ret.push_back(i);
+      return false;
+    });
+    return ret;
+  }
+
+}
@@ -0,0 +1,200 @@
+/* layermesh/src/clip.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <clip.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace layermesh {
+
+  namespace {
+
+    // (the tolerances, as fractions of the size of the scene.)
+    const double ON_PLANE = 1e-11;
+    const double WELD = 1e-10;
+    const double PROBE = 1e-6;
+
+  }
+
+  clip_tolerances::clip_tolerances(const gbox& box) {
+    double scale = max(modulus(box.high - box.low),
+                       max(modulus(box.low), modulus(box.high)));
+    on_plane = ON_PLANE * scale;
+    weld = WELD * scale;
+    probe = PROBE * scale;
+  }
+
+  double clip_tolerances::step(double clearance) const {
+    return max(min(probe, 0.5 * clearance), 2.0 * on_plane);
+  }
+
+  unit_planes planes_of(const Atom& atom) {
+    memsafe_gplane_list planes = atom.half_spaces();
+    unit_planes out;
+    size_t i;
+    for (i = 0; i < planes->size(); ++i) {
+      const gplane& p = (*planes)[i];
+      double length = modulus(p.normal);
+      if (length == 0.0) continue;
+      unit_plane u;
+      u.normal = p.normal / length;
+      u.offset = p.offset / length;
+      out.push_back(u);
+    }
+    return out;
+  }
+
+  pair<double, double> extent(const gvec_list& corners, const unit_plane& p) {
+    double least = numeric_limits<double>::infinity(), greatest = -least;
+    size_t i;
+    for (i = 0; i < corners.size(); ++i) {
+      double d = distance(corners[i], p);
+      least = min(least, d);
+      greatest = max(greatest, d);
+    }
+    return make_pair(least, greatest);
+  }
+
+  void split(const gvec_list& piece,
+             const unit_plane& p,
+             double tolerance,
+             gvec_list& back,
+             gvec_list& front) {
+    back.clear();
+    front.clear();
+    // (a segment has one edge, where a polygon wraps around.)
+    size_t n = piece.size(), edges = n == 2 ? 1 : n, i;
+    for (i = 0; i < n; ++i) {
+      const gvec& a = piece[i];
+      double da = distance(a, p);
+      if (da <= tolerance) back.push_back(a);
+      if (da >= -tolerance) front.push_back(a);
+      if (i >= edges) continue;
+      const gvec& b = piece[(i + 1) % n];
+      double db = distance(b, p);
+      // (a crossing strictly between them goes to both.)
+      if ((da < -tolerance && db > tolerance) ||
+          (da > tolerance && db < -tolerance)) {
+        gvec crossing = a + (da / (da - db)) * (b - a);
+        back.push_back(crossing);
+        front.push_back(crossing);
+      }
+    }
+    size_t needed = min(n, size_t(3));
+    if (back.size() < needed) back.clear();
+    if (front.size() < needed) front.clear();
+  }
+
+  void cut_by(const gvec_list& piece,
+              const unit_planes& by,
+              double tolerance,
+              vector<gvec_list>& out) {
+    size_t j;
+    for (j = 0; j < by.size(); ++j) {
+      pair<double, double> e = extent(piece, by[j]);
+      if (e.first > -tolerance && e.second > tolerance) {
+        out.push_back(piece);
+        return;
+      }
+    }
+    gvec_list rest = piece, back, front;
+    for (j = 0; j < by.size(); ++j) {
+      pair<double, double> e = extent(rest, by[j]);
+      // (a plane the piece lies in doesn't cut it.)
+      if (e.first >= -tolerance && e.second <= tolerance) continue;
+      split(rest, by[j], tolerance, back, front);
+      if (!front.empty()) out.push_back(front);
+      rest.swap(back);
+      if (rest.empty()) return;
+    }
+    out.push_back(rest);
+  }
+
+  bool shares_face(const unit_planes& by,
+                   const gvec& point,
+                   const gvec& normal,
+                   double tolerance) {
+    bool coplanar = false;
+    size_t j;
+    for (j = 0; j < by.size(); ++j) {
+      double d = distance(point, by[j]);
+      if (d > tolerance) return false;
+      if (fabs(d) <= tolerance && fabs(by[j].normal * normal) > 1.0 - 1e-9) {
+        coplanar = true;
+      }
+    }
+    return coplanar;
+  }
+
+  double clearance(const gvec& point,
+                   const unit_planes& planes,
+                   double tolerance,
+                   double least) {
+    size_t j;
+    for (j = 0; j < planes.size(); ++j) {
+      double d = fabs(distance(point, planes[j]));
+      if (d > tolerance) least = min(least, d);
+    }
+    return least;
+  }
+
+  gbox box_of(const gvec_list& corners, double margin) {
+    gvec m(margin, margin, margin);
+    gbox box{corners[0], corners[0]};
+    size_t i;
+    int a;
+    for (i = 1; i < corners.size(); ++i) {
+      for (a = 0; a < 3; ++a) {
+        box.low[a] = min(box.low[a], corners[i][a]);
+        box.high[a] = max(box.high[a], corners[i][a]);
+      }
+    }
+    return gbox{box.low - m, box.high + m};
+  }
+
+  unsigned point_welder::add(const gvec& point) {
+    array<long long, 3> cell;
+    int a, dx, dy, dz;
+    for (a = 0; a < 3; ++a) cell[a] = (long long)(floor(point[a] / weld));
+    unsigned found = numeric_limits<unsigned>::max();
+    for (dx = -1; dx <= 1; ++dx) {
+      for (dy = -1; dy <= 1; ++dy) {
+        for (dz = -1; dz <= 1; ++dz) {
+          array<long long, 3> near = {{cell[0] + dx, cell[1] + dy,
+                                       cell[2] + dz}};
+          auto it = cells.find(near);
+          if (it == cells.end()) continue;
+          for (unsigned v : it->second) {
+            if (found > v && modulus(_points[v] - point) <= weld) found = v;
+          }
+        }
+      }
+    }
+    if (found == numeric_limits<unsigned>::max()) {
+      found = _points.size();
+      _points.push_back(point);
+      cells[cell].push_back(found);
+    }
+    return found;
+  }
+
+}
@@ -0,0 +1,698 @@
+/* layermesh/src/contour.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <contour.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  namespace {
+
+    // (how many times each crossing edge is halved, leaving the crossing
+    // within a millionth of a voxel or so of the surface.)
+    const unsigned BISECTIONS = 20;
+    // (the least barycentric weight of any corner of a tetrahedron in its
+    // vertex, so that vertices of neighbouring tetrahedra stay apart.)
+    const double VERTEX_MARGIN = 0.01;
+    // (eigenvalues of the fitted planes below this fraction of the largest
+    // are taken as zero, leaving the vertex free to stay near the crossings
+    // along them, as on a flat facet.)
+    const double QEF_CUTOFF = 0.1;
+
+    // What is contoured, whatever it comes from:
+    class contour_field {
+      public:
+        virtual ~contour_field() {};
+        // layer k of the grid, as render_slice renders it.
+        virtual void layer(const voxel_grid& grid,
+                           unsigned k,
+                           unsigned char* pixels) const = 0;
+        virtual bool inside(const gvec& point) const = 0;
+        // the unit normal of the surface at (or very near) point, or zero if
+        // it isn't known.
+        virtual gvec normal(const gvec& point) const = 0;
+    };
+
+    class solid_field : public contour_field {
+      private:
+        const Solid& solid;
+        double reach;
+      public:
+        solid_field(const Solid& solid, double reach)
+          : solid(solid), reach(reach) {};
+        virtual void layer(const voxel_grid& grid,
+                           unsigned k,
+                           unsigned char* pixels) const {
+          render_slice(solid, grid, k, pixels);
+        };
+        virtual bool inside(const gvec& point) const {
+          return solid.contains(point);
+        };
+        virtual gvec normal(const gvec& point) const {
+          gvec n;
+          solid.surface_distance(point, reach, n);
+          return n;
+        };
+    };
+
+    class atom_field : public contour_field {
+      private:
+        const Atom& atom;
+      public:
+        atom_field(const Atom& atom) : atom(atom) {};
+        virtual void layer(const voxel_grid& grid,
+                           unsigned k,
+                           unsigned char* pixels) const {
+          render_slice(atom, grid, k, pixels);
+        };
+        virtual bool inside(const gvec& point) const {
+          return atom.contains(point);
+        };
+        virtual gvec normal(const gvec& point) const {
+          gvec n;
+          atom.surface_distance(point, n);
+          return n;
+        };
+    };
+
+    class distance_field : public contour_field {
+      private:
+        const function<double(const gvec&)>& distance;
+        double step;
+      public:
+        distance_field(const function<double(const gvec&)>& distance,
+                       double step)
+          : distance(distance), step(step) {};
+        virtual void layer(const voxel_grid& grid,
+                           unsigned k,
+                           unsigned char* pixels) const {
+          unsigned i, j;
+          for (j = 0; j < grid.height; ++j) {
+            for (i = 0; i < grid.width; ++i) {
+              gvec centre = grid.origin +
+                grid.voxel * gvec(i + 0.5, j + 0.5, k + 0.5);
+              pixels[j * grid.width + i] = inside(centre) ? 255 : 0;
+            }
+          }
+        };
+        virtual bool inside(const gvec& point) const {
+          return distance(point) < 0.0;
+        };
+        virtual gvec normal(const gvec& point) const {
+          gvec g;
+          int a;
+          for (a = 0; a < 3; ++a) {
+            gvec d;
+            d[a] = step;
+            g[a] = distance(point + d) - distance(point - d);
+          }
+          double length = modulus(g);
+          return length > 0.0 ? g / length : gvec();
+        };
+    };
+
+    // The six tetrahedra of a cube: each is the path from the cube's lowest
+    // corner to its highest along the axes in one of these orders.
+    const unsigned TETRAHEDRON_AXES[6][3] = {
+      {0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}
+    };
+
+    // the corners of tetrahedron t, as offsets x + 2y + 4z from the cube's
+    // lowest corner. (Each is a subset of the next, so the edge between
+    // two of them runs along the offset of their difference.)
+    void tetrahedron_corners(unsigned t, unsigned corners[4]) {
+      corners[0] = 0;
+      corners[1] = 1u << TETRAHEDRON_AXES[t][0];
+      corners[2] = corners[1] | (1u << TETRAHEDRON_AXES[t][1]);
+      corners[3] = 7;
+    }
+
+    gvec offset_of(unsigned corner) {
+      return gvec(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+    }
+
+    // A tetrahedron around an edge of the lattice: that of the cube whose
+    // lowest corner is offset from the edge's lower end.
+    struct ring_entry {
+      int offset[3];
+      unsigned tetrahedron;
+    };
+
+    typedef vector<ring_entry> ring;
+
+    // The tetrahedra around the lattice edge from (0, 0, 0) along each
+    // offset d (as above, from 1 to 7), anticlockwise looking back along d.
+    vector<ring> make_rings() {
+      vector<ring> rings(8);
+      unsigned d, c, t;
+      for (d = 1; d < 8; ++d) {
+        gvec along = offset_of(d);
+        along = along / modulus(along);
+        gvec across = along ^ gvec(1.0, 0.0, 0.0);
+        if (modulus(across) < 0.5) across = along ^ gvec(0.0, 1.0, 0.0);
+        across = across / modulus(across);
+        gvec up = along ^ across;
+        vector<pair<double, ring_entry> > found;
+        // (the cubes meeting the edge are offset by -1 or 0 across it.)
+        for (c = 0; c < 8; ++c) {
+          if (c & d) continue;
+          for (t = 0; t < 6; ++t) {
+            unsigned corners[4];
+            tetrahedron_corners(t, corners);
+            unsigned* end = corners + 4;
+            if (find(corners, end, c) == end ||
+                find(corners, end, c | d) == end) continue;
+            ring_entry e;
+            gvec centroid;
+            int a;
+            for (a = 0; a < 3; ++a) e.offset[a] = -int((c >> a) & 1);
+            e.tetrahedron = t;
+            for (a = 0; a < 4; ++a) centroid = centroid + offset_of(corners[a]);
+            centroid = 0.25 * centroid - offset_of(c);
+            found.push_back(make_pair(atan2(centroid * up, centroid * across),
+                                      e));
+          }
+        }
+        sort(found.begin(), found.end(),
+             [](const pair<double, ring_entry>& l,
+                const pair<double, ring_entry>& r) {
+          return l.first < r.first;
+        });
+        for (c = 0; c < found.size(); ++c) rings[d].push_back(found[c].second);
+      }
+      return rings;
+    }
+
+    const vector<ring>& rings() {
+      static const vector<ring> all = make_rings();
+      return all;
+    }
+
+    // Where an edge of the lattice crosses the surface, and its normal
+    // there:
+    struct hermite {
+      gvec point;
+      gvec normal;
+    };
+
+    hermite crossing(const contour_field& field,
+                     gvec a,
+                     gvec b,
+                     bool a_inside) {
+      unsigned i;
+      for (i = 0; i < BISECTIONS; ++i) {
+        gvec middle = 0.5 * (a + b);
+        if (field.inside(middle) == a_inside) a = middle; else b = middle;
+      }
+      hermite h;
+      h.point = 0.5 * (a + b);
+      h.normal = field.normal(h.point);
+      return h;
+    }
+
+    // The eigenvalues and (unit) eigenvectors, as columns, of the symmetric
+    // matrix m, by Jacobi rotations (which leave m diagonal.)
+    void symmetric_eigen(double m[3][3],
+                         double values[3],
+                         double vectors[3][3]) {
+      int p, q, k;
+      unsigned sweep;
+      for (p = 0; p < 3; ++p) {
+        for (q = 0; q < 3; ++q) vectors[p][q] = p == q ? 1.0 : 0.0;
+      }
+      for (sweep = 0; sweep < 16; ++sweep) {
+        double off = fabs(m[0][1]) + fabs(m[0][2]) + fabs(m[1][2]);
+        double scale = fabs(m[0][0]) + fabs(m[1][1]) + fabs(m[2][2]);
+        if (off <= 1e-15 * scale || off == 0.0) break;
+        for (p = 0; p < 2; ++p) {
+          for (q = p + 1; q < 3; ++q) {
+            if (m[p][q] == 0.0) continue;
+            double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+            double t = (theta < 0.0 ? -1.0 : 1.0) /
+                       (fabs(theta) + sqrt(theta * theta + 1.0));
+            double c = 1.0 / sqrt(t * t + 1.0), s = t * c;
+            for (k = 0; k < 3; ++k) {
+              double kp = m[k][p], kq = m[k][q];
+              m[k][p] = c * kp - s * kq;
+              m[k][q] = s * kp + c * kq;
+            }
+            for (k = 0; k < 3; ++k) {
+              double pk = m[p][k], qk = m[q][k];
+              m[p][k] = c * pk - s * qk;
+              m[q][k] = s * pk + c * qk;
+            }
+            for (k = 0; k < 3; ++k) {
+              double kp = vectors[k][p], kq = vectors[k][q];
+              vectors[k][p] = c * kp - s * kq;
+              vectors[k][q] = s * kp + c * kq;
+            }
+          }
+        }
+      }
+      for (p = 0; p < 3; ++p) values[p] = m[p][p];
+    }
+
+    // t = reference + m^+ (rhs - m reference), where m^+ is the
+    // pseudo-inverse of the symmetric matrix m (its eigenvalues below cutoff
+    // times the largest being taken as zero), so t solves m t = rhs where it
+    // can, and stays as near reference as it can where m leaves it free.
+    void solve_symmetric(double m[3][3],
+                         const double rhs[3],
+                         const double reference[3],
+                         double cutoff,
+                         double t[3]) {
+      double residual[3], values[3], vectors[3][3];
+      int p, q;
+      for (p = 0; p < 3; ++p) {
+        residual[p] = rhs[p];
+        for (q = 0; q < 3; ++q) residual[p] -= m[p][q] * reference[q];
+        t[p] = reference[p];
+      }
+      symmetric_eigen(m, values, vectors);
+      double largest = max(values[0], max(values[1], values[2]));
+      for (p = 0; p < 3; ++p) {
+        if (largest <= 0.0 || values[p] <= cutoff * largest) continue;
+        double along = 0.0;
+        for (q = 0; q < 3; ++q) along += vectors[q][p] * residual[q];
+        for (q = 0; q < 3; ++q) t[q] += vectors[q][p] * along / values[p];
+      }
+    }
+
+    // The least squares fit of a point to the planes through some crossings
+    // (the quadratic error function of dual contouring.)
+    class plane_fit {
+      private:
+        // (the error of x is x.a.x - 2 b.x + c.)
+        double a[3][3];
+        gvec b, mean;
+        double c;
+      public:
+        plane_fit(const hermite* crossings, unsigned count);
+        double error(const gvec& x) const;
+        // the best fit on the plane (or line) through the count corners, as
+        // the weights of corners 1 to count - 1 (corner 0 having the rest),
+        // preferring the point nearest the crossings' mean where the planes
+        // leave it free.
+        void fit_on(const gvec* corners, unsigned count, double w[3]) const;
+        // the best fit within the tetrahedron: where it is inside, or
+        // otherwise the best of the fits on its faces, edges and corners
+        // which are (which, since the error is convex, is the best of all.)
+        gvec fit_within(const gvec corners[4]) const;
+    };
+
+    plane_fit::plane_fit(const hermite* crossings, unsigned count) : c(0.0) {
+      unsigned i;
+      int p, q;
+      for (p = 0; p < 3; ++p) {
+        for (q = 0; q < 3; ++q) a[p][q] = 0.0;
+      }
+      for (i = 0; i < count; ++i) {
+        const gvec& n = crossings[i].normal;
+        double offset = n * crossings[i].point;
+        mean = mean + crossings[i].point;
+        b = b + offset * n;
+        c += offset * offset;
+        for (p = 0; p < 3; ++p) {
+          for (q = 0; q < 3; ++q) a[p][q] += n[p] * n[q];
+        }
+      }
+      mean = mean / double(count);
+    }
+
+    double plane_fit::error(const gvec& x) const {
+      double e = c - 2.0 * (b * x);
+      int p, q;
+      for (p = 0; p < 3; ++p) {
+        for (q = 0; q < 3; ++q) e += x[p] * a[p][q] * x[q];
+      }
+      return e;
+    }
+
+    void plane_fit::fit_on(const gvec* corners,
+                           unsigned count,
+                           double w[3]) const {
+      gvec basis[3];
+      double m[3][3] = {{0.0}}, gram[3][3] = {{0.0}};
+      double rhs[3] = {0.0}, towards[3] = {0.0}, zero[3] = {0.0};
+      double reference[3];
+      unsigned k = count - 1, p, q;
+      int r;
+      for (p = 0; p < k; ++p) basis[p] = corners[p + 1] - corners[0];
+      gvec from_origin = b;
+      for (r = 0; r < 3; ++r) {
+        for (q = 0; q < 3; ++q) from_origin[r] -= a[r][q] * corners[0][q];
+      }
+      for (p = 0; p < k; ++p) {
+        gvec ab;
+        for (r = 0; r < 3; ++r) {
+          for (q = 0; q < 3; ++q) ab[r] += a[r][q] * basis[p][q];
+        }
+        for (q = 0; q < k; ++q) {
+          m[p][q] = ab * basis[q];
+          gram[p][q] = basis[p] * basis[q];
+        }
+        rhs[p] = basis[p] * from_origin;
+        towards[p] = basis[p] * (mean - corners[0]);
+      }
+      // (the crossings' mean, projected into the plane, as weights.)
+      solve_symmetric(gram, towards, zero, 1e-12, reference);
+      solve_symmetric(m, rhs, reference, QEF_CUTOFF, w);
+    }
+
+    gvec plane_fit::fit_within(const gvec corners[4]) const {
+      gvec best;
+      double least = numeric_limits<double>::infinity();
+      unsigned subset, i, count;
+      // (from the whole tetrahedron down to its corners.)
+      for (subset = 15; subset > 0; --subset) {
+        gvec chosen[4];
+        count = 0;
+        for (i = 0; i < 4; ++i) {
+          if (subset & (1u << i)) chosen[count++] = corners[i];
+        }
+        double w[3] = {0.0, 0.0, 0.0}, rest = 1.0;
+        if (count > 1) fit_on(chosen, count, w);
+        gvec x = chosen[0];
+        bool within = true;
+        for (i = 0; i + 1 < count; ++i) {
+          within = within && w[i] >= -1e-9;
+          rest -= w[i];
+          x = x + w[i] * (chosen[i + 1] - chosen[0]);
+        }
+        if (!within || rest < -1e-9) continue;
+        if (subset == 15) return x;
+        double e = error(x);
+        if (e < least) {
+          least = e;
+          best = x;
+        }
+      }
+      return best;
+    }
+
+    // The vertices placed by one slab of cubes, and the facets it makes:
+    struct cell_vertices {
+      size_t cell;
+      // (the slab's index of the vertex of the first of the cube's
+      // tetrahedra which crosses the surface, and a bit for each which
+      // does, so the others follow in order.)
+      uint32_t first;
+      unsigned char tetrahedra;
+    };
+
+    struct contour_slab {
+      size_t first, last;
+      gvec_list points;
+      vector<cell_vertices> cells;
+      facet_triples facets;
+      size_t offset;
+    };
+
+    class contourer {
+      private:
+        const contour_field& field;
+        const voxel_grid& grid;
+        // the lattice of centres, with a layer outside the grid all round:
+        size_t nx, ny, nz;
+        vector<unsigned char> inside;
+        vector<contour_slab> slabs;
+
+        size_t lattice_index(size_t x, size_t y, size_t z) const {
+          return (z * ny + y) * nx + x;
+        };
+        size_t cell_index(size_t x, size_t y, size_t z) const {
+          return (z * (ny - 1) + y) * (nx - 1) + x;
+        };
+        gvec position(size_t x, size_t y, size_t z) const {
+          return grid.origin + grid.voxel * gvec(x - 0.5, y - 0.5, z - 0.5);
+        };
+
+        void sample(unsigned first, unsigned last);
+        void place_vertices(contour_slab& s);
+        void make_facets(contour_slab& s) const;
+        unsigned vertex_of(size_t x, size_t y, size_t z, unsigned t) const;
+      public:
+        contourer(const contour_field& field, const voxel_grid& grid)
+          : field(field), grid(grid),
+            nx(grid.width + 2), ny(grid.height + 2), nz(grid.layers + 2),
+            inside(nx * ny * nz, 0) {};
+        IndexedMesh run(unsigned threads);
+    };
+
+    void contourer::sample(unsigned first, unsigned last) {
+      vector<unsigned char> pixels(size_t(grid.width) * grid.height);
+      unsigned k, j, i;
+      for (k = first; k < last; ++k) {
+        field.layer(grid, k, pixels.data());
+        for (j = 0; j < grid.height; ++j) {
+          const unsigned char* row = &pixels[size_t(j) * grid.width];
+          unsigned char* out = &inside[lattice_index(1, j + 1, k + 1)];
+          for (i = 0; i < grid.width; ++i) out[i] = row[i] != 0;
+        }
+      }
+    }
+
+    void contourer::place_vertices(contour_slab& s) {
+      unordered_map<size_t, hermite> crossings;
+      size_t x, y, z;
+      unsigned c, t, i, j;
+      for (z = s.first; z < s.last; ++z) {
+        for (y = 0; y + 1 < ny; ++y) {
+          for (x = 0; x + 1 < nx; ++x) {
+            bool corner_inside[8];
+            unsigned count = 0;
+            for (c = 0; c < 8; ++c) {
+              corner_inside[c] = inside[lattice_index(x + (c & 1),
+                                                      y + ((c >> 1) & 1),
+                                                      z + ((c >> 2) & 1))];
+              count += corner_inside[c];
+            }
+            if (count == 0 || count == 8) continue;
+            cell_vertices cell;
+            cell.cell = cell_index(x, y, z);
+            cell.first = s.points.size();
+            cell.tetrahedra = 0;
+            gvec low = position(x, y, z);
+            for (t = 0; t < 6; ++t) {
+              unsigned corners[4];
+              tetrahedron_corners(t, corners);
+              hermite found[6];
+              unsigned n = 0;
+              for (i = 0; i < 4; ++i) {
+                for (j = i + 1; j < 4; ++j) {
+                  unsigned a = corners[i], d = corners[i] ^ corners[j];
+                  if (corner_inside[a] == corner_inside[corners[j]]) continue;
+                  size_t ax = x + (a & 1), ay = y + ((a >> 1) & 1),
+                         az = z + ((a >> 2) & 1);
+                  size_t key = lattice_index(ax, ay, az) * 8 + d;
+                  unordered_map<size_t, hermite>::iterator it =
+                    crossings.find(key);
+                  if (it == crossings.end()) {
+                    hermite h = crossing(field,
+                                         position(ax, ay, az),
+                                         position(ax + (d & 1),
+                                                  ay + ((d >> 1) & 1),
+                                                  az + ((d >> 2) & 1)),
+                                         corner_inside[a]);
+                    it = crossings.insert(make_pair(key, h)).first;
+                  }
+                  found[n++] = it->second;
+                }
+              }
+              if (n == 0) continue;
+              // (fitted within the tetrahedron shrunk towards its centroid,
+              // so that every corner has at least VERTEX_MARGIN of it.)
+              gvec centroid, shrunk[4];
+              for (i = 0; i < 4; ++i) {
+                centroid = centroid + 0.25 * offset_of(corners[i]);
+              }
+              for (i = 0; i < 4; ++i) {
+                shrunk[i] = low + grid.voxel * (centroid +
+                  (1.0 - 4.0 * VERTEX_MARGIN) *
+                  (offset_of(corners[i]) - centroid));
+              }
+              cell.tetrahedra |= 1u << t;
+              s.points.push_back(plane_fit(found, n).fit_within(shrunk));
+            }
+            s.cells.push_back(cell);
+          }
+        }
+      }
+    }
+
+    unsigned contourer::vertex_of(size_t x,
+                                  size_t y,
+                                  size_t z,
+                                  unsigned t) const {
+      // (the slabs are few, so are simply searched in turn.)
+      const contour_slab* s = &slabs[0];
+      while (z >= s->last) ++s;
+      size_t cell = cell_index(x, y, z);
+      vector<cell_vertices>::const_iterator it =
+        lower_bound(s->cells.begin(), s->cells.end(), cell,
+                    [](const cell_vertices& l, size_t r) {
+          return l.cell < r;
+        });
+      unsigned before = 0, b;
+      for (b = 0; b < t; ++b) before += (it->tetrahedra >> b) & 1;
+      return unsigned(s->offset + it->first + before);
+    }
+
+    void contourer::make_facets(contour_slab& s) const {
+      const vector<ring>& around = rings();
+      size_t x, y, z;
+      unsigned d, i;
+      for (z = s.first; z < s.last; ++z) {
+        for (y = 0; y < ny; ++y) {
+          for (x = 0; x < nx; ++x) {
+            bool here = inside[lattice_index(x, y, z)];
+            for (d = 1; d < 8; ++d) {
+              size_t qx = x + (d & 1), qy = y + ((d >> 1) & 1),
+                     qz = z + ((d >> 2) & 1);
+              if (qx >= nx || qy >= ny || qz >= nz) continue;
+              if (inside[lattice_index(qx, qy, qz)] == here) continue;
+              const ring& r = around[d];
+              unsigned polygon[6];
+              for (i = 0; i < r.size(); ++i) {
+                const ring_entry& e = r[i];
+                polygon[i] = vertex_of(x + e.offset[0], y + e.offset[1],
+                                       z + e.offset[2], e.tetrahedron);
+              }
+              // (anticlockwise around d faces along d, out of the solid
+              // when it is the lower end which is inside.)
+              if (!here) reverse(polygon, polygon + r.size());
+              for (i = 1; i + 1 < r.size(); ++i) {
+                facet_triple f = {{polygon[0], polygon[i], polygon[i + 1]}};
+                s.facets.push_back(f);
+              }
+            }
+          }
+        }
+      }
+    }
+
+    IndexedMesh contourer::run(unsigned threads) {
+      unsigned parts = resolve_threads(threads);
+      vector<exception_ptr> errors(parts);
+      split_range(grid.layers, parts,
+                  [&](unsigned t, size_t first, size_t last) {
+        try {
+          sample(first, last);
+        } catch (...) {
+          errors[t] = current_exception();
+        }
+      });
+      unsigned t;
+      for (t = 0; t < parts; ++t) {
+        if (errors[t]) rethrow_exception(errors[t]);
+      }
+
+      // (the slabs of cubes, each of which also makes the facets around
+      // the lattice edges leaving its lower layers of centres.)
+      slabs.resize(parts);
+      split_range(nz - 1, parts, [&](unsigned t, size_t first, size_t last) {
+        slabs[t].first = first;
+        slabs[t].last = last;
+        try {
+          place_vertices(slabs[t]);
+        } catch (...) {
+          errors[t] = current_exception();
+        }
+      });
+      size_t total = 0;
+      for (t = 0; t < parts; ++t) {
+        if (errors[t]) rethrow_exception(errors[t]);
+        slabs[t].offset = total;
+        total += slabs[t].points.size();
+      }
+      if (total > numeric_limits<unsigned>::max()) {
+        throw runtime_error("contour: too many vertices for the facets to "
+                            "index.");
+      }
+      split_range(parts, parts, [&](unsigned t, size_t, size_t) {
+        try {
+          make_facets(slabs[t]);
+        } catch (...) {
+          errors[t] = current_exception();
+        }
+      });
+
+      IndexedMesh mesh;
+      size_t facets = 0;
+      for (t = 0; t < parts; ++t) {
+        if (errors[t]) rethrow_exception(errors[t]);
+        facets += slabs[t].facets.size();
+      }
+      mesh.points.reserve(total);
+      mesh.facets.reserve(facets);
+      for (t = 0; t < parts; ++t) {
+        contour_slab& s = slabs[t];
+        mesh.points.insert(mesh.points.end(), s.points.begin(),
+                           s.points.end());
+        mesh.facets.insert(mesh.facets.end(), s.facets.begin(),
+                           s.facets.end());
+        gvec_list().swap(s.points);
+        facet_triples().swap(s.facets);
+      }
+      return mesh;
+    }
+
+    void check_grid(const voxel_grid& grid) {
+      if (grid.width == 0 || grid.height == 0 || grid.layers == 0) {
+        throw invalid_argument("contour: the grid has no voxels.");
+      }
+    }
+
+  }
+
+  IndexedMesh contour(const Solid& solid,
+                      const voxel_grid& grid,
+                      unsigned threads) {
+    check_grid(grid);
+    solid_field field(solid, grid.voxel);
+    return contourer(field, grid).run(threads);
+  }
+
+  IndexedMesh contour(const Atom& atom,
+                      const voxel_grid& grid,
+                      unsigned threads) {
+    check_grid(grid);
+    atom_field field(atom);
+    return contourer(field, grid).run(threads);
+  }
+
+  IndexedMesh contour(const function<double(const gvec&)>& distance,
+                      const voxel_grid& grid,
+                      unsigned threads) {
+    check_grid(grid);
+    distance_field field(distance, grid.voxel / 1000.0);
+    return contourer(field, grid).run(threads);
+  }
+
+}
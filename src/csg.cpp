@@ -0,0 +1,1022 @@
+/* layermesh/src/csg.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <csg.hpp>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace layermesh {
+
+  // One query in SAMPLE_INTERVAL (per thread) times the children it
+  // evaluates, since reading the clock costs as much as a small atom's
+  // contains(). Batches are always timed, once per child.
+  static const unsigned SAMPLE_INTERVAL = 32;
+  // Statistics of fewer evaluations than this are not trusted by reorder():
+  static const unsigned long long MIN_SAMPLES = 16;
+  // (and no child is assumed to settle fewer queries than this, so that one
+  // which has never settled any is still ranked by its cost.)
+  static const double MIN_DECISION_RATE = 1e-3;
+
+  // Composites of at least this many children find those near a point
+  // through a Bvh, rather than testing every child's sphere:
+  static const size_t HIERARCHY_MIN_CHILDREN = 16;
+
+  static thread_local unsigned sample_clock = 0;
+
+  namespace {
+
+    typedef chrono::steady_clock clock_type;
+
+    unsigned long long since(clock_type::time_point start) {
+      return chrono::duration_cast<chrono::nanoseconds>(
+        clock_type::now() - start).count();
+    }
+
+    // the smallest sphere containing both (for the spheres of unions.)
+    gsphere enclose(const gsphere& a, const gsphere& b) {
+      gvec offset = b.centre - a.centre;
+      double distance = modulus(offset);
+      if (distance + b.radius <= a.radius) return a;
+      if (distance + a.radius <= b.radius) return b;
+      gsphere ret;
+      ret.radius = (distance + a.radius + b.radius) / 2.0;
+      ret.centre = a.centre + offset * ((ret.radius - a.radius) / distance);
+      return ret;
+    }
+
+    // The points of a batch which are still undecided and may be inside one
+    // child, copied out so that the child can be given them as a batch of
+    // its own.
+    template <typename T>
+    struct sub_batch {
+      vector<size_t> index;
+      vector<T> x, y, z;
+      vector<unsigned char> mask;
+
+      // gathers the points (all count of them, or those listed, if a list
+      // is given) for which pending[i] (if given) is set, and which are
+      // inside the sphere, returning how many there are.
+      size_t gather(const T* px, const T* py, const T* pz,
+                    const size_t* listed, size_t count,
+                    const unsigned char* pending,
+                    double cx, double cy, double cz, double radius_squared) {
+        index.clear();
+        x.clear();
+        y.clear();
+        z.clear();
+        size_t k;
+        for (k = 0; k < count; ++k) {
+          size_t i = listed != NULL ? listed[k] : k;
+          if (pending != NULL && !pending[i]) continue;
+          double dx = px[i] - cx, dy = py[i] - cy, dz = pz[i] - cz;
+          if (dx * dx + dy * dy + dz * dz > radius_squared) continue;
+          index.push_back(i);
+          x.push_back(px[i]);
+          y.push_back(py[i]);
+          z.push_back(pz[i]);
+        }
+        mask.resize(index.size());
+        return index.size();
+      }
+
+      // gives the gathered points to the solid, leaving its answers in mask
+      // and recording them in stats, if given.
+      void evaluate(const Solid& solid, child_stats* stats,
+                    bool decided_by_acceptance) {
+        clock_type::time_point start = clock_type::now();
+        solid.contains_batch(&x[0], &y[0], &z[0], index.size(), &mask[0]);
+        if (stats == NULL) return;
+        unsigned long long elapsed = since(start);
+        unsigned long long accepted = 0;
+        size_t i;
+        for (i = 0; i < mask.size(); ++i) {
+          accepted += mask[i];
+        }
+        stats->record(index.size(),
+                      decided_by_acceptance ? accepted
+                                            : index.size() - accepted,
+                      index.size(),
+                      elapsed);
+      }
+    };
+
+    // The children of a composite (in a hierarchy over their boxes) which
+    // may contain some of a batch of pending points (all the points, if
+    // pending isn't given), in order, and for each those points: child[k]'s
+    // are points[start[k]] up to points[start[k + 1]], in order.
+    struct candidate_lists {
+      vector<size_t> child;
+      vector<size_t> start;
+      vector<size_t> points;
+
+      template <typename T>
+      void find(const Bvh& hierarchy,
+                const T* x, const T* y, const T* z, size_t count,
+                const unsigned char* pending) {
+        vector<pair<size_t, size_t> > found;
+        size_t i;
+        for (i = 0; i < count; ++i) {
+          if (pending != NULL && !pending[i]) continue;
+          hierarchy.containing(gvec(x[i], y[i], z[i]), [&](size_t c) {
+            found.push_back(make_pair(c, i));
+            return false;
+          });
+        }
+        sort(found.begin(), found.end());
+        child.clear();
+        start.clear();
+        points.resize(found.size());
+        for (i = 0; i < found.size(); ++i) {
+          if (i == 0 || found[i].first != found[i - 1].first) {
+            child.push_back(found[i].first);
+            start.push_back(i);
+          }
+          points[i] = found[i].second;
+        }
+        start.push_back(found.size());
+      }
+    };
+
+    // whether the line through (0, y, z) parallel to the x axis meets the
+    // box between low and high.
+    bool line_meets(const gbox& box, double y, double z,
+                    double low, double high) {
+      return y >= box.low[1] && y <= box.high[1] &&
+             z >= box.low[2] && z <= box.high[2] &&
+             low <= box.high[0] && high >= box.low[0];
+    }
+
+    // sorts spans[from, end) and merges those which overlap or touch.
+    void merge_spans(span_list& spans, size_t from) {
+      sort(spans.begin() + from, spans.end(),
+           [](const span& a, const span& b) { return a.enter < b.enter; });
+      size_t out = from, i;
+      for (i = from; i < spans.size(); ++i) {
+        if (out > from && spans[i].enter <= spans[out - 1].exit) {
+          spans[out - 1].exit = max(spans[out - 1].exit, spans[i].exit);
+        } else {
+          spans[out++] = spans[i];
+        }
+      }
+      spans.resize(out);
+    }
+
+    // appends the parts of a which are in b (both in order and disjoint.)
+    void intersect_spans(const span_list& a, const span_list& b,
+                         span_list& out) {
+      size_t i = 0, j = 0;
+      while (i < a.size() && j < b.size()) {
+        double enter = max(a[i].enter, b[j].enter);
+        double exit = min(a[i].exit, b[j].exit);
+        if (enter <= exit) out.push_back(span{enter, exit});
+        if (a[i].exit < b[j].exit) ++i; else ++j;
+      }
+    }
+
+    // appends the parts of a which aren't in b (likewise.)
+    void subtract_spans(const span_list& a, const span_list& b,
+                        span_list& out) {
+      size_t i, j = 0;
+      for (i = 0; i < a.size(); ++i) {
+        double enter = a[i].enter;
+        while (j < b.size() && b[j].exit < enter) ++j;
+        size_t k = j;
+        for (; k < b.size() && b[k].enter <= a[i].exit; ++k) {
+          if (b[k].enter > enter) out.push_back(span{enter, b[k].enter});
+          enter = max(enter, b[k].exit);
+        }
+        if (enter < a[i].exit) out.push_back(span{enter, a[i].exit});
+      }
+    }
+
+  }
+
+  void Solid::contains_batch(const double* x,
+                             const double* y,
+                             const double* z,
+                             size_t count,
+                             unsigned char* mask) const {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      mask[i] = contains(gvec(x[i], y[i], z[i])) ? 1 : 0;
+    }
+  }
+
+  void Solid::contains_batch(const float* x,
+                             const float* y,
+                             const float* z,
+                             size_t count,
+                             unsigned char* mask) const {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+      mask[i] = contains(gvec(x[i], y[i], z[i])) ? 1 : 0;
+    }
+  }
+
+  Leaf::Leaf(shared_ptr<const Atom> atom) : _atom(atom) {
+    if (!atom) {
+      throw invalid_argument("Leaf: atom must not be null.");
+    }
+    boundary = atom->get_boundary();
+    aabb = atom->get_aabb();
+  }
+
+  bool Leaf::contains(gvec point) const {
+    return _atom->contains(point);
+  }
+
+  void Leaf::scanline_spans(double y,
+                            double z,
+                            double low,
+                            double high,
+                            span_list& spans) const {
+    span s;
+    if (!_atom->scanline_span(y, z, s)) return;
+    s.enter = max(s.enter, low);
+    s.exit = min(s.exit, high);
+    if (s.enter <= s.exit) spans.push_back(s);
+  }
+
+  box_relation Leaf::classify(const gbox& box) const {
+    if (!boxes_meet(aabb, box)) return box_outside;
+    return _atom->classify(box);
+  }
+
+  double Leaf::surface_distance(const gvec& point,
+                                double reach,
+                                gvec& normal) const {
+    return _atom->surface_distance(point, normal);
+  }
+
+  void Leaf::contains_batch(const double* x,
+                            const double* y,
+                            const double* z,
+                            size_t count,
+                            unsigned char* mask) const {
+    _atom->contains_batch(x, y, z, count, mask);
+  }
+
+  void Leaf::contains_batch(const float* x,
+                            const float* y,
+                            const float* z,
+                            size_t count,
+                            unsigned char* mask) const {
+    _atom->contains_batch(x, y, z, count, mask);
+  }
+
+  child_stats& child_stats::operator=(const child_stats& other) {
+    tested.store(other.tested.load(memory_order_relaxed),
+                 memory_order_relaxed);
+    decided.store(other.decided.load(memory_order_relaxed),
+                  memory_order_relaxed);
+    timed.store(other.timed.load(memory_order_relaxed), memory_order_relaxed);
+    nanoseconds.store(other.nanoseconds.load(memory_order_relaxed),
+                      memory_order_relaxed);
+    return *this;
+  }
+
+  void child_stats::record(unsigned long long tested,
+                           unsigned long long decided,
+                           unsigned long long timed,
+                           unsigned long long nanoseconds) {
+    this->tested.fetch_add(tested, memory_order_relaxed);
+    this->decided.fetch_add(decided, memory_order_relaxed);
+    this->timed.fetch_add(timed, memory_order_relaxed);
+    this->nanoseconds.fetch_add(nanoseconds, memory_order_relaxed);
+  }
+
+  void child_stats::clear() {
+    tested.store(0, memory_order_relaxed);
+    decided.store(0, memory_order_relaxed);
+    timed.store(0, memory_order_relaxed);
+    nanoseconds.store(0, memory_order_relaxed);
+  }
+
+  gbox Solid::get_aabb() const {
+    return box_of(get_boundary());
+  }
+
+  box_relation Solid::classify(const gbox& box) const {
+    return boxes_meet(get_aabb(), box) ? box_crossing : box_outside;
+  }
+
+  Composite::Composite()
+    : leaf_count(0), precision(numeric_limits<double>::epsilon()) {
+    Composite::reset_bounds();
+  }
+
+  void Composite::reset_bounds() {
+    boundary.centre = gvec();
+    boundary.radius = 0.0;
+    // (the box of nothing, which the first child replaces.)
+    double inf = numeric_limits<double>::infinity();
+    aabb = gbox{gvec(inf, inf, inf), gvec(-inf, -inf, -inf)};
+  }
+
+  void Composite::recompute_bounds() {
+    // (extend_boundary and extend_aabb expect the child to have just been
+    // added, so the children are added again one at a time.)
+    vector<child> all;
+    all.swap(children);
+    children.reserve(all.size());
+    reset_bounds();
+    leaf_count = 0;
+    precision = numeric_limits<double>::epsilon();
+    size_t i;
+    for (i = 0; i < all.size(); ++i) {
+      children.push_back(all[i]);
+      leaf_count += all[i].leaves;
+      precision = max(precision, all[i].precision);
+      boundary = extend_boundary(all[i].boundary);
+      aabb = extend_aabb(all[i].box);
+    }
+  }
+
+  void Composite::replace(size_t i,
+                          shared_ptr<const Solid> solid,
+                          vector<gbox>& changed) {
+    if (i >= children.size()) {
+      throw out_of_range("Composite::replace: no such child.");
+    }
+    if (!solid) {
+      throw invalid_argument("Composite::replace: solid must not be null.");
+    }
+    child& c = children[i];
+    changed.push_back(c.box);
+    c.solid = solid;
+    c.boundary = solid->get_boundary();
+    c.box = solid->get_aabb();
+    c.leaves = solid->leaves();
+    c.precision = solid->relative_precision();
+    c.stats.clear();
+    changed.push_back(c.box);
+    centre_x[i] = c.boundary.centre[0];
+    centre_y[i] = c.boundary.centre[1];
+    centre_z[i] = c.boundary.centre[2];
+    radius_squared[i] = c.boundary.radius * c.boundary.radius;
+    recompute_bounds();
+    refit_hierarchy();
+  }
+
+  void Composite::refit_hierarchy() {
+    if (children.size() < HIERARCHY_MIN_CHILDREN) return;
+    vector<gbox> boxes(children.size());
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      boxes[i] = children[i].box;
+    }
+    shared_ptr<Bvh> refitted = make_shared<Bvh>(*hierarchy());
+    refitted->refit(boxes);
+    _hierarchy = once_value<shared_ptr<const Bvh> >();
+    _hierarchy.get([&]() { return shared_ptr<const Bvh>(refitted); });
+  }
+
+  void Composite::refresh_bounds() {
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      children[i].boundary = children[i].solid->get_boundary();
+      children[i].box = children[i].solid->get_aabb();
+      children[i].leaves = children[i].solid->leaves();
+      children[i].precision = children[i].solid->relative_precision();
+    }
+    sync_spheres();
+    recompute_bounds();
+    refit_hierarchy();
+  }
+
+  void Composite::replace(size_t i,
+                          shared_ptr<const Atom> atom,
+                          vector<gbox>& changed) {
+    if (!atom) {
+      throw invalid_argument("Composite::replace: atom must not be null.");
+    }
+    replace(i, make_shared<Leaf>(atom), changed);
+  }
+
+  void Composite::remove(size_t i, vector<gbox>& changed) {
+    if (i >= children.size()) {
+      throw out_of_range("Composite::remove: no such child.");
+    }
+    changed.push_back(children[i].box);
+    children.erase(children.begin() + i);
+    sync_spheres();
+    recompute_bounds();
+    _hierarchy = once_value<shared_ptr<const Bvh> >();
+    // (what the others contain outside the child's box may now be inside.)
+    if (!decided_by_acceptance() && !children.empty()) {
+      changed.push_back(aabb);
+    }
+  }
+
+  void Composite::add(shared_ptr<const Solid> solid, vector<gbox>& changed) {
+    // (a child of an intersection may cut away anything it had, but the
+    // first one only gives it the child's own contents.)
+    gbox before = aabb;
+    bool cuts = !decided_by_acceptance() && !children.empty();
+    add_child(solid);
+    changed.push_back(cuts ? before : children.back().box);
+  }
+
+  void Composite::add(shared_ptr<const Atom> atom, vector<gbox>& changed) {
+    add(make_shared<Leaf>(atom), changed);
+  }
+
+  bool Composite::sample_query() {
+    return ++sample_clock % SAMPLE_INTERVAL == 0;
+  }
+
+  void Composite::add(shared_ptr<const Atom> atom) {
+    add_child(make_shared<Leaf>(atom));
+  }
+
+  void Composite::add_child(shared_ptr<const Solid> solid) {
+    if (!solid) {
+      throw invalid_argument("Composite::add: solid must not be null.");
+    }
+    child c;
+    c.solid = solid;
+    c.boundary = solid->get_boundary();
+    c.box = solid->get_aabb();
+    c.leaves = solid->leaves();
+    c.precision = solid->relative_precision();
+
+    children.push_back(c);
+    leaf_count += c.leaves;
+    precision = max(precision, c.precision);
+    boundary = extend_boundary(c.boundary);
+    aabb = extend_aabb(c.box);
+    centre_x.push_back(c.boundary.centre[0]);
+    centre_y.push_back(c.boundary.centre[1]);
+    centre_z.push_back(c.boundary.centre[2]);
+    radius_squared.push_back(c.boundary.radius * c.boundary.radius);
+    _hierarchy = once_value<shared_ptr<const Bvh> >();
+  }
+
+  const Bvh* Composite::hierarchy() const {
+    if (children.size() < HIERARCHY_MIN_CHILDREN) return NULL;
+    return _hierarchy.get([&]() {
+      vector<gbox> boxes(children.size());
+      size_t i;
+      for (i = 0; i < children.size(); ++i) {
+        boxes[i] = children[i].box;
+      }
+      return make_shared<const Bvh>(boxes, 0);
+    }).get();
+  }
+
+  void Composite::child_spans(double y,
+                              double z,
+                              double low,
+                              double high,
+                              span_list& spans) const {
+    const Bvh* h = hierarchy();
+    if (h != NULL) {
+      h->along_ray(gvec(low, y, z), gvec(high - low, 0.0, 0.0), 1.0,
+                   [&](size_t i) {
+        if (line_meets(children[i].box, y, z, low, high)) {
+          children[i].solid->scanline_spans(y, z, low, high, spans);
+        }
+        return false;
+      });
+      return;
+    }
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      if (line_meets(children[i].box, y, z, low, high)) {
+        children[i].solid->scanline_spans(y, z, low, high, spans);
+      }
+    }
+  }
+  box_relation Composite::children_classify(const gbox& box) const {
+    bool crossing = false;
+    auto visit = [&](size_t i) {
+      if (!boxes_meet(children[i].box, box)) return false;
+      box_relation r = children[i].solid->classify(box);
+      if (r == box_crossing) crossing = true;
+      return r == box_inside;
+    };
+    const Bvh* h = hierarchy();
+    bool inside = false;
+    if (h != NULL) {
+      inside = h->overlapping(box, visit);
+    } else {
+      size_t i;
+      for (i = 0; i < children.size() && !inside; ++i) inside = visit(i);
+    }
+    if (inside) return box_inside;
+    return crossing ? box_crossing : box_outside;
+  }
+
+  void Composite::atoms(vector<shared_ptr<const Atom> >& out) const {
+    size_t i;
+    for (i = 0; i < children.size(); ++i) children[i].solid->atoms(out);
+  }
+
+  double Composite::children_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const {
+    gvec r(reach, reach, reach);
+    gbox near{point - r, point + r};
+    double least = reach;
+    auto visit = [&](size_t i) {
+      if (!boxes_meet(children[i].box, near)) return false;
+      gvec n;
+      double d = children[i].solid->surface_distance(point, reach, n);
+      if (d < least) {
+        least = d;
+        normal = n;
+      }
+      return false;
+    };
+    const Bvh* h = hierarchy();
+    if (h != NULL) {
+      h->overlapping(near, visit);
+    } else {
+      size_t i;
+      for (i = 0; i < children.size(); ++i) visit(i);
+    }
+    return least;
+  }
+
+  void Composite::sync_spheres() {
+    centre_x.resize(children.size());
+    centre_y.resize(children.size());
+    centre_z.resize(children.size());
+    radius_squared.resize(children.size());
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      const gsphere& b = children[i].boundary;
+      centre_x[i] = b.centre[0];
+      centre_y[i] = b.centre[1];
+      centre_z[i] = b.centre[2];
+      radius_squared[i] = b.radius * b.radius;
+    }
+  }
+
+  bool Composite::evaluate(size_t i, const gvec& point, bool sampled) const {
+    if (!sampled) {
+      return children[i].solid->contains(point);
+    }
+    clock_type::time_point start = clock_type::now();
+    bool inside = children[i].solid->contains(point);
+    children[i].stats.record(1, inside == decided_by_acceptance() ? 1 : 0,
+                             1, since(start));
+    return inside;
+  }
+
+  double Composite::prior_decision_rate(const gsphere& child_boundary) const {
+    if (!decided_by_acceptance()) {
+      // (a point which reaches the children of an intersection is inside
+      // all their spheres, which says nothing about which will reject it.)
+      return 0.5;
+    }
+    // the chance that a point in the whole is in the child, if it filled
+    // its sphere:
+    if (boundary.radius <= 0.0) return 1.0;
+    double ratio = child_boundary.radius / boundary.radius;
+    return min(1.0, ratio * ratio * ratio);
+  }
+
+  double Composite::rank(size_t i, double nanoseconds_per_leaf) const {
+    const child& c = children[i];
+    unsigned long long tested = c.stats.tested.load(memory_order_relaxed);
+    unsigned long long timed = c.stats.timed.load(memory_order_relaxed);
+    double cost = timed >= MIN_SAMPLES
+      ? double(c.stats.nanoseconds.load(memory_order_relaxed)) / timed
+      : c.leaves * nanoseconds_per_leaf;
+    double rate = tested >= MIN_SAMPLES
+      ? double(c.stats.decided.load(memory_order_relaxed)) / tested
+      : prior_decision_rate(c.boundary);
+    return cost / max(rate, MIN_DECISION_RATE);
+  }
+
+  void Composite::reorder() {
+    // (children without timings are costed by the mean per leaf of those
+    // with them.)
+    double nanoseconds = 0.0, timed_leaves = 0.0;
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      unsigned long long timed =
+        children[i].stats.timed.load(memory_order_relaxed);
+      if (timed >= MIN_SAMPLES) {
+        nanoseconds +=
+          double(children[i].stats.nanoseconds.load(memory_order_relaxed)) /
+          timed;
+        timed_leaves += children[i].leaves;
+      }
+    }
+    double nanoseconds_per_leaf =
+      timed_leaves > 0.0 ? nanoseconds / timed_leaves : 1.0;
+
+    vector<pair<double, size_t> > ranks(children.size());
+    for (i = 0; i < children.size(); ++i) {
+      ranks[i] = make_pair(rank(i, nanoseconds_per_leaf), i);
+    }
+    stable_sort(ranks.begin(), ranks.end());
+
+    vector<child> sorted;
+    sorted.reserve(children.size());
+    for (i = 0; i < ranks.size(); ++i) {
+      sorted.push_back(children[ranks[i].second]);
+      sorted.back().stats.clear();
+    }
+    children.swap(sorted);
+    sync_spheres();
+    _hierarchy = once_value<shared_ptr<const Bvh> >();
+  }
+
+  gsphere Union::extend_boundary(const gsphere& child) const {
+    return children.size() == 1 ? child : enclose(boundary, child);
+  }
+
+  gbox Union::extend_aabb(const gbox& child) const {
+    if (children.size() == 1) return child;
+    gbox ret = aabb;
+    int a;
+    for (a = 0; a < 3; ++a) {
+      ret.low[a] = min(ret.low[a], child.low[a]);
+      ret.high[a] = max(ret.high[a], child.high[a]);
+    }
+    return ret;
+  }
+
+  bool Union::contains(gvec point) const {
+    gvec offset = point - boundary.centre;
+    if (offset * offset > boundary.radius * boundary.radius) return false;
+    bool sampled = sample_query();
+    const Bvh* h = hierarchy();
+    if (h != NULL) {
+      return h->containing(point, [&](size_t i) {
+        return in_child_boundary(i, point) && evaluate(i, point, sampled);
+      });
+    }
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      if (in_child_boundary(i, point) && evaluate(i, point, sampled)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename T>
+  void Union::contains_batch_of(const T* x, const T* y, const T* z,
+                                size_t count, unsigned char* mask) const {
+    fill(mask, mask + count, 0);
+    // (every point starts pending, and is settled once a child accepts it.)
+    vector<unsigned char> pending(count, 1);
+    const Bvh* h = hierarchy();
+    candidate_lists lists;
+    if (h != NULL) {
+      lists.find(*h, x, y, z, count, NULL);
+    }
+    sub_batch<T> batch;
+    size_t k, j;
+    for (k = 0; k < (h != NULL ? lists.child.size() : children.size()); ++k) {
+      size_t i = h != NULL ? lists.child[k] : k;
+      size_t n = h != NULL
+        ? batch.gather(x, y, z, &lists.points[lists.start[k]],
+                       lists.start[k + 1] - lists.start[k], pending.data(),
+                       centre_x[i], centre_y[i], centre_z[i],
+                       radius_squared[i])
+        : batch.gather(x, y, z, NULL, count, pending.data(), centre_x[i],
+                       centre_y[i], centre_z[i], radius_squared[i]);
+      if (n == 0) continue;
+      batch.evaluate(*children[i].solid, &children[i].stats, true);
+      for (j = 0; j < batch.index.size(); ++j) {
+        if (batch.mask[j]) {
+          mask[batch.index[j]] = 1;
+          pending[batch.index[j]] = 0;
+        }
+      }
+    }
+  }
+
+  void Union::contains_batch(const double* x,
+                             const double* y,
+                             const double* z,
+                             size_t count,
+                             unsigned char* mask) const {
+    contains_batch_of(x, y, z, count, mask);
+  }
+
+  void Union::contains_batch(const float* x,
+                             const float* y,
+                             const float* z,
+                             size_t count,
+                             unsigned char* mask) const {
+    contains_batch_of(x, y, z, count, mask);
+  }
+
+  void Union::scanline_spans(double y,
+                             double z,
+                             double low,
+                             double high,
+                             span_list& spans) const {
+    if (!line_meets(aabb, y, z, low, high)) return;
+    size_t from = spans.size();
+    child_spans(y, z, low, high, spans);
+    merge_spans(spans, from);
+  }
+
+  box_relation Union::classify(const gbox& box) const {
+    if (!boxes_meet(aabb, box)) return box_outside;
+    return children_classify(box);
+  }
+
+  double Union::surface_distance(const gvec& point,
+                                 double reach,
+                                 gvec& normal) const {
+    return children_distance(point, reach, normal);
+  }
+
+  gsphere Intersection::extend_boundary(const gsphere& child) const {
+    // (the smallest of the children's.)
+    return children.size() == 1 || child.radius < boundary.radius
+      ? child : boundary;
+  }
+
+  gbox Intersection::extend_aabb(const gbox& child) const {
+    // (the overlap of the children's, which may be empty.)
+    if (children.size() == 1) return child;
+    gbox ret = aabb;
+    int a;
+    for (a = 0; a < 3; ++a) {
+      ret.low[a] = max(ret.low[a], child.low[a]);
+      ret.high[a] = min(ret.high[a], child.high[a]);
+    }
+    return ret;
+  }
+
+  bool Intersection::contains(gvec point) const {
+    if (children.empty()) return false;
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      if (!in_child_boundary(i, point)) return false;
+    }
+    bool sampled = sample_query();
+    for (i = 0; i < children.size(); ++i) {
+      if (!evaluate(i, point, sampled)) return false;
+    }
+    return true;
+  }
+
+  template <typename T>
+  void Intersection::contains_batch_of(const T* x, const T* y, const T* z,
+                                       size_t count,
+                                       unsigned char* mask) const {
+    fill(mask, mask + count, children.empty() ? 0 : 1);
+    size_t i, j;
+    for (i = 0; i < children.size(); ++i) {
+      for (j = 0; j < count; ++j) {
+        double dx = x[j] - centre_x[i];
+        double dy = y[j] - centre_y[i];
+        double dz = z[j] - centre_z[i];
+        if (dx * dx + dy * dy + dz * dz > radius_squared[i]) mask[j] = 0;
+      }
+    }
+    sub_batch<T> batch;
+    const double everywhere = numeric_limits<double>::infinity();
+    for (i = 0; i < children.size(); ++i) {
+      if (batch.gather(x, y, z, NULL, count, mask, 0.0, 0.0, 0.0,
+                       everywhere) == 0) {
+        return;
+      }
+      batch.evaluate(*children[i].solid, &children[i].stats, false);
+      for (j = 0; j < batch.index.size(); ++j) {
+        mask[batch.index[j]] = batch.mask[j];
+      }
+    }
+  }
+
+  void Intersection::contains_batch(const double* x,
+                                    const double* y,
+                                    const double* z,
+                                    size_t count,
+                                    unsigned char* mask) const {
+    contains_batch_of(x, y, z, count, mask);
+  }
+
+  void Intersection::contains_batch(const float* x,
+                                    const float* y,
+                                    const float* z,
+                                    size_t count,
+                                    unsigned char* mask) const {
+    contains_batch_of(x, y, z, count, mask);
+  }
+
+  void Intersection::scanline_spans(double y,
+                                    double z,
+                                    double low,
+                                    double high,
+                                    span_list& spans) const {
+    if (children.empty() || !line_meets(aabb, y, z, low, high)) return;
+    span_list inside, next, child;
+    children[0].solid->scanline_spans(y, z, low, high, inside);
+    size_t i;
+    for (i = 1; i < children.size() && !inside.empty(); ++i) {
+      child.clear();
+      children[i].solid->scanline_spans(y, z, inside.front().enter,
+                                        inside.back().exit, child);
+      next.clear();
+      intersect_spans(inside, child, next);
+      inside.swap(next);
+    }
+    spans.insert(spans.end(), inside.begin(), inside.end());
+  }
+
+  box_relation Intersection::classify(const gbox& box) const {
+    if (children.empty() || !boxes_meet(aabb, box)) return box_outside;
+    bool crossing = false;
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      box_relation r = children[i].solid->classify(box);
+      if (r == box_outside) return box_outside;
+      if (r == box_crossing) crossing = true;
+    }
+    return crossing ? box_crossing : box_inside;
+  }
+
+  double Intersection::surface_distance(const gvec& point,
+                                        double reach,
+                                        gvec& normal) const {
+    if (children.empty()) return reach;
+    double greatest = -numeric_limits<double>::infinity();
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      gvec n;
+      double d = children[i].solid->surface_distance(point, reach, n);
+      if (d > greatest) {
+        greatest = d;
+        normal = n;
+      }
+    }
+    return greatest;
+  }
+
+  Difference::Difference(shared_ptr<const Solid> base) : _base(base) {
+    if (!base) {
+      throw invalid_argument("Difference: base must not be null.");
+    }
+    boundary = base->get_boundary();
+    aabb = base->get_aabb();
+  }
+
+  Difference::Difference(shared_ptr<const Atom> base)
+    : _base(make_shared<Leaf>(base)) {
+    boundary = _base->get_boundary();
+    aabb = _base->get_aabb();
+  }
+
+  void Difference::reset_bounds() {
+    boundary = _base->get_boundary();
+    aabb = _base->get_aabb();
+  }
+
+  gsphere Difference::extend_boundary(const gsphere&) const {
+    return boundary;
+  }
+
+  gbox Difference::extend_aabb(const gbox&) const {
+    return aabb;
+  }
+
+  bool Difference::contains(gvec point) const {
+    gvec offset = point - boundary.centre;
+    if (offset * offset > boundary.radius * boundary.radius ||
+        !_base->contains(point)) {
+      return false;
+    }
+    bool sampled = sample_query();
+    const Bvh* h = hierarchy();
+    if (h != NULL) {
+      return !h->containing(point, [&](size_t i) {
+        return in_child_boundary(i, point) && evaluate(i, point, sampled);
+      });
+    }
+    size_t i;
+    for (i = 0; i < children.size(); ++i) {
+      if (in_child_boundary(i, point) && evaluate(i, point, sampled)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename T>
+  void Difference::contains_batch_of(const T* x, const T* y, const T* z,
+                                     size_t count,
+                                     unsigned char* mask) const {
+    fill(mask, mask + count, 0);
+    sub_batch<T> batch;
+    size_t i, j;
+    if (batch.gather(x, y, z, NULL, count, NULL, boundary.centre[0],
+                     boundary.centre[1], boundary.centre[2],
+                     boundary.radius * boundary.radius) == 0) {
+      return;
+    }
+    batch.evaluate(*_base, NULL, true);
+    for (j = 0; j < batch.index.size(); ++j) {
+      mask[batch.index[j]] = batch.mask[j];
+    }
+
+    const Bvh* h = hierarchy();
+    candidate_lists lists;
+    if (h != NULL) {
+      lists.find(*h, x, y, z, count, mask);
+    }
+    size_t k;
+    for (k = 0; k < (h != NULL ? lists.child.size() : children.size()); ++k) {
+      i = h != NULL ? lists.child[k] : k;
+      size_t n = h != NULL
+        ? batch.gather(x, y, z, &lists.points[lists.start[k]],
+                       lists.start[k + 1] - lists.start[k], mask,
+                       centre_x[i], centre_y[i], centre_z[i],
+                       radius_squared[i])
+        : batch.gather(x, y, z, NULL, count, mask, centre_x[i], centre_y[i],
+                       centre_z[i], radius_squared[i]);
+      if (n == 0) continue;
+      batch.evaluate(*children[i].solid, &children[i].stats, true);
+      for (j = 0; j < batch.index.size(); ++j) {
+        if (batch.mask[j]) mask[batch.index[j]] = 0;
+      }
+    }
+  }
+
+  void Difference::contains_batch(const double* x,
+                                  const double* y,
+                                  const double* z,
+                                  size_t count,
+                                  unsigned char* mask) const {
+    contains_batch_of(x, y, z, count, mask);
+  }
+
+  void Difference::contains_batch(const float* x,
+                                  const float* y,
+                                  const float* z,
+                                  size_t count,
+                                  unsigned char* mask) const {
+    contains_batch_of(x, y, z, count, mask);
+  }
+
+  void Difference::scanline_spans(double y,
+                                  double z,
+                                  double low,
+                                  double high,
+                                  span_list& spans) const {
+    if (!line_meets(aabb, y, z, low, high)) return;
+    span_list base, cut;
+    _base->scanline_spans(y, z, low, high, base);
+    if (base.empty()) return;
+    child_spans(y, z, base.front().enter, base.back().exit, cut);
+    merge_spans(cut, 0);
+    subtract_spans(base, cut, spans);
+  }
+
+  box_relation Difference::classify(const gbox& box) const {
+    if (!boxes_meet(aabb, box)) return box_outside;
+    box_relation base = _base->classify(box);
+    if (base == box_outside) return box_outside;
+    box_relation cut = children_classify(box);
+    if (cut == box_inside) return box_outside;
+    return cut == box_outside ? base : box_crossing;
+  }
+
+  void Difference::atoms(vector<shared_ptr<const Atom> >& out) const {
+    _base->atoms(out);
+    Composite::atoms(out);
+  }
+
+  double Difference::surface_distance(const gvec& point,
+                                      double reach,
+                                      gvec& normal) const {
+    gvec n;
+    double base = _base->surface_distance(point, reach, normal);
+    double cut = children_distance(point, reach, n);
+    if (-cut <= base) return base;
+    normal = -n;
+    return -cut;
+  }
+
+}
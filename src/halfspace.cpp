@@ -0,0 +1,406 @@
+/* layermesh/src/halfspace.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <halfspace.hpp>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+namespace layermesh {
+
+  template <typename T>
+  basic_gplane<T> plane_through(const basic_gvec<T>& origin,
+                                const basic_gvec<T>& normal) {
+    basic_gplane<T> p;
+    p.normal = normal;
+    p.offset = normal * origin;
+    return p;
+  }
+
+  // The projection is accumulated in the same order in every code path below,
+  // so that the vector kernels agree bit-for-bit with the scalar test.
+  template <typename T>
+  static inline bool inside_plane(const basic_gplane<T>& p, T x, T y, T z) {
+    T s = p.normal[0] * x;
+    s = s + p.normal[1] * y;
+    s = s + p.normal[2] * z;
+    return s <= p.offset;
+  }
+
+  template <typename T>
+  bool halfspaces_contain(const basic_gplane<T>* planes,
+                          unsigned num_planes,
+                          const basic_gvec<T>& point) {
+    unsigned i;
+    for (i = 0; i < num_planes; ++i) {
+      if (!inside_plane(planes[i], point[0], point[1], point[2])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename T>
+  static void contain_scalar(const basic_gplane<T>* planes,
+                             unsigned num_planes,
+                             const T* x,
+                             const T* y,
+                             const T* z,
+                             size_t count,
+                             unsigned char* mask) {
+    size_t i;
+    unsigned j;
+    for (i = 0; i < count; ++i) {
+      unsigned char inside = 1;
+      for (j = 0; j < num_planes; ++j) {
+        if (!inside_plane(planes[j], x[i], y[i], z[i])) {
+          inside = 0;
+          break;
+        }
+      }
+      mask[i] = inside;
+    }
+  }
+
+  static inline void unpack_bits(int bits, unsigned lanes, unsigned char* mask) {
+    unsigned k;
+    for (k = 0; k < lanes; ++k) {
+      mask[k] = (bits >> k) & 1;
+    }
+  }
+
+  // Each contain_vector overload handles as many whole blocks as it can and
+  // returns the number of points done; a block is abandoned as soon as every
+  // lane in it has been rejected by some plane.
+
+#if defined(__AVX2__)
+
+  // four doubles per instruction:
+  static size_t contain_vector(const gplane* planes,
+                               unsigned num_planes,
+                               const double* x,
+                               const double* y,
+                               const double* z,
+                               size_t count,
+                               unsigned char* mask) {
+    size_t i;
+    unsigned j;
+    for (i = 0; i + 4 <= count; i += 4) {
+      __m256d px = _mm256_loadu_pd(x + i);
+      __m256d py = _mm256_loadu_pd(y + i);
+      __m256d pz = _mm256_loadu_pd(z + i);
+      __m256d inside = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+      for (j = 0; j < num_planes; ++j) {
+        const gplane& p = planes[j];
+        __m256d s = _mm256_mul_pd(_mm256_set1_pd(p.normal[0]), px);
+        s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_set1_pd(p.normal[1]), py));
+        s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_set1_pd(p.normal[2]), pz));
+        inside = _mm256_and_pd(inside,
+            _mm256_cmp_pd(s, _mm256_set1_pd(p.offset), _CMP_LE_OQ));
+        if (_mm256_movemask_pd(inside) == 0) {
+          break;
+        }
+      }
+      unpack_bits(_mm256_movemask_pd(inside), 4, mask + i);
+    }
+    return i;
+  }
+
+  // eight floats per instruction:
+  static size_t contain_vector(const gplane32* planes,
+                               unsigned num_planes,
+                               const float* x,
+                               const float* y,
+                               const float* z,
+                               size_t count,
+                               unsigned char* mask) {
+    size_t i;
+    unsigned j;
+    for (i = 0; i + 8 <= count; i += 8) {
+      __m256 px = _mm256_loadu_ps(x + i);
+      __m256 py = _mm256_loadu_ps(y + i);
+      __m256 pz = _mm256_loadu_ps(z + i);
+      __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+      for (j = 0; j < num_planes; ++j) {
+        const gplane32& p = planes[j];
+        __m256 s = _mm256_mul_ps(_mm256_set1_ps(p.normal[0]), px);
+        s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_set1_ps(p.normal[1]), py));
+        s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_set1_ps(p.normal[2]), pz));
+        inside = _mm256_and_ps(inside,
+            _mm256_cmp_ps(s, _mm256_set1_ps(p.offset), _CMP_LE_OQ));
+        if (_mm256_movemask_ps(inside) == 0) {
+          break;
+        }
+      }
+      unpack_bits(_mm256_movemask_ps(inside), 8, mask + i);
+    }
+    return i;
+  }
+
+#elif defined(__SSE2__)
+
+  // two doubles per instruction, interleaved in pairs of registers so that a
+  // block still covers four points:
+  static size_t contain_vector(const gplane* planes,
+                               unsigned num_planes,
+                               const double* x,
+                               const double* y,
+                               const double* z,
+                               size_t count,
+                               unsigned char* mask) {
+    size_t i;
+    unsigned j;
+    for (i = 0; i + 4 <= count; i += 4) {
+      __m128d ax = _mm_loadu_pd(x + i), bx = _mm_loadu_pd(x + i + 2);
+      __m128d ay = _mm_loadu_pd(y + i), by = _mm_loadu_pd(y + i + 2);
+      __m128d az = _mm_loadu_pd(z + i), bz = _mm_loadu_pd(z + i + 2);
+      __m128d all = _mm_castsi128_pd(_mm_set1_epi32(-1));
+      __m128d a_inside = all, b_inside = all;
+      for (j = 0; j < num_planes; ++j) {
+        const gplane& p = planes[j];
+        __m128d nx = _mm_set1_pd(p.normal[0]);
+        __m128d ny = _mm_set1_pd(p.normal[1]);
+        __m128d nz = _mm_set1_pd(p.normal[2]);
+        __m128d d = _mm_set1_pd(p.offset);
+        __m128d sa = _mm_mul_pd(nx, ax);
+        __m128d sb = _mm_mul_pd(nx, bx);
+        sa = _mm_add_pd(sa, _mm_mul_pd(ny, ay));
+        sb = _mm_add_pd(sb, _mm_mul_pd(ny, by));
+        sa = _mm_add_pd(sa, _mm_mul_pd(nz, az));
+        sb = _mm_add_pd(sb, _mm_mul_pd(nz, bz));
+        a_inside = _mm_and_pd(a_inside, _mm_cmple_pd(sa, d));
+        b_inside = _mm_and_pd(b_inside, _mm_cmple_pd(sb, d));
+        if ((_mm_movemask_pd(a_inside) | _mm_movemask_pd(b_inside)) == 0) {
+          break;
+        }
+      }
+      unpack_bits(_mm_movemask_pd(a_inside), 2, mask + i);
+      unpack_bits(_mm_movemask_pd(b_inside), 2, mask + i + 2);
+    }
+    return i;
+  }
+
+  // four floats per instruction:
+  static size_t contain_vector(const gplane32* planes,
+                               unsigned num_planes,
+                               const float* x,
+                               const float* y,
+                               const float* z,
+                               size_t count,
+                               unsigned char* mask) {
+    size_t i;
+    unsigned j;
+    for (i = 0; i + 4 <= count; i += 4) {
+      __m128 px = _mm_loadu_ps(x + i);
+      __m128 py = _mm_loadu_ps(y + i);
+      __m128 pz = _mm_loadu_ps(z + i);
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (j = 0; j < num_planes; ++j) {
+        const gplane32& p = planes[j];
+        __m128 s = _mm_mul_ps(_mm_set1_ps(p.normal[0]), px);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(p.normal[1]), py));
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_set1_ps(p.normal[2]), pz));
+        inside = _mm_and_ps(inside, _mm_cmple_ps(s, _mm_set1_ps(p.offset)));
+        if (_mm_movemask_ps(inside) == 0) {
+          break;
+        }
+      }
+      unpack_bits(_mm_movemask_ps(inside), 4, mask + i);
+    }
+    return i;
+  }
+
+#else
+
+  template <typename T>
+  static size_t contain_vector(const basic_gplane<T>*, unsigned,
+                               const T*, const T*, const T*,
+                               size_t, unsigned char*) {
+    return 0;
+  }
+
+#endif
+
+  template <typename T>
+  void halfspaces_contain_batch(const basic_gplane<T>* planes,
+                                unsigned num_planes,
+                                const T* x,
+                                const T* y,
+                                const T* z,
+                                size_t count,
+                                unsigned char* mask) {
+    // the vector kernel handles whole blocks, the scalar loop the remainder:
+    size_t done = contain_vector(planes, num_planes, x, y, z, count, mask);
+    contain_scalar(planes, num_planes,
+                   x + done, y + done, z + done, count - done, mask + done);
+  }
+
+  void order_by_rejection(gplane_list& planes, const gvec_list& samples) {
+    vector<vector<unsigned> > rejects(planes.size());
+    size_t i, j;
+    for (i = 0; i < planes.size(); ++i) {
+      for (j = 0; j < samples.size(); ++j) {
+        if (!inside_plane(planes[i], samples[j][0], samples[j][1],
+                          samples[j][2])) {
+          rejects[i].push_back(j);
+        }
+      }
+    }
+
+    vector<bool> rejected(samples.size(), false);
+    vector<bool> placed(planes.size(), false);
+    gplane_list ordered;
+    ordered.reserve(planes.size());
+    while (true) {
+      size_t best = 0, best_count = 0;
+      for (i = 0; i < planes.size(); ++i) {
+        if (placed[i]) continue;
+        size_t count = 0;
+        vector<unsigned>::const_iterator it = rejects[i].begin();
+        for (; it != rejects[i].end(); ++it) {
+          if (!rejected[*it]) ++count;
+        }
+        if (count > best_count) {
+          best = i;
+          best_count = count;
+        }
+      }
+      if (best_count == 0) {
+        break;
+      }
+      placed[best] = true;
+      ordered.push_back(planes[best]);
+      vector<unsigned>::const_iterator it = rejects[best].begin();
+      for (; it != rejects[best].end(); ++it) {
+        rejected[*it] = true;
+      }
+    }
+    for (i = 0; i < planes.size(); ++i) {
+      if (!placed[i]) ordered.push_back(planes[i]);
+    }
+    planes.swap(ordered);
+  }
+
+  template <typename T>
+  bool halfspaces_clip_x(const basic_gplane<T>* planes,
+                         unsigned num_planes,
+                         double y,
+                         double z,
+                         span& s) {
+    s.enter = -numeric_limits<double>::infinity();
+    s.exit = numeric_limits<double>::infinity();
+    unsigned i;
+    for (i = 0; i < num_planes; ++i) {
+      const basic_gplane<T>& p = planes[i];
+      // (the plane is n_x x <= r along the line.)
+      double r = double(p.offset) - (double(p.normal[1]) * y +
+                                     double(p.normal[2]) * z);
+      double nx = p.normal[0];
+      if (nx > 0.0) {
+        s.exit = min(s.exit, r / nx);
+      } else if (nx < 0.0) {
+        s.enter = max(s.enter, r / nx);
+      } else if (r < 0.0) {
+        return false;
+      }
+    }
+    return s.enter <= s.exit;
+  }
+
+  template <typename T>
+  box_relation halfspaces_classify(const basic_gplane<T>* planes,
+                                   unsigned num_planes,
+                                   const gbox& box) {
+    bool inside = true;
+    unsigned i;
+    int a;
+    for (i = 0; i < num_planes; ++i) {
+      const basic_gplane<T>& p = planes[i];
+      // (the least and greatest projections are at the corners the normal
+      // points away from and towards.)
+      double least = 0.0, greatest = 0.0, scale = fabs(double(p.offset));
+      for (a = 0; a < 3; ++a) {
+        double n = p.normal[a];
+        least += n * (n > 0.0 ? box.low[a] : box.high[a]);
+        greatest += n * (n > 0.0 ? box.high[a] : box.low[a]);
+        scale += fabs(n) * max(fabs(box.low[a]), fabs(box.high[a]));
+      }
+      double margin = 16.0 * numeric_limits<T>::epsilon() * scale;
+      if (least > p.offset + margin) return box_outside;
+      if (greatest > p.offset - margin) inside = false;
+    }
+    return inside ? box_inside : box_crossing;
+  }
+
+  template <typename T>
+  double halfspaces_distance(const basic_gplane<T>* planes,
+                             unsigned num_planes,
+                             const gvec& point,
+                             gvec& normal) {
+    double greatest = numeric_limits<double>::infinity();
+    unsigned i;
+    for (i = 0; i < num_planes; ++i) {
+      gvec n(planes[i].normal);
+      double length = modulus(n);
+      if (length == 0.0) continue;
+      double d = (n * point - double(planes[i].offset)) / length;
+      if (greatest == numeric_limits<double>::infinity() || d > greatest) {
+        greatest = d;
+        normal = n / length;
+      }
+    }
+    return greatest;
+  }
+
+  template gplane plane_through(const gvec&, const gvec&);
+  template gplane32 plane_through(const gvec32&, const gvec32&);
+  template bool halfspaces_contain(const gplane*, unsigned, const gvec&);
+  template bool halfspaces_contain(const gplane32*, unsigned, const gvec32&);
+  template void halfspaces_contain_batch(const gplane*, unsigned,
+                                         const double*, const double*,
+                                         const double*, size_t,
+                                         unsigned char*);
+  template void halfspaces_contain_batch(const gplane32*, unsigned,
+                                         const float*, const float*,
+                                         const float*, size_t,
+                                         unsigned char*);
+  template bool halfspaces_clip_x(const gplane*, unsigned, double, double,
+                                  span&);
+  template bool halfspaces_clip_x(const gplane32*, unsigned, double, double,
+                                  span&);
+  template box_relation halfspaces_classify(const gplane*, unsigned,
+                                            const gbox&);
+  template box_relation halfspaces_classify(const gplane32*, unsigned,
+                                            const gbox&);
+  template double halfspaces_distance(const gplane*, unsigned, const gvec&,
+                                      gvec&);
+  template double halfspaces_distance(const gplane32*, unsigned, const gvec&,
+                                      gvec&);
+
+}
@@ -0,0 +1,414 @@
+/* layermesh/src/hull.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <hull.hpp>
+#include <parallel.hpp>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+
+namespace layermesh {
+
+  static const unsigned NO_FACE = ~0u;
+  // points are only split between threads to be given to faces when there
+  // are at least this many per thread:
+  static const size_t MIN_POINTS_PER_THREAD = 4096;
+
+  // A triangle of the hull under construction. neighbour[k] is the face on
+  // the other side of the edge v[k] -> v[(k + 1) % 3].
+  struct hull_face {
+    unsigned v[3];
+    unsigned neighbour[3];
+    gvec normal;
+    double offset;
+    // the points which are outside this face (and not assigned to another),
+    // and which of them is furthest from it:
+    vector<unsigned> outside;
+    unsigned furthest;
+    double furthest_distance;
+    bool live;
+    bool visible;
+  };
+
+  // Quickhull: start from a tetrahedron of extreme points, give every other
+  // point to a face it is outside of, and then repeatedly take the furthest
+  // point from some face, remove every face it can see, and connect it to
+  // the edges of the hole (the horizon.)
+  class quickhull {
+    private:
+      const gvec* points;
+      size_t count;
+      unsigned threads;
+      double epsilon;
+      vector<hull_face> faces;
+      vector<unsigned> free_faces;
+      vector<unsigned> pending;
+      // reused by each step, to avoid allocating per point:
+      vector<unsigned> visible;
+      vector<pair<unsigned, unsigned> > horizon;
+      vector<pair<unsigned, unsigned> > new_faces;
+      vector<unsigned> created;
+      vector<unsigned> gathered;
+      vector<unsigned> targets;
+      vector<double> distances;
+
+      double distance(const hull_face& f, unsigned p) const {
+        return f.normal * points[p] - f.offset;
+      }
+
+      unsigned add_face(unsigned a, unsigned b, unsigned c) {
+        unsigned i;
+        if (free_faces.empty()) {
+          i = faces.size();
+          faces.push_back(hull_face());
+        } else {
+          i = free_faces.back();
+          free_faces.pop_back();
+        }
+        hull_face& f = faces[i];
+        f.v[0] = a;
+        f.v[1] = b;
+        f.v[2] = c;
+        f.neighbour[0] = f.neighbour[1] = f.neighbour[2] = NO_FACE;
+        gvec n = (points[b] - points[a]) ^ (points[c] - points[a]);
+        f.normal = n / layermesh::modulus(n);
+        f.offset = f.normal * points[a];
+        f.outside.clear();
+        f.furthest_distance = 0.0;
+        f.live = true;
+        f.visible = false;
+        return i;
+      }
+
+      // gives each of the points to the first of the faces it is outside of,
+      // dropping those which are inside all of them. Finding the face is most
+      // of the work, so for many points that is split between threads, and
+      // only the (cheap, and ordered) appending to the faces is serial.
+      void assign(const vector<unsigned>& points_to_assign,
+                  const vector<unsigned>& to_faces) {
+        size_t n = points_to_assign.size();
+        unsigned parts = threads;
+        if (parts > n / MIN_POINTS_PER_THREAD) {
+          parts = n / MIN_POINTS_PER_THREAD;
+        }
+        targets.resize(n);
+        distances.resize(n);
+        split_range(n, parts, [&](unsigned, size_t first, size_t last) {
+          size_t i;
+          for (i = first; i < last; ++i) {
+            targets[i] = NO_FACE;
+            vector<unsigned>::const_iterator f = to_faces.begin();
+            for (; f != to_faces.end(); ++f) {
+              double d = distance(faces[*f], points_to_assign[i]);
+              if (d > epsilon) {
+                targets[i] = *f;
+                distances[i] = d;
+                break;
+              }
+            }
+          }
+        });
+
+        size_t i;
+        for (i = 0; i < n; ++i) {
+          if (targets[i] == NO_FACE) {
+            continue;
+          }
+          hull_face& f = faces[targets[i]];
+          f.outside.push_back(points_to_assign[i]);
+          if (distances[i] > f.furthest_distance) {
+            f.furthest_distance = distances[i];
+            f.furthest = points_to_assign[i];
+          }
+        }
+      }
+
+      void link(unsigned f, unsigned a, unsigned b, unsigned g) {
+        unsigned k;
+        for (k = 0; k < 3; ++k) {
+          if (faces[f].v[k] == a && faces[f].v[(k + 1) % 3] == b) {
+            faces[f].neighbour[k] = g;
+            return;
+          }
+        }
+      }
+
+      void initial_simplex();
+      void add_point(unsigned face);
+
+    public:
+      quickhull(const gvec* points, size_t count, unsigned threads)
+        : points(points), count(count), threads(threads) {};
+      void build();
+      facet_triples facets() const;
+  };
+
+  void quickhull::initial_simplex() {
+    if (count < 4) {
+      throw invalid_argument("A convex hull needs at least four points.");
+    }
+
+    // the extreme points along each axis:
+    unsigned extremes[6] = {0, 0, 0, 0, 0, 0};
+    double largest[3] = {0.0, 0.0, 0.0};
+    size_t i;
+    unsigned a;
+    for (i = 0; i < count; ++i) {
+      for (a = 0; a < 3; ++a) {
+        if (points[i][a] < points[extremes[2 * a]][a]) extremes[2 * a] = i;
+        if (points[i][a] > points[extremes[2 * a + 1]][a]) {
+          extremes[2 * a + 1] = i;
+        }
+        largest[a] = max(largest[a], fabs(points[i][a]));
+      }
+    }
+    // (as in qhull, the rounding error in a distance is of this order.)
+    epsilon = 3 * DBL_EPSILON * (largest[0] + largest[1] + largest[2]);
+
+    // the two extremes furthest apart,
+    unsigned v[4] = {0, 0, 0, 0};
+    double best = -1.0;
+    unsigned j, k;
+    for (j = 0; j < 6; ++j) {
+      for (k = j + 1; k < 6; ++k) {
+        double d = layermesh::modulus(points[extremes[j]] -
+                                      points[extremes[k]]);
+        if (d > best) {
+          best = d;
+          v[0] = extremes[j];
+          v[1] = extremes[k];
+        }
+      }
+    }
+    // the point furthest from the line through them,
+    gvec line = points[v[1]] - points[v[0]];
+    best = 0.0;
+    for (i = 0; i < count; ++i) {
+      double d = layermesh::modulus((points[i] - points[v[0]]) ^ line);
+      if (d > best) {
+        best = d;
+        v[2] = i;
+      }
+    }
+    if (best <= epsilon * layermesh::modulus(line)) {
+      throw invalid_argument("The points of a convex hull are collinear.");
+    }
+    // and the point furthest from the plane through all three.
+    gvec n = line ^ (points[v[2]] - points[v[0]]);
+    n = n / layermesh::modulus(n);
+    best = 0.0;
+    for (i = 0; i < count; ++i) {
+      double d = fabs(n * (points[i] - points[v[0]]));
+      if (d > best) {
+        best = d;
+        v[3] = i;
+      }
+    }
+    if (best <= epsilon) {
+      throw invalid_argument("The points of a convex hull are coplanar.");
+    }
+
+    // each face of the tetrahedron leaves out one of its vertices, and is
+    // wound so that the vertex it leaves out is behind it:
+    unsigned first = faces.size();
+    for (j = 0; j < 4; ++j) {
+      unsigned a = v[(j + 1) % 4], b = v[(j + 2) % 4], c = v[(j + 3) % 4];
+      gvec m = (points[b] - points[a]) ^ (points[c] - points[a]);
+      if (m * (points[v[j]] - points[a]) > 0.0) {
+        swap(b, c);
+      }
+      add_face(a, b, c);
+    }
+    for (j = first; j < first + 4; ++j) {
+      for (k = first; k < first + 4; ++k) {
+        if (j == k) continue;
+        unsigned e;
+        for (e = 0; e < 3; ++e) {
+          link(k, faces[j].v[(e + 1) % 3], faces[j].v[e], j);
+        }
+      }
+    }
+
+    created.clear();
+    for (j = 0; j < 4; ++j) {
+      created.push_back(first + j);
+    }
+    gathered.clear();
+    gathered.reserve(count);
+    for (i = 0; i < count; ++i) {
+      if (i != v[0] && i != v[1] && i != v[2] && i != v[3]) {
+        gathered.push_back(i);
+      }
+    }
+    assign(gathered, created);
+    pending.insert(pending.end(), created.begin(), created.end());
+  }
+
+  void quickhull::add_point(unsigned face) {
+    unsigned eye = faces[face].furthest;
+
+    // find the faces which can see the eye point (a connected region around
+    // face), and the edges around their boundary:
+    visible.clear();
+    horizon.clear();
+    faces[face].visible = true;
+    visible.push_back(face);
+    size_t i;
+    unsigned k;
+    for (i = 0; i < visible.size(); ++i) {
+      unsigned f = visible[i];
+      for (k = 0; k < 3; ++k) {
+        unsigned g = faces[f].neighbour[k];
+        if (faces[g].visible) {
+          continue;
+        }
+        if (distance(faces[g], eye) > epsilon) {
+          faces[g].visible = true;
+          visible.push_back(g);
+        } else {
+          horizon.push_back(make_pair(f, k));
+        }
+      }
+    }
+
+    // a new face from each horizon edge to the eye, wound the same way as
+    // the visible face it replaces; new_faces maps the first vertex of each
+    // to the face, to connect them to each other.
+    new_faces.clear();
+    for (i = 0; i < horizon.size(); ++i) {
+      unsigned f = horizon[i].first;
+      k = horizon[i].second;
+      unsigned a = faces[f].v[k];
+      unsigned b = faces[f].v[(k + 1) % 3];
+      unsigned behind = faces[f].neighbour[k];
+      unsigned n = add_face(a, b, eye);
+      faces[n].neighbour[0] = behind;
+      link(behind, b, a, n);
+      new_faces.push_back(make_pair(a, n));
+    }
+    sort(new_faces.begin(), new_faces.end());
+    for (i = 0; i < new_faces.size(); ++i) {
+      unsigned n = new_faces[i].second;
+      // the face sharing edge b -> eye is the one which starts from b:
+      vector<pair<unsigned, unsigned> >::iterator next =
+        lower_bound(new_faces.begin(), new_faces.end(),
+                    make_pair(faces[n].v[1], 0u));
+      if (next == new_faces.end() || next->first != faces[n].v[1]) {
+        // (only if rounding made the visible region inconsistent.)
+        throw runtime_error("Couldn't find a consistent convex hull.");
+      }
+      faces[n].neighbour[1] = next->second;
+      faces[next->second].neighbour[2] = n;
+    }
+
+    // the visible faces' points either belong to a new face, or are now
+    // inside the hull:
+    created.clear();
+    for (i = 0; i < new_faces.size(); ++i) {
+      created.push_back(new_faces[i].second);
+    }
+    gathered.clear();
+    for (i = 0; i < visible.size(); ++i) {
+      hull_face& f = faces[visible[i]];
+      vector<unsigned>::const_iterator p = f.outside.begin();
+      for (; p != f.outside.end(); ++p) {
+        if (*p != eye) {
+          gathered.push_back(*p);
+        }
+      }
+      vector<unsigned>().swap(f.outside);
+      f.live = false;
+      f.visible = false;
+      free_faces.push_back(visible[i]);
+    }
+    assign(gathered, created);
+    pending.insert(pending.end(), created.begin(), created.end());
+  }
+
+  void quickhull::build() {
+    initial_simplex();
+    while (!pending.empty()) {
+      unsigned f = pending.back();
+      pending.pop_back();
+      if (faces[f].live && !faces[f].outside.empty()) {
+        add_point(f);
+      }
+    }
+  }
+
+  facet_triples quickhull::facets() const {
+    facet_triples triples;
+    vector<hull_face>::const_iterator it = faces.begin();
+    for (; it != faces.end(); ++it) {
+      if (it->live) {
+        triples.push_back({{it->v[0], it->v[1], it->v[2]}});
+      }
+    }
+    return triples;
+  }
+
+  facet_triples convex_hull(const gvec* points, size_t count,
+                            unsigned threads) {
+    quickhull hull(points, count, resolve_threads(threads));
+    hull.build();
+    return hull.facets();
+  }
+
+  gplane_list hull_planes(const gvec* points, const facet_triples& facets) {
+    // coplanar facets are found by sorting on their normals and offsets,
+    // rounded to a relative precision of about 1e-9:
+    double scale = 0.0;
+    facet_triples::const_iterator fit = facets.begin();
+    for (; fit != facets.end(); ++fit) {
+      scale = max(scale, layermesh::modulus(points[(*fit)[0]]));
+    }
+    if (scale == 0.0) scale = 1.0;
+
+    typedef pair<array<long long, 4>, unsigned> keyed_plane;
+    vector<keyed_plane> keyed;
+    gplane_list planes;
+    for (fit = facets.begin(); fit != facets.end(); ++fit) {
+      const gvec& o = points[(*fit)[0]];
+      gvec n = (points[(*fit)[1]] - o) ^ (points[(*fit)[2]] - o);
+      gplane p = plane_through(o, n / layermesh::modulus(n));
+      array<long long, 4> key = {{
+        llround(p.normal[0] * 1e9), llround(p.normal[1] * 1e9),
+        llround(p.normal[2] * 1e9), llround(p.offset / scale * 1e9)
+      }};
+      keyed.push_back(make_pair(key, planes.size()));
+      planes.push_back(p);
+    }
+    sort(keyed.begin(), keyed.end());
+
+    gplane_list distinct;
+    size_t i;
+    for (i = 0; i < keyed.size(); ++i) {
+      if (i == 0 || keyed[i].first != keyed[i - 1].first) {
+        distinct.push_back(planes[keyed[i].second]);
+      }
+    }
+    return distinct;
+  }
+
+}
@@ -0,0 +1,171 @@
+/* layermesh/src/normals.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <normals.hpp>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace layermesh {
+
+  // The initial estimate comes from a float32 rsqrt, so squared lengths
+  // outside (roughly) the range of a normal float are left to the scalar path.
+  static const double MIN_VECTOR_LENGTH2 = 1e-30;
+  static const double MAX_VECTOR_LENGTH2 = 1e30;
+
+  static inline void normalise_scalar(double& x, double& y, double& z) {
+    double r = 1.0 / sqrt(x * x + y * y + z * z);
+    x *= r;
+    y *= r;
+    z *= r;
+  }
+
+  // Each normalise_vector overload handles as many whole blocks as it can, and
+  // returns the number of vectors done. Blocks with a length out of the float
+  // range are done with normalise_scalar instead.
+
+#if defined(__AVX2__)
+
+  static size_t normalise_vector(double* x, double* y, double* z,
+                                 size_t count) {
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d three_halves = _mm256_set1_pd(1.5);
+    const __m256d low = _mm256_set1_pd(MIN_VECTOR_LENGTH2);
+    const __m256d high = _mm256_set1_pd(MAX_VECTOR_LENGTH2);
+    size_t i;
+    for (i = 0; i + 4 <= count; i += 4) {
+      __m256d vx = _mm256_loadu_pd(x + i);
+      __m256d vy = _mm256_loadu_pd(y + i);
+      __m256d vz = _mm256_loadu_pd(z + i);
+      __m256d l2 = _mm256_mul_pd(vx, vx);
+      l2 = _mm256_add_pd(l2, _mm256_mul_pd(vy, vy));
+      l2 = _mm256_add_pd(l2, _mm256_mul_pd(vz, vz));
+
+      __m256d r = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(l2)));
+      __m256d h = _mm256_mul_pd(half, l2);
+      // r = r * (1.5 - 0.5 * l2 * r * r), twice:
+      r = _mm256_mul_pd(r, _mm256_sub_pd(
+            three_halves, _mm256_mul_pd(h, _mm256_mul_pd(r, r))));
+      r = _mm256_mul_pd(r, _mm256_sub_pd(
+            three_halves, _mm256_mul_pd(h, _mm256_mul_pd(r, r))));
+
+      __m256d ok = _mm256_and_pd(_mm256_cmp_pd(l2, low, _CMP_GE_OQ),
+                                 _mm256_cmp_pd(l2, high, _CMP_LE_OQ));
+      if (_mm256_movemask_pd(ok) == 0xF) {
+        _mm256_storeu_pd(x + i, _mm256_mul_pd(vx, r));
+        _mm256_storeu_pd(y + i, _mm256_mul_pd(vy, r));
+        _mm256_storeu_pd(z + i, _mm256_mul_pd(vz, r));
+      } else {
+        unsigned k;
+        for (k = 0; k < 4; ++k) {
+          normalise_scalar(x[i + k], y[i + k], z[i + k]);
+        }
+      }
+    }
+    return i;
+  }
+
+#elif defined(__SSE2__)
+
+  static size_t normalise_vector(double* x, double* y, double* z,
+                                 size_t count) {
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d three_halves = _mm_set1_pd(1.5);
+    const __m128d low = _mm_set1_pd(MIN_VECTOR_LENGTH2);
+    const __m128d high = _mm_set1_pd(MAX_VECTOR_LENGTH2);
+    size_t i;
+    for (i = 0; i + 2 <= count; i += 2) {
+      __m128d vx = _mm_loadu_pd(x + i);
+      __m128d vy = _mm_loadu_pd(y + i);
+      __m128d vz = _mm_loadu_pd(z + i);
+      __m128d l2 = _mm_mul_pd(vx, vx);
+      l2 = _mm_add_pd(l2, _mm_mul_pd(vy, vy));
+      l2 = _mm_add_pd(l2, _mm_mul_pd(vz, vz));
+
+      __m128d r = _mm_cvtps_pd(_mm_rsqrt_ps(_mm_cvtpd_ps(l2)));
+      __m128d h = _mm_mul_pd(half, l2);
+      // r = r * (1.5 - 0.5 * l2 * r * r), twice:
+      r = _mm_mul_pd(r, _mm_sub_pd(three_halves,
+                                   _mm_mul_pd(h, _mm_mul_pd(r, r))));
+      r = _mm_mul_pd(r, _mm_sub_pd(three_halves,
+                                   _mm_mul_pd(h, _mm_mul_pd(r, r))));
+
+      int bits = _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(l2, low),
+                                            _mm_cmple_pd(l2, high)));
+      if (bits == 0x3) {
+        _mm_storeu_pd(x + i, _mm_mul_pd(vx, r));
+        _mm_storeu_pd(y + i, _mm_mul_pd(vy, r));
+        _mm_storeu_pd(z + i, _mm_mul_pd(vz, r));
+      } else {
+        normalise_scalar(x[i], y[i], z[i]);
+        normalise_scalar(x[i + 1], y[i + 1], z[i + 1]);
+      }
+    }
+    return i;
+  }
+
+#else
+
+  static size_t normalise_vector(double*, double*, double*, size_t) {
+    return 0;
+  }
+
+#endif
+
+  void normalise_batch(double* x, double* y, double* z, size_t count) {
+    size_t i = normalise_vector(x, y, z, count);
+    for (; i < count; ++i) {
+      normalise_scalar(x[i], y[i], z[i]);
+    }
+  }
+
+  template <typename T>
+  void facet_normals_batch(basic_gvec_view<T> points,
+                           const facet_triples& facets,
+                           size_t first,
+                           size_t last,
+                           double* x,
+                           double* y,
+                           double* z) {
+    size_t f;
+    for (f = first; f < last; ++f) {
+      gvec o(points[facets[f][0]]);
+      gvec n = (gvec(points[facets[f][1]]) - o) ^
+               (gvec(points[facets[f][2]]) - o);
+      x[f - first] = n[0];
+      y[f - first] = n[1];
+      z[f - first] = n[2];
+    }
+    normalise_batch(x, y, z, last - first);
+  }
+
+  template void facet_normals_batch(gvec_view, const facet_triples&,
+                                    size_t, size_t,
+                                    double*, double*, double*);
+  template void facet_normals_batch(gvec32_view, const facet_triples&,
+                                    size_t, size_t,
+                                    double*, double*, double*);
+
+}
@@ -0,0 +1,695 @@
+/* layermesh/src/octree.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <octree.hpp>
+#include <binary.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <string.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  const uint32_t VoxelOctree::EMPTY;
+  const uint32_t VoxelOctree::FULL;
+
+  // the deepest octree built (so 2^20 voxels a side), which also keeps the
+  // indices of nodes and bricks within an entry's 30 bits for any sensible
+  // solid:
+  static const unsigned MAX_DEPTH = 20;
+  static const uint32_t MAX_INDEX = (1u << 30) - 1;
+  static const unsigned BRICK_DEPTH = 3;
+  static const uint32_t ENCODING_VERSION = 1;
+  // magic, version, origin and voxel, the grid's counts, depth and root, and
+  // the numbers of nodes and bricks:
+  static const size_t HEADER_BYTES = 4 + 4 + 4 * 8 + 3 * 4 + 4 + 4 + 2 * 8;
+
+  static bool is_node(uint32_t entry) { return (entry & 3) == 2; }
+  static bool is_brick(uint32_t entry) { return (entry & 3) == 3; }
+
+  // the depth of the smallest octree covering the grid.
+  static unsigned depth_for(const voxel_grid& grid) {
+    if (!(grid.voxel > 0.0) || grid.width == 0 || grid.height == 0 ||
+        grid.layers == 0) {
+      throw invalid_argument("VoxelOctree: the grid must have voxels of "
+                             "positive size.");
+    }
+    unsigned longest = max(grid.width, max(grid.height, grid.layers));
+    unsigned depth = BRICK_DEPTH;
+    while (depth <= MAX_DEPTH && (1u << depth) < longest) ++depth;
+    if (depth > MAX_DEPTH) {
+      throw invalid_argument("VoxelOctree: the grid is too large.");
+    }
+    return depth;
+  }
+
+  namespace {
+
+    // voxels [low[a], high[a]) along each axis a.
+    struct voxel_block {
+      unsigned low[3], high[3];
+    };
+
+    // the voxels of the grid whose centres may lie in the box (with one to
+    // spare on each side, against rounding.)
+    voxel_block block_meeting(const voxel_grid& grid, const gbox& box) {
+      voxel_block ret;
+      unsigned counts[3] = {grid.width, grid.height, grid.layers};
+      int a;
+      for (a = 0; a < 3; ++a) {
+        double low = floor((box.low[a] - grid.origin[a]) / grid.voxel - 0.5);
+        double high = ceil((box.high[a] - grid.origin[a]) / grid.voxel - 0.5);
+        low -= 1.0;
+        high += 2.0;
+        // (an empty or NaN box meets nothing:)
+        if (!(box.low[a] <= box.high[a])) low = high = 0.0;
+        ret.low[a] = low > 0.0 ? (low < counts[a] ? unsigned(low) : counts[a])
+                               : 0;
+        ret.high[a] = high > 0.0
+          ? (high < counts[a] ? unsigned(high) : counts[a]) : 0;
+      }
+      return ret;
+    }
+
+    // A tree built before, and the voxels whose occupancy may have changed
+    // since, for building it again from the parts which haven't.
+    struct octree_source {
+      uint32_t root;
+      const vector<uint32_t>& nodes;
+      const vector<octree_brick>& bricks;
+      vector<voxel_block> dirty;
+    };
+
+    template <typename S>
+    struct octree_builder {
+      const S& solid;
+      const voxel_grid& grid;
+      const octree_source* old;
+      vector<uint32_t> nodes;
+      vector<octree_brick> bricks;
+      // (scratch space for render_row:)
+      span_list spans;
+
+      octree_builder(const S& solid,
+                     const voxel_grid& grid,
+                     const octree_source* old)
+        : solid(solid), grid(grid), old(old) {};
+
+      // the centre of voxel i along axis a, computed just as render_slice
+      // computes it.
+      double centre(int a, unsigned i) const {
+        return grid.origin[a] + (i + 0.5) * grid.voxel;
+      }
+
+      // how the solid lies against the centres of the node's voxels which
+      // are within the grid (none, for a node beyond it.)
+      box_relation classify(unsigned i0, unsigned j0, unsigned k0,
+                            unsigned size) const {
+        if (i0 >= grid.width || j0 >= grid.height || k0 >= grid.layers) {
+          return box_outside;
+        }
+        unsigned i1 = min(i0 + size, grid.width);
+        unsigned j1 = min(j0 + size, grid.height);
+        unsigned k1 = min(k0 + size, grid.layers);
+        gbox box{gvec(centre(0, i0), centre(1, j0), centre(2, k0)),
+                 gvec(centre(0, i1 - 1), centre(1, j1 - 1),
+                      centre(2, k1 - 1))};
+        return solid.classify(box);
+      }
+
+      // whether the node meets any of the old tree's changed voxels.
+      bool dirty(unsigned i0, unsigned j0, unsigned k0, unsigned size) const {
+        unsigned start[3] = {i0, j0, k0};
+        size_t d;
+        int a;
+        for (d = 0; d < old->dirty.size(); ++d) {
+          const voxel_block& b = old->dirty[d];
+          for (a = 0; a < 3; ++a) {
+            if (b.high[a] <= start[a] || b.low[a] >= start[a] + size) break;
+          }
+          if (a == 3) return true;
+        }
+        return false;
+      }
+
+      // the old tree's entry for child c of a node whose entry was previous
+      // (a full or empty node stands for children all the same.)
+      uint32_t child_of(uint32_t previous, unsigned c) const {
+        return is_node(previous) ? old->nodes[(previous >> 2) + c] : previous;
+      }
+
+      // the entry for the node of size voxels a side at (i0, j0, k0),
+      // appending its descendants to nodes and bricks. When rebuilding, the
+      // old tree's entry for the node is previous, and is copied unless the
+      // node has changed.
+      uint32_t build(unsigned i0, unsigned j0, unsigned k0, unsigned size,
+                     uint32_t previous) {
+        if (old != NULL && !dirty(i0, j0, k0, size)) return copy(previous);
+        box_relation r = classify(i0, j0, k0, size);
+        if (r == box_outside) return VoxelOctree::EMPTY;
+        if (r == box_inside) return VoxelOctree::FULL;
+        if (size == OCTREE_BRICK) return brick(i0, j0, k0);
+        return split(i0, j0, k0, size, previous);
+      }
+
+      size_t new_block() {
+        size_t block = nodes.size();
+        if (block > MAX_INDEX) {
+          throw invalid_argument("VoxelOctree: too many nodes.");
+        }
+        nodes.resize(block + 8);
+        return block;
+      }
+
+      uint32_t new_brick(const octree_brick& b) {
+        if (bricks.size() > MAX_INDEX) {
+          throw invalid_argument("VoxelOctree: too many bricks.");
+        }
+        bricks.push_back(b);
+        return (uint32_t(bricks.size() - 1) << 2) | 3;
+      }
+
+      // (an old subtree, moved across whole.)
+      uint32_t copy(uint32_t previous) {
+        if (is_brick(previous)) return new_brick(old->bricks[previous >> 2]);
+        if (!is_node(previous)) return previous;
+        size_t block = new_block();
+        unsigned c;
+        for (c = 0; c < 8; ++c) {
+          uint32_t entry = copy(child_of(previous, c));
+          nodes[block + c] = entry;
+        }
+        return (uint32_t(block) << 2) | 2;
+      }
+
+      uint32_t split(unsigned i0, unsigned j0, unsigned k0, unsigned size,
+                     uint32_t previous) {
+        size_t block = new_block();
+        unsigned half = size / 2, c;
+        bool uniform = true;
+        for (c = 0; c < 8; ++c) {
+          uint32_t entry = build(i0 + (c & 1 ? half : 0),
+                                 j0 + (c & 2 ? half : 0),
+                                 k0 + (c & 4 ? half : 0), half,
+                                 child_of(previous, c));
+          nodes[block + c] = entry;
+          if (entry > VoxelOctree::FULL || entry != nodes[block]) {
+            uniform = false;
+          }
+        }
+        // (a merged node's children were the last appended, since their
+        // own were merged or never made.)
+        if (uniform) {
+          uint32_t entry = nodes[block];
+          nodes.resize(block);
+          return entry;
+        }
+        return (uint32_t(block) << 2) | 2;
+      }
+
+      uint32_t brick(unsigned i0, unsigned j0, unsigned k0) {
+        unsigned i1 = min(i0 + OCTREE_BRICK, grid.width);
+        unsigned j1 = min(j0 + OCTREE_BRICK, grid.height);
+        unsigned k1 = min(k0 + OCTREE_BRICK, grid.layers);
+        unsigned char row[OCTREE_BRICK];
+        octree_brick b;
+        memset(&b, 0, sizeof(b));
+        size_t n = 0, set = 0;
+        unsigned i, j, k;
+        for (k = k0; k < k1; ++k) {
+          for (j = j0; j < j1; ++j) {
+            render_row(solid, grid, j, k, i0, i1, row, spans);
+            for (i = i0; i < i1; ++i, ++n) {
+              if (!row[i - i0]) continue;
+              b.layers[k - k0] |= uint64_t(1) << ((i - i0) + 8 * (j - j0));
+              ++set;
+            }
+          }
+        }
+        if (set == 0) return VoxelOctree::EMPTY;
+        if (set == n) return VoxelOctree::FULL;
+        return new_brick(b);
+      }
+    };
+
+    // (an entry of one builder's, moved to follow others' nodes and bricks.)
+    uint32_t relocate(uint32_t entry, size_t node_base, size_t brick_base) {
+      if (is_node(entry)) return entry + (uint32_t(node_base) << 2);
+      if (is_brick(entry)) return entry + (uint32_t(brick_base) << 2);
+      return entry;
+    }
+
+  }
+
+  // Builds the tree of the solid over the grid into root, nodes and
+  // bricks, or (given the old tree) builds it again, reusing what hasn't
+  // changed.
+  template <typename S>
+  static void build_octree(const S& solid,
+                           const voxel_grid& grid,
+                           unsigned depth,
+                           unsigned threads,
+                           const octree_source* old,
+                           uint32_t& root,
+                           vector<uint32_t>& nodes,
+                           vector<octree_brick>& bricks) {
+    unsigned size = 1u << depth;
+    threads = min(resolve_threads(threads), 8u);
+    octree_builder<S> top(solid, grid, old);
+    uint32_t previous = old != NULL ? old->root : VoxelOctree::EMPTY;
+    if (threads <= 1 || size == OCTREE_BRICK ||
+        (old != NULL ? !top.dirty(0, 0, 0, size)
+                     : top.classify(0, 0, 0, size) != box_crossing)) {
+      root = top.build(0, 0, 0, size, previous);
+      nodes.swap(top.nodes);
+      bricks.swap(top.bricks);
+      return;
+    }
+    // (the octants are built separately, then laid out one after another
+    // behind the root's block.)
+    vector<octree_builder<S> > octants(8, top);
+    vector<uint32_t> entries(8);
+    vector<exception_ptr> errors(threads);
+    unsigned half = size / 2;
+    split_range(8, threads, [&](unsigned t, size_t first, size_t last) {
+      size_t c;
+      try {
+        for (c = first; c < last; ++c) {
+          entries[c] = octants[c].build(c & 1 ? half : 0, c & 2 ? half : 0,
+                                        c & 4 ? half : 0, half,
+                                        top.child_of(previous, c));
+        }
+      } catch (...) {
+        errors[t] = current_exception();
+      }
+    });
+    unsigned t, c;
+    for (t = 0; t < threads; ++t) {
+      if (errors[t]) rethrow_exception(errors[t]);
+    }
+
+    bool uniform = true;
+    for (c = 0; c < 8; ++c) {
+      if (entries[c] > VoxelOctree::FULL || entries[c] != entries[0]) {
+        uniform = false;
+      }
+    }
+    if (uniform) {
+      root = entries[0];
+      return;
+    }
+    nodes.assign(8, 0);
+    for (c = 0; c < 8; ++c) {
+      size_t node_base = nodes.size(), brick_base = bricks.size();
+      if (node_base + octants[c].nodes.size() > MAX_INDEX ||
+          brick_base + octants[c].bricks.size() > MAX_INDEX) {
+        throw invalid_argument("VoxelOctree: too many nodes.");
+      }
+      nodes[c] = relocate(entries[c], node_base, brick_base);
+      size_t i;
+      for (i = 0; i < octants[c].nodes.size(); ++i) {
+        nodes.push_back(relocate(octants[c].nodes[i], node_base, brick_base));
+      }
+      bricks.insert(bricks.end(), octants[c].bricks.begin(),
+                    octants[c].bricks.end());
+    }
+    root = 2;
+  }
+
+  VoxelOctree::VoxelOctree(const Solid& solid,
+                           const voxel_grid& grid,
+                           unsigned threads)
+    : _grid(grid), depth(depth_for(grid)) {
+    build_octree(solid, grid, depth, threads, NULL, root, nodes, bricks);
+  }
+
+  VoxelOctree::VoxelOctree(const Atom& atom,
+                           const voxel_grid& grid,
+                           unsigned threads)
+    : _grid(grid), depth(depth_for(grid)) {
+    build_octree(atom, grid, depth, threads, NULL, root, nodes, bricks);
+  }
+
+  void VoxelOctree::update(const Solid& solid,
+                           const vector<gbox>& changed,
+                           unsigned threads) {
+    octree_source old = {root, nodes, bricks, vector<voxel_block>()};
+    size_t i;
+    for (i = 0; i < changed.size(); ++i) {
+      voxel_block b = block_meeting(_grid, changed[i]);
+      if (b.low[0] < b.high[0] && b.low[1] < b.high[1] &&
+          b.low[2] < b.high[2]) {
+        old.dirty.push_back(b);
+      }
+    }
+    if (old.dirty.empty()) return;
+    uint32_t new_root;
+    vector<uint32_t> new_nodes;
+    vector<octree_brick> new_bricks;
+    build_octree(solid, _grid, depth, threads, &old, new_root, new_nodes,
+                 new_bricks);
+    root = new_root;
+    nodes.swap(new_nodes);
+    bricks.swap(new_bricks);
+  }
+
+  voxel_grid VoxelOctree::grid(unsigned level) const {
+    if (level > depth) {
+      throw invalid_argument("VoxelOctree::grid: no such level.");
+    }
+    voxel_grid ret = _grid;
+    unsigned scale = 1u << level;
+    ret.voxel = _grid.voxel * scale;
+    ret.width = (_grid.width + scale - 1) >> level;
+    ret.height = (_grid.height + scale - 1) >> level;
+    ret.layers = (_grid.layers + scale - 1) >> level;
+    return ret;
+  }
+
+  bool VoxelOctree::occupied(unsigned i, unsigned j, unsigned k) const {
+    if (i >= _grid.width || j >= _grid.height || k >= _grid.layers) {
+      return false;
+    }
+    uint32_t entry = root;
+    unsigned size = 1u << depth;
+    while (is_node(entry)) {
+      // (size is now the children's, which is the bit choosing between
+      // them.)
+      size >>= 1;
+      entry = nodes[(entry >> 2) + (i & size ? 1 : 0) + (j & size ? 2 : 0) +
+                    (k & size ? 4 : 0)];
+    }
+    if (!is_brick(entry)) return entry == FULL;
+    const octree_brick& b = bricks[entry >> 2];
+    return (b.layers[k % OCTREE_BRICK] >>
+            (i % OCTREE_BRICK + OCTREE_BRICK * (j % OCTREE_BRICK))) & 1;
+  }
+
+  bool VoxelOctree::contains(const gvec& point) const {
+    double index[3];
+    unsigned counts[3] = {_grid.width, _grid.height, _grid.layers};
+    int a;
+    for (a = 0; a < 3; ++a) {
+      index[a] = floor((point[a] - _grid.origin[a]) / _grid.voxel);
+      // (NaN is refused here too.)
+      if (!(index[a] >= 0.0 && index[a] < counts[a])) return false;
+    }
+    return occupied(static_cast<unsigned>(index[0]),
+                    static_cast<unsigned>(index[1]),
+                    static_cast<unsigned>(index[2]));
+  }
+
+  namespace {
+
+    // Counts the occupied voxels under each pixel of a slice of a coarser
+    // grid (level levels up), between layers k0 and k1 of the octree's.
+    struct slice_counter {
+      const vector<uint32_t>& nodes;
+      const vector<octree_brick>& bricks;
+      const voxel_grid& grid;
+      unsigned level, width, k0, k1;
+      vector<uint64_t>& counts;
+
+      // adds the voxels [i0, i1) x [j0, j1) x [z0, z1), all occupied.
+      void add_block(unsigned i0, unsigned i1, unsigned j0, unsigned j1,
+                     unsigned z0, unsigned z1) {
+        unsigned px, py;
+        uint64_t depth = z1 - z0;
+        for (py = j0 >> level; py <= (j1 - 1) >> level; ++py) {
+          uint64_t dy = min(j1, (py + 1) << level) - max(j0, py << level);
+          for (px = i0 >> level; px <= (i1 - 1) >> level; ++px) {
+            uint64_t dx = min(i1, (px + 1) << level) - max(i0, px << level);
+            counts[size_t(py) * width + px] += dx * dy * depth;
+          }
+        }
+      }
+
+      void add(uint32_t entry, unsigned i0, unsigned j0, unsigned z0,
+               unsigned size) {
+        if (entry == VoxelOctree::EMPTY || i0 >= grid.width ||
+            j0 >= grid.height || z0 >= k1 || z0 + size <= k0) {
+          return;
+        }
+        if (entry == VoxelOctree::FULL) {
+          add_block(i0, min(i0 + size, grid.width), j0,
+                    min(j0 + size, grid.height), max(z0, k0),
+                    min(z0 + size, k1));
+          return;
+        }
+        if (is_node(entry)) {
+          unsigned half = size / 2, c;
+          for (c = 0; c < 8; ++c) {
+            add(nodes[(entry >> 2) + c], i0 + (c & 1 ? half : 0),
+                j0 + (c & 2 ? half : 0), z0 + (c & 4 ? half : 0), half);
+          }
+          return;
+        }
+        const octree_brick& b = bricks[entry >> 2];
+        unsigned k, bit;
+        for (k = max(z0, k0); k < min(z0 + size, k1); ++k) {
+          uint64_t word = b.layers[k - z0];
+          for (bit = 0; word != 0; ++bit, word >>= 1) {
+            if (!(word & 1)) continue;
+            unsigned i = i0 + bit % OCTREE_BRICK;
+            unsigned j = j0 + bit / OCTREE_BRICK;
+            if (i < grid.width && j < grid.height) {
+              ++counts[size_t(j >> level) * width + (i >> level)];
+            }
+          }
+        }
+      }
+    };
+
+  }
+
+  void VoxelOctree::slice(unsigned layer,
+                          unsigned char* pixels,
+                          unsigned level) const {
+    voxel_grid coarse = grid(level);
+    if (layer >= coarse.layers) {
+      throw invalid_argument("VoxelOctree::slice: no such layer.");
+    }
+    unsigned scale = 1u << level;
+    unsigned k0 = layer << level;
+    unsigned k1 = min(k0 + scale, _grid.layers);
+    vector<uint64_t> counts(size_t(coarse.width) * coarse.height, 0);
+    slice_counter counter = {nodes, bricks, _grid, level, coarse.width, k0,
+                             k1, counts};
+    counter.add(root, 0, 0, 0, 1u << depth);
+
+    unsigned px, py;
+    for (py = 0; py < coarse.height; ++py) {
+      uint64_t dy = min(_grid.height, (py + 1) << level) - (py << level);
+      for (px = 0; px < coarse.width; ++px) {
+        uint64_t dx = min(_grid.width, (px + 1) << level) - (px << level);
+        uint64_t total = dx * dy * (k1 - k0);
+        size_t p = size_t(py) * coarse.width + px;
+        pixels[p] = static_cast<unsigned char>(
+          (counts[p] * 255 + total / 2) / total);
+      }
+    }
+  }
+
+  void VoxelOctree::write_tiff(const string& filename,
+                               unsigned level,
+                               tiff_compression compression) const {
+    voxel_grid coarse = grid(level);
+    TiffWriter out(filename, coarse.width, coarse.height, compression);
+    vector<unsigned char> pixels(size_t(coarse.width) * coarse.height);
+    unsigned layer;
+    for (layer = 0; layer < coarse.layers; ++layer) {
+      slice(layer, &pixels[0], level);
+      out.write_page(&pixels[0]);
+    }
+    out.close();
+  }
+
+  void VoxelOctree::encode(vector<unsigned char>& out) const {
+    out.clear();
+    out.reserve(HEADER_BYTES + memory());
+    const char magic[4] = {'L', 'M', 'V', 'O'};
+    out.insert(out.end(), magic, magic + 4);
+    put32(out, ENCODING_VERSION);
+    int a;
+    for (a = 0; a < 3; ++a) put_double(out, _grid.origin[a]);
+    put_double(out, _grid.voxel);
+    put32(out, _grid.width);
+    put32(out, _grid.height);
+    put32(out, _grid.layers);
+    put32(out, depth);
+    put32(out, root);
+    put64(out, nodes.size());
+    put64(out, bricks.size());
+    size_t i;
+    unsigned k;
+    for (i = 0; i < nodes.size(); ++i) put32(out, nodes[i]);
+    for (i = 0; i < bricks.size(); ++i) {
+      for (k = 0; k < OCTREE_BRICK; ++k) put64(out, bricks[i].layers[k]);
+    }
+  }
+
+  VoxelOctree::VoxelOctree(const unsigned char* data, size_t size) {
+    if (size < HEADER_BYTES || memcmp(data, "LMVO", 4) != 0) {
+      throw invalid_argument("VoxelOctree: not an encoded octree.");
+    }
+    if (get_uint(data + 4, 4) != ENCODING_VERSION) {
+      throw invalid_argument("VoxelOctree: unknown encoding version.");
+    }
+    const unsigned char* p = data + 8;
+    int a;
+    for (a = 0; a < 3; ++a, p += 8) _grid.origin[a] = get_double(p);
+    _grid.voxel = get_double(p);
+    _grid.width = get_uint(p + 8, 4);
+    _grid.height = get_uint(p + 12, 4);
+    _grid.layers = get_uint(p + 16, 4);
+    depth = get_uint(p + 20, 4);
+    root = get_uint(p + 24, 4);
+    uint64_t node_total = get_uint(p + 28, 8);
+    uint64_t brick_total = get_uint(p + 36, 8);
+    if (depth != depth_for(_grid)) {
+      throw invalid_argument("VoxelOctree: the depth doesn't fit the grid.");
+    }
+    // (checked before anything is allocated for them:)
+    uint64_t body = size - HEADER_BYTES;
+    if (node_total > body / 4 || brick_total > body / sizeof(octree_brick) ||
+        body != node_total * 4 + brick_total * sizeof(octree_brick)) {
+      throw invalid_argument("VoxelOctree: the data is the wrong size.");
+    }
+    p = data + HEADER_BYTES;
+    nodes.resize(node_total);
+    bricks.resize(brick_total);
+    size_t i;
+    unsigned k;
+    for (i = 0; i < nodes.size(); ++i, p += 4) nodes[i] = get_uint(p, 4);
+    for (i = 0; i < bricks.size(); ++i) {
+      for (k = 0; k < OCTREE_BRICK; ++k, p += 8) {
+        bricks[i].layers[k] = get_uint(p, 8);
+      }
+    }
+    size_t seen = 0;
+    check_node(root, 1u << depth, seen);
+  }
+
+  void VoxelOctree::check_node(uint32_t entry,
+                               unsigned size,
+                               size_t& seen) const {
+    if (entry == EMPTY || entry == FULL) return;
+    size_t index = entry >> 2;
+    if (is_brick(entry)) {
+      if (size != OCTREE_BRICK || index >= bricks.size()) {
+        throw invalid_argument("VoxelOctree: a brick is misplaced.");
+      }
+      return;
+    }
+    // (a tree uses each block of children once, so seen can't pass the
+    // number of nodes unless some are shared, or the structure loops.)
+    seen += 8;
+    if (!is_node(entry) || size == OCTREE_BRICK ||
+        index + 8 > nodes.size() || seen > nodes.size()) {
+      throw invalid_argument("VoxelOctree: the nodes don't form a tree.");
+    }
+    unsigned c;
+    for (c = 0; c < 8; ++c) {
+      check_node(nodes[index + c], size / 2, seen);
+    }
+  }
+
+  void VoxelOctree::save(const string& filename) const {
+    vector<unsigned char> data;
+    encode(data);
+    write_file(filename, data.data(), data.size());
+  }
+
+  VoxelOctree VoxelOctree::load(const string& filename) {
+    vector<unsigned char> data = read_file(filename);
+    return VoxelOctree(data.empty() ? NULL : &data[0], data.size());
+  }
+
+  TiffStack::TiffStack(unsigned level, tiff_compression compression)
+    : level(level), compression(compression), written(), last_encoded(0) {}
+
+  void TiffStack::invalidate(const VoxelOctree& octree,
+                             const vector<gbox>& changed) {
+    size_t i;
+    unsigned layer;
+    for (i = 0; i < changed.size(); ++i) {
+      voxel_block b = block_meeting(octree.grid(), changed[i]);
+      if (b.low[0] >= b.high[0] || b.low[1] >= b.high[1]) continue;
+      for (layer = b.low[2] >> level;
+           layer < stale.size() && (layer << level) < b.high[2]; ++layer) {
+        stale[layer] = true;
+      }
+    }
+  }
+
+  void TiffStack::write(const string& filename,
+                        const VoxelOctree& octree,
+                        unsigned threads) {
+    voxel_grid coarse = octree.grid(level);
+    if (coarse.origin[0] != written.origin[0] ||
+        coarse.origin[1] != written.origin[1] ||
+        coarse.origin[2] != written.origin[2] ||
+        coarse.voxel != written.voxel || coarse.width != written.width ||
+        coarse.height != written.height || coarse.layers != pages.size()) {
+      written = coarse;
+      pages.assign(coarse.layers, vector<unsigned char>());
+      stale.assign(coarse.layers, true);
+    }
+    vector<unsigned> todo;
+    unsigned layer;
+    for (layer = 0; layer < coarse.layers; ++layer) {
+      if (stale[layer]) todo.push_back(layer);
+    }
+    threads = max(1u, min(resolve_threads(threads), unsigned(todo.size())));
+    vector<exception_ptr> errors(threads);
+    split_range(todo.size(), threads,
+                [&](unsigned t, size_t first, size_t last) {
+      vector<unsigned char> pixels(size_t(written.width) * written.height);
+      size_t i;
+      try {
+        for (i = first; i < last; ++i) {
+          octree.slice(todo[i], &pixels[0], level);
+          encode_tiff_page(&pixels[0], written.width, written.height,
+                           compression, pages[todo[i]]);
+        }
+      } catch (...) {
+        errors[t] = current_exception();
+      }
+    });
+    unsigned t;
+    for (t = 0; t < threads; ++t) {
+      if (errors[t]) rethrow_exception(errors[t]);
+    }
+    for (layer = 0; layer < coarse.layers; ++layer) {
+      stale[layer] = false;
+    }
+    last_encoded = todo.size();
+
+    TiffWriter out(filename, written.width, written.height, compression);
+    for (layer = 0; layer < coarse.layers; ++layer) {
+      out.write_encoded_page(pages[layer]);
+    }
+    out.close();
+  }
+
+}
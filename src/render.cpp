@@ -0,0 +1,390 @@
+/* layermesh/src/render.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <render.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <string.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  // render_tiff keeps up to this many pages per thread rendered but not yet
+  // written, so that a slow layer doesn't stall the others:
+  static const unsigned PAGES_PER_THREAD = 2;
+  // render_spans checks voxels whose centres are this close (in voxels) to
+  // the end of a span with contains(), since the span's ends are only exact
+  // up to rounding:
+  static const double SPAN_END_CHECK = 1e-4;
+  // (or, where the solid's contains() rounds more coarsely than that, this
+  // many times its relative_precision() of the coordinates' magnitude, as
+  // halfspaces_classify allows.)
+  static const double SPAN_END_ROUNDING = 16.0;
+
+  static void check_grid(const voxel_grid& grid) {
+    if (!(grid.voxel > 0.0) || grid.width == 0 || grid.height == 0 ||
+        grid.layers == 0) {
+      throw invalid_argument("voxel_grid: must have voxels of positive size.");
+    }
+  }
+
+  voxel_grid grid_covering(const gbox& box, double voxel) {
+    if (!(voxel > 0.0)) {
+      throw invalid_argument("grid_covering: voxel must be positive.");
+    }
+    voxel_grid grid;
+    grid.origin = box.low;
+    grid.voxel = voxel;
+    unsigned* counts[3] = {&grid.width, &grid.height, &grid.layers};
+    int a;
+    for (a = 0; a < 3; ++a) {
+      double extent = box.high[a] - box.low[a];
+      // (also refusing NaN and infinite boxes:)
+      if (!(extent >= 0.0) || !(extent / voxel < 1e9)) {
+        throw invalid_argument("grid_covering: the box must be finite and "
+                               "not empty.");
+      }
+      *counts[a] = max(1u, static_cast<unsigned>(ceil(extent / voxel)));
+    }
+    return grid;
+  }
+
+  // the range [first, last) of the n voxels along an axis whose centres may
+  // lie in [low, high] (rounded outwards; an empty or missed range gives
+  // first >= last.)
+  static void voxel_range(double low, double high, double origin,
+                          double voxel, unsigned n,
+                          unsigned& first, unsigned& last) {
+    double f = floor((low - origin) / voxel - 0.5);
+    double l = ceil((high - origin) / voxel - 0.5) + 1.0;
+    first = f > 0.0 ? (f < n ? static_cast<unsigned>(f) : n) : 0;
+    last = l > 0.0 ? (l < n ? static_cast<unsigned>(l) : n) : 0;
+  }
+
+  namespace {
+
+    // the coordinates and answers of one row of a slice, reused from row to
+    // row and slice to slice.
+    struct row_buffers {
+      vector<double> x, y, z;
+      vector<unsigned char> mask;
+      span_list spans;
+    };
+
+    void spans_of(const Solid& solid, double y, double z, double low,
+                  double high, span_list& spans) {
+      solid.scanline_spans(y, z, low, high, spans);
+    }
+
+    void spans_of(const Atom& atom, double y, double z, double low,
+                  double high, span_list& spans) {
+      span s;
+      if (!atom.scanline_span(y, z, s)) return;
+      s.enter = max(s.enter, low);
+      s.exit = min(s.exit, high);
+      if (s.enter <= s.exit) spans.push_back(s);
+    }
+
+  }
+
+  // fills the voxels [i0, i1) of a row whose centres are in its spans (out
+  // being voxel i0's byte.)
+  template <typename S>
+  static void fill_spans(const S& solid,
+                         const voxel_grid& grid,
+                         double y,
+                         double z,
+                         unsigned i0,
+                         unsigned i1,
+                         unsigned char* out,
+                         span_list& spans) {
+    double x0 = grid.origin[0] + 0.5 * grid.voxel;
+    // (the centres are computed just as render_sampled computes them.)
+    auto inside = [&](long i) {
+      return solid.contains(gvec(grid.origin[0] + (i + 0.5) * grid.voxel,
+                                 y, z));
+    };
+    spans.clear();
+    spans_of(solid, y, z, x0 + i0 * grid.voxel, x0 + (i1 - 1) * grid.voxel,
+             spans);
+    double scale = fabs(y) + fabs(z) +
+                   max(fabs(x0 + i0 * grid.voxel),
+                       fabs(x0 + (i1 - 1) * grid.voxel));
+    double band = max(SPAN_END_CHECK, SPAN_END_ROUNDING *
+                      solid.relative_precision() * scale / grid.voxel);
+    long low = i0, high = i1;
+    size_t s;
+    for (s = 0; s < spans.size(); ++s) {
+      // (the voxels are numbered from x0, so that the centre of voxel i is
+      // at i. A span narrower than a voxel may have first == last + 1, and
+      // still gain a voxel at one end below.)
+      double enter = (spans[s].enter - x0) / grid.voxel;
+      double exit = (spans[s].exit - x0) / grid.voxel;
+      long first = min(max(ceil(enter), double(low)), double(high));
+      long last = max(min(floor(exit), double(high - 1)), double(low - 1));
+      if (first > last + 1) continue;
+      // (each end moves past the voxels within band of it which contains()
+      // puts on the other side; usually none, or one.)
+      if (first < high && first - enter <= band && !inside(first)) {
+        do {
+          ++first;
+        } while (first < high && first - enter <= band && !inside(first));
+      } else {
+        while (first > low && enter - (first - 1) <= band &&
+               inside(first - 1)) {
+          --first;
+        }
+      }
+      if (last >= low && exit - last <= band && !inside(last)) {
+        do {
+          --last;
+        } while (last >= low && exit - last <= band && !inside(last));
+      } else {
+        while (last + 1 < high && (last + 1) - exit <= band &&
+               inside(last + 1)) {
+          ++last;
+        }
+      }
+      if (first <= last) {
+        memset(out + (first - low), 255, last - first + 1);
+      }
+    }
+  }
+
+  template <typename S>
+  static void render_slice_of(const S& solid,
+                              const voxel_grid& grid,
+                              unsigned layer,
+                              unsigned char* pixels,
+                              render_method method,
+                              row_buffers& row) {
+    memset(pixels, 0, size_t(grid.width) * grid.height);
+    gbox box = solid.get_aabb();
+    double z = grid.origin[2] + (layer + 0.5) * grid.voxel;
+    if (!(z >= box.low[2] && z <= box.high[2])) return;
+    unsigned i0, i1, j0, j1, i, j;
+    voxel_range(box.low[0], box.high[0], grid.origin[0], grid.voxel,
+                grid.width, i0, i1);
+    voxel_range(box.low[1], box.high[1], grid.origin[1], grid.voxel,
+                grid.height, j0, j1);
+    if (i0 >= i1 || j0 >= j1) return;
+
+    if (method == render_spans) {
+      for (j = j0; j < j1; ++j) {
+        fill_spans(solid, grid, grid.origin[1] + (j + 0.5) * grid.voxel, z,
+                   i0, i1, pixels + size_t(j) * grid.width + i0, row.spans);
+      }
+      return;
+    }
+
+    size_t n = i1 - i0;
+    row.x.resize(n);
+    row.y.resize(n);
+    row.z.assign(n, z);
+    row.mask.resize(n);
+    for (i = 0; i < n; ++i) {
+      row.x[i] = grid.origin[0] + (i0 + i + 0.5) * grid.voxel;
+    }
+    for (j = j0; j < j1; ++j) {
+      fill(row.y.begin(), row.y.end(),
+           grid.origin[1] + (j + 0.5) * grid.voxel);
+      solid.contains_batch(&row.x[0], &row.y[0], &row.z[0], n, &row.mask[0]);
+      unsigned char* out = pixels + size_t(j) * grid.width + i0;
+      for (i = 0; i < n; ++i) {
+        out[i] = row.mask[i] ? 255 : 0;
+      }
+    }
+  }
+
+  void render_row(const Solid& solid,
+                  const voxel_grid& grid,
+                  unsigned row,
+                  unsigned layer,
+                  unsigned i0,
+                  unsigned i1,
+                  unsigned char* out,
+                  span_list& spans) {
+    memset(out, 0, i1 - i0);
+    fill_spans(solid, grid, grid.origin[1] + (row + 0.5) * grid.voxel,
+               grid.origin[2] + (layer + 0.5) * grid.voxel, i0, i1, out,
+               spans);
+  }
+
+  void render_row(const Atom& atom,
+                  const voxel_grid& grid,
+                  unsigned row,
+                  unsigned layer,
+                  unsigned i0,
+                  unsigned i1,
+                  unsigned char* out,
+                  span_list& spans) {
+    memset(out, 0, i1 - i0);
+    fill_spans(atom, grid, grid.origin[1] + (row + 0.5) * grid.voxel,
+               grid.origin[2] + (layer + 0.5) * grid.voxel, i0, i1, out,
+               spans);
+  }
+
+  void render_slice(const Solid& solid,
+                    const voxel_grid& grid,
+                    unsigned layer,
+                    unsigned char* pixels,
+                    render_method method) {
+    check_grid(grid);
+    row_buffers row;
+    render_slice_of(solid, grid, layer, pixels, method, row);
+  }
+
+  void render_slice(const Atom& atom,
+                    const voxel_grid& grid,
+                    unsigned layer,
+                    unsigned char* pixels,
+                    render_method method) {
+    check_grid(grid);
+    row_buffers row;
+    render_slice_of(atom, grid, layer, pixels, method, row);
+  }
+
+  // The workers claim layers in order, but no further ahead of the writer
+  // (the calling thread) than the window of pages it holds; each renders
+  // and encodes its layer, and leaves it in the window for the writer to
+  // take. The first exception, on any thread, stops them all, and is
+  // rethrown once they have.
+  template <typename S>
+  static void render_tiff_of(const string& filename,
+                             const S& solid,
+                             const voxel_grid& grid,
+                             tiff_compression compression,
+                             unsigned threads,
+                             render_method method) {
+    check_grid(grid);
+    threads = min(resolve_threads(threads), grid.layers);
+    TiffWriter out(filename, grid.width, grid.height, compression);
+
+    const unsigned window = PAGES_PER_THREAD * threads;
+    vector<vector<unsigned char> > pages(window);
+    vector<bool> ready(window, false);
+    mutex lock;
+    condition_variable changed;
+    unsigned claimed = 0, written = 0;
+    bool stop = false;
+    exception_ptr error;
+
+    auto fail = [&](exception_ptr e) {
+      lock_guard<mutex> guard(lock);
+      if (!error) error = e;
+      stop = true;
+    };
+
+    auto work = [&]() {
+      row_buffers row;
+      vector<unsigned char> pixels(size_t(grid.width) * grid.height);
+      vector<unsigned char> strip;
+      while (true) {
+        unsigned layer;
+        {
+          unique_lock<mutex> guard(lock);
+          changed.wait(guard, [&]() {
+            return stop || claimed >= grid.layers ||
+                   claimed < written + window;
+          });
+          if (stop || claimed >= grid.layers) return;
+          layer = claimed++;
+        }
+        try {
+          render_slice_of(solid, grid, layer, &pixels[0], method, row);
+          encode_tiff_page(&pixels[0], grid.width, grid.height, compression,
+                           strip);
+        } catch (...) {
+          fail(current_exception());
+          changed.notify_all();
+          return;
+        }
+        {
+          lock_guard<mutex> guard(lock);
+          pages[layer % window].swap(strip);
+          ready[layer % window] = true;
+        }
+        changed.notify_all();
+      }
+    };
+
+    vector<thread> workers;
+    workers.reserve(threads);
+    unsigned t, layer;
+    try {
+      // (if a thread can't be started, those which were are stopped.)
+      for (t = 0; t < threads; ++t) {
+        workers.push_back(thread(work));
+      }
+      vector<unsigned char> page;
+      for (layer = 0; layer < grid.layers; ++layer) {
+        {
+          unique_lock<mutex> guard(lock);
+          changed.wait(guard, [&]() {
+            return stop || ready[layer % window];
+          });
+          if (stop) break;
+          page.swap(pages[layer % window]);
+          ready[layer % window] = false;
+          ++written;
+        }
+        changed.notify_all();
+        out.write_encoded_page(page);
+      }
+    } catch (...) {
+      fail(current_exception());
+    }
+    changed.notify_all();
+    for (t = 0; t < workers.size(); ++t) {
+      workers[t].join();
+    }
+    if (error) {
+      rethrow_exception(error);
+    }
+    out.close();
+  }
+
+  void render_tiff(const string& filename,
+                   const Solid& solid,
+                   const voxel_grid& grid,
+                   tiff_compression compression,
+                   unsigned threads,
+                   render_method method) {
+    render_tiff_of(filename, solid, grid, compression, threads, method);
+  }
+
+  void render_tiff(const string& filename,
+                   const Atom& atom,
+                   const voxel_grid& grid,
+                   tiff_compression compression,
+                   unsigned threads,
+                   render_method method) {
+    render_tiff_of(filename, atom, grid, compression, threads, method);
+  }
+
+}
@@ -0,0 +1,552 @@
+/* layermesh/src/slice.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <slice.hpp>
+#include <binary.hpp>
+#include <bounds.hpp>
+#include <bvh.hpp>
+#include <clip.hpp>
+#include <parallel.hpp>
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <string.h>
+#include <stdint.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  static const uint32_t ENCODING_VERSION = 1;
+  // magic, version and the number of layers:
+  static const size_t HEADER_BYTES = 4 + 4 + 8;
+
+  namespace {
+
+    // The index of the atoms' heights: their ranges of z, in a balanced
+    // binary tree kept in an array sorted by the bottoms of the ranges, each
+    // node also holding the highest top beneath it, so that the ranges
+    // spanning a height are found without looking at the rest.
+    class interval_index {
+      private:
+        vector<size_t> order;
+        vector<double> bottom, top, highest;
+        double build(size_t first, size_t last);
+        void stab(size_t first,
+                  size_t last,
+                  double height,
+                  vector<size_t>& out) const;
+      public:
+        interval_index() {};
+        interval_index(const vector<gbox>& boxes);
+        // sets out to the indices of the boxes spanning height, in order.
+        void stab(double height, vector<size_t>& out) const;
+    };
+
+    interval_index::interval_index(const vector<gbox>& boxes) {
+      size_t i;
+      for (i = 0; i < boxes.size(); ++i) order.push_back(i);
+      sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return boxes[a].low[2] < boxes[b].low[2];
+      });
+      for (i = 0; i < order.size(); ++i) {
+        bottom.push_back(boxes[order[i]].low[2]);
+        top.push_back(boxes[order[i]].high[2]);
+      }
+      highest.resize(order.size());
+      build(0, order.size());
+    }
+
+    // (the node of [first, last) is its middle, and the ranges either side
+    // of it its children.)
+    double interval_index::build(size_t first, size_t last) {
+      if (first >= last) return -numeric_limits<double>::infinity();
+      size_t middle = first + (last - first) / 2;
+      double h = max(top[middle], max(build(first, middle),
+                                      build(middle + 1, last)));
+      highest[middle] = h;
+      return h;
+    }
+
+    void interval_index::stab(size_t first,
+                              size_t last,
+                              double height,
+                              vector<size_t>& out) const {
+      if (first >= last) return;
+      size_t middle = first + (last - first) / 2;
+      if (highest[middle] < height) return;
+      stab(first, middle, height, out);
+      // (everything from here on starts above the node.)
+      if (bottom[middle] > height) return;
+      if (top[middle] >= height) out.push_back(order[middle]);
+      stab(middle + 1, last, height, out);
+    }
+
+    void interval_index::stab(double height, vector<size_t>& out) const {
+      out.clear();
+      stab(0, order.size(), height, out);
+      sort(out.begin(), out.end());
+    }
+
+    // The section by the plane z = height of the atom with the given planes
+    // (see planes_of) and box: the lines in which its planes meet it (set in
+    // lines, as upright planes with unit normals, so that their distances
+    // are true ones at any height), and a square about the atom's box,
+    // larger than it, cut by them. Empty if a plane parallel to the slice
+    // leaves it wholly outside. Its corners run anticlockwise, seen from
+    // above.
+    gvec_list section_of(const unit_planes& planes,
+                         const gbox& box,
+                         double height,
+                         double tolerance,
+                         unit_planes& lines) {
+      lines.clear();
+      size_t i;
+      for (i = 0; i < planes.size(); ++i) {
+        const gvec& n = planes[i].normal;
+        double offset = planes[i].offset - n[2] * height;
+        double across = sqrt(n[0] * n[0] + n[1] * n[1]);
+        // (a plane parallel to the slice keeps all of it, or none.)
+        if (across < 1e-12) {
+          if (offset < -tolerance) return gvec_list();
+          continue;
+        }
+        unit_plane l;
+        l.normal = gvec(n[0] / across, n[1] / across, 0.0);
+        l.offset = offset / across;
+        lines.push_back(l);
+      }
+      double half = modulus(box.high - box.low) + tolerance;
+      double x = 0.5 * (box.low[0] + box.high[0]);
+      double y = 0.5 * (box.low[1] + box.high[1]);
+      gvec_list section = {gvec(x - half, y - half, height),
+                           gvec(x + half, y - half, height),
+                           gvec(x + half, y + half, height),
+                           gvec(x - half, y + half, height)};
+      gvec_list back, front;
+      for (i = 0; i < lines.size() && !section.empty(); ++i) {
+        split(section, lines[i], tolerance, back, front);
+        section.swap(back);
+      }
+      return section;
+    }
+
+    // the section of one atom at the layer being sliced.
+    struct atom_section {
+      size_t atom;
+      gvec_list corners;
+      unit_planes lines;
+      gbox box;
+    };
+
+    class slicer {
+      private:
+        const Solid& solid;
+        vector<shared_ptr<const Atom> > atoms;
+        vector<gbox> boxes;
+        // (each atom's planes, normalised once for all the layers.)
+        vector<unit_planes> planes;
+        interval_index heights;
+        clip_tolerances tolerances;
+
+        // the pieces of the sections' edges on the outline of the solid
+        // (each its two ends), with the solid on their left.
+        vector<gvec_list> outline(const vector<atom_section>& sections) const;
+        vector<gvec_list> join(const vector<gvec_list>& pieces) const;
+      public:
+        slicer(const Solid& solid);
+        layer_contours slice(double height) const;
+    };
+
+    slicer::slicer(const Solid& solid) : solid(solid) {
+      solid.atoms(atoms);
+      if (atoms.empty()) return;
+      size_t i;
+      gbox all = atoms[0]->get_aabb();
+      for (i = 0; i < atoms.size(); ++i) {
+        boxes.push_back(atoms[i]->get_aabb());
+        planes.push_back(planes_of(*atoms[i]));
+        int a;
+        for (a = 0; a < 3; ++a) {
+          all.low[a] = min(all.low[a], boxes[i].low[a]);
+          all.high[a] = max(all.high[a], boxes[i].high[a]);
+        }
+      }
+      tolerances = clip_tolerances(all);
+      heights = interval_index(boxes);
+    }
+
+    vector<gvec_list> slicer::outline(
+      const vector<atom_section>& sections) const {
+      double tolerance = tolerances.on_plane, weld = tolerances.weld;
+      vector<gbox> section_boxes(sections.size());
+      size_t s, i, j, k;
+      for (s = 0; s < sections.size(); ++s) {
+        section_boxes[s] = sections[s].box;
+      }
+      Bvh hierarchy(section_boxes);
+      vector<gvec_list> found, pieces, next;
+      vector<size_t> others;
+      for (s = 0; s < sections.size(); ++s) {
+        const gvec_list& corners = sections[s].corners;
+        for (i = 0; i < corners.size(); ++i) {
+          gvec_list edge = {corners[i], corners[(i + 1) % corners.size()]};
+          gvec along = edge[1] - edge[0];
+          double length = modulus(along);
+          if (length <= weld) continue;
+          // (outwards, since the corners run anticlockwise.)
+          gvec normal(along[1] / length, -along[0] / length, 0.0);
+          gbox box = box_of(edge, tolerance);
+          others.clear();
+          hierarchy.overlapping(box, [&](size_t b) {
+            if (b != s && boxes_meet(section_boxes[b], box)) {
+              others.push_back(b);
+            }
+            return false;
+          });
+          sort(others.begin(), others.end());
+          pieces.assign(1, edge);
+          for (j = 0; j < others.size(); ++j) {
+            next.clear();
+            for (k = 0; k < pieces.size(); ++k) {
+              cut_by(pieces[k], sections[others[j]].lines, tolerance, next);
+            }
+            pieces.swap(next);
+          }
+          for (k = 0; k < pieces.size(); ++k) {
+            const gvec_list& piece = pieces[k];
+            if (modulus(piece[1] - piece[0]) <= weld) continue;
+            gvec middle = 0.5 * (piece[0] + piece[1]);
+            double least = clearance(middle, sections[s].lines, tolerance,
+                                     numeric_limits<double>::infinity());
+            for (j = 0; j < others.size(); ++j) {
+              least = clearance(middle, sections[others[j]].lines, tolerance,
+                                least);
+            }
+            double step = tolerances.step(least);
+            bool outside = solid.contains(middle + step * normal);
+            bool inside = solid.contains(middle - step * normal);
+            if (outside == inside) continue;
+            // (where an earlier section has an edge here too, the solid is
+            // the same either side of both, so that section's piece stands
+            // for both.)
+            bool shared = false;
+            for (j = 0; j < others.size() && others[j] < s && !shared; ++j) {
+              shared = shares_face(sections[others[j]].lines, middle, normal,
+                                   tolerance);
+            }
+            if (shared) continue;
+            found.push_back(piece);
+            // (with the solid on the right, the piece runs the other way.)
+            if (outside) reverse(found.back().begin(), found.back().end());
+          }
+        }
+      }
+      return found;
+    }
+
+    // whether corner b lies on the straight line from a to c, between them.
+    bool on_the_way(const gvec& a, const gvec& b, const gvec& c,
+                    double weld) {
+      gvec along = c - a, to_b = b - a;
+      double length = modulus(along);
+      if (length <= weld) return false;
+      double cross = along[0] * to_b[1] - along[1] * to_b[0];
+      double t = (to_b * along) / (length * length);
+      return fabs(cross) / length <= weld && t > 0.0 && t < 1.0;
+    }
+
+    vector<gvec_list> slicer::join(const vector<gvec_list>& pieces) const {
+      double weld = tolerances.weld;
+      // (ends within weld of one already seen are taken as that one.)
+      point_welder welder(weld);
+      vector<pair<unsigned, unsigned> > edges;
+      size_t i, j;
+      for (i = 0; i < pieces.size(); ++i) {
+        unsigned from = welder.add(pieces[i][0]), to = welder.add(pieces[i][1]);
+        if (from != to) edges.push_back(make_pair(from, to));
+      }
+      const gvec_list& corners = welder.points();
+
+      // (followed from corner to corner, taking the sharpest turn to the
+      // left where parts of the section meet at a corner, so that they
+      // stay apart.)
+      vector<vector<size_t> > leaving(corners.size());
+      for (i = 0; i < edges.size(); ++i) {
+        leaving[edges[i].first].push_back(i);
+      }
+      vector<bool> used(edges.size(), false);
+      vector<gvec_list> loops;
+      for (i = 0; i < edges.size(); ++i) {
+        if (used[i]) continue;
+        unsigned start = edges[i].first;
+        vector<unsigned> ring;
+        size_t e = i;
+        while (true) {
+          used[e] = true;
+          ring.push_back(edges[e].first);
+          unsigned at = edges[e].second;
+          if (at == start) break;
+          gvec in = corners[at] - corners[edges[e].first];
+          size_t best = edges.size();
+          double best_turn = -numeric_limits<double>::infinity();
+          for (size_t candidate : leaving[at]) {
+            if (used[candidate]) continue;
+            gvec out = corners[edges[candidate].second] - corners[at];
+            double turn = atan2(in[0] * out[1] - in[1] * out[0], in * out);
+            if (turn > best_turn) {
+              best_turn = turn;
+              best = candidate;
+            }
+          }
+          // (an outline left open by rounding is closed where it stops.)
+          if (best == edges.size()) break;
+          e = best;
+        }
+
+        // (dropping corners along straight edges.)
+        gvec_list loop;
+        for (j = 0; j < ring.size(); ++j) loop.push_back(corners[ring[j]]);
+        bool changed = true;
+        while (changed && loop.size() >= 3) {
+          changed = false;
+          for (j = 0; j < loop.size() && loop.size() >= 3; ++j) {
+            const gvec& before = loop[(j + loop.size() - 1) % loop.size()];
+            const gvec& after = loop[(j + 1) % loop.size()];
+            if (on_the_way(before, loop[j], after, weld)) {
+              loop.erase(loop.begin() + j);
+              --j;
+              changed = true;
+            }
+          }
+        }
+        if (loop.size() < 3) continue;
+        double twice_area = 0.0;
+        for (j = 0; j < loop.size(); ++j) {
+          const gvec& a = loop[j];
+          const gvec& b = loop[(j + 1) % loop.size()];
+          twice_area += a[0] * b[1] - a[1] * b[0];
+        }
+        if (fabs(twice_area) <= weld * weld) continue;
+        loops.push_back(loop);
+      }
+      return loops;
+    }
+
+    layer_contours slicer::slice(double height) const {
+      layer_contours layer;
+      layer.height = height;
+      vector<size_t> spanning;
+      heights.stab(height, spanning);
+      vector<atom_section> sections;
+      size_t i;
+      for (i = 0; i < spanning.size(); ++i) {
+        atom_section s;
+        s.atom = spanning[i];
+        s.corners = section_of(planes[s.atom], boxes[s.atom], height,
+                               tolerances.on_plane, s.lines);
+        if (s.corners.empty()) continue;
+        s.box = box_of(s.corners, tolerances.on_plane);
+        s.box.low[2] = s.box.high[2] = height;
+        sections.push_back(s);
+      }
+      if (!sections.empty()) layer.loops = join(outline(sections));
+      return layer;
+    }
+
+  }
+
+  vector<double> layer_heights(const gbox& box, double thickness) {
+    if (!(thickness > 0.0) || !(box.low[2] <= box.high[2])) {
+      throw invalid_argument("layer_heights: the layers must have positive "
+                             "thickness, and the box must not be empty.");
+    }
+    double count = max(1.0, ceil((box.high[2] - box.low[2]) / thickness));
+    if (count > double(numeric_limits<unsigned>::max())) {
+      throw invalid_argument("layer_heights: too many layers.");
+    }
+    size_t layers = size_t(count);
+    vector<double> heights(layers);
+    size_t k;
+    for (k = 0; k < heights.size(); ++k) {
+      heights[k] = box.low[2] + (k + 0.5) * thickness;
+    }
+    return heights;
+  }
+
+  vector<layer_contours> slice_layers(const Solid& solid,
+                                      const vector<double>& heights,
+                                      unsigned threads) {
+    slicer layers(solid);
+    vector<layer_contours> out(heights.size());
+    unsigned parts = resolve_threads(threads);
+    vector<exception_ptr> errors(parts);
+    split_range(heights.size(), parts,
+                [&](unsigned t, size_t first, size_t last) {
+      try {
+        size_t k;
+        for (k = first; k < last; ++k) out[k] = layers.slice(heights[k]);
+      } catch (...) {
+        errors[t] = current_exception();
+      }
+    });
+    unsigned t;
+    for (t = 0; t < parts; ++t) {
+      if (errors[t]) rethrow_exception(errors[t]);
+    }
+    return out;
+  }
+
+  void write_svg(const string& filename, const layer_contours& layer) {
+    double low[2] = {0.0, 0.0}, high[2] = {0.0, 0.0};
+    bool first = true;
+    size_t i, j;
+    for (i = 0; i < layer.loops.size(); ++i) {
+      for (j = 0; j < layer.loops[i].size(); ++j) {
+        const gvec& p = layer.loops[i][j];
+        int a;
+        for (a = 0; a < 2; ++a) {
+          // (y is turned upside down, as SVG's runs down the page.)
+          double v = a == 0 ? p[0] : -p[1];
+          low[a] = first ? v : min(low[a], v);
+          high[a] = first ? v : max(high[a], v);
+        }
+        first = false;
+      }
+    }
+    ostringstream svg;
+    svg.precision(10);
+    svg << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\""
+        << low[0] << " " << low[1] << " "
+        << max(high[0] - low[0], 1e-9) << " "
+        << max(high[1] - low[1], 1e-9) << "\">\n"
+        << "<!-- z = " << layer.height << " -->\n"
+        << "<path fill=\"black\" fill-rule=\"nonzero\" d=\"";
+    for (i = 0; i < layer.loops.size(); ++i) {
+      for (j = 0; j < layer.loops[i].size(); ++j) {
+        const gvec& p = layer.loops[i][j];
+        svg << (j == 0 ? "M" : " L") << p[0] << " " << -p[1];
+      }
+      svg << " Z\n";
+    }
+    svg << "\"/>\n</svg>\n";
+    string data = svg.str();
+    write_file(filename, data.data(), data.size());
+  }
+
+  void encode_layers(const vector<layer_contours>& layers,
+                     vector<unsigned char>& out) {
+    out.clear();
+    size_t bytes = HEADER_BYTES, k, i, j;
+    for (k = 0; k < layers.size(); ++k) {
+      bytes += 12;
+      for (i = 0; i < layers[k].loops.size(); ++i) {
+        bytes += 4 + 8 * layers[k].loops[i].size();
+      }
+    }
+    out.reserve(bytes);
+    const char magic[4] = {'L', 'M', 'S', 'L'};
+    out.insert(out.end(), magic, magic + 4);
+    put32(out, ENCODING_VERSION);
+    put64(out, layers.size());
+    for (k = 0; k < layers.size(); ++k) {
+      put_double(out, layers[k].height);
+      put32(out, layers[k].loops.size());
+      for (i = 0; i < layers[k].loops.size(); ++i) {
+        const gvec_list& loop = layers[k].loops[i];
+        put32(out, loop.size());
+        for (j = 0; j < loop.size(); ++j) {
+          put_float(out, loop[j][0]);
+          put_float(out, loop[j][1]);
+        }
+      }
+    }
+  }
+
+  vector<layer_contours> decode_layers(const unsigned char* data,
+                                       size_t size) {
+    if (size < HEADER_BYTES || memcmp(data, "LMSL", 4) != 0) {
+      throw invalid_argument("decode_layers: not encoded layers.");
+    }
+    if (get_uint(data + 4, 4) != ENCODING_VERSION) {
+      throw invalid_argument("decode_layers: unknown encoding version.");
+    }
+    uint64_t count = get_uint(data + 8, 8);
+    const unsigned char* p = data + HEADER_BYTES;
+    const unsigned char* end = data + size;
+    // (each count is checked against what is left before anything is
+    // allocated for it.)
+    if (count > uint64_t(end - p) / 12) {
+      throw invalid_argument("decode_layers: the data is too short.");
+    }
+    vector<layer_contours> layers(count);
+    size_t k, i, j;
+    for (k = 0; k < layers.size(); ++k) {
+      if (end - p < 12) {
+        throw invalid_argument("decode_layers: the data is too short.");
+      }
+      layer_contours& layer = layers[k];
+      layer.height = get_double(p);
+      uint64_t loops = get_uint(p + 8, 4);
+      p += 12;
+      if (loops > uint64_t(end - p) / 4) {
+        throw invalid_argument("decode_layers: the data is too short.");
+      }
+      layer.loops.resize(loops);
+      for (i = 0; i < layer.loops.size(); ++i) {
+        if (end - p < 4) {
+          throw invalid_argument("decode_layers: the data is too short.");
+        }
+        uint64_t corners = get_uint(p, 4);
+        p += 4;
+        if (corners > uint64_t(end - p) / 8) {
+          throw invalid_argument("decode_layers: the data is too short.");
+        }
+        gvec_list& loop = layer.loops[i];
+        loop.resize(corners);
+        for (j = 0; j < loop.size(); ++j, p += 8) {
+          loop[j] = gvec(get_float(p), get_float(p + 4), layer.height);
+        }
+      }
+    }
+    if (p != end) {
+      throw invalid_argument("decode_layers: the data is the wrong size.");
+    }
+    return layers;
+  }
+
+  void save_layers(const string& filename,
+                   const vector<layer_contours>& layers) {
+    vector<unsigned char> data;
+    encode_layers(layers, data);
+    write_file(filename, data.data(), data.size());
+  }
+
+  vector<layer_contours> load_layers(const string& filename) {
+    vector<unsigned char> data = read_file(filename);
+    return decode_layers(data.empty() ? NULL : &data[0], data.size());
+  }
+
+}
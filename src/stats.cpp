@@ -0,0 +1,302 @@
+/* layermesh/src/stats.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stats.hpp>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+
+using namespace std;
+
+namespace layermesh {
+
+  // Each thread records into a block of its own. Only that thread writes to
+  // it, so its counts are updated with a relaxed load and store rather than
+  // a locked add, but they are atomics so that get_stats() may read them at
+  // any time. When a thread exits, its block is folded into the retired
+  // totals, and kept for reuse by a later thread.
+
+  namespace {
+
+    // a slot of the per-thread table of atoms, which is open addressed:
+    struct atom_slot {
+      atomic<const Atom*> atom;
+      atomic<uint64_t> hits;
+      atomic<uint64_t> rejects;
+    };
+
+    // slots probed before an atom is counted in the overflow entry:
+    const unsigned MAX_PROBES = 16;
+
+    inline void bump(atomic<uint64_t>& count, uint64_t amount) {
+      count.store(count.load(memory_order_relaxed) + amount,
+                  memory_order_relaxed);
+    }
+
+    struct stats_block {
+      atomic<uint64_t> counters[NUM_STAT_COUNTERS];
+      atomic<uint64_t> nanoseconds[NUM_STAT_TIMERS];
+      atom_slot atoms[STATS_ATOMS_PER_THREAD];
+      atomic<uint64_t> overflow_hits;
+      atomic<uint64_t> overflow_rejects;
+
+      stats_block() {
+        clear();
+      }
+
+      void clear() {
+        unsigned i;
+        for (i = 0; i < NUM_STAT_COUNTERS; ++i) {
+          counters[i].store(0, memory_order_relaxed);
+        }
+        for (i = 0; i < NUM_STAT_TIMERS; ++i) {
+          nanoseconds[i].store(0, memory_order_relaxed);
+        }
+        for (i = 0; i < STATS_ATOMS_PER_THREAD; ++i) {
+          atoms[i].hits.store(0, memory_order_relaxed);
+          atoms[i].rejects.store(0, memory_order_relaxed);
+          atoms[i].atom.store(NULL, memory_order_relaxed);
+        }
+        overflow_hits.store(0, memory_order_relaxed);
+        overflow_rejects.store(0, memory_order_relaxed);
+      }
+
+      void count_contains(const Atom* atom, uint64_t hits, uint64_t rejects) {
+        size_t h = (reinterpret_cast<uintptr_t>(atom) >> 4) *
+                   0x9E3779B97F4A7C15ULL;
+        unsigned probe;
+        for (probe = 0; atom != NULL && probe < MAX_PROBES; ++probe) {
+          atom_slot& slot = atoms[(h + probe) % STATS_ATOMS_PER_THREAD];
+          const Atom* owner = slot.atom.load(memory_order_relaxed);
+          if (owner == NULL) {
+            // (the counts are already zero, so readers may see the atom
+            // before its first counts, but never another atom's.)
+            slot.atom.store(atom, memory_order_release);
+            owner = atom;
+          }
+          if (owner == atom) {
+            bump(slot.hits, hits);
+            bump(slot.rejects, rejects);
+            return;
+          }
+        }
+        bump(overflow_hits, hits);
+        bump(overflow_rejects, rejects);
+      }
+    };
+
+    typedef map<const Atom*, pair<uint64_t, uint64_t> > atom_totals;
+
+    // (the retired totals, and the blocks, guarded by lock.)
+    struct registry {
+      mutex lock;
+      vector<stats_block*> live;
+      vector<stats_block*> spare;
+      uint64_t counters[NUM_STAT_COUNTERS];
+      uint64_t nanoseconds[NUM_STAT_TIMERS];
+      atom_totals atoms;
+
+      registry() {
+        fill(counters, counters + NUM_STAT_COUNTERS, 0);
+        fill(nanoseconds, nanoseconds + NUM_STAT_TIMERS, 0);
+      }
+    };
+
+    // (never destroyed, since threads may exit after static destruction.)
+    registry& the_registry() {
+      static registry* r = new registry();
+      return *r;
+    }
+
+    // adds block's counts into the totals given.
+    void sum_block(const stats_block& block,
+                   uint64_t* counters,
+                   uint64_t* nanoseconds,
+                   atom_totals& atoms) {
+      unsigned i;
+      for (i = 0; i < NUM_STAT_COUNTERS; ++i) {
+        counters[i] += block.counters[i].load(memory_order_relaxed);
+      }
+      for (i = 0; i < NUM_STAT_TIMERS; ++i) {
+        nanoseconds[i] += block.nanoseconds[i].load(memory_order_relaxed);
+      }
+      for (i = 0; i < STATS_ATOMS_PER_THREAD; ++i) {
+        const Atom* atom = block.atoms[i].atom.load(memory_order_acquire);
+        if (atom != NULL) {
+          pair<uint64_t, uint64_t>& total = atoms[atom];
+          total.first += block.atoms[i].hits.load(memory_order_relaxed);
+          total.second += block.atoms[i].rejects.load(memory_order_relaxed);
+        }
+      }
+      uint64_t hits = block.overflow_hits.load(memory_order_relaxed);
+      uint64_t rejects = block.overflow_rejects.load(memory_order_relaxed);
+      if (hits + rejects > 0) {
+        pair<uint64_t, uint64_t>& total = atoms[NULL];
+        total.first += hits;
+        total.second += rejects;
+      }
+    }
+
+    // the calling thread's block, registered on first use and retired when
+    // the thread exits.
+    struct block_owner {
+      stats_block* block;
+
+      block_owner() {
+        registry& r = the_registry();
+        lock_guard<mutex> guard(r.lock);
+        if (r.spare.empty()) {
+          block = new stats_block();
+        } else {
+          block = r.spare.back();
+          r.spare.pop_back();
+        }
+        r.live.push_back(block);
+      }
+
+      ~block_owner() {
+        registry& r = the_registry();
+        lock_guard<mutex> guard(r.lock);
+        sum_block(*block, r.counters, r.nanoseconds, r.atoms);
+        r.live.erase(find(r.live.begin(), r.live.end(), block));
+        block->clear();
+        r.spare.push_back(block);
+      }
+    };
+
+    stats_block& this_thread_block() {
+      static thread_local block_owner owner;
+      return *owner.block;
+    }
+
+  }
+
+  bool stats_enabled() {
+#ifdef LAYERMESH_STATS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  stats_snapshot get_stats() {
+    stats_snapshot snapshot;
+    registry& r = the_registry();
+    lock_guard<mutex> guard(r.lock);
+    copy(r.counters, r.counters + NUM_STAT_COUNTERS, snapshot.counters);
+    copy(r.nanoseconds, r.nanoseconds + NUM_STAT_TIMERS, snapshot.nanoseconds);
+    atom_totals atoms(r.atoms);
+    vector<stats_block*>::const_iterator it = r.live.begin();
+    for (; it != r.live.end(); ++it) {
+      sum_block(**it, snapshot.counters, snapshot.nanoseconds, atoms);
+    }
+
+    atom_totals::const_iterator a = atoms.begin();
+    for (; a != atoms.end(); ++a) {
+      atom_stats s;
+      s.atom = a->first;
+      s.hits = a->second.first;
+      s.rejects = a->second.second;
+      snapshot.atoms.push_back(s);
+    }
+    return snapshot;
+  }
+
+  void reset_stats() {
+    registry& r = the_registry();
+    lock_guard<mutex> guard(r.lock);
+    fill(r.counters, r.counters + NUM_STAT_COUNTERS, 0);
+    fill(r.nanoseconds, r.nanoseconds + NUM_STAT_TIMERS, 0);
+    r.atoms.clear();
+    vector<stats_block*>::iterator it = r.live.begin();
+    for (; it != r.live.end(); ++it) {
+      (*it)->clear();
+    }
+  }
+
+  const char* stat_counter_name(stat_counter counter) {
+    static const char* names[NUM_STAT_COUNTERS] = {
+      "facets_encoded",
+      "bytes_written",
+      "contains_calls",
+      "contains_hits"
+    };
+    return names[counter];
+  }
+
+  const char* stat_timer_name(stat_timer timer) {
+    static const char* names[NUM_STAT_TIMERS] = {
+      "save_stl_ms",
+      "normals_ms",
+      "io_ms"
+    };
+    return names[timer];
+  }
+
+  void write_stats(ostream& out, const stats_snapshot& stats) {
+    unsigned i;
+    for (i = 0; i < NUM_STAT_COUNTERS; ++i) {
+      out << stat_counter_name(static_cast<stat_counter>(i)) << " "
+          << stats.counters[i] << "\n";
+    }
+    for (i = 0; i < NUM_STAT_TIMERS; ++i) {
+      out << stat_timer_name(static_cast<stat_timer>(i)) << " "
+          << stats.nanoseconds[i] / 1e6 << "\n";
+    }
+    vector<atom_stats>::const_iterator it = stats.atoms.begin();
+    for (; it != stats.atoms.end(); ++it) {
+      uint64_t calls = it->hits + it->rejects;
+      out << "atom " << static_cast<const void*>(it->atom)
+          << " hits " << it->hits << " rejects " << it->rejects
+          << " hit_ratio " << (calls ? double(it->hits) / calls : 0.0) << "\n";
+    }
+  }
+
+  namespace stats {
+
+    void add(stat_counter counter, uint64_t amount) {
+      bump(this_thread_block().counters[counter], amount);
+    }
+
+    void add_time(stat_timer timer, uint64_t nanoseconds) {
+      bump(this_thread_block().nanoseconds[timer], nanoseconds);
+    }
+
+    void count_contains(const Atom* atom, uint64_t hits, uint64_t rejects) {
+      stats_block& block = this_thread_block();
+      bump(block.counters[STAT_CONTAINS_CALLS], hits + rejects);
+      bump(block.counters[STAT_CONTAINS_HITS], hits);
+      block.count_contains(atom, hits, rejects);
+    }
+
+    void count_contains_batch(const Atom* atom,
+                              const unsigned char* mask,
+                              size_t count) {
+      uint64_t hits = 0;
+      size_t i;
+      for (i = 0; i < count; ++i) {
+        hits += mask[i];
+      }
+      count_contains(atom, hits, count - hits);
+    }
+
+  }
+
+}
@@ -0,0 +1,546 @@
+/* layermesh/src/stl.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stl.hpp>
+#include <normals.hpp>
+#include <parallel.hpp>
+#include <stats.hpp>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  // files up to this size are encoded into a single buffer by stl_auto:
+  static const size_t AUTO_BUFFER_LIMIT = 64 << 20;
+  // stl_streamed encodes this many facets per chunk, and hands the kernel
+  // STREAM_CHUNKS chunks per writev() call:
+  static const size_t STREAM_CHUNK_FACETS = 16384;
+  static const unsigned STREAM_CHUNKS = 4;
+  // the ASCII writer flushes its buffer when there is less than a facet's
+  // worth of space (at most 7 lines of up to 70 chars) left in it:
+  static const size_t ASCII_BUFFER_BYTES = 1 << 20;
+  static const size_t ASCII_FACET_CHARS = 512;
+  // normals are computed in batches of this many facets at a time:
+  static const size_t NORMAL_BLOCK = 256;
+  // it isn't worth starting a thread for fewer facets than this:
+  static const size_t MIN_FACETS_PER_THREAD = 8192;
+
+  static void fail(const string& what, const string& filename) {
+    throw runtime_error(what + " " + filename + ": " + strerror(errno));
+  }
+
+  size_t binary_stl_size(size_t num_facets) {
+    return STL_HEADER_BYTES + STL_FACET_BYTES * num_facets;
+  }
+
+  void encode_binary_stl_header(char* buffer, size_t num_facets) {
+    memset(buffer, 0, 80);
+    memcpy(buffer, "layermesh", 9);
+    uint32_t n = static_cast<uint32_t>(num_facets);
+    memcpy(buffer + 80, &n, 4);
+  }
+
+  // writes 12 bytes (3 * float32) into the buffer.
+  template <typename T>
+  static inline void encode_vertex(char* buffer, const basic_gvec<T>& v) {
+    float r[3] = {
+      static_cast<float>(v[0]),
+      static_cast<float>(v[1]),
+      static_cast<float>(v[2])
+    };
+    memcpy(buffer, r, 12);
+  }
+
+  // Supplies the normal of each facet, either from a precomputed list or by
+  // computing them NORMAL_BLOCK at a time with facet_normals_batch. Facets
+  // must be asked for in order.
+  template <typename T>
+  class normal_source {
+    private:
+      basic_gvec_view<T> points;
+      const facet_triples& facets;
+      basic_gvec_view<T> normals;
+      size_t block_start, block_end;
+      double x[NORMAL_BLOCK], y[NORMAL_BLOCK], z[NORMAL_BLOCK];
+    public:
+      normal_source(basic_gvec_view<T> points,
+                    const facet_triples& facets,
+                    basic_gvec_view<T> normals)
+        : points(points), facets(facets), normals(normals),
+          block_start(0), block_end(0) {};
+
+      gvec operator()(size_t f) {
+        if (!normals.empty()) {
+          return gvec(normals[f]);
+        }
+        if (f >= block_end || f < block_start) {
+          block_start = f;
+          block_end = f + NORMAL_BLOCK;
+          if (block_end > facets.size()) block_end = facets.size();
+          LAYERMESH_TIME_SCOPE(STAT_TIME_NORMALS);
+          facet_normals_batch(points, facets, block_start, block_end, x, y, z);
+        }
+        size_t i = f - block_start;
+        return gvec(x[i], y[i], z[i]);
+      }
+  };
+
+  template <typename T>
+  void encode_binary_stl_facets(char* buffer,
+                                basic_gvec_view<T> points,
+                                const facet_triples& facets,
+                                basic_gvec_view<T> normals,
+                                size_t first,
+                                size_t last) {
+    const uint16_t attributes = 0;
+    normal_source<T> normal(points, facets, normals);
+    size_t f;
+    for (f = first; f < last; ++f, buffer += STL_FACET_BYTES) {
+      encode_vertex(buffer, normal(f));
+      encode_vertex(buffer + 12, points[facets[f][0]]);
+      encode_vertex(buffer + 24, points[facets[f][1]]);
+      encode_vertex(buffer + 36, points[facets[f][2]]);
+      memcpy(buffer + 48, &attributes, 2);
+    }
+    LAYERMESH_COUNT(STAT_FACETS_ENCODED, last - first);
+  }
+
+  // encode_binary_stl_facets, with [first, last) split between threads (the
+  // calling thread takes the first range.)
+  template <typename T>
+  static void encode_facets(char* buffer,
+                            basic_gvec_view<T> points,
+                            const facet_triples& facets,
+                            basic_gvec_view<T> normals,
+                            size_t first,
+                            size_t last,
+                            unsigned threads) {
+    size_t count = last - first;
+    if (threads > count / MIN_FACETS_PER_THREAD) {
+      threads = count / MIN_FACETS_PER_THREAD;
+    }
+    if (threads <= 1) {
+      encode_binary_stl_facets(buffer, points, facets, normals, first, last);
+      return;
+    }
+
+    vector<thread> workers;
+    workers.reserve(threads - 1);
+    size_t per_thread = (count + threads - 1) / threads;
+    size_t start;
+    vector<thread>::iterator it;
+    try {
+      for (start = first + per_thread; start < last; start += per_thread) {
+        size_t end = start + per_thread < last ? start + per_thread : last;
+        workers.push_back(thread(encode_binary_stl_facets<T>,
+                                 buffer + (start - first) * STL_FACET_BYTES,
+                                 points, cref(facets), normals,
+                                 start, end));
+      }
+    } catch (...) {
+      // (a thread couldn't be started; those which were must finish before
+      // the buffer goes.)
+      for (it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+      }
+      throw;
+    }
+    encode_binary_stl_facets(buffer, points, facets, normals,
+                             first, first + per_thread);
+
+    for (it = workers.begin(); it != workers.end(); ++it) {
+      it->join();
+    }
+  }
+
+  // write()s all of the iovecs, resuming after partial writes.
+  static void write_all(int fd, struct iovec* iov, int count,
+                        const string& filename) {
+    LAYERMESH_TIME_SCOPE(STAT_TIME_IO);
+    while (count > 0) {
+      ssize_t written = writev(fd, iov, count);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        fail("couldn't write", filename);
+      }
+      LAYERMESH_COUNT(STAT_BYTES_WRITTEN, written);
+      size_t left = static_cast<size_t>(written);
+      while (count > 0 && left >= iov->iov_len) {
+        left -= iov->iov_len;
+        ++iov;
+        --count;
+      }
+      if (count > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+        iov->iov_len -= left;
+      }
+    }
+  }
+
+  template <typename T>
+  static void write_buffered(int fd,
+                             const string& filename,
+                             basic_gvec_view<T> points,
+                             const facet_triples& facets,
+                             basic_gvec_view<T> normals,
+                             unsigned threads) {
+    // (not a vector<char>, which would zero the whole buffer first.)
+    size_t size = binary_stl_size(facets.size());
+    unique_ptr<char[]> buffer(new char[size]);
+    encode_binary_stl_header(buffer.get(), facets.size());
+    encode_facets(buffer.get() + STL_HEADER_BYTES,
+                  points, facets, normals, 0, facets.size(), threads);
+
+    struct iovec iov;
+    iov.iov_base = buffer.get();
+    iov.iov_len = size;
+    write_all(fd, &iov, 1, filename);
+  }
+
+  template <typename T>
+  static void write_mapped(int fd,
+                           const string& filename,
+                           basic_gvec_view<T> points,
+                           const facet_triples& facets,
+                           basic_gvec_view<T> normals,
+                           unsigned threads) {
+    size_t size = binary_stl_size(facets.size());
+    if (ftruncate(fd, size) != 0) {
+      fail("couldn't resize", filename);
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      fail("couldn't map", filename);
+    }
+    char* buffer = static_cast<char*>(map);
+    encode_binary_stl_header(buffer, facets.size());
+    encode_facets(buffer + STL_HEADER_BYTES,
+                  points, facets, normals, 0, facets.size(), threads);
+    LAYERMESH_COUNT(STAT_BYTES_WRITTEN, size);
+    LAYERMESH_TIME_SCOPE(STAT_TIME_IO);
+    munmap(map, size);
+  }
+
+  template <typename T>
+  static void write_streamed(int fd,
+                             const string& filename,
+                             basic_gvec_view<T> points,
+                             const facet_triples& facets,
+                             basic_gvec_view<T> normals,
+                             unsigned threads) {
+    const size_t chunk_bytes = STREAM_CHUNK_FACETS * STL_FACET_BYTES;
+    char header[STL_HEADER_BYTES];
+    vector<char> buffer(STREAM_CHUNKS * chunk_bytes);
+    struct iovec iov[STREAM_CHUNKS + 1];
+
+    encode_binary_stl_header(header, facets.size());
+
+    size_t f = 0;
+    do {
+      int count = 0;
+      if (f == 0) {
+        iov[count].iov_base = header;
+        iov[count].iov_len = STL_HEADER_BYTES;
+        ++count;
+      }
+      // the chunks are contiguous in buffer, so are encoded in one go:
+      size_t batch = f;
+      size_t last = batch + STREAM_CHUNKS * STREAM_CHUNK_FACETS;
+      if (last > facets.size()) last = facets.size();
+      encode_facets(&buffer[0], points, facets, normals, batch, last,
+                    threads);
+      for (; f < last; f += STREAM_CHUNK_FACETS) {
+        size_t end = f + STREAM_CHUNK_FACETS < last ?
+                     f + STREAM_CHUNK_FACETS : last;
+        iov[count].iov_base = &buffer[(f - batch) * STL_FACET_BYTES];
+        iov[count].iov_len = (end - f) * STL_FACET_BYTES;
+        ++count;
+      }
+      write_all(fd, iov, count, filename);
+    } while (f < facets.size());
+  }
+
+  template <typename T>
+  void write_binary_stl(const string& filename,
+                        basic_gvec_view<T> points,
+                        const facet_triples& facets,
+                        stl_write_mode mode,
+                        unsigned threads,
+                        basic_gvec_view<T> normals) {
+    threads = resolve_threads(threads);
+
+    if (mode == stl_auto) {
+      if (threads > 1) {
+        mode = stl_mapped;
+      } else {
+        mode = binary_stl_size(facets.size()) <= AUTO_BUFFER_LIMIT ?
+               stl_buffered : stl_streamed;
+      }
+    }
+
+    int flags = O_CREAT | O_TRUNC | (mode == stl_mapped ? O_RDWR : O_WRONLY);
+    int fd = open(filename.c_str(), flags, 0666);
+    if (fd < 0) {
+      fail("couldn't open", filename);
+    }
+
+    try {
+      switch (mode) {
+        case stl_mapped:
+          write_mapped(fd, filename, points, facets, normals, threads);
+          break;
+        case stl_streamed:
+          write_streamed(fd, filename, points, facets, normals, threads);
+          break;
+        default:
+          write_buffered(fd, filename, points, facets, normals, threads);
+      }
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+
+    if (close(fd) != 0) {
+      fail("couldn't close", filename);
+    }
+  }
+
+  // powers of ten up to 1e22 are exact in a double:
+  static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  static inline double pow10(int e) {
+    return e <= 22 ? POW10[e] : POW10[22] * pow10(e - 22);
+  }
+
+  // v * 10^e, dividing for negative e so that it stays exact where possible.
+  static inline double scale10(double v, int e) {
+    return e >= 0 ? v * pow10(e) : v / pow10(-e);
+  }
+
+  static inline char* append(char* out, const char* s, size_t length) {
+    memcpy(out, s, length);
+    return out + length;
+  }
+
+  // A float has at most 9 significant decimal digits, and its exact value is
+  // representable in a double, as are the candidate decimals scaled back by a
+  // power of ten, so the shortest string is found by trying 1, 2, ... digits
+  // and keeping the first which converts back to the same float.
+  size_t format_stl_float(char* buffer, float v) {
+    char* out = buffer;
+    if (signbit(v)) {
+      *out++ = '-';
+    }
+    if (isnan(v)) {
+      return append(out, "nan", 3) - buffer;
+    }
+    if (isinf(v)) {
+      return append(out, "inf", 3) - buffer;
+    }
+
+    float target = fabsf(v);
+    double d = target;
+    if (d == 0.0) {
+      *out++ = '0';
+      return out - buffer;
+    }
+
+    // decimal exponent, so that 1 <= d / 10^k < 10 (log10 can be off by one
+    // either side of an exact power of ten):
+    int k = static_cast<int>(floor(log10(d)));
+    double mantissa = scale10(d, -k);
+    if (mantissa >= 10.0) {
+      ++k;
+    } else if (mantissa < 1.0) {
+      --k;
+    }
+
+    uint64_t n = 0;
+    int p;
+    for (p = 1; p <= 9; ++p) {
+      n = static_cast<uint64_t>(llround(scale10(d, p - 1 - k)));
+      int e = k;
+      if (n >= static_cast<uint64_t>(POW10[p])) {
+        // rounded up to the next power of ten, e.g. 9.99 -> 10.
+        n /= 10;
+        ++e;
+      }
+      if (static_cast<float>(scale10(static_cast<double>(n), e - p + 1)) ==
+          target) {
+        k = e;
+        break;
+      }
+    }
+    if (p > 9) {
+      p = 9;
+    }
+
+    while (p > 1 && n % 10 == 0) {
+      n /= 10;
+      --p;
+    }
+    char digits[9];
+    int i;
+    for (i = p - 1; i >= 0; --i) {
+      digits[i] = static_cast<char>('0' + n % 10);
+      n /= 10;
+    }
+
+    // %g, at the ostream's default precision of 6:
+    if (k < -4 || k >= 6) {
+      *out++ = digits[0];
+      if (p > 1) {
+        *out++ = '.';
+        out = append(out, digits + 1, p - 1);
+      }
+      *out++ = 'e';
+      *out++ = k < 0 ? '-' : '+';
+      int magnitude = k < 0 ? -k : k;
+      if (magnitude >= 10) {
+        *out++ = static_cast<char>('0' + magnitude / 10);
+      } else {
+        *out++ = '0';
+      }
+      *out++ = static_cast<char>('0' + magnitude % 10);
+    } else if (k >= 0) {
+      for (i = 0; i <= k; ++i) {
+        *out++ = i < p ? digits[i] : '0';
+      }
+      if (p > k + 1) {
+        *out++ = '.';
+        out = append(out, digits + k + 1, p - k - 1);
+      }
+    } else {
+      *out++ = '0';
+      *out++ = '.';
+      for (i = -1; i > k; --i) {
+        *out++ = '0';
+      }
+      out = append(out, digits, p);
+    }
+
+    return out - buffer;
+  }
+
+  template <typename T>
+  static inline char* append_vector(char* out, const basic_gvec<T>& v) {
+    out += format_stl_float(out, static_cast<float>(v[0]));
+    *out++ = ' ';
+    out += format_stl_float(out, static_cast<float>(v[1]));
+    *out++ = ' ';
+    out += format_stl_float(out, static_cast<float>(v[2]));
+    *out++ = '\n';
+    return out;
+  }
+
+  #define APPEND_LITERAL(out, s) append(out, s, sizeof(s) - 1)
+
+  template <typename T>
+  void write_ascii_stl(const string& filename,
+                       basic_gvec_view<T> points,
+                       const facet_triples& facets,
+                       basic_gvec_view<T> normals) {
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      fail("couldn't open", filename);
+    }
+
+    try {
+      vector<char> buffer(ASCII_BUFFER_BYTES);
+      char* const start = &buffer[0];
+      char* const limit = start + buffer.size() - ASCII_FACET_CHARS;
+      char* out = APPEND_LITERAL(start, "solid layermesh\n");
+      struct iovec iov;
+      normal_source<T> normal(points, facets, normals);
+
+      size_t f;
+      for (f = 0; f < facets.size(); ++f) {
+        const basic_gvec<T>& o = points[facets[f][0]];
+        const basic_gvec<T>& i = points[facets[f][1]];
+        const basic_gvec<T>& j = points[facets[f][2]];
+
+        out = APPEND_LITERAL(out, "  facet normal ");
+        out = append_vector(out, normal(f));
+        out = APPEND_LITERAL(out, "    outer loop\n      vertex ");
+        out = append_vector(out, o);
+        out = APPEND_LITERAL(out, "      vertex ");
+        out = append_vector(out, i);
+        out = APPEND_LITERAL(out, "      vertex ");
+        out = append_vector(out, j);
+        out = APPEND_LITERAL(out, "    endloop\n  endfacet\n");
+
+        if (out > limit) {
+          iov.iov_base = start;
+          iov.iov_len = out - start;
+          write_all(fd, &iov, 1, filename);
+          out = start;
+        }
+      }
+
+      LAYERMESH_COUNT(STAT_FACETS_ENCODED, facets.size());
+      out = APPEND_LITERAL(out, "endsolid layermesh\n");
+      iov.iov_base = start;
+      iov.iov_len = out - start;
+      write_all(fd, &iov, 1, filename);
+    } catch (...) {
+      close(fd);
+      throw;
+    }
+
+    if (close(fd) != 0) {
+      fail("couldn't close", filename);
+    }
+  }
+
+  #undef APPEND_LITERAL
+
+  template void encode_binary_stl_facets(char*, gvec_view,
+                                         const facet_triples&,
+                                         gvec_view, size_t, size_t);
+  template void encode_binary_stl_facets(char*, gvec32_view,
+                                         const facet_triples&,
+                                         gvec32_view, size_t, size_t);
+  template void write_binary_stl(const string&, gvec_view,
+                                 const facet_triples&, stl_write_mode,
+                                 unsigned, gvec_view);
+  template void write_binary_stl(const string&, gvec32_view,
+                                 const facet_triples&, stl_write_mode,
+                                 unsigned, gvec32_view);
+
+  template void write_ascii_stl(const string&, gvec_view,
+                                const facet_triples&, gvec_view);
+  template void write_ascii_stl(const string&, gvec32_view,
+                                const facet_triples&, gvec32_view);
+
+}
@@ -0,0 +1,426 @@
+/* layermesh/src/stl_reader.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stl_reader.hpp>
+#include <stl.hpp>
+#include <parallel.hpp>
+#include <stdexcept>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  // it isn't worth starting a thread for fewer vertices than this:
+  static const size_t MIN_VERTICES_PER_THREAD = 3 * 8192;
+  // the vertices are hash-partitioned into enough partitions that each has
+  // about this many, so that the table a partition is welded in (16 bytes per
+  // entry, at most half full) stays in cache:
+  static const size_t PARTITION_VERTICES = 1 << 15;
+  static const unsigned MAX_PARTITION_BITS = 12;
+  // vertices are numbered with uint32s, and this one marks an empty entry:
+  static const uint32_t NO_VERTEX = 0xFFFFFFFF;
+
+  static void fail(const string& what, const string& filename) {
+    throw runtime_error(what + " " + filename + ": " + strerror(errno));
+  }
+
+  static void malformed(const string& filename, const string& what) {
+    throw runtime_error(filename + " " + what + ".");
+  }
+
+  // A read-only mapping of a whole file, unmapped on destruction.
+  class mapped_file {
+    private:
+      mapped_file(const mapped_file&);
+      mapped_file& operator=(const mapped_file&);
+    public:
+      const char* data;
+      size_t size;
+
+      mapped_file(const string& filename) : data(NULL), size(0) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+          fail("couldn't open", filename);
+        }
+        struct stat st;
+        void* map = NULL;
+        if (fstat(fd, &st) == 0) {
+          size = st.st_size;
+          // (an empty file can't be mapped, and isn't an STL file anyway.)
+          map = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                         : NULL;
+        } else {
+          map = MAP_FAILED;
+        }
+        if (map == MAP_FAILED) {
+          int error = errno;
+          close(fd);
+          errno = error;
+          fail("couldn't map", filename);
+        }
+        close(fd);
+        if (map) {
+          // the whole file is about to be read, in parallel:
+          madvise(map, size, MADV_WILLNEED);
+          data = static_cast<const char*>(map);
+        }
+      };
+
+      ~mapped_file() {
+        if (data) {
+          munmap(const_cast<char*>(data), size);
+        }
+      };
+  };
+
+  // Where vertex s (that is, vertex s % 3 of facet s / 3) is stored, as three
+  // float32s: in place in a binary file, or in the array an ASCII file was
+  // parsed into.
+  struct vertex_source {
+    const char* data;
+    size_t facet_stride;
+
+    const char* operator()(size_t s) const {
+      return data + (s / 3) * facet_stride + (s % 3) * 12;
+    }
+  };
+
+  struct vertex_key {
+    uint32_t bits[3];
+
+    bool operator==(const vertex_key& other) const {
+      return bits[0] == other.bits[0] &&
+             bits[1] == other.bits[1] &&
+             bits[2] == other.bits[2];
+    }
+  };
+
+  static inline vertex_key key_of(const char* p) {
+    vertex_key k;
+    memcpy(k.bits, p, 12);
+    unsigned i;
+    for (i = 0; i < 3; ++i) {
+      // -0 welds with 0:
+      if (k.bits[i] == 0x80000000) k.bits[i] = 0;
+    }
+    return k;
+  }
+
+  // Coordinates are often round numbers, with only their top bits set, so
+  // every bit of the key has to reach every bit of the hash (this is the
+  // 64 bit finaliser from MurmurHash3.)
+  static inline uint32_t hash_of(const vertex_key& k) {
+    uint64_t h = (uint64_t(k.bits[0]) << 32 | k.bits[1]) ^
+                 (uint64_t(k.bits[2]) * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h);
+  }
+
+  // partitions are chosen by the top bits of the hash, and table slots within
+  // a partition by the bottom bits.
+  static inline size_t partition_of(uint32_t hash, unsigned bits) {
+    return bits ? hash >> (32 - bits) : 0;
+  }
+
+  // a vertex's key travels with it through the partitions, so that welding
+  // a partition reads only its own entries, sequentially, and not the file.
+  struct keyed_vertex {
+    vertex_key key;
+    uint32_t vertex;
+  };
+
+  // Welds the num_vertices vertices of source into points, and makes a facet
+  // of each consecutive three. Every pass is split between threads:
+  // 1. hash each vertex, counting how many land in each partition;
+  // 2. copy the keys into their partitions, in order;
+  // 3. weld each partition in its own table, finding for each vertex the
+  //    first vertex with the same key;
+  // 4. number the first occurrences in order, and copy them into points;
+  // 5. look up the point of every vertex of every facet.
+  template <typename T>
+  static void weld(const vertex_source& source,
+                   size_t num_vertices,
+                   unsigned threads,
+                   basic_gvec_list<T>& points,
+                   facet_triples& facets,
+                   const string& filename) {
+    if (num_vertices >= NO_VERTEX) {
+      malformed(filename, "has too many facets");
+    }
+    unsigned parts = threads;
+    if (parts > num_vertices / MIN_VERTICES_PER_THREAD) {
+      parts = num_vertices / MIN_VERTICES_PER_THREAD;
+    }
+    if (parts == 0) {
+      parts = 1;
+    }
+    unsigned bits = 0;
+    while (bits < MAX_PARTITION_BITS &&
+           (PARTITION_VERTICES << bits) < num_vertices) {
+      ++bits;
+    }
+    const size_t num_partitions = size_t(1) << bits;
+
+    // next[t * num_partitions + p] is first a count, and then the position
+    // in partitioned that part t writes its next vertex in partition p to.
+    vector<size_t> next(parts * num_partitions, 0);
+    vector<size_t> partition_start(num_partitions + 1);
+
+    split_range(num_vertices, parts,
+                [&](unsigned t, size_t begin, size_t end) {
+      size_t* count = &next[t * num_partitions];
+      size_t s;
+      for (s = begin; s < end; ++s) {
+        ++count[partition_of(hash_of(key_of(source(s))), bits)];
+      }
+    });
+
+    size_t total = 0;
+    size_t p;
+    unsigned t;
+    for (p = 0; p < num_partitions; ++p) {
+      partition_start[p] = total;
+      for (t = 0; t < parts; ++t) {
+        size_t count = next[t * num_partitions + p];
+        next[t * num_partitions + p] = total;
+        total += count;
+      }
+    }
+    partition_start[num_partitions] = total;
+
+    // (not vectors, which would zero them first.)
+    unique_ptr<keyed_vertex[]> partitioned(new keyed_vertex[num_vertices]);
+    split_range(num_vertices, parts,
+                [&](unsigned t, size_t begin, size_t end) {
+      size_t* position = &next[t * num_partitions];
+      size_t s;
+      for (s = begin; s < end; ++s) {
+        keyed_vertex v;
+        v.key = key_of(source(s));
+        v.vertex = s;
+        partitioned[position[partition_of(hash_of(v.key), bits)]++] = v;
+      }
+    });
+
+    // first[s] is the first vertex with the same key as vertex s (which may
+    // be s itself.)
+    unique_ptr<uint32_t[]> first(new uint32_t[num_vertices]);
+    split_range(num_partitions, parts,
+                [&](unsigned, size_t begin, size_t end) {
+      keyed_vertex empty;
+      empty.vertex = NO_VERTEX;
+      vector<keyed_vertex> table;
+      size_t p;
+      for (p = begin; p < end; ++p) {
+        size_t capacity = 16;
+        while (capacity < 2 * (partition_start[p + 1] - partition_start[p])) {
+          capacity <<= 1;
+        }
+        table.assign(capacity, empty);
+        const size_t mask = capacity - 1;
+
+        size_t i;
+        for (i = partition_start[p]; i < partition_start[p + 1]; ++i) {
+          const keyed_vertex& v = partitioned[i];
+          size_t slot = hash_of(v.key) & mask;
+          while (true) {
+            keyed_vertex& e = table[slot];
+            if (e.vertex == NO_VERTEX) {
+              e = v;
+              first[v.vertex] = v.vertex;
+              break;
+            }
+            if (e.key == v.key) {
+              first[v.vertex] = e.vertex;
+              break;
+            }
+            slot = (slot + 1) & mask;
+          }
+        }
+      }
+    });
+    partitioned.reset();
+
+    vector<size_t> part_points(parts + 1, 0);
+    split_range(num_vertices, parts,
+                [&](unsigned t, size_t begin, size_t end) {
+      size_t count = 0;
+      size_t s;
+      for (s = begin; s < end; ++s) {
+        if (first[s] == s) ++count;
+      }
+      part_points[t + 1] = count;
+    });
+    for (t = 0; t < parts; ++t) {
+      part_points[t + 1] += part_points[t];
+    }
+
+    // point[s] is the point number of vertex s, if it's a first occurrence.
+    unique_ptr<uint32_t[]> point(new uint32_t[num_vertices]);
+    points.resize(part_points[parts]);
+    split_range(num_vertices, parts,
+                [&](unsigned t, size_t begin, size_t end) {
+      uint32_t id = part_points[t];
+      size_t s;
+      for (s = begin; s < end; ++s) {
+        if (first[s] == s) {
+          float v[3];
+          memcpy(v, source(s), 12);
+          points[id] = basic_gvec<T>(v[0], v[1], v[2]);
+          point[s] = id++;
+        }
+      }
+    });
+
+    facets.resize(num_vertices / 3);
+    split_range(facets.size(), parts,
+                [&](unsigned, size_t begin, size_t end) {
+      size_t f;
+      for (f = begin; f < end; ++f) {
+        facets[f][0] = point[first[3 * f]];
+        facets[f][1] = point[first[3 * f + 1]];
+        facets[f][2] = point[first[3 * f + 2]];
+      }
+    });
+  }
+
+  static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+           c == '\f' || c == '\v';
+  }
+
+  // finds the next whitespace separated token in [p, end), and advances p
+  // past it. Returns false at the end of the file.
+  static inline bool next_token(const char*& p,
+                                const char* end,
+                                const char*& token,
+                                size_t& length) {
+    while (p < end && is_space(*p)) ++p;
+    if (p == end) {
+      return false;
+    }
+    token = p;
+    while (p < end && !is_space(*p)) ++p;
+    length = p - token;
+    return true;
+  }
+
+  static inline bool token_is(const char* token, size_t length,
+                              const char* word) {
+    return length == strlen(word) && memcmp(token, word, length) == 0;
+  }
+
+  // (the mapping isn't null terminated, so the token is copied before it is
+  // given to strtof.)
+  static float parse_float(const char* token, size_t length,
+                           const string& filename) {
+    char buffer[64];
+    if (length >= sizeof(buffer)) {
+      malformed(filename, "has a malformed vertex");
+    }
+    memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    char* stop;
+    float v = strtof(buffer, &stop);
+    if (stop != buffer + length) {
+      malformed(filename, "has a malformed vertex");
+    }
+    return v;
+  }
+
+  // Collects the coordinates following every "vertex" keyword; the rest of
+  // the file's structure (facet normals, loops, names) is not needed to weld
+  // the vertices, and so is only loosely checked.
+  static void parse_ascii(const mapped_file& file,
+                          const string& filename,
+                          vector<float>& coords) {
+    const char* p = file.data;
+    const char* end = file.data + file.size;
+    const char* token;
+    size_t length;
+    if (!next_token(p, end, token, length) ||
+        !token_is(token, length, "solid")) {
+      malformed(filename, "isn't an STL file");
+    }
+    while (next_token(p, end, token, length)) {
+      if (token_is(token, length, "vertex")) {
+        unsigned i;
+        for (i = 0; i < 3; ++i) {
+          if (!next_token(p, end, token, length)) {
+            malformed(filename, "ends part way through a vertex");
+          }
+          coords.push_back(parse_float(token, length, filename));
+        }
+      }
+    }
+    if (coords.size() % 9 != 0) {
+      malformed(filename, "has a facet without three vertices");
+    }
+  }
+
+  template <typename T>
+  void read_stl(const string& filename,
+                basic_gvec_list<T>& points,
+                facet_triples& facets,
+                unsigned threads) {
+    threads = resolve_threads(threads);
+    mapped_file file(filename);
+
+    // (ASCII files start with "solid", but so do the headers of some binary
+    // files, so the size is the more reliable test.)
+    if (file.size >= STL_HEADER_BYTES) {
+      uint32_t num_facets;
+      memcpy(&num_facets, file.data + 80, 4);
+      if (file.size == binary_stl_size(num_facets)) {
+        vertex_source source = {
+          file.data + STL_HEADER_BYTES + 12, STL_FACET_BYTES
+        };
+        weld(source, 3 * size_t(num_facets), threads,
+             points, facets, filename);
+        return;
+      }
+    }
+
+    vector<float> coords;
+    parse_ascii(file, filename, coords);
+    vertex_source source = {
+      reinterpret_cast<const char*>(coords.data()), 36
+    };
+    weld(source, coords.size() / 3, threads, points, facets, filename);
+  }
+
+  template void read_stl(const string&, gvec_list&, facet_triples&, unsigned);
+  template void read_stl(const string&, gvec32_list&, facet_triples&,
+                         unsigned);
+
+}
@@ -19,20 +19,26 @@
 
 #include <array>
 #include <tetrahedron.hpp>
+#include <stats.hpp>
 
 using namespace std;
 using namespace layermesh;
 
-void Tetrahedron::compute_centroid() {
+template <typename T>
+static basic_gvec<T> centroid_of(const basic_gvec<T>* points) {
+  basic_gvec<T> centroid;
   unsigned i;
   for (i = 0; i < 4; ++i) {
     centroid = centroid + points[i];
   }
 
-  centroid = centroid / 4.0;
+  return centroid / T(4);
 }
 
-void Tetrahedron::compute_normals_and_triples() {
+template <typename T>
+void layermesh::tetrahedron_facets(const basic_gvec<T>* points,
+                                   basic_gplane<T>* planes,
+                                   facet_triple* triples) {
   // Notice that index 0 of each inner array == outer index. This is relied
   // upon by the loop below to reduce indirection, and in contains() to find a
   // point on each facet to use as the origin.
@@ -43,15 +49,16 @@ void Tetrahedron::compute_normals_and_triples() {
     {{3, 2, 1}}
   }};
 
+  basic_gvec<T> centroid = centroid_of(points);
   unsigned i;
 
   for (i = 0; i < 4; ++i) {
     array<unsigned, 3> js(facet_indices[i]);
-    gvec normal = (points[js[1]] - points[i]) ^
-                  (points[js[2]] - points[i]);
-    double proj = normal * (centroid - points[i]);
-    if (proj > 0.0) {
-      normal = normal * -1.0;
+    basic_gvec<T> normal = (points[js[1]] - points[i]) ^
+                           (points[js[2]] - points[i]);
+    T proj = normal * (centroid - points[i]);
+    if (proj > T(0)) {
+      normal = normal * T(-1);
       // We also swap the indices, to make sure they satisfy:
       // normal = (v1 - v0) ^ (v2 - v0)
       // (where the normal points from the solid phase to the void.)
@@ -62,63 +69,166 @@ void Tetrahedron::compute_normals_and_triples() {
 
     normal = normal / layermesh::modulus(normal);
 
-    facet_normals.push_back(normal);
-    _facet_triples.push_back(js);
+    planes[i] = plane_through(points[i], normal);
+    triples[i] = js;
   }
 }
 
-memsafe_gvec_list Tetrahedron::point_cloud() {
-  return make_shared<gvec_list>(points);
+// (Tetrahedron keeps a double copy of its points only when they are stored in
+// another precision.)
+static void copy_cloud(const array<gvec, 4>&, array<gvec, 0>&) {}
+
+static void copy_cloud(const array<gvec32, 4>& points, array<gvec, 4>& cloud) {
+  unsigned i;
+  for (i = 0; i < 4; ++i) {
+    cloud[i] = gvec(points[i]);
+  }
+}
+
+static gvec_view view_cloud(const array<gvec, 4>& points,
+                            const array<gvec, 0>&) {
+  return points;
+}
+
+static gvec_view view_cloud(const array<gvec32, 4>&,
+                            const array<gvec, 4>& cloud) {
+  return cloud;
 }
 
-unsigned Tetrahedron::internal_points_start_index() const {
+template <typename T>
+void BasicTetrahedron<T>::init() {
+  tetrahedron_facets(points.data(), facet_planes.data(),
+                     _facet_triples.data());
+  copy_cloud(points, cloud);
+  boundary = minimal_sphere(point_cloud_view());
+  aabb = bounding_box(point_cloud_view());
+}
+
+template <typename T>
+gvec_view BasicTetrahedron<T>::point_cloud_view() const {
+  return view_cloud(points, cloud);
+}
+
+template <typename T>
+unsigned BasicTetrahedron<T>::internal_points_start_index() const {
   return 4;
 }
 
-gsphere Tetrahedron::get_boundary() {
-  gsphere ret;
-  ret.centre = centroid;
+template <typename T>
+gsphere BasicTetrahedron<T>::get_boundary() const {
+  return boundary;
+}
 
-  ret.radius = 0.0;
-  unsigned i;
-  double d;
+template <typename T>
+gbox BasicTetrahedron<T>::get_aabb() const {
+  return aabb;
+}
 
+template <typename T>
+memsafe_gplane_list BasicTetrahedron<T>::half_spaces() const {
+  std::shared_ptr<gplane_list> planes = make_shared<gplane_list>();
+  unsigned i;
   for (i = 0; i < 4; ++i) {
-    d = layermesh::modulus(ret.centre - points[i]);
-    if (d > ret.radius) {
-      ret.radius = d;
-    }
+    gplane p;
+    p.normal = gvec(facet_planes[i].normal);
+    p.offset = facet_planes[i].offset;
+    planes->push_back(p);
   }
+  return planes;
+}
 
-  return ret;
+template <typename T>
+bool BasicTetrahedron<T>::contains(gvec point) const {
+  bool inside = halfspaces_contain(facet_planes.data(), 4,
+                                   basic_gvec<T>(point));
+  LAYERMESH_COUNT_CONTAINS(this, inside, !inside);
+  return inside;
 }
 
-bool Tetrahedron::contains(gvec point) {
-  if (facet_normals.size() == 0) {
-    compute_normals_and_triples();
-  }
+template <typename T>
+bool BasicTetrahedron<T>::scanline_span(double y, double z, span& s) const {
+  return halfspaces_clip_x(facet_planes.data(), 4, y, z, s);
+}
 
-  bool contained = true;
-  unsigned i;
+template <typename T>
+box_relation BasicTetrahedron<T>::classify(const gbox& box) const {
+  return halfspaces_classify(facet_planes.data(), 4, box);
+}
 
-  for (i = 0; i < 4; ++i) {
-    double proj = facet_normals[i] * (point - points[i]);
+template <typename T>
+double BasicTetrahedron<T>::surface_distance(const gvec& point,
+                                             gvec& normal) const {
+  return halfspaces_distance(facet_planes.data(), 4, point, normal);
+}
 
-    if (proj > 0.0) {
-      contained = false;
-      break;
+// the batch is converted to the storage precision a block at a time (which is
+// a no-op when they already match), so the answers are the same as contains().
+template <typename T, typename U>
+static void contains_batch_as(const basic_gplane<T>* planes,
+                              const U* x,
+                              const U* y,
+                              const U* z,
+                              size_t count,
+                              unsigned char* mask) {
+  const size_t block = 256;
+  T bx[block], by[block], bz[block];
+  size_t start, i;
+  for (start = 0; start < count; start += block) {
+    size_t n = count - start < block ? count - start : block;
+    for (i = 0; i < n; ++i) {
+      bx[i] = static_cast<T>(x[start + i]);
+      by[i] = static_cast<T>(y[start + i]);
+      bz[i] = static_cast<T>(z[start + i]);
     }
+    halfspaces_contain_batch(planes, 4, bx, by, bz, n, mask + start);
   }
+}
 
-  return contained;
+template <typename T>
+static void contains_batch_as(const basic_gplane<T>* planes,
+                              const T* x,
+                              const T* y,
+                              const T* z,
+                              size_t count,
+                              unsigned char* mask) {
+  halfspaces_contain_batch(planes, 4, x, y, z, count, mask);
 }
 
-void Tetrahedron::save_stl(std::string filename, bool binary) {
-  if (_facet_triples.size() == 0) {
-    compute_normals_and_triples();
-  }
+template <typename T>
+void BasicTetrahedron<T>::contains_batch(const double* x,
+                                         const double* y,
+                                         const double* z,
+                                         size_t count,
+                                         unsigned char* mask) const {
+  contains_batch_as(facet_planes.data(), x, y, z, count, mask);
+  LAYERMESH_COUNT_CONTAINS_BATCH(this, mask, count);
+}
 
-  save_stl_inner(filename, binary, points, _facet_triples);
+template <typename T>
+void BasicTetrahedron<T>::contains_batch(const float* x,
+                                         const float* y,
+                                         const float* z,
+                                         size_t count,
+                                         unsigned char* mask) const {
+  contains_batch_as(facet_planes.data(), x, y, z, count, mask);
+  LAYERMESH_COUNT_CONTAINS_BATCH(this, mask, count);
 }
 
+template <typename T>
+void BasicTetrahedron<T>::save_stl(std::string filename, bool binary) {
+  facet_triples facets(_facet_triples.begin(), _facet_triples.end());
+  array<basic_gvec<T>, 4> normals;
+  unsigned i;
+  for (i = 0; i < 4; ++i) {
+    normals[i] = facet_planes[i].normal;
+  }
+
+  save_stl_inner(filename, binary, points, facets, normals);
+}
 
+template void layermesh::tetrahedron_facets(const gvec*, gplane*,
+                                            facet_triple*);
+template void layermesh::tetrahedron_facets(const gvec32*, gplane32*,
+                                            facet_triple*);
+template class layermesh::BasicTetrahedron<double>;
+template class layermesh::BasicTetrahedron<float>;
@@ -0,0 +1,414 @@
+/* layermesh/src/tetrahedron_soup.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tetrahedron_soup.hpp>
+#include <tetrahedron.hpp>
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+using namespace layermesh;
+
+// The arena's components: vertex v's coordinates are at VERTEX_X + v, etc,
+// and facet f's plane at NORMAL_X + f, ..., OFFSET + f.
+static const unsigned VERTEX_X = 0;
+static const unsigned VERTEX_Y = 4;
+static const unsigned VERTEX_Z = 8;
+static const unsigned NORMAL_X = 12;
+static const unsigned NORMAL_Y = 16;
+static const unsigned NORMAL_Z = 20;
+static const unsigned OFFSET = 24;
+static const unsigned COMPONENTS = 28;
+// the number of plane components, which start at NORMAL_X:
+static const unsigned PLANE_COMPONENTS = 16;
+
+// The first capacity allocated by push_back:
+static const size_t INITIAL_CAPACITY = 64;
+
+// Each any_contain_vector overload tests the point against as many whole
+// blocks of tetrahedra as it can, stopping at the first block with one that
+// contains it (and setting found), and returns the number of tetrahedra
+// done. planes holds the PLANE_COMPONENTS component arrays, in order. The
+// projections are accumulated in the same order as halfspaces_contain, so the
+// answers are the same.
+
+#if defined(__AVX2__)
+
+// four tetrahedra per instruction:
+static size_t any_contain_vector(const double* const* planes,
+                                 size_t count,
+                                 double x,
+                                 double y,
+                                 double z,
+                                 bool& found) {
+  const __m256d px = _mm256_set1_pd(x);
+  const __m256d py = _mm256_set1_pd(y);
+  const __m256d pz = _mm256_set1_pd(z);
+  size_t i;
+  unsigned f;
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m256d inside = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (f = 0; f < 4; ++f) {
+      __m256d s = _mm256_mul_pd(_mm256_loadu_pd(planes[f] + i), px);
+      s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_loadu_pd(planes[4 + f] + i),
+                                         py));
+      s = _mm256_add_pd(s, _mm256_mul_pd(_mm256_loadu_pd(planes[8 + f] + i),
+                                         pz));
+      inside = _mm256_and_pd(inside,
+          _mm256_cmp_pd(s, _mm256_loadu_pd(planes[12 + f] + i), _CMP_LE_OQ));
+    }
+    if (_mm256_movemask_pd(inside) != 0) {
+      found = true;
+      break;
+    }
+  }
+  return i;
+}
+
+// eight tetrahedra per instruction:
+static size_t any_contain_vector(const float* const* planes,
+                                 size_t count,
+                                 float x,
+                                 float y,
+                                 float z,
+                                 bool& found) {
+  const __m256 px = _mm256_set1_ps(x);
+  const __m256 py = _mm256_set1_ps(y);
+  const __m256 pz = _mm256_set1_ps(z);
+  size_t i;
+  unsigned f;
+  for (i = 0; i + 8 <= count; i += 8) {
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (f = 0; f < 4; ++f) {
+      __m256 s = _mm256_mul_ps(_mm256_loadu_ps(planes[f] + i), px);
+      s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(planes[4 + f] + i),
+                                         py));
+      s = _mm256_add_ps(s, _mm256_mul_ps(_mm256_loadu_ps(planes[8 + f] + i),
+                                         pz));
+      inside = _mm256_and_ps(inside,
+          _mm256_cmp_ps(s, _mm256_loadu_ps(planes[12 + f] + i), _CMP_LE_OQ));
+    }
+    if (_mm256_movemask_ps(inside) != 0) {
+      found = true;
+      break;
+    }
+  }
+  return i;
+}
+
+#elif defined(__SSE2__)
+
+// two tetrahedra per instruction:
+static size_t any_contain_vector(const double* const* planes,
+                                 size_t count,
+                                 double x,
+                                 double y,
+                                 double z,
+                                 bool& found) {
+  const __m128d px = _mm_set1_pd(x);
+  const __m128d py = _mm_set1_pd(y);
+  const __m128d pz = _mm_set1_pd(z);
+  size_t i;
+  unsigned f;
+  for (i = 0; i + 2 <= count; i += 2) {
+    __m128d inside = _mm_castsi128_pd(_mm_set1_epi32(-1));
+    for (f = 0; f < 4; ++f) {
+      __m128d s = _mm_mul_pd(_mm_loadu_pd(planes[f] + i), px);
+      s = _mm_add_pd(s, _mm_mul_pd(_mm_loadu_pd(planes[4 + f] + i), py));
+      s = _mm_add_pd(s, _mm_mul_pd(_mm_loadu_pd(planes[8 + f] + i), pz));
+      inside = _mm_and_pd(inside,
+                          _mm_cmple_pd(s, _mm_loadu_pd(planes[12 + f] + i)));
+    }
+    if (_mm_movemask_pd(inside) != 0) {
+      found = true;
+      break;
+    }
+  }
+  return i;
+}
+
+// four tetrahedra per instruction:
+static size_t any_contain_vector(const float* const* planes,
+                                 size_t count,
+                                 float x,
+                                 float y,
+                                 float z,
+                                 bool& found) {
+  const __m128 px = _mm_set1_ps(x);
+  const __m128 py = _mm_set1_ps(y);
+  const __m128 pz = _mm_set1_ps(z);
+  size_t i;
+  unsigned f;
+  for (i = 0; i + 4 <= count; i += 4) {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (f = 0; f < 4; ++f) {
+      __m128 s = _mm_mul_ps(_mm_loadu_ps(planes[f] + i), px);
+      s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(planes[4 + f] + i), py));
+      s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(planes[8 + f] + i), pz));
+      inside = _mm_and_ps(inside,
+                          _mm_cmple_ps(s, _mm_loadu_ps(planes[12 + f] + i)));
+    }
+    if (_mm_movemask_ps(inside) != 0) {
+      found = true;
+      break;
+    }
+  }
+  return i;
+}
+
+#else
+
+template <typename T>
+static size_t any_contain_vector(const T* const*, size_t, T, T, T, bool&) {
+  return 0;
+}
+
+#endif
+
+template <typename T>
+static inline bool inside_tetrahedron(const T* const* planes,
+                                      size_t i,
+                                      T x,
+                                      T y,
+                                      T z) {
+  unsigned f;
+  for (f = 0; f < 4; ++f) {
+    T s = planes[f][i] * x;
+    s = s + planes[4 + f][i] * y;
+    s = s + planes[8 + f][i] * z;
+    if (!(s <= planes[12 + f][i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T>
+static bool any_contain(const T* const* planes, size_t count, T x, T y, T z) {
+  bool found = false;
+  size_t i = any_contain_vector(planes, count, x, y, z, found);
+  if (found) {
+    return true;
+  }
+  for (; i < count; ++i) {
+    if (inside_tetrahedron(planes, i, x, y, z)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T, typename U>
+static void any_contain_batch(const T* const* planes,
+                              size_t num_tetrahedra,
+                              const U* x,
+                              const U* y,
+                              const U* z,
+                              size_t count,
+                              unsigned char* mask) {
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    mask[i] = any_contain(planes, num_tetrahedra, static_cast<T>(x[i]),
+                          static_cast<T>(y[i]), static_cast<T>(z[i])) ? 1 : 0;
+  }
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::grow(size_t new_capacity) {
+  vector<T> grown(COMPONENTS * new_capacity);
+  unsigned c;
+  size_t i;
+  for (c = 0; c < COMPONENTS; ++c) {
+    for (i = 0; i < _size; ++i) {
+      grown[c * new_capacity + i] = arena[c * capacity + i];
+    }
+  }
+  arena.swap(grown);
+  capacity = new_capacity;
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::reserve(size_t count) {
+  if (count > capacity) {
+    grow(count);
+  }
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::push_back(const basic_gvec_list<T>& points) {
+  if (points.size() != 4) {
+    throw invalid_argument("A tetrahedron has four points.");
+  }
+  array<basic_gvec<T>, 4> vertices;
+  unsigned v;
+  for (v = 0; v < 4; ++v) {
+    vertices[v] = points[v];
+  }
+  push_back(vertices);
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::push_back(const array<basic_gvec<T>, 4>& points) {
+  if (_size == capacity) {
+    grow(capacity ? 2 * capacity : INITIAL_CAPACITY);
+  }
+
+  array<basic_gplane<T>, 4> planes;
+  array<facet_triple, 4> triples;
+  tetrahedron_facets(points.data(), planes.data(), triples.data());
+
+  T* base = &arena[_size];
+  unsigned k;
+  for (k = 0; k < 4; ++k) {
+    base[(VERTEX_X + k) * capacity] = points[k][0];
+    base[(VERTEX_Y + k) * capacity] = points[k][1];
+    base[(VERTEX_Z + k) * capacity] = points[k][2];
+    base[(NORMAL_X + k) * capacity] = planes[k].normal[0];
+    base[(NORMAL_Y + k) * capacity] = planes[k].normal[1];
+    base[(NORMAL_Z + k) * capacity] = planes[k].normal[2];
+    base[(OFFSET + k) * capacity] = planes[k].offset;
+  }
+  ++_size;
+}
+
+template <typename T>
+basic_gvec<T> BasicTetrahedronSoup<T>::vertex(size_t tetrahedron,
+                                              unsigned v) const {
+  return basic_gvec<T>(component(VERTEX_X + v)[tetrahedron],
+                       component(VERTEX_Y + v)[tetrahedron],
+                       component(VERTEX_Z + v)[tetrahedron]);
+}
+
+template <typename T>
+basic_gplane<T> BasicTetrahedronSoup<T>::plane(size_t tetrahedron,
+                                               unsigned f) const {
+  basic_gplane<T> p;
+  p.normal = basic_gvec<T>(component(NORMAL_X + f)[tetrahedron],
+                           component(NORMAL_Y + f)[tetrahedron],
+                           component(NORMAL_Z + f)[tetrahedron]);
+  p.offset = component(OFFSET + f)[tetrahedron];
+  return p;
+}
+
+template <typename T>
+bool BasicTetrahedronSoup<T>::contains(size_t tetrahedron, gvec point) const {
+  array<basic_gplane<T>, 4> planes;
+  unsigned f;
+  for (f = 0; f < 4; ++f) {
+    planes[f] = plane(tetrahedron, f);
+  }
+  return halfspaces_contain(planes.data(), 4, basic_gvec<T>(point));
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::plane_arrays(const T** planes) const {
+  unsigned c;
+  for (c = 0; c < PLANE_COMPONENTS; ++c) {
+    planes[c] = component(NORMAL_X + c);
+  }
+}
+
+template <typename T>
+bool BasicTetrahedronSoup<T>::contains(gvec point) const {
+  if (_size == 0) {
+    return false;
+  }
+  const T* planes[PLANE_COMPONENTS];
+  plane_arrays(planes);
+  basic_gvec<T> p(point);
+  return any_contain(planes, _size, p[0], p[1], p[2]);
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::contains_batch(const double* x,
+                                             const double* y,
+                                             const double* z,
+                                             size_t count,
+                                             unsigned char* mask) const {
+  if (_size == 0) {
+    fill(mask, mask + count, 0);
+    return;
+  }
+  const T* planes[PLANE_COMPONENTS];
+  plane_arrays(planes);
+  any_contain_batch(planes, _size, x, y, z, count, mask);
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::contains_batch(const float* x,
+                                             const float* y,
+                                             const float* z,
+                                             size_t count,
+                                             unsigned char* mask) const {
+  if (_size == 0) {
+    fill(mask, mask + count, 0);
+    return;
+  }
+  const T* planes[PLANE_COMPONENTS];
+  plane_arrays(planes);
+  any_contain_batch(planes, _size, x, y, z, count, mask);
+}
+
+template <typename T>
+void BasicTetrahedronSoup<T>::save_stl(std::string filename, bool binary) {
+  if (_size > UINT_MAX / 4) {
+    throw runtime_error("Too many tetrahedra to index in an STL facet list.");
+  }
+
+  basic_gvec_list<T> points;
+  basic_gvec_list<T> normals;
+  facet_triples facets;
+  points.reserve(4 * _size);
+  normals.reserve(4 * _size);
+  facets.reserve(4 * _size);
+
+  array<basic_gvec<T>, 4> vertices;
+  array<basic_gplane<T>, 4> planes;
+  array<facet_triple, 4> triples;
+  size_t t;
+  unsigned k, j;
+  for (t = 0; t < _size; ++t) {
+    for (k = 0; k < 4; ++k) {
+      vertices[k] = vertex(t, k);
+      points.push_back(vertices[k]);
+    }
+    // (recomputing the triples gives the same orientation as the planes.)
+    tetrahedron_facets(vertices.data(), planes.data(), triples.data());
+    for (k = 0; k < 4; ++k) {
+      for (j = 0; j < 3; ++j) {
+        triples[k][j] += 4 * t;
+      }
+      facets.push_back(triples[k]);
+      normals.push_back(planes[k].normal);
+    }
+  }
+
+  save_stl_inner(filename, binary, points, facets, normals);
+}
+
+template class layermesh::BasicTetrahedronSoup<double>;
+template class layermesh::BasicTetrahedronSoup<float>;
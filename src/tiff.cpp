@@ -0,0 +1,271 @@
+/* layermesh/src/tiff.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <tiff.hpp>
+#include <stats.hpp>
+#include <stdexcept>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace layermesh {
+
+  // the longest literal or repeat a PackBits header can describe:
+  static const size_t PACKBITS_MAX_RUN = 128;
+  static const unsigned IFD_ENTRIES = 13;
+  static const size_t IFD_BYTES = 2 + IFD_ENTRIES * 12 + 4;
+  // (the two resolutions, stored after the directory:)
+  static const size_t RATIONAL_BYTES = 16;
+  static const uint64_t MAX_TIFF_BYTES = 0xFFFFFFFFULL;
+
+  // TIFF field types:
+  static const uint16_t TIFF_SHORT = 3;
+  static const uint16_t TIFF_LONG = 4;
+  static const uint16_t TIFF_RATIONAL = 5;
+
+  static void fail(const string& what, const string& filename) {
+    throw runtime_error(what + " " + filename + ": " + strerror(errno));
+  }
+
+  // (little-endian, whatever the host.)
+  static unsigned char* put16(unsigned char* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+  }
+
+  static unsigned char* put32(unsigned char* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+    return p + 4;
+  }
+
+  static unsigned char* put_entry(unsigned char* p, uint16_t tag,
+                                  uint16_t type, uint32_t value) {
+    p = put16(p, tag);
+    p = put16(p, type);
+    p = put32(p, 1);
+    // (a SHORT sits in the first two bytes of the value.)
+    if (type == TIFF_SHORT) {
+      p = put16(p, static_cast<uint16_t>(value));
+      return put16(p, 0);
+    }
+    return put32(p, value);
+  }
+
+  void packbits_encode(const unsigned char* in,
+                       size_t count,
+                       vector<unsigned char>& out) {
+    size_t i = 0, start, run;
+    while (i < count) {
+      run = 1;
+      while (i + run < count && run < PACKBITS_MAX_RUN &&
+             in[i + run] == in[i]) {
+        ++run;
+      }
+      if (run >= 3) {
+        out.push_back(static_cast<unsigned char>(257 - run));
+        out.push_back(in[i]);
+        i += run;
+        continue;
+      }
+      // a literal, up to the next run of three:
+      start = i;
+      while (i < count && i - start < PACKBITS_MAX_RUN) {
+        if (i + 2 < count && in[i] == in[i + 1] && in[i] == in[i + 2]) break;
+        ++i;
+      }
+      out.push_back(static_cast<unsigned char>(i - start - 1));
+      out.insert(out.end(), in + start, in + i);
+    }
+  }
+
+  size_t packbits_decode(const unsigned char* in,
+                         size_t in_size,
+                         unsigned char* out,
+                         size_t count) {
+    size_t i = 0, o = 0, n;
+    while (o < count) {
+      if (i >= in_size) {
+        throw invalid_argument("packbits_decode: input ends early.");
+      }
+      int header = static_cast<signed char>(in[i++]);
+      if (header == -128) continue;
+      if (header >= 0) {
+        n = header + 1;
+        if (i + n > in_size || o + n > count) {
+          throw invalid_argument("packbits_decode: literal overruns.");
+        }
+        memcpy(out + o, in + i, n);
+        i += n;
+      } else {
+        n = 1 - header;
+        if (i >= in_size || o + n > count) {
+          throw invalid_argument("packbits_decode: repeat overruns.");
+        }
+        memset(out + o, in[i++], n);
+      }
+      o += n;
+    }
+    return i;
+  }
+
+  void encode_tiff_page(const unsigned char* pixels,
+                        unsigned width,
+                        unsigned height,
+                        tiff_compression compression,
+                        vector<unsigned char>& out) {
+    out.clear();
+    size_t size = size_t(width) * height;
+    if (compression == tiff_uncompressed) {
+      out.assign(pixels, pixels + size);
+      return;
+    }
+    // (which is enough unless the page is noise.)
+    out.reserve(size / 8);
+    unsigned row;
+    for (row = 0; row < height; ++row) {
+      packbits_encode(pixels + size_t(row) * width, width, out);
+    }
+  }
+
+  TiffWriter::TiffWriter(const string& filename,
+                         unsigned width,
+                         unsigned height,
+                         tiff_compression compression)
+    : fd(-1), filename(filename), width(width), height(height),
+      compression(compression), end(8), next_link(4), page_count(0) {
+    if (width == 0 || height == 0) {
+      throw invalid_argument("TiffWriter: pages must have pixels.");
+    }
+    fd = open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0666);
+    if (fd < 0) {
+      fail("couldn't open", filename);
+    }
+    // (the link to the first directory is patched in by the first page.)
+    unsigned char header[8] = {'I', 'I', 42, 0, 0, 0, 0, 0};
+    try {
+      write_at(header, 8, 0);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+  }
+
+  TiffWriter::~TiffWriter() {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  void TiffWriter::write_at(const unsigned char* data, size_t size,
+                            uint64_t offset) {
+    LAYERMESH_TIME_SCOPE(STAT_TIME_IO);
+    while (size > 0) {
+      ssize_t written = pwrite(fd, data, size, offset);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        fail("couldn't write", filename);
+      }
+      LAYERMESH_COUNT(STAT_BYTES_WRITTEN, written);
+      data += written;
+      size -= written;
+      offset += written;
+    }
+  }
+
+  void TiffWriter::write_page(const unsigned char* pixels) {
+    encode_tiff_page(pixels, width, height, compression, buffer);
+    write_encoded_page(buffer);
+  }
+
+  void TiffWriter::write_encoded_page(const vector<unsigned char>& strip) {
+    if (fd < 0) {
+      throw runtime_error("TiffWriter: " + filename + " is closed.");
+    }
+    // (directories must start on a word boundary.)
+    uint64_t strip_offset = end;
+    uint64_t ifd_offset = (strip_offset + strip.size() + 1) & ~uint64_t(1);
+    uint64_t rationals = ifd_offset + IFD_BYTES;
+    if (rationals + RATIONAL_BYTES > MAX_TIFF_BYTES) {
+      throw runtime_error("TiffWriter: " + filename +
+                          " would be larger than TIFF allows (4GB.)");
+    }
+
+    unsigned char ifd[IFD_BYTES + RATIONAL_BYTES];
+    unsigned char* p = put16(ifd, IFD_ENTRIES);
+    // (in order of tag, as the spec requires; 2 marks a page of many.)
+    p = put_entry(p, 254, TIFF_LONG, 2);
+    p = put_entry(p, 256, TIFF_LONG, width);
+    p = put_entry(p, 257, TIFF_LONG, height);
+    p = put_entry(p, 258, TIFF_SHORT, 8);
+    p = put_entry(p, 259, TIFF_SHORT, compression);
+    // (black is zero:)
+    p = put_entry(p, 262, TIFF_SHORT, 1);
+    p = put_entry(p, 273, TIFF_LONG, strip_offset);
+    p = put_entry(p, 277, TIFF_SHORT, 1);
+    p = put_entry(p, 278, TIFF_LONG, height);
+    p = put_entry(p, 279, TIFF_LONG, strip.size());
+    p = put_entry(p, 282, TIFF_RATIONAL, rationals);
+    p = put_entry(p, 283, TIFF_RATIONAL, rationals + 8);
+    // (72 pixels per inch: the slices' scale is the voxel size, which the
+    // printer is told separately.)
+    p = put_entry(p, 296, TIFF_SHORT, 2);
+    p = put32(p, 0);
+    p = put32(p, 72);
+    p = put32(p, 1);
+    p = put32(p, 72);
+    put32(p, 1);
+
+    if (!strip.empty()) {
+      write_at(&strip[0], strip.size(), strip_offset);
+    }
+    if (ifd_offset > strip_offset + strip.size()) {
+      unsigned char pad = 0;
+      write_at(&pad, 1, ifd_offset - 1);
+    }
+    write_at(ifd, sizeof(ifd), ifd_offset);
+    unsigned char link[4];
+    put32(link, ifd_offset);
+    write_at(link, 4, next_link);
+
+    next_link = ifd_offset + IFD_BYTES - 4;
+    end = rationals + RATIONAL_BYTES;
+    ++page_count;
+  }
+
+  void TiffWriter::close() {
+    if (fd < 0) return;
+    int closing = fd;
+    fd = -1;
+    if (page_count == 0) {
+      ::close(closing);
+      throw runtime_error("TiffWriter: " + filename + " has no pages.");
+    }
+    if (::close(closing) != 0) {
+      fail("couldn't close", filename);
+    }
+  }
+
+}
@@ -0,0 +1,132 @@
+/* layermesh/test/solid_helper.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+#include <csg.hpp>
+#include <mesh.hpp>
+#include <tetrahedron.hpp>
+
+// Solids and checks shared by the tests of the things built from atoms.
+
+// the corner of a cube of the given size at (x, y, z): the tetrahedron of
+// that point and the three next to it along the axes.
+inline std::shared_ptr<layermesh::Tetrahedron> corner(double x,
+                                                      double y,
+                                                      double z,
+                                                      double size = 1.0) {
+  std::array<layermesh::gvec, 4> points = {{
+    layermesh::gvec(x, y, z),
+    layermesh::gvec(x + size, y, z),
+    layermesh::gvec(x, y + size, z),
+    layermesh::gvec(x, y, z + size)
+  }};
+  return std::make_shared<layermesh::Tetrahedron>(points);
+}
+
+// a cube of the given size from (x, y, z), as the intersection of two large
+// corners facing each other.
+inline std::shared_ptr<layermesh::Intersection> cube(double x,
+                                                     double y,
+                                                     double z,
+                                                     double size = 1.0) {
+  std::shared_ptr<layermesh::Intersection> c =
+    std::make_shared<layermesh::Intersection>();
+  c->add(corner(x, y, z, 3.0 * size));
+  c->add(std::make_shared<layermesh::Tetrahedron>(
+    std::array<layermesh::gvec, 4>{{
+      layermesh::gvec(x + size, y + size, z + size),
+      layermesh::gvec(x - 2.0 * size, y + size, z + size),
+      layermesh::gvec(x + size, y - 2.0 * size, z + size),
+      layermesh::gvec(x + size, y + size, z - 2.0 * size)
+    }}));
+  return c;
+}
+
+// two overlapping corners, with a notch cut through the first one's.
+inline std::shared_ptr<layermesh::Difference> notched_corners() {
+  std::shared_ptr<layermesh::Union> u = std::make_shared<layermesh::Union>();
+  u->add(corner(0.0, 0.0, 0.0));
+  u->add(corner(0.3, 0.3, 0.3));
+  std::shared_ptr<layermesh::Difference> d =
+    std::make_shared<layermesh::Difference>(u);
+  d->add(corner(-0.1, -0.1, -0.1, 0.6));
+  return d;
+}
+
+// checks that the mesh is a single closed, consistently oriented manifold
+// surface (each edge used once in each direction, and every facet reachable
+// from the first) with no two vertices alike in single precision, and
+// returns the volume it encloses.
+inline double expect_closed_manifold(const layermesh::IndexedMesh& mesh) {
+  EXPECT_GT(mesh.facets.size(), 0u);
+  if (mesh.facets.empty()) return 0.0;
+  typedef std::pair<unsigned, unsigned> edge;
+  std::map<edge, std::size_t> edges;
+  std::size_t f;
+  unsigned i;
+  double volume = 0.0;
+  for (f = 0; f < mesh.facets.size(); ++f) {
+    const layermesh::facet_triple& t = mesh.facets[f];
+    for (i = 0; i < 3; ++i) {
+      EXPECT_LT(t[i], mesh.points.size());
+      EXPECT_NE(t[i], t[(i + 1) % 3]) << "facet " << f << " is degenerate.";
+      edge e(t[i], t[(i + 1) % 3]);
+      EXPECT_EQ(edges.count(e), 0u) << "edge used twice the same way.";
+      edges[e] = f;
+    }
+    volume += (mesh.points[t[0]] ^ mesh.points[t[1]]) * mesh.points[t[2]];
+  }
+  // (each facet's neighbours, by the reverse of its edges.)
+  std::vector<bool> seen(mesh.facets.size(), false);
+  std::vector<std::size_t> stack(1, 0);
+  seen[0] = true;
+  std::size_t reached = 1;
+  while (!stack.empty()) {
+    const layermesh::facet_triple& t = mesh.facets[stack.back()];
+    stack.pop_back();
+    for (i = 0; i < 3; ++i) {
+      std::map<edge, std::size_t>::const_iterator it =
+        edges.find(edge(t[(i + 1) % 3], t[i]));
+      if (it == edges.end()) {
+        ADD_FAILURE() << "edge with no facet on the other side.";
+        continue;
+      }
+      if (!seen[it->second]) {
+        seen[it->second] = true;
+        stack.push_back(it->second);
+        ++reached;
+      }
+    }
+  }
+  EXPECT_EQ(reached, mesh.facets.size()) << "more than one component.";
+  std::set<std::array<float, 3> > distinct;
+  for (i = 0; i < mesh.points.size(); ++i) {
+    const layermesh::gvec& p = mesh.points[i];
+    std::array<float, 3> single = {{float(p[0]), float(p[1]), float(p[2])}};
+    distinct.insert(single);
+  }
+  EXPECT_EQ(distinct.size(), mesh.points.size());
+  return volume / 6.0;
+}
@@ -17,9 +17,14 @@
  * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <array>
+#include <limits>
 #include <stdexcept>
 #include <gtest/gtest.h>
 #include <atom.hpp>
+#include <stl.hpp>
+#include <stdlib.h>
+#include <sys/stat.h>
 
 using namespace std;
 using namespace layermesh;
@@ -36,12 +41,12 @@ class Tetrahedron : Atom {
       }
     };
     virtual ~Tetrahedron() {};
-    virtual memsafe_gvec_list point_cloud();
+    virtual memsafe_gvec_list point_cloud() const;
     virtual unsigned internal_points_start_index() const;
-    virtual gsphere get_boundary();
+    virtual gsphere get_boundary() const;
 };
 
-memsafe_gvec_list Tetrahedron::point_cloud() {
+memsafe_gvec_list Tetrahedron::point_cloud() const {
   unsigned i;
   memsafe_gvec_list point_cloud = make_shared<gvec_list>();
   gvec centroid;
@@ -62,10 +67,10 @@ unsigned Tetrahedron::internal_points_start_index() const {
   return 4;
 }
 
-gsphere Tetrahedron::get_boundary() {
+gsphere Tetrahedron::get_boundary() const {
   gsphere ret;
 
-  ret.centre = (*point_cloud())[internal_points_start_index()];
+  ret.centre = point_cloud_view()[internal_points_start_index()];
 
   ret.radius = 0.0;
   unsigned i;
@@ -81,6 +86,138 @@ gsphere Tetrahedron::get_boundary() {
   return ret;
 }
 
+// an atom which leaves contains() to the default, hull based, implementation:
+class Cube : public Atom {
+  private:
+    memsafe_gvec_list points;
+  public:
+    Cube() : points(make_shared<gvec_list>()) {
+      unsigned i;
+      for (i = 0; i < 8; ++i) {
+        points->push_back(gvec(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+      }
+      points->push_back(gvec(0.5, 0.5, 0.5));
+    };
+    virtual ~Cube() {};
+    virtual memsafe_gvec_list point_cloud() const { return points; };
+    virtual unsigned internal_points_start_index() const { return 8; };
+    virtual gsphere get_boundary() const {
+      gsphere ret;
+      ret.centre = gvec(0.5, 0.5, 0.5);
+      ret.radius = sqrt(0.75);
+      return ret;
+    };
+};
+
+// the same cube, viewing points it keeps in an array of its own:
+class ArrayCube : public Atom {
+  private:
+    array<gvec, 9> points;
+  public:
+    ArrayCube() {
+      unsigned i;
+      for (i = 0; i < 8; ++i) {
+        points[i] = gvec(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+      }
+      points[8] = gvec(0.5, 0.5, 0.5);
+    };
+    virtual ~ArrayCube() {};
+    virtual gvec_view point_cloud_view() const { return points; };
+    virtual unsigned internal_points_start_index() const { return 8; };
+    virtual gsphere get_boundary() const {
+      gsphere ret;
+      ret.centre = gvec(0.5, 0.5, 0.5);
+      ret.radius = sqrt(0.75);
+      return ret;
+    };
+};
+
+// an atom with no planes of its own, so containing everywhere:
+class Everywhere : public Cube {
+  public:
+    virtual memsafe_gplane_list half_spaces() const {
+      return make_shared<gplane_list>();
+    };
+};
+
+// an atom which (wrongly) provides neither point_cloud method:
+class NoPoints : public Atom {
+  public:
+    virtual unsigned internal_points_start_index() const { return 0; };
+    virtual gsphere get_boundary() const { return gsphere(); };
+};
+
+TEST(Atom, point_cloud_view_of_point_cloud_is_cached) {
+  Cube c;
+  gvec_view view = c.point_cloud_view();
+
+  EXPECT_EQ(view.size(), 9u) << "unexpected view length.";
+  EXPECT_EQ(view.data(), c.point_cloud()->data())
+    << "the view should be of the cached point cloud.";
+}
+
+TEST(Atom, point_cloud_of_point_cloud_view_is_built_once) {
+  ArrayCube c;
+  memsafe_gvec_list cloud = c.point_cloud();
+
+  ASSERT_EQ(cloud->size(), 9u) << "unexpected point_cloud length.";
+  EXPECT_EQ((*cloud)[8][0], 0.5) << "point_cloud doesn't match the view.";
+  EXPECT_TRUE(cloud == c.point_cloud()) << "point_cloud wasn't cached.";
+
+  EXPECT_TRUE(c.contains(gvec(0.5, 0.5, 0.5))) << "centre not contained.";
+  EXPECT_FALSE(c.contains(gvec(0.5, 1.01, 0.5))) << "outside contained.";
+}
+
+TEST(Atom, missing_point_cloud_throws) {
+  NoPoints n;
+
+  EXPECT_THROW(n.point_cloud_view(), logic_error);
+  EXPECT_THROW(n.point_cloud(), logic_error);
+}
+
+TEST(Atom, default_contains_uses_hull) {
+  Cube c;
+
+  EXPECT_TRUE(c.contains(gvec(0.5, 0.5, 0.5))) << "centre not contained.";
+  EXPECT_TRUE(c.contains(gvec(0.0, 0.3, 1.0))) << "surface not contained.";
+  EXPECT_FALSE(c.contains(gvec(0.5, 1.01, 0.5))) << "outside contained.";
+  EXPECT_FALSE(c.contains(gvec(-0.2, -0.2, -0.2))) << "outside contained.";
+
+  EXPECT_EQ(c.half_spaces()->size(), 6u) << "a cube has six half-spaces.";
+  EXPECT_TRUE(c.half_spaces() == c.half_spaces())
+    << "half-spaces weren't cached.";
+}
+
+TEST(Atom, no_half_spaces_contain_everything) {
+  Everywhere e;
+
+  EXPECT_TRUE(e.contains(gvec(0.5, 0.5, 0.5)));
+  EXPECT_TRUE(e.contains(gvec(-30.0, 12.0, 7.5)));
+  span s;
+  ASSERT_TRUE(e.scanline_span(4.0, -2.0, s));
+  EXPECT_EQ(s.enter, -numeric_limits<double>::infinity());
+  EXPECT_EQ(s.exit, numeric_limits<double>::infinity());
+  gbox box{gvec(-1.0, -1.0, -1.0), gvec(3.0, 3.0, 3.0)};
+  EXPECT_EQ(e.classify(box), box_inside);
+  gvec normal(1.0, 0.0, 0.0);
+  EXPECT_EQ(e.surface_distance(gvec(0.0, 0.0, 0.0), normal),
+            numeric_limits<double>::infinity());
+}
+
+TEST(Atom, default_save_stl_uses_hull) {
+  Cube c;
+  c.set_hull_threads(2);
+  c.save_stl("foo.stl", true);
+
+  struct stat st;
+  ASSERT_EQ(stat("foo.stl", &st), 0) << "no file was written.";
+  EXPECT_EQ((size_t)st.st_size, binary_stl_size(12))
+    << "a cube's hull should have twelve facets.";
+  EXPECT_EQ(c.hull_facets()->size(), 12u) << "wrong number of hull facets.";
+
+  system("rm foo.stl");
+}
+
 TEST(Atom, can_derive_class) {
   vector<gvec> points;
   points.push_back(gvec(1.2, 3.4, 5.6));
@@ -0,0 +1,191 @@
+/* layermesh/test/test_bounds.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <atom.hpp>
+#include <bounds.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+static double uniform() {
+  return static_cast<double>(rand()) / RAND_MAX;
+}
+
+static gvec_list random_cloud(size_t count) {
+  gvec_list points;
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    points.push_back(gvec(uniform(), 0.2 * uniform(), 3.0 * uniform()));
+  }
+  return points;
+}
+
+// (the sphere about the centroid, which minimal_sphere() should beat.)
+static double centroid_radius(const gvec_list& points) {
+  gvec centroid;
+  size_t i;
+  for (i = 0; i < points.size(); ++i) {
+    centroid = centroid + points[i];
+  }
+  centroid = centroid / double(points.size());
+  double radius = 0.0;
+  for (i = 0; i < points.size(); ++i) {
+    radius = max(radius, layermesh::modulus(points[i] - centroid));
+  }
+  return radius;
+}
+
+static void expect_encloses(const gsphere& s, const gvec_list& points) {
+  size_t i;
+  for (i = 0; i < points.size(); ++i) {
+    EXPECT_TRUE(sphere_contains(s, points[i])) << "point " << i;
+  }
+}
+
+TEST(Bounds, test_random_clouds) {
+  srand(3);
+  size_t count;
+  for (count = 1; count <= 1000; count *= 4) {
+    gvec_list points = random_cloud(count);
+    gsphere s = minimal_sphere(points);
+    expect_encloses(s, points);
+    EXPECT_LE(s.radius, centroid_radius(points) * (1.0 + 1e-9));
+
+    // (the minimal sphere has points on its surface: shrinking it a little
+    // must leave some outside.)
+    gsphere smaller = s;
+    smaller.radius *= 1.0 - 1e-6;
+    bool outside = false;
+    size_t i;
+    for (i = 0; i < points.size(); ++i) {
+      outside = outside || !sphere_contains(smaller, points[i]);
+    }
+    EXPECT_TRUE(outside || count == 1) << count << " points";
+  }
+}
+
+TEST(Bounds, test_known_spheres) {
+  EXPECT_LT(minimal_sphere(gvec_view()).radius, 0.0);
+
+  gvec_list two = {gvec(0.0, 0.0, 0.0), gvec(2.0, 0.0, 0.0)};
+  gsphere s = minimal_sphere(two);
+  EXPECT_NEAR(s.centre[0], 1.0, 1e-12);
+  EXPECT_NEAR(s.radius, 1.0, 1e-9);
+
+  // a regular tetrahedron's minimal sphere is its circumsphere:
+  gvec_list regular = {
+    gvec(1.0, 1.0, 1.0), gvec(1.0, -1.0, -1.0),
+    gvec(-1.0, 1.0, -1.0), gvec(-1.0, -1.0, 1.0)
+  };
+  s = minimal_sphere(regular);
+  EXPECT_NEAR(layermesh::modulus(s.centre), 0.0, 1e-12);
+  EXPECT_NEAR(s.radius, sqrt(3.0), 1e-9);
+
+  // the points of a cube, and its centre:
+  gvec_list cube;
+  unsigned i;
+  for (i = 0; i < 8; ++i) {
+    cube.push_back(gvec(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+  }
+  cube.push_back(gvec(0.5, 0.5, 0.5));
+  s = minimal_sphere(cube);
+  EXPECT_NEAR(s.centre[1], 0.5, 1e-12);
+  EXPECT_NEAR(s.radius, sqrt(0.75), 1e-9);
+}
+
+TEST(Bounds, test_degenerate_clouds) {
+  // repeated, collinear and coplanar points:
+  gvec_list same(20, gvec(1.0, 2.0, 3.0));
+  gsphere s = minimal_sphere(same);
+  EXPECT_EQ(s.centre[2], 3.0);
+  EXPECT_NEAR(s.radius, 0.0, 1e-12);
+
+  gvec_list line;
+  gvec_list plane;
+  unsigned i, j;
+  for (i = 0; i <= 10; ++i) {
+    line.push_back(gvec(0.1 * i, 0.2 * i, -0.1 * i));
+    for (j = 0; j <= 10; ++j) {
+      plane.push_back(gvec(0.1 * i, 0.1 * j, 1.0));
+    }
+  }
+  s = minimal_sphere(line);
+  expect_encloses(s, line);
+  EXPECT_NEAR(s.radius, layermesh::modulus(line.back()) / 2.0, 1e-9);
+
+  s = minimal_sphere(plane);
+  expect_encloses(s, plane);
+  EXPECT_NEAR(s.radius, sqrt(0.5), 1e-9);
+  EXPECT_NEAR(s.centre[2], 1.0, 1e-12);
+}
+
+TEST(Bounds, test_bounding_box) {
+  gvec_list points = {
+    gvec(1.0, -2.0, 0.5), gvec(-1.0, 3.0, 0.0), gvec(0.0, 0.0, 4.0)
+  };
+  gbox box = bounding_box(points);
+  EXPECT_EQ(box.low[0], -1.0);
+  EXPECT_EQ(box.low[1], -2.0);
+  EXPECT_EQ(box.low[2], 0.0);
+  EXPECT_EQ(box.high[0], 1.0);
+  EXPECT_EQ(box.high[1], 3.0);
+  EXPECT_EQ(box.high[2], 4.0);
+  EXPECT_TRUE(box_contains(box, gvec(0.0, 0.0, 1.0)));
+  EXPECT_FALSE(box_contains(box, gvec(0.0, 0.0, 5.0)));
+
+  gbox empty = bounding_box(gvec_view());
+  EXPECT_GT(empty.low[0], empty.high[0]);
+}
+
+// An atom with an internal point far outside its boundary points (which
+// the default bounds must ignore.)
+class Cloud : public Atom {
+  private:
+    gvec_list points;
+  public:
+    Cloud(const gvec_list& points) : points(points) {};
+    virtual gvec_view point_cloud_view() const { return points; };
+    virtual unsigned internal_points_start_index() const {
+      return points.size() - 1;
+    };
+};
+
+TEST(Bounds, test_atom_defaults) {
+  gvec_list points = {
+    gvec(0.0, 0.0, 0.0), gvec(4.0, 0.0, 0.0), gvec(2.0, 0.1, 0.0),
+    gvec(2.0, 0.0, 0.1), gvec(100.0, 100.0, 100.0)
+  };
+  Cloud atom(points);
+  gsphere s = atom.get_boundary();
+  EXPECT_NEAR(s.centre[0], 2.0, 1e-12);
+  EXPECT_NEAR(s.radius, 2.0, 1e-9);
+  gbox box = atom.get_aabb();
+  EXPECT_EQ(box.high[0], 4.0);
+  EXPECT_EQ(box.high[1], 0.1);
+  EXPECT_EQ(box.low[2], 0.0);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,108 @@
+/* layermesh/test/test_brep.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <cmath>
+#include <vector>
+#include <gtest/gtest.h>
+#include <brep.hpp>
+#include <tetrahedron.hpp>
+#include "stl_helper.hpp"
+#include "solid_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+TEST(Brep, test_single_atom) {
+  Leaf leaf(corner(0.0, 0.0, 0.0));
+  IndexedMesh mesh = brep_mesh(leaf);
+  EXPECT_EQ(mesh.facets.size(), 4u);
+  EXPECT_EQ(mesh.points.size(), 4u);
+  EXPECT_NEAR(expect_closed_manifold(mesh), 1.0 / 6.0, 1e-12);
+}
+
+TEST(Brep, test_intersection_is_exact) {
+  shared_ptr<Intersection> c = cube(0.0, 0.0, 0.0);
+  IndexedMesh mesh = brep_mesh(*c);
+  EXPECT_NEAR(expect_closed_manifold(mesh), 1.0, 1e-12);
+  // every vertex lies on the cube's faces.
+  size_t i;
+  for (i = 0; i < mesh.points.size(); ++i) {
+    gvec normal;
+    EXPECT_NEAR(c->surface_distance(mesh.points[i], 1.0, normal), 0.0,
+                1e-12);
+  }
+}
+
+TEST(Brep, test_union_and_difference) {
+  shared_ptr<Difference> d = notched_corners();
+  IndexedMesh mesh = brep_mesh(*d);
+  // (the two corners, less the tip of the second within the first, and the
+  // notch cut from the first.)
+  double expected = (2.0 - 0.1 * 0.1 * 0.1 - 0.3 * 0.3 * 0.3) / 6.0;
+  EXPECT_NEAR(expect_closed_manifold(mesh), expected, 1e-12);
+}
+
+TEST(Brep, test_shared_and_touching_faces) {
+  // two cubes overlapping a quarter of the way, so their tops and bottoms
+  // lie in the same planes:
+  Union overlapping;
+  overlapping.add(cube(0.0, 0.0, 0.0));
+  overlapping.add(cube(0.5, 0.5, 0.0));
+  EXPECT_NEAR(expect_closed_manifold(brep_mesh(overlapping)), 1.75, 1e-12);
+
+  // two cubes side by side, the face between them left out:
+  Union touching;
+  touching.add(cube(0.0, 0.0, 0.0));
+  touching.add(cube(1.0, 0.2, 0.0));
+  EXPECT_NEAR(expect_closed_manifold(brep_mesh(touching)), 2.0, 1e-12);
+
+  // and a cube with a cube taken from its corner, flush with three faces:
+  Difference notched(cube(0.0, 0.0, 0.0));
+  notched.add(cube(0.5, 0.5, 0.5));
+  EXPECT_NEAR(expect_closed_manifold(brep_mesh(notched)), 0.875, 1e-12);
+}
+
+TEST(Brep, test_same_on_any_number_of_threads) {
+  Union u;
+  unsigned i;
+  for (i = 0; i < 20; ++i) {
+    u.add(corner(0.05 * i, 0.03 * i, 0.02 * i, 0.5));
+  }
+  IndexedMesh serial = brep_mesh(u);
+  IndexedMesh parallel = brep_mesh(u, 3);
+  expect_closed_manifold(serial);
+  ASSERT_EQ(parallel.points.size(), serial.points.size());
+  for (i = 0; i < serial.points.size(); ++i) {
+    EXPECT_EQ(layermesh::modulus(parallel.points[i] - serial.points[i]), 0.0);
+  }
+  EXPECT_TRUE(parallel.facets == serial.facets);
+}
+
+TEST(Brep, test_can_generate_valid_stl) {
+  IndexedMesh mesh = brep_mesh(*notched_corners(), 2);
+  mesh.save_stl("test_brep.stl", true);
+  EXPECT_VALID_STL("test_brep.stl", true);
+  remove("test_brep.stl");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,214 @@
+/* layermesh/test/test_bvh.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <bvh.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+static double uniform() {
+  return static_cast<double>(rand()) / RAND_MAX;
+}
+
+static vector<gbox> random_boxes(size_t count) {
+  vector<gbox> boxes(count);
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    gsphere s;
+    s.centre = gvec(uniform(), uniform(), uniform());
+    s.radius = 0.01 + 0.02 * uniform();
+    boxes[i] = box_of(s);
+  }
+  return boxes;
+}
+
+static bool box_contains(const gbox& b, const gvec& p) {
+  return p[0] >= b.low[0] && p[0] <= b.high[0] &&
+         p[1] >= b.low[1] && p[1] <= b.high[1] &&
+         p[2] >= b.low[2] && p[2] <= b.high[2];
+}
+
+static bool boxes_overlap(const gbox& a, const gbox& b) {
+  return a.low[0] <= b.high[0] && a.high[0] >= b.low[0] &&
+         a.low[1] <= b.high[1] && a.high[1] >= b.low[1] &&
+         a.low[2] <= b.high[2] && a.high[2] >= b.low[2];
+}
+
+// the ray origin + t * direction, 0 <= t <= 1, against the box (sampled
+// finely, which is enough for these boxes.)
+static bool segment_meets(const gbox& b, const gvec& origin,
+                          const gvec& direction) {
+  unsigned i;
+  for (i = 0; i <= 1000; ++i) {
+    if (box_contains(b, origin + direction * (i / 1000.0))) return true;
+  }
+  return false;
+}
+
+// checks that every primitive the brute force test finds is among those the
+// hierarchy found (which may include a few more.)
+static void expect_found(const vector<bool>& expected,
+                         const vector<size_t>& found) {
+  size_t i;
+  for (i = 0; i < expected.size(); ++i) {
+    if (expected[i]) {
+      EXPECT_NE(find(found.begin(), found.end(), i), found.end())
+        << "primitive " << i << " was missed.";
+    }
+  }
+  EXPECT_LE(found.size(), 3 * size_t(count(expected.begin(), expected.end(),
+                                           true)) + 16)
+    << "too many candidates: the hierarchy isn't narrowing the search.";
+}
+
+static void expect_queries_correct(const Bvh& bvh,
+                                   const vector<gbox>& boxes) {
+  vector<bool> expected(boxes.size());
+  unsigned q;
+  size_t i;
+  for (q = 0; q < 200; ++q) {
+    gvec p(uniform(), uniform(), uniform());
+    for (i = 0; i < boxes.size(); ++i) {
+      expected[i] = box_contains(boxes[i], p);
+    }
+    expect_found(expected, bvh.containing(p));
+
+    gsphere s;
+    s.centre = p;
+    s.radius = 0.05;
+    gbox query = box_of(s);
+    for (i = 0; i < boxes.size(); ++i) {
+      expected[i] = boxes_overlap(boxes[i], query);
+    }
+    expect_found(expected, bvh.overlapping(query));
+  }
+}
+
+TEST(Bvh, test_point_and_box_queries) {
+  srand(7);
+  vector<gbox> boxes = random_boxes(2000);
+  Bvh bvh(boxes);
+  EXPECT_EQ(bvh.size(), boxes.size());
+  EXPECT_LT(bvh.node_count(), boxes.size());
+  expect_queries_correct(bvh, boxes);
+}
+
+TEST(Bvh, test_ray_queries) {
+  srand(8);
+  vector<gbox> boxes = random_boxes(500);
+  Bvh bvh(boxes);
+  vector<bool> expected(boxes.size());
+  unsigned q;
+  size_t i;
+  for (q = 0; q < 20; ++q) {
+    gvec origin(uniform(), uniform(), -0.5);
+    gvec direction = gvec(uniform(), uniform(), 2.0) - origin;
+    if (q == 0) direction = gvec(0.0, 0.0, 2.0);
+    for (i = 0; i < boxes.size(); ++i) {
+      expected[i] = segment_meets(boxes[i], origin, direction);
+    }
+    vector<size_t> found;
+    bvh.along_ray(origin, direction, 1.0, [&](size_t p) {
+      found.push_back(p);
+      return false;
+    });
+    expect_found(expected, found);
+  }
+}
+
+TEST(Bvh, test_search_stops_when_found) {
+  srand(9);
+  vector<gbox> boxes = random_boxes(100);
+  Bvh bvh(boxes);
+  gvec p = (boxes[10].low + boxes[10].high) / 2.0;
+  unsigned visited = 0;
+  EXPECT_TRUE(bvh.containing(p, [&](size_t i) {
+    ++visited;
+    return i == 10;
+  }));
+  EXPECT_FALSE(bvh.containing(gvec(5.0, 5.0, 5.0), [](size_t) {
+    return true;
+  }));
+  EXPECT_GE(visited, 1u);
+}
+
+TEST(Bvh, test_parallel_build) {
+  srand(11);
+  vector<gbox> boxes = random_boxes(20000);
+  Bvh serial(boxes), parallel(boxes, 4);
+  EXPECT_EQ(parallel.size(), boxes.size());
+  EXPECT_EQ(parallel.node_count(), serial.node_count())
+    << "the parallel build should make the same tree.";
+  expect_queries_correct(parallel, boxes);
+}
+
+TEST(Bvh, test_refit) {
+  srand(12);
+  vector<gbox> boxes = random_boxes(1000);
+  Bvh bvh(boxes);
+  size_t i;
+  for (i = 0; i < boxes.size(); i += 3) {
+    gvec shift(0.1 * uniform(), -0.1 * uniform(), 0.05);
+    boxes[i].low = boxes[i].low + shift;
+    boxes[i].high = boxes[i].high + shift;
+  }
+  bvh.refit(boxes);
+  vector<bool> expected(boxes.size());
+  unsigned q;
+  for (q = 0; q < 200; ++q) {
+    gvec p(uniform(), uniform(), uniform());
+    for (i = 0; i < boxes.size(); ++i) {
+      expected[i] = box_contains(boxes[i], p);
+    }
+    vector<size_t> found = bvh.containing(p);
+    for (i = 0; i < boxes.size(); ++i) {
+      if (expected[i]) {
+        EXPECT_NE(find(found.begin(), found.end(), i), found.end());
+      }
+    }
+  }
+
+  boxes.pop_back();
+  EXPECT_THROW(bvh.refit(boxes), invalid_argument);
+}
+
+TEST(Bvh, test_empty_and_coincident) {
+  Bvh empty((vector<gbox>()));
+  EXPECT_TRUE(empty.containing(gvec()).empty());
+  EXPECT_FALSE(empty.along_ray(gvec(), gvec(1.0, 0.0, 0.0), 1.0,
+                               [](size_t) { return true; }));
+
+  // (boxes which can't be told apart by their centres:)
+  gsphere s;
+  s.centre = gvec(0.5, 0.5, 0.5);
+  s.radius = 0.1;
+  vector<gbox> same(100, box_of(s));
+  Bvh bvh(same);
+  EXPECT_EQ(bvh.containing(gvec(0.5, 0.5, 0.5)).size(), 100u);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
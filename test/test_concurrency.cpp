@@ -0,0 +1,177 @@
+/* layermesh/test/test_concurrency.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Stress tests for the const query path of atoms: many threads query one
+// atom at once, starting from cold caches. Run under ThreadSanitizer with
+// `make check-tsan` to check that there are no data races.
+
+#include <stdlib.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <atom.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+static const unsigned THREADS = 8;
+static const size_t POINTS = 2000;
+
+// a ball of points, leaving contains() etc to the hull based defaults:
+class Ball : public Atom {
+  private:
+    memsafe_gvec_list points;
+  public:
+    Ball() {
+      shared_ptr<gvec_list> cloud = make_shared<gvec_list>();
+      const double golden_angle = M_PI * (3.0 - sqrt(5.0));
+      unsigned i;
+      for (i = 0; i < 200; ++i) {
+        double z = 1.0 - (2.0 * i + 1.0) / 200;
+        double r = sqrt(1.0 - z * z);
+        cloud->push_back(gvec(r * cos(golden_angle * i),
+                              r * sin(golden_angle * i),
+                              z));
+      }
+      points = cloud;
+    };
+    virtual memsafe_gvec_list point_cloud() const { return points; };
+    virtual unsigned internal_points_start_index() const {
+      return points->size();
+    };
+    virtual gsphere get_boundary() const {
+      gsphere ret;
+      ret.radius = 1.0;
+      return ret;
+    };
+};
+
+// the same, through point_cloud_view(), so point_cloud() is the default:
+class ViewBall : public Ball {
+  private:
+    gvec_list points;
+  public:
+    ViewBall() : points(*Ball::point_cloud()) {};
+    virtual gvec_view point_cloud_view() const { return points; };
+    virtual memsafe_gvec_list point_cloud() const {
+      return Atom::point_cloud();
+    };
+};
+
+static void query_points(vector<double>& x,
+                         vector<double>& y,
+                         vector<double>& z) {
+  x.resize(POINTS);
+  y.resize(POINTS);
+  z.resize(POINTS);
+  srand(3);
+  size_t i;
+  for (i = 0; i < POINTS; ++i) {
+    x[i] = 2.4 * rand() / RAND_MAX - 1.2;
+    y[i] = 2.4 * rand() / RAND_MAX - 1.2;
+    z[i] = 2.4 * rand() / RAND_MAX - 1.2;
+  }
+}
+
+// Queries the fresh atom from THREADS threads at once (released together, to
+// make them race for the caches), and checks every thread's answers against
+// those of reference, a separate atom queried from this thread.
+static void stress(const Atom& atom, const Atom& reference) {
+  vector<double> x, y, z;
+  query_points(x, y, z);
+  vector<unsigned char> expected(POINTS);
+  reference.contains_batch(&x[0], &y[0], &z[0], POINTS, &expected[0]);
+
+  vector<vector<unsigned char> > single(THREADS), batch(THREADS);
+  vector<size_t> planes(THREADS), cloud(THREADS), facets(THREADS);
+  vector<double> radius(THREADS);
+  atomic<bool> go(false);
+  vector<thread> workers;
+  unsigned t;
+  for (t = 0; t < THREADS; ++t) {
+    workers.push_back(thread([&, t]() {
+      while (!go.load()) {
+        this_thread::yield();
+      }
+      single[t].resize(POINTS);
+      batch[t].resize(POINTS);
+      size_t i;
+      for (i = 0; i < POINTS; ++i) {
+        single[t][i] = atom.contains(gvec(x[i], y[i], z[i])) ? 1 : 0;
+      }
+      atom.contains_batch(&x[0], &y[0], &z[0], POINTS, &batch[t][0]);
+      planes[t] = atom.half_spaces()->size();
+      cloud[t] = atom.point_cloud()->size() + atom.point_cloud_view().size();
+      radius[t] = atom.get_boundary().radius;
+    }));
+  }
+  go.store(true);
+  for (t = 0; t < THREADS; ++t) {
+    workers[t].join();
+  }
+
+  for (t = 0; t < THREADS; ++t) {
+    EXPECT_TRUE(single[t] == expected) << "thread " << t << " disagreed.";
+    EXPECT_TRUE(batch[t] == expected) << "thread " << t << " disagreed.";
+    EXPECT_EQ(planes[t], reference.half_spaces()->size());
+    EXPECT_EQ(cloud[t], 2 * reference.point_cloud_view().size());
+    EXPECT_EQ(radius[t], reference.get_boundary().radius);
+  }
+}
+
+TEST(Concurrency, test_tetrahedron_queries) {
+  array<gvec, 4> points = {{
+    gvec(-1.0, -1.0, -1.0),
+    gvec(1.0, 0.0, -1.0),
+    gvec(0.0, 1.0, -1.0),
+    gvec(0.0, 0.0, 1.0)
+  }};
+  Tetrahedron t(points), reference(points);
+  stress(t, reference);
+}
+
+TEST(Concurrency, test_default_hull_queries) {
+  Ball b, reference;
+  stress(b, reference);
+  EXPECT_EQ(b.hull_facets(), b.hull_facets());
+}
+
+TEST(Concurrency, test_default_point_cloud_queries) {
+  ViewBall b, reference;
+  stress(b, reference);
+  EXPECT_EQ(b.point_cloud(), b.point_cloud());
+}
+
+TEST(Concurrency, test_copies_have_their_own_caches) {
+  Ball b;
+  b.half_spaces();
+  Ball copy(b);
+  EXPECT_NE(copy.half_spaces(), b.half_spaces())
+    << "a copy should compute its own half-spaces.";
+  EXPECT_EQ(copy.half_spaces()->size(), b.half_spaces()->size());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,152 @@
+/* layermesh/test/test_contour.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <contour.hpp>
+#include <tetrahedron.hpp>
+#include "stl_helper.hpp"
+#include "solid_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+static voxel_grid grid_around(const gbox& box, double voxel) {
+  gvec margin(voxel, voxel, voxel);
+  return grid_covering(gbox{box.low - margin, box.high + margin}, voxel);
+}
+
+TEST(Contour, test_closed_manifold) {
+  shared_ptr<Difference> d = notched_corners();
+  voxel_grid grid = grid_around(d->get_aabb(), 0.025);
+  IndexedMesh mesh = contour(*d, grid);
+  // (the two corners, less the tip of the second within the first, and the
+  // notch cut from the first.)
+  double expected = (2.0 - 0.1 * 0.1 * 0.1 - 0.3 * 0.3 * 0.3) / 6.0;
+  EXPECT_NEAR(expect_closed_manifold(mesh), expected, 0.01 * expected);
+}
+
+TEST(Contour, test_keeps_sharp_features) {
+  // a unit cube, on a grid which doesn't line up with it.
+  shared_ptr<Intersection> unit = cube(0.0, 0.0, 0.0);
+  voxel_grid grid = grid_around(gbox{gvec(0.0, 0.0, 0.0),
+                                     gvec(1.0, 1.0, 1.0)}, 0.07);
+  grid.origin = grid.origin - gvec(0.013, 0.021, 0.008);
+  IndexedMesh mesh = contour(*unit, grid);
+  EXPECT_NEAR(expect_closed_manifold(mesh), 1.0, 0.005);
+  // the vertices lie on the faces, rather than cutting the edges and
+  // corners off as the voxels would (but for those of tetrahedra which see
+  // two faces the grid can't tell apart, which are still near them.)
+  unsigned i, c, on_faces = 0;
+  for (i = 0; i < mesh.points.size(); ++i) {
+    gvec normal;
+    double d = unit->surface_distance(mesh.points[i], grid.voxel, normal);
+    EXPECT_LT(fabs(d), 0.5 * grid.voxel) << "vertex " << i;
+    on_faces += fabs(d) < 0.01 * grid.voxel;
+  }
+  EXPECT_GT(on_faces, 0.95 * mesh.points.size());
+  // and each corner has a vertex near it:
+  for (c = 0; c < 8; ++c) {
+    gvec point(c & 1, (c >> 1) & 1, (c >> 2) & 1);
+    double nearest = 1.0;
+    for (i = 0; i < mesh.points.size(); ++i) {
+      nearest = min(nearest, layermesh::modulus(mesh.points[i] - point));
+    }
+    EXPECT_LT(nearest, 0.5 * grid.voxel) << "corner " << c;
+  }
+}
+
+TEST(Contour, test_single_atom) {
+  shared_ptr<Tetrahedron> t = corner(0.0, 0.0, 0.0);
+  voxel_grid grid = grid_around(t->get_aabb(), 0.025);
+  IndexedMesh mesh = contour(*t, grid);
+  EXPECT_NEAR(expect_closed_manifold(mesh), 1.0 / 6.0, 0.01 / 6.0);
+  // (just as it would be as a solid.)
+  Union u;
+  u.add(t);
+  IndexedMesh solid = contour(u, grid);
+  ASSERT_EQ(mesh.points.size(), solid.points.size());
+  size_t i;
+  for (i = 0; i < mesh.points.size(); ++i) {
+    EXPECT_EQ(layermesh::modulus(mesh.points[i] - solid.points[i]), 0.0);
+  }
+  EXPECT_TRUE(mesh.facets == solid.facets);
+}
+
+TEST(Contour, test_same_on_any_number_of_threads) {
+  shared_ptr<Difference> d = notched_corners();
+  voxel_grid grid = grid_around(d->get_aabb(), 0.04);
+  IndexedMesh serial = contour(*d, grid);
+  IndexedMesh parallel = contour(*d, grid, 3);
+  ASSERT_EQ(parallel.points.size(), serial.points.size());
+  ASSERT_EQ(parallel.facets.size(), serial.facets.size());
+  size_t i;
+  for (i = 0; i < serial.points.size(); ++i) {
+    EXPECT_EQ(layermesh::modulus(parallel.points[i] - serial.points[i]), 0.0);
+  }
+  EXPECT_TRUE(parallel.facets == serial.facets);
+  // (more threads than layers.)
+  voxel_grid flat = grid;
+  flat.layers = 2;
+  expect_closed_manifold(contour(*d, flat, 8));
+}
+
+TEST(Contour, test_distance_function) {
+  // a sphere, within the grid.
+  double radius = 0.4;
+  function<double(const gvec&)> sphere = [radius](const gvec& p) {
+    return layermesh::modulus(p) - radius;
+  };
+  voxel_grid grid = grid_around(gbox{gvec(-0.4, -0.4, -0.4),
+                                     gvec(0.4, 0.4, 0.4)}, 0.04);
+  IndexedMesh mesh = contour(sphere, grid, 2);
+  EXPECT_NEAR(expect_closed_manifold(mesh), 4.0 / 3.0 * M_PI * 0.064, 0.004);
+  size_t i;
+  for (i = 0; i < mesh.points.size(); ++i) {
+    EXPECT_NEAR(layermesh::modulus(mesh.points[i]), radius, 0.1 * grid.voxel);
+  }
+
+  // (and one which the grid cuts off on one side.)
+  grid.height /= 2;
+  expect_closed_manifold(contour(sphere, grid));
+}
+
+TEST(Contour, test_can_generate_valid_stl) {
+  shared_ptr<Difference> d = notched_corners();
+  IndexedMesh mesh = contour(*d, grid_around(d->get_aabb(), 0.05), 2);
+  mesh.save_stl("test_contour.stl", true);
+  EXPECT_VALID_STL("test_contour.stl", true);
+  remove("test_contour.stl");
+}
+
+TEST(Contour, test_refuses_empty_grids) {
+  shared_ptr<Tetrahedron> t = corner(0.0, 0.0, 0.0);
+  voxel_grid grid = grid_around(t->get_aabb(), 0.1);
+  grid.width = 0;
+  EXPECT_THROW(contour(*t, grid), invalid_argument);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,430 @@
+/* layermesh/test/test_csg.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <gtest/gtest.h>
+#include <csg.hpp>
+#include <tetrahedron.hpp>
+#include "solid_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+// A ball which counts how often it is asked whether it contains a point, and
+// whose bounding sphere may be given larger than the ball itself.
+class CountingBall : public Atom {
+  private:
+    gsphere ball;
+    double boundary_radius;
+    gvec_list points;
+  public:
+    mutable atomic<unsigned> calls;
+
+    CountingBall(gvec centre, double radius, double boundary_radius)
+      : boundary_radius(boundary_radius), calls(0) {
+      ball.centre = centre;
+      ball.radius = radius;
+      unsigned a;
+      for (a = 0; a < 3; ++a) {
+        gvec offset;
+        offset[a] = radius;
+        points.push_back(centre + offset);
+        points.push_back(centre - offset);
+      }
+    };
+    virtual gvec_view point_cloud_view() const { return points; };
+    virtual unsigned internal_points_start_index() const {
+      return points.size();
+    };
+    virtual gsphere get_boundary() const {
+      gsphere ret = ball;
+      ret.radius = boundary_radius;
+      return ret;
+    };
+    virtual bool contains(gvec point) const {
+      ++calls;
+      gvec offset = point - ball.centre;
+      return offset * offset <= ball.radius * ball.radius;
+    };
+};
+
+// checks the batch forms of solid against contains(), over a box of points.
+static void expect_batches_agree(const Solid& solid) {
+  const size_t count = 1000;
+  vector<double> x(count), y(count), z(count);
+  vector<float> xf(count), yf(count), zf(count);
+  srand(5);
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    xf[i] = x[i] = float(3.0 * rand() / RAND_MAX - 1.0);
+    yf[i] = y[i] = float(3.0 * rand() / RAND_MAX - 1.0);
+    zf[i] = z[i] = float(3.0 * rand() / RAND_MAX - 1.0);
+  }
+  vector<unsigned char> mask(count), mask32(count);
+  solid.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+  solid.contains_batch(&xf[0], &yf[0], &zf[0], count, &mask32[0]);
+  unsigned inside = 0;
+  for (i = 0; i < count; ++i) {
+    bool expected = solid.contains(gvec(x[i], y[i], z[i]));
+    EXPECT_EQ(mask[i], expected ? 1 : 0) << "point " << i;
+    EXPECT_EQ(mask32[i], expected ? 1 : 0) << "point " << i;
+    inside += expected;
+  }
+  EXPECT_GT(inside, 0u) << "the test points all missed the solid.";
+  // (an empty batch leaves the mask alone.)
+  unsigned char untouched[2] = {7, 7};
+  solid.contains_batch(&x[0], &y[0], &z[0], 0, untouched);
+  solid.contains_batch(&xf[0], &yf[0], &zf[0], 0, untouched + 1);
+  EXPECT_EQ(untouched[0], 7);
+  EXPECT_EQ(untouched[1], 7);
+}
+
+TEST(CSG, test_union) {
+  Union u;
+  u.add(corner(0.0, 0.0, 0.0));
+  u.add(corner(1.0, 0.0, 0.0));
+
+  EXPECT_EQ(u.size(), 2u);
+  EXPECT_EQ(u.leaves(), 2u);
+  EXPECT_TRUE(u.contains(gvec(0.1, 0.1, 0.1)));
+  EXPECT_TRUE(u.contains(gvec(1.1, 0.1, 0.1)));
+  EXPECT_FALSE(u.contains(gvec(0.6, 0.6, 0.6)));
+  EXPECT_FALSE(u.contains(gvec(-5.0, 0.0, 0.0)));
+  expect_batches_agree(u);
+
+  gsphere boundary = u.get_boundary();
+  gvec offset = gvec(2.0, 0.0, 0.0) - boundary.centre;
+  EXPECT_LE(layermesh::modulus(offset), boundary.radius + 1e-12)
+    << "the union's boundary doesn't contain its children.";
+}
+
+TEST(CSG, test_intersection) {
+  Intersection i;
+  EXPECT_FALSE(i.contains(gvec(0.0, 0.0, 0.0)))
+    << "an empty intersection should contain nothing.";
+
+  i.add(corner(0.0, 0.0, 0.0));
+  i.add(corner(-0.5, 0.0, 0.0));
+  EXPECT_TRUE(i.contains(gvec(0.1, 0.1, 0.1)));
+  EXPECT_FALSE(i.contains(gvec(0.6, 0.1, 0.1)));
+  EXPECT_FALSE(i.contains(gvec(-0.4, 0.1, 0.1)));
+  expect_batches_agree(i);
+}
+
+TEST(CSG, test_difference_of_union) {
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(corner(0.0, 0.0, 0.0));
+  u->add(corner(1.0, 0.0, 0.0));
+  Difference d(u);
+  d.add(corner(0.05, 0.05, 0.05));
+
+  EXPECT_EQ(d.leaves(), 3u);
+  EXPECT_TRUE(d.contains(gvec(0.02, 0.02, 0.02)));
+  EXPECT_FALSE(d.contains(gvec(0.1, 0.1, 0.1)));
+  EXPECT_TRUE(d.contains(gvec(1.1, 0.1, 0.1)));
+  EXPECT_FALSE(d.contains(gvec(3.0, 0.0, 0.0)));
+  expect_batches_agree(d);
+}
+
+TEST(CSG, test_bounding_spheres_skip_children) {
+  shared_ptr<CountingBall> near = make_shared<CountingBall>(gvec(), 1.0, 1.0);
+  shared_ptr<CountingBall> far =
+    make_shared<CountingBall>(gvec(10.0, 0.0, 0.0), 1.0, 1.0);
+  Union u;
+  u.add(near);
+  u.add(far);
+
+  EXPECT_TRUE(u.contains(gvec(0.5, 0.0, 0.0)));
+  EXPECT_FALSE(u.contains(gvec(5.0, 0.0, 0.0)));
+  EXPECT_FALSE(u.contains(gvec(50.0, 0.0, 0.0)));
+  EXPECT_EQ(near->calls.load(), 1u);
+  EXPECT_EQ(far->calls.load(), 0u)
+    << "a child was asked about points outside its bounding sphere.";
+
+  Intersection i;
+  i.add(near);
+  i.add(far);
+  EXPECT_FALSE(i.contains(gvec(0.5, 0.0, 0.0)));
+  EXPECT_EQ(near->calls.load(), 1u)
+    << "an intersection should reject points outside any child's sphere.";
+}
+
+TEST(CSG, test_union_accepts_at_first_child) {
+  shared_ptr<CountingBall> a = make_shared<CountingBall>(gvec(), 1.0, 1.0);
+  shared_ptr<CountingBall> b = make_shared<CountingBall>(gvec(), 1.0, 1.0);
+  Union u;
+  u.add(a);
+  u.add(b);
+  EXPECT_TRUE(u.contains(gvec()));
+  EXPECT_EQ(a->calls.load() + b->calls.load(), 1u);
+}
+
+TEST(CSG, test_reorder_by_observed_decisions) {
+  // The hollow ball has the larger sphere, so is guessed the more likely to
+  // contain a point and evaluated first, but contains nothing:
+  shared_ptr<CountingBall> hollow =
+    make_shared<CountingBall>(gvec(), 0.0, 2.0);
+  shared_ptr<CountingBall> ball = make_shared<CountingBall>(gvec(), 1.0, 1.0);
+  Union u;
+  u.add(ball);
+  u.add(hollow);
+  u.reorder();
+  ASSERT_EQ(&static_cast<const Leaf&>(u[0]).atom(), hollow.get());
+
+  const size_t count = 64;
+  vector<double> x(count, 0.1), y(count, 0.2), z(count, 0.3);
+  vector<unsigned char> mask(count);
+  u.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+  EXPECT_EQ(u.stats(0).tested.load(), count);
+  EXPECT_EQ(u.stats(0).decided.load(), 0u);
+  EXPECT_EQ(u.stats(1).decided.load(), count);
+
+  u.reorder();
+  EXPECT_EQ(&static_cast<const Leaf&>(u[0]).atom(), ball.get())
+    << "the child which settles queries should now be evaluated first.";
+  EXPECT_EQ(u.stats(0).tested.load(), 0u) << "reorder() should reset stats.";
+
+  hollow->calls = 0;
+  u.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+  EXPECT_EQ(hollow->calls.load(), 0u);
+  expect_batches_agree(u);
+}
+
+TEST(CSG, test_many_children_through_hierarchy) {
+  // (enough children that the union and difference search a Bvh.)
+  vector<shared_ptr<Tetrahedron> > atoms;
+  Union u;
+  array<gvec, 4> base = {{
+    gvec(-1.0, -1.0, -1.0),
+    gvec(2.0, -1.0, -1.0),
+    gvec(-1.0, 2.0, -1.0),
+    gvec(-1.0, -1.0, 2.0)
+  }};
+  shared_ptr<Difference> d =
+    make_shared<Difference>(make_shared<Tetrahedron>(base));
+  unsigned i, j, k;
+  for (i = 0; i < 5; ++i) {
+    for (j = 0; j < 5; ++j) {
+      for (k = 0; k < 2; ++k) {
+        atoms.push_back(corner(0.4 * i - 1.0, 0.4 * j - 1.0, 0.6 * k - 1.0));
+        u.add(atoms.back());
+        d->add(atoms.back());
+      }
+    }
+  }
+  expect_batches_agree(u);
+  expect_batches_agree(*d);
+
+  srand(6);
+  for (i = 0; i < 2000; ++i) {
+    gvec p(3.0 * rand() / RAND_MAX - 1.0,
+           3.0 * rand() / RAND_MAX - 1.0,
+           3.0 * rand() / RAND_MAX - 1.0);
+    bool in_any = false;
+    for (j = 0; j < atoms.size(); ++j) {
+      in_any = in_any || atoms[j]->contains(p);
+    }
+    EXPECT_EQ(u.contains(p), in_any) << "point " << i;
+    EXPECT_EQ(d->contains(p), !in_any && d->base().contains(p))
+      << "point " << i;
+  }
+}
+
+TEST(CSG, test_empty_child_in_hierarchy) {
+  // (a child with an empty box, among enough that the union uses a Bvh.)
+  Union u;
+  u.add(make_shared<Union>());
+  unsigned i;
+  for (i = 0; i < 20; ++i) u.add(corner(1.5 * i, 0.0, 0.0));
+  u.add(make_shared<Intersection>());
+  for (i = 0; i < 20; ++i) {
+    EXPECT_TRUE(u.contains(gvec(1.5 * i + 0.1, 0.1, 0.1))) << "corner " << i;
+    EXPECT_FALSE(u.contains(gvec(1.5 * i + 0.9, 0.9, 0.9))) << "corner " << i;
+  }
+  expect_batches_agree(u);
+}
+
+TEST(CSG, test_scanline_spans) {
+  // (along the line y = z = 0.1, each corner spans 0.8 in x.)
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(corner(0.0, 0.0, 0.0));
+  u->add(corner(0.5, 0.0, 0.0));
+  u->add(corner(2.0, 0.0, 0.0));
+  span_list spans;
+  u->scanline_spans(0.1, 0.1, -10.0, 10.0, spans);
+  ASSERT_EQ(spans.size(), 2u) << "overlapping spans should be merged.";
+  EXPECT_NEAR(spans[0].enter, 0.0, 1e-12);
+  EXPECT_NEAR(spans[0].exit, 1.3, 1e-12);
+  EXPECT_NEAR(spans[1].enter, 2.0, 1e-12);
+
+  spans.clear();
+  u->scanline_spans(0.1, 0.1, 0.2, 2.1, spans);
+  ASSERT_EQ(spans.size(), 2u);
+  EXPECT_EQ(spans[0].enter, 0.2) << "spans should be clipped to the range.";
+  EXPECT_EQ(spans[1].exit, 2.1);
+
+  Intersection i;
+  i.add(corner(0.0, 0.0, 0.0));
+  i.add(corner(0.5, 0.0, 0.0));
+  spans.clear();
+  i.scanline_spans(0.1, 0.1, -10.0, 10.0, spans);
+  ASSERT_EQ(spans.size(), 1u);
+  EXPECT_NEAR(spans[0].enter, 0.5, 1e-12);
+  EXPECT_NEAR(spans[0].exit, 0.8, 1e-12);
+
+  Difference d(u);
+  d.add(corner(0.3, 0.0, 0.0));
+  spans.clear();
+  d.scanline_spans(0.1, 0.1, -10.0, 10.0, spans);
+  ASSERT_EQ(spans.size(), 3u) << "the cut should split the first span.";
+  EXPECT_NEAR(spans[0].exit, 0.3, 1e-12);
+  EXPECT_NEAR(spans[1].enter, 1.1, 1e-12);
+  EXPECT_NEAR(spans[1].exit, 1.3, 1e-12);
+
+  spans.clear();
+  d.scanline_spans(5.0, 0.1, -10.0, 10.0, spans);
+  EXPECT_TRUE(spans.empty());
+}
+
+// classifies random boxes, checking a grid of points in each against the
+// answer.
+static void expect_classify_agrees(const Solid& solid) {
+  unsigned q, i, j, k, counts[3] = {0, 0, 0};
+  for (q = 0; q < 500; ++q) {
+    gvec low(2.4 * rand() / RAND_MAX - 0.2, 1.6 * rand() / RAND_MAX - 0.2,
+             1.4 * rand() / RAND_MAX - 0.2);
+    gvec size = gvec(rand(), rand(), rand()) * (0.3 / RAND_MAX);
+    box_relation r = solid.classify(gbox{low, low + size});
+    ++counts[r];
+    if (r == box_crossing) continue;
+    for (i = 0; i <= 4; ++i) {
+      for (j = 0; j <= 4; ++j) {
+        for (k = 0; k <= 4; ++k) {
+          gvec p = low + gvec(size[0] * i, size[1] * j, size[2] * k) / 4.0;
+          EXPECT_EQ(solid.contains(p), r == box_inside) << "box " << q;
+        }
+      }
+    }
+  }
+  EXPECT_GT(counts[box_inside], 0u);
+  EXPECT_GT(counts[box_outside], 0u);
+}
+
+TEST(CSG, test_classify_boxes) {
+  srand(31);
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(corner(0.0, 0.0, 0.0));
+  u->add(corner(0.8, 0.3, 0.0));
+  expect_classify_agrees(*u);
+  Difference d(u);
+  d.add(corner(0.1, 0.1, 0.1));
+  expect_classify_agrees(d);
+
+  Intersection i;
+  i.add(corner(0.0, 0.0, 0.0));
+  i.add(corner(0.2, 0.0, 0.0));
+  expect_classify_agrees(i);
+  EXPECT_EQ(Intersection().classify(gbox{gvec(), gvec(1.0, 1.0, 1.0)}),
+            box_outside);
+}
+
+TEST(CSG, test_replace_and_remove) {
+  shared_ptr<Union> u = make_shared<Union>();
+  unsigned i;
+  for (i = 0; i < 20; ++i) {
+    u->add(corner(2.0 * i, 0.0, 0.0));
+  }
+  Difference d(u);
+  d.add(corner(0.0, 0.0, 0.0));
+  EXPECT_TRUE(u->contains(gvec(10.1, 0.1, 0.1)));
+
+  vector<gbox> changed;
+  u->replace(5, corner(10.0, 5.0, 0.0), changed);
+  ASSERT_EQ(changed.size(), 2u) << "both boxes should be listed.";
+  EXPECT_EQ(changed[0].high[1], 1.0);
+  EXPECT_EQ(changed[1].low[1], 5.0);
+  EXPECT_FALSE(u->contains(gvec(10.1, 0.1, 0.1)));
+  EXPECT_TRUE(u->contains(gvec(10.1, 5.1, 0.1)));
+  EXPECT_EQ(u->get_aabb().high[1], 6.0);
+  EXPECT_EQ(u->size(), 20u);
+
+  // (the difference still has the union's old bounds, until refreshed:)
+  EXPECT_EQ(d.get_aabb().high[1], 1.0);
+  d.refresh_bounds();
+  EXPECT_EQ(d.get_aabb().high[1], 6.0);
+  EXPECT_TRUE(d.contains(gvec(10.1, 5.1, 0.1)));
+
+  u->remove(19, changed);
+  ASSERT_EQ(changed.size(), 3u);
+  EXPECT_EQ(changed[2].low[0], 38.0);
+  EXPECT_EQ(u->size(), 19u);
+  EXPECT_EQ(u->leaves(), 19u);
+  EXPECT_EQ(u->get_aabb().high[0], 37.0);
+  EXPECT_FALSE(u->contains(gvec(38.1, 0.1, 0.1)));
+  EXPECT_TRUE(u->contains(gvec(36.1, 0.1, 0.1)));
+
+  Intersection n;
+  n.add(corner(0.0, 0.0, 0.0));
+  n.add(corner(0.5, 0.0, 0.0));
+  n.replace(1, corner(0.2, 0.0, 0.0), changed);
+  EXPECT_EQ(n.get_aabb().low[0], 0.2);
+  EXPECT_TRUE(n.contains(gvec(0.3, 0.1, 0.1)));
+  n.remove(0, changed);
+  n.remove(0, changed);
+  EXPECT_FALSE(n.contains(gvec(0.3, 0.1, 0.1)));
+
+  // (an added child is listed; but in an intersection, which it may cut
+  // anywhere, so is the whole, unless it was empty.)
+  changed.clear();
+  u->add(corner(50.0, 0.0, 0.0), changed);
+  n.add(corner(0.0, 0.0, 0.0), changed);
+  n.add(corner(0.5, 0.0, 0.0), changed);
+  ASSERT_EQ(changed.size(), 3u);
+  EXPECT_EQ(changed[0].low[0], 50.0);
+  EXPECT_EQ(changed[1].high[0], 1.0);
+  EXPECT_EQ(changed[2].low[0], 0.0);
+  EXPECT_EQ(changed[2].high[0], 1.0);
+  EXPECT_TRUE(u->contains(gvec(50.1, 0.1, 0.1)));
+  // (and losing one may grow it anywhere in what's left.)
+  n.remove(1, changed);
+  ASSERT_EQ(changed.size(), 5u);
+  EXPECT_EQ(changed[3].low[0], 0.5);
+  EXPECT_EQ(changed[4].low[0], 0.0);
+  EXPECT_EQ(changed[4].high[0], 1.0);
+
+  EXPECT_THROW(u->replace(20, corner(0.0, 0.0, 0.0), changed), out_of_range);
+  EXPECT_THROW(u->remove(20, changed), out_of_range);
+  EXPECT_THROW(u->replace(0, shared_ptr<const Solid>(), changed),
+               invalid_argument);
+}
+
+TEST(CSG, test_null_children_are_refused) {
+  Union u;
+  EXPECT_THROW(u.add(shared_ptr<const Solid>()), invalid_argument);
+  EXPECT_THROW(u.add(shared_ptr<const Atom>()), invalid_argument);
+  EXPECT_THROW(Difference(shared_ptr<const Solid>()), invalid_argument);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
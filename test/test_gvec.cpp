@@ -154,6 +154,35 @@ TEST(gvec, test_algebraic_expressions) {
   EXPECT_LT((normal * b), epsilon) << "couldn't compute the normal.";
 }
 
+TEST(gvec, test_single_precision) {
+  layermesh::gvec32 a(0.0f, 1.0f, 2.0f);
+  layermesh::gvec32 c = (a + a) * 2;
+
+  EXPECT_EQ(c[2], 8.0f) << "cannot do arithmetic in single precision.";
+  EXPECT_EQ(sizeof(layermesh::gvec32), 3 * sizeof(float))
+    << "single precision gvec is padded.";
+
+  layermesh::gvec d(a);
+  EXPECT_EQ(d[1], 1.0) << "cannot convert between precisions.";
+
+  layermesh::gvec32_list points(2, a);
+  layermesh::gsphere32 s = {a, 1.5f};
+  EXPECT_EQ(points[1][2], s.centre[2]) << "missing single precision aliases.";
+}
+
+TEST(gvec, test_constexpr) {
+  // the arithmetic is usable in constant expressions:
+  constexpr layermesh::gvec x(1.0, 0.0, 0.0);
+  constexpr layermesh::gvec y(0.0, 1.0, 0.0);
+  constexpr layermesh::gvec z = (x - y) ^ (y + x * 2.0);
+
+  static_assert(z[2] == 3.0, "cannot compute cross product at compile time.");
+  static_assert(x * y == 0.0, "cannot compute dot product at compile time.");
+
+  EXPECT_EQ(z[0], 0.0) << "cannot compute compound expression.";
+  EXPECT_EQ(z[1], 0.0) << "cannot compute compound expression.";
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
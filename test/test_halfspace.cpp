@@ -0,0 +1,133 @@
+/* layermesh/test/test_halfspace.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <halfspace.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+// the unit cube [0, 1]^3 as six half-spaces:
+gplane_list unit_cube() {
+  gplane_list planes;
+  planes.push_back(plane_through(gvec(1., 0., 0.), gvec(1., 0., 0.)));
+  planes.push_back(plane_through(gvec(0., 0., 0.), gvec(-1., 0., 0.)));
+  planes.push_back(plane_through(gvec(0., 1., 0.), gvec(0., 1., 0.)));
+  planes.push_back(plane_through(gvec(0., 0., 0.), gvec(0., -1., 0.)));
+  planes.push_back(plane_through(gvec(0., 0., 1.), gvec(0., 0., 1.)));
+  planes.push_back(plane_through(gvec(0., 0., 0.), gvec(0., 0., -1.)));
+  return planes;
+}
+
+TEST(halfspace, test_plane_through) {
+  gplane p = plane_through(gvec(2., 3., 4.), gvec(0., 0., 1.));
+
+  EXPECT_EQ(p.offset, 4.) << "incorrect plane offset.";
+  EXPECT_EQ(p.normal[2], 1.) << "plane normal not preserved.";
+}
+
+TEST(halfspace, test_contains) {
+  gplane_list planes = unit_cube();
+
+  EXPECT_TRUE(halfspaces_contain(&planes[0], 6, gvec(0.5, 0.5, 0.5)))
+    << "can't detect point contained";
+  EXPECT_TRUE(halfspaces_contain(&planes[0], 6, gvec(1.0, 0.5, 0.0)))
+    << "points on the boundary should be contained";
+  EXPECT_FALSE(halfspaces_contain(&planes[0], 6, gvec(0.5, 1.5, 0.5)))
+    << "doesn't reject point not contained";
+}
+
+TEST(halfspace, test_batch_agrees_with_scalar) {
+  gplane_list planes = unit_cube();
+
+  // an awkward length, so that the scalar remainder is exercised too:
+  const size_t count = 1003;
+  vector<double> x(count), y(count), z(count);
+  vector<unsigned char> mask(count, 7);
+
+  srand(17);
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    x[i] = 3.0 * rand() / RAND_MAX - 1.0;
+    y[i] = 3.0 * rand() / RAND_MAX - 1.0;
+    z[i] = 3.0 * rand() / RAND_MAX - 1.0;
+  }
+
+  halfspaces_contain_batch(&planes[0], 6, &x[0], &y[0], &z[0], count, &mask[0]);
+
+  unsigned hits = 0;
+  for (i = 0; i < count; ++i) {
+    bool expected = halfspaces_contain(&planes[0], 6, gvec(x[i], y[i], z[i]));
+    ASSERT_EQ(mask[i], expected ? 1 : 0) << "batch disagrees at point " << i;
+    hits += mask[i];
+  }
+
+  EXPECT_GT(hits, 0u) << "test points never landed in the cube.";
+  EXPECT_LT(hits, count) << "test points never missed the cube.";
+}
+
+TEST(halfspace, test_order_by_rejection) {
+  gplane_list planes = unit_cube();
+
+  // samples above and to the right of the cube, which only the +y and +x
+  // planes reject (the +y plane more of them):
+  gvec_list samples;
+  unsigned i;
+  for (i = 0; i < 10; ++i) {
+    samples.push_back(gvec(0.5, 1.5, 0.5));
+  }
+  for (i = 0; i < 5; ++i) {
+    samples.push_back(gvec(1.5, 0.5, 0.5));
+  }
+  samples.push_back(gvec(1.5, 1.5, 0.5));
+
+  order_by_rejection(planes, samples);
+  ASSERT_EQ(planes.size(), 6u) << "planes were lost.";
+  EXPECT_EQ(planes[0].normal[1], 1.) << "+y plane should be first.";
+  EXPECT_EQ(planes[1].normal[0], 1.) << "+x plane should be second.";
+  EXPECT_EQ(planes[2].normal[0], -1.) << "unused planes should keep order.";
+}
+
+TEST(halfspace, test_clip_x) {
+  gplane_list planes = unit_cube();
+  span s;
+
+  ASSERT_TRUE(halfspaces_clip_x(&planes[0], 6, 0.5, 0.25, s))
+    << "the line through the cube should meet it.";
+  EXPECT_EQ(s.enter, 0.0);
+  EXPECT_EQ(s.exit, 1.0);
+  EXPECT_FALSE(halfspaces_clip_x(&planes[0], 6, 1.5, 0.25, s))
+    << "a line beside the cube should miss it.";
+
+  // a slanted plane, x + y <= 1, cuts the line at x = 1 - y:
+  planes[0] = plane_through(gvec(1., 0., 0.), gvec(1., 1., 0.));
+  ASSERT_TRUE(halfspaces_clip_x(&planes[0], 6, 0.25, 0.5, s));
+  EXPECT_DOUBLE_EQ(s.exit, 0.75);
+
+  // (unbounded along x, with only the other planes.)
+  ASSERT_TRUE(halfspaces_clip_x(&planes[2], 4, 0.5, 0.5, s));
+  EXPECT_LT(s.enter, -1e300);
+  EXPECT_GT(s.exit, 1e300);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
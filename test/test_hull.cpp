@@ -0,0 +1,138 @@
+/* layermesh/test/test_hull.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <set>
+#include <stdexcept>
+#include <hull.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+namespace {
+
+  // n points spread evenly over the unit sphere (a Fibonacci lattice):
+  gvec_list sphere_points(unsigned n) {
+    gvec_list points;
+    const double golden_angle = M_PI * (3.0 - sqrt(5.0));
+    unsigned i;
+    for (i = 0; i < n; ++i) {
+      double z = 1.0 - (2.0 * i + 1.0) / n;
+      double r = sqrt(1.0 - z * z);
+      points.push_back(gvec(r * cos(golden_angle * i),
+                            r * sin(golden_angle * i),
+                            z));
+    }
+    return points;
+  }
+
+  // true if every point is on the inner side of (or on) every facet.
+  bool all_inside(const gvec_list& points, const facet_triples& facets) {
+    facet_triples::const_iterator it = facets.begin();
+    for (; it != facets.end(); ++it) {
+      const gvec& o = points[(*it)[0]];
+      gvec n = (points[(*it)[1]] - o) ^ (points[(*it)[2]] - o);
+      n = n / layermesh::modulus(n);
+      gvec_list::const_iterator p = points.begin();
+      for (; p != points.end(); ++p) {
+        if (n * (*p - o) > 1e-12) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+}
+
+TEST(hull, test_cube) {
+  gvec_list points;
+  unsigned i;
+  // some interior points first, so that they are seen before the corners:
+  for (i = 0; i < 20; ++i) {
+    points.push_back(gvec(0.1 + 0.04 * i, 0.5, 0.9 - 0.04 * i));
+  }
+  for (i = 0; i < 8; ++i) {
+    points.push_back(gvec(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+  }
+
+  facet_triples facets = convex_hull(&points[0], points.size());
+  EXPECT_EQ(facets.size(), 12u) << "a cube has twelve triangular facets.";
+  EXPECT_TRUE(all_inside(points, facets)) << "facets aren't wound outwards.";
+
+  set<unsigned> vertices;
+  for (i = 0; i < facets.size(); ++i) {
+    vertices.insert(facets[i].begin(), facets[i].end());
+  }
+  EXPECT_EQ(vertices.size(), 8u) << "interior points became vertices.";
+  EXPECT_EQ(*vertices.begin(), 20u) << "interior points became vertices.";
+
+  gplane_list planes = hull_planes(&points[0], facets);
+  EXPECT_EQ(planes.size(), 6u) << "coplanar facets weren't merged.";
+  EXPECT_TRUE(halfspaces_contain(&planes[0], planes.size(),
+                                 gvec(0.5, 0.5, 0.5)))
+    << "hull planes don't contain the centre.";
+  EXPECT_FALSE(halfspaces_contain(&planes[0], planes.size(),
+                                  gvec(0.5, 1.5, 0.5)))
+    << "hull planes contain a point outside.";
+}
+
+TEST(hull, test_sphere) {
+  gvec_list points = sphere_points(2000);
+
+  facet_triples facets = convex_hull(&points[0], points.size());
+  // every point is a vertex, and a closed triangulation with V vertices has
+  // 2V - 4 faces:
+  EXPECT_EQ(facets.size(), 2 * points.size() - 4)
+    << "wrong number of facets.";
+  EXPECT_TRUE(all_inside(points, facets)) << "facets aren't wound outwards.";
+}
+
+TEST(hull, test_threads_agree) {
+  // enough points that the first partitions are split between threads:
+  gvec_list points = sphere_points(40000);
+
+  facet_triples serial = convex_hull(&points[0], points.size());
+  facet_triples parallel = convex_hull(&points[0], points.size(), 4);
+  EXPECT_EQ(serial.size(), 2 * points.size() - 4)
+    << "wrong number of facets.";
+  EXPECT_TRUE(serial == parallel)
+    << "the hull found on several threads is different.";
+}
+
+TEST(hull, test_degenerate_points_throw) {
+  gvec_list points;
+  points.push_back(gvec(0.0, 0.0, 0.0));
+  points.push_back(gvec(1.0, 0.0, 0.0));
+  points.push_back(gvec(0.0, 1.0, 0.0));
+  EXPECT_THROW(convex_hull(&points[0], points.size()), invalid_argument)
+    << "too few points weren't reported.";
+
+  points.push_back(gvec(1.0, 1.0, 0.0));
+  points.push_back(gvec(0.5, 0.3, 0.0));
+  EXPECT_THROW(convex_hull(&points[0], points.size()), invalid_argument)
+    << "coplanar points weren't reported.";
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,77 @@
+/* layermesh/test/test_normals.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+#include <normals.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+TEST(normals, test_normalise_batch) {
+  // an awkward length, so that the scalar remainder is exercised, and some
+  // lengths far outside the range of a float:
+  const size_t count = 23;
+  vector<double> x(count), y(count), z(count);
+  gvec_list expected;
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    double scale = pow(10.0, (int)(i % 7) * 10 - 30);
+    gvec v(scale * (1.0 + i), scale * (2.0 - 0.3 * i), scale * 0.7);
+    x[i] = v[0];
+    y[i] = v[1];
+    z[i] = v[2];
+    expected.push_back(v / layermesh::modulus(v));
+  }
+
+  normalise_batch(&x[0], &y[0], &z[0], count);
+
+  // (two Newton steps from the float estimate leave an error of a few ulps.)
+  for (i = 0; i < count; ++i) {
+    EXPECT_NEAR(x[i], expected[i][0], 1e-14) << "x wrong at " << i;
+    EXPECT_NEAR(y[i], expected[i][1], 1e-14) << "y wrong at " << i;
+    EXPECT_NEAR(z[i], expected[i][2], 1e-14) << "z wrong at " << i;
+  }
+}
+
+TEST(normals, test_facet_normals_batch) {
+  gvec_list points;
+  points.push_back(gvec(0.0, 0.0, 0.0));
+  points.push_back(gvec(1.0, 0.0, 0.0));
+  points.push_back(gvec(0.0, 2.0, 0.0));
+  points.push_back(gvec(0.0, 0.0, 3.0));
+  facet_triples facets;
+  facets.push_back({{0, 1, 2}});
+  facets.push_back({{0, 2, 1}});
+  facets.push_back({{0, 3, 2}});
+
+  double x[2], y[2], z[2];
+  facet_normals_batch(points, facets, 1, 3, x, y, z);
+
+  EXPECT_FLOAT_EQ(z[0], -1.0f) << "normal of reversed facet should point down.";
+  EXPECT_FLOAT_EQ(x[1], -1.0f) << "normal of yz facet should point along -x.";
+  EXPECT_FLOAT_EQ(y[1], 0.0f) << "normal of yz facet has a y component.";
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,324 @@
+/* layermesh/test/test_octree.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <octree.hpp>
+#include <tetrahedron.hpp>
+#include "tiff_helper.hpp"
+#include "solid_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+static shared_ptr<Difference> scene() {
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(corner(0.0, 0.0, 0.0));
+  u->add(corner(0.8, 0.3, 0.0));
+  shared_ptr<Difference> d = make_shared<Difference>(u);
+  d->add(corner(0.1, 0.1, 0.1));
+  return d;
+}
+
+// a corner with walls wall thick: the corner, less a smaller one inside it.
+static shared_ptr<Difference> shell(double wall) {
+  shared_ptr<Difference> d = make_shared<Difference>(corner(0.0, 0.0, 0.0));
+  d->add(corner(wall, wall, wall, 1.0 - 4.0 * wall));
+  return d;
+}
+
+// checks every layer of the octree against render_slice.
+template <typename S>
+static void expect_slices_match(const S& solid, const VoxelOctree& octree) {
+  const voxel_grid& grid = octree.grid();
+  vector<unsigned char> expected(grid.width * grid.height),
+                        found(grid.width * grid.height);
+  unsigned k, inside = 0;
+  for (k = 0; k < grid.layers; ++k) {
+    render_slice(solid, grid, k, &expected[0], render_sampled);
+    octree.slice(k, &found[0]);
+    EXPECT_EQ(found, expected) << "layer " << k;
+    inside += count(expected.begin(), expected.end(), 255);
+  }
+  EXPECT_GT(inside, 0u) << "nothing was rendered.";
+}
+
+TEST(VoxelOctree, test_matches_rendering) {
+  shared_ptr<Difference> d = scene();
+  gbox box = d->get_aabb();
+  // (with a margin, so that some nodes lie beyond the solid's box.)
+  box.low = box.low - gvec(0.1, 0.1, 0.1);
+  voxel_grid grid = grid_covering(box, 0.03);
+  VoxelOctree octree(*d, grid);
+  expect_slices_match(*d, octree);
+  EXPECT_GT(octree.brick_count(), 0u);
+
+  VoxelOctree parallel(*d, grid, 4);
+  EXPECT_EQ(parallel.node_count(), octree.node_count());
+  EXPECT_EQ(parallel.brick_count(), octree.brick_count());
+  expect_slices_match(*d, parallel);
+
+  shared_ptr<Tetrahedron> t = corner(0.0, 0.0, 0.0);
+  VoxelOctree atom(*t, grid_covering(t->get_aabb(), 0.05));
+  expect_slices_match(*t, atom);
+}
+
+TEST(VoxelOctree, test_point_queries) {
+  shared_ptr<Difference> d = scene();
+  voxel_grid grid = grid_covering(d->get_aabb(), 0.02);
+  VoxelOctree octree(*d, grid);
+  srand(21);
+  unsigned q, inside = 0;
+  for (q = 0; q < 2000; ++q) {
+    gvec p(2.0 * rand() / RAND_MAX - 0.2, 1.6 * rand() / RAND_MAX - 0.2,
+           1.4 * rand() / RAND_MAX - 0.2);
+    gvec index = (p - grid.origin) / grid.voxel;
+    bool in_grid = index[0] >= 0.0 && index[0] < grid.width &&
+                   index[1] >= 0.0 && index[1] < grid.height &&
+                   index[2] >= 0.0 && index[2] < grid.layers;
+    bool expected = false;
+    if (in_grid) {
+      unsigned i = index[0], j = index[1], k = index[2];
+      expected = d->contains(grid.origin +
+                             gvec(i + 0.5, j + 0.5, k + 0.5) * grid.voxel);
+      EXPECT_EQ(octree.occupied(i, j, k), expected);
+    }
+    EXPECT_EQ(octree.contains(p), expected) << "query " << q;
+    inside += expected;
+  }
+  EXPECT_GT(inside, 0u);
+  EXPECT_FALSE(octree.occupied(grid.width, 0, 0));
+  EXPECT_FALSE(octree.contains(gvec(-1.0, 0.5, 0.5)));
+}
+
+TEST(VoxelOctree, test_memory_follows_surface) {
+  // (a solid block collapses to a handful of nodes:)
+  shared_ptr<Tetrahedron> t = corner(-1.0, -1.0, -1.0, 10.0);
+  voxel_grid grid = grid_covering(gbox{gvec(0.0, 0.0, 0.0),
+                                       gvec(1.0, 1.0, 1.0)}, 1.0 / 128);
+  VoxelOctree block(*t, grid);
+  EXPECT_EQ(block.node_count(), 0u);
+  EXPECT_EQ(block.brick_count(), 0u);
+  EXPECT_TRUE(block.occupied(5, 6, 7));
+
+  // halving the voxels of a thin walled solid should roughly quadruple the
+  // bricks, not multiply them by eight.
+  shared_ptr<Difference> s = shell(0.05);
+  VoxelOctree coarse(*s, grid_covering(s->get_aabb(), 1.0 / 64));
+  VoxelOctree fine(*s, grid_covering(s->get_aabb(), 1.0 / 128));
+  expect_slices_match(*s, fine);
+  double growth = double(fine.memory()) / coarse.memory();
+  EXPECT_GT(growth, 3.0);
+  EXPECT_LT(growth, 5.5);
+  // (and a bit per voxel of the whole grid would be far more:)
+  const voxel_grid& g = fine.grid();
+  EXPECT_LT(fine.memory(), size_t(g.width) * g.height * g.layers / 8 / 4);
+}
+
+TEST(VoxelOctree, test_coarser_levels) {
+  shared_ptr<Difference> d = scene();
+  VoxelOctree octree(*d, grid_covering(d->get_aabb(), 0.03));
+  const voxel_grid& grid = octree.grid();
+  unsigned level;
+  for (level = 1; level <= 2; ++level) {
+    voxel_grid coarse = octree.grid(level);
+    unsigned scale = 1u << level;
+    EXPECT_EQ(coarse.voxel, grid.voxel * scale);
+    EXPECT_GE(coarse.width * scale, grid.width);
+    EXPECT_LT((coarse.width - 1) * scale, grid.width);
+    vector<unsigned char> pixels(coarse.width * coarse.height);
+    unsigned layer, px, py, i, j, k;
+    for (layer = 0; layer < coarse.layers; ++layer) {
+      octree.slice(layer, &pixels[0], level);
+      for (py = 0; py < coarse.height; ++py) {
+        for (px = 0; px < coarse.width; ++px) {
+          unsigned occupied = 0, total = 0;
+          for (k = layer * scale; k < min((layer + 1) * scale, grid.layers);
+               ++k) {
+            for (j = py * scale; j < min((py + 1) * scale, grid.height); ++j) {
+              for (i = px * scale; i < min((px + 1) * scale, grid.width);
+                   ++i) {
+                occupied += octree.occupied(i, j, k);
+                ++total;
+              }
+            }
+          }
+          EXPECT_EQ(pixels[py * coarse.width + px],
+                    (occupied * 255 + total / 2) / total)
+            << "level " << level << ", pixel " << px << ", " << py
+            << ", layer " << layer;
+        }
+      }
+    }
+  }
+  vector<unsigned char> pixels(grid.width * grid.height);
+  EXPECT_THROW(octree.slice(grid.layers, &pixels[0]), invalid_argument);
+  EXPECT_THROW(octree.grid(30), invalid_argument);
+}
+
+TEST(VoxelOctree, test_tiff) {
+  shared_ptr<Difference> d = scene();
+  VoxelOctree octree(*d, grid_covering(d->get_aabb(), 0.04));
+  octree.write_tiff("test_octree.tiff", 1);
+  tiff_pages read = read_tiff("test_octree.tiff");
+  remove("test_octree.tiff");
+  voxel_grid coarse = octree.grid(1);
+  ASSERT_EQ(read.width, coarse.width);
+  ASSERT_EQ(read.height, coarse.height);
+  ASSERT_EQ(read.pages.size(), coarse.layers);
+  vector<unsigned char> pixels(coarse.width * coarse.height);
+  unsigned layer;
+  for (layer = 0; layer < coarse.layers; ++layer) {
+    octree.slice(layer, &pixels[0], 1);
+    EXPECT_EQ(read.pages[layer], pixels);
+  }
+}
+
+TEST(VoxelOctree, test_serialisation) {
+  shared_ptr<Difference> d = scene();
+  VoxelOctree octree(*d, grid_covering(d->get_aabb(), 0.03));
+  vector<unsigned char> data;
+  octree.encode(data);
+  VoxelOctree decoded(&data[0], data.size());
+  EXPECT_EQ(decoded.node_count(), octree.node_count());
+  EXPECT_EQ(decoded.brick_count(), octree.brick_count());
+  EXPECT_EQ(decoded.grid().origin[1], octree.grid().origin[1]);
+  EXPECT_EQ(decoded.grid().voxel, octree.grid().voxel);
+  expect_slices_match(*d, decoded);
+
+  octree.save("test_octree.lmvo");
+  VoxelOctree loaded = VoxelOctree::load("test_octree.lmvo");
+  remove("test_octree.lmvo");
+  expect_slices_match(*d, loaded);
+  EXPECT_THROW(VoxelOctree::load("test_octree.lmvo"), runtime_error);
+
+  // (truncated, or with a node pointing past the end:)
+  EXPECT_THROW(VoxelOctree(&data[0], data.size() - 1), invalid_argument);
+  vector<unsigned char> broken(data);
+  broken[0] = 'X';
+  EXPECT_THROW(VoxelOctree(&broken[0], broken.size()), invalid_argument);
+  broken = data;
+  // (the root's entry, made a node at the end of the nodes:)
+  size_t root = 4 + 4 + 4 * 8 + 3 * 4 + 4;
+  broken[root] = 0xFE;
+  broken[root + 1] = broken[root + 2] = broken[root + 3] = 0xFF;
+  EXPECT_THROW(VoxelOctree(&broken[0], broken.size()), invalid_argument);
+}
+
+// a union of a row of small corners (enough to be found through a
+// hierarchy), less one more.
+static shared_ptr<Difference> row_scene(shared_ptr<Union>& u) {
+  u = make_shared<Union>();
+  unsigned i;
+  for (i = 0; i < 20; ++i) {
+    u->add(corner(0.1 * i, 0.05 * (i % 3), 0.0, 0.3));
+  }
+  shared_ptr<Difference> d = make_shared<Difference>(u);
+  d->add(corner(0.5, 0.0, 0.0, 0.2));
+  return d;
+}
+
+static vector<unsigned char> encoded(const VoxelOctree& octree) {
+  vector<unsigned char> data;
+  octree.encode(data);
+  return data;
+}
+
+TEST(VoxelOctree, test_update_after_edits) {
+  shared_ptr<Union> u;
+  shared_ptr<Difference> d = row_scene(u);
+  gbox box = d->get_aabb();
+  box.high = box.high + gvec(0.2, 0.2, 0.2);
+  voxel_grid grid = grid_covering(box, 0.01);
+  VoxelOctree octree(*d, grid), parallel(*d, grid, 4);
+
+  vector<gbox> changed;
+  u->replace(7, corner(0.75, 0.2, 0.1, 0.35), changed);
+  u->remove(15, changed);
+  u->replace(0, corner(-0.05, 0.0, 0.0, 0.3), changed);
+  u->add(corner(1.2, 0.3, 0.2, 0.15), changed);
+  d->add(corner(0.05, 0.1, 0.1, 0.1), changed);
+  d->refresh_bounds();
+  octree.update(*d, changed);
+  parallel.update(*d, changed, 4);
+  expect_slices_match(*d, octree);
+  // (the reused parts of the tree are laid out just as a new build would
+  // lay them out:)
+  VoxelOctree rebuilt(*d, grid);
+  EXPECT_EQ(encoded(octree), encoded(rebuilt));
+  EXPECT_EQ(encoded(parallel), encoded(rebuilt));
+
+  // (nothing changed, nothing to do; and a change beyond the grid is
+  // ignored.)
+  octree.update(*d, vector<gbox>());
+  octree.update(*d, vector<gbox>(1, gbox{gvec(5.0, 5.0, 5.0),
+                                         gvec(6.0, 6.0, 6.0)}));
+  EXPECT_EQ(encoded(octree), encoded(rebuilt));
+}
+
+TEST(VoxelOctree, test_tiff_stack_rewrites_changed_pages) {
+  shared_ptr<Union> u;
+  shared_ptr<Difference> d = row_scene(u);
+  vector<gbox> changed;
+  u->replace(4, corner(0.4, 0.1, 0.6, 0.05), changed);
+  d->refresh_bounds();
+  VoxelOctree octree(*d, grid_covering(d->get_aabb(), 0.01));
+  TiffStack stack(1);
+  stack.write("test_octree.tiff", octree);
+  unsigned layers = octree.grid(1).layers;
+  EXPECT_EQ(stack.encoded(), layers);
+
+  // (a small change, high up:)
+  changed.clear();
+  u->replace(4, corner(0.45, 0.1, 0.6, 0.05), changed);
+  d->refresh_bounds();
+  octree.update(*d, changed);
+  stack.invalidate(octree, changed);
+  stack.write("test_octree.tiff", octree);
+  EXPECT_GT(stack.encoded(), 0u);
+  EXPECT_LT(stack.encoded(), layers / 2);
+  tiff_pages read = read_tiff("test_octree.tiff");
+
+  VoxelOctree(*d, octree.grid()).write_tiff("test_octree.tiff", 1);
+  EXPECT_EQ(read.pages, read_tiff("test_octree.tiff").pages);
+  remove("test_octree.tiff");
+
+  stack.write("test_octree.tiff", octree);
+  EXPECT_EQ(stack.encoded(), 0u);
+
+  // (another octree of the same size, but elsewhere, shares no pages.)
+  voxel_grid moved = octree.grid();
+  moved.origin[0] -= 0.05;
+  VoxelOctree other(*d, moved);
+  stack.write("test_octree.tiff", other);
+  EXPECT_EQ(stack.encoded(), layers);
+  read = read_tiff("test_octree.tiff");
+  other.write_tiff("test_octree.tiff", 1);
+  EXPECT_EQ(read.pages, read_tiff("test_octree.tiff").pages);
+  remove("test_octree.tiff");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
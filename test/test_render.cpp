@@ -0,0 +1,176 @@
+/* layermesh/test/test_render.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <render.hpp>
+#include <tetrahedron.hpp>
+#include "tiff_helper.hpp"
+#include "solid_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+// checks every pixel of the pages against contains() at its voxel's centre.
+template <typename S>
+static void expect_pages_match(const S& solid, const voxel_grid& grid,
+                               const tiff_pages& read) {
+  ASSERT_EQ(read.width, grid.width);
+  ASSERT_EQ(read.height, grid.height);
+  ASSERT_EQ(read.pages.size(), grid.layers);
+  unsigned i, j, k, inside = 0;
+  for (k = 0; k < grid.layers; ++k) {
+    for (j = 0; j < grid.height; ++j) {
+      for (i = 0; i < grid.width; ++i) {
+        gvec centre = grid.origin +
+          gvec(i + 0.5, j + 0.5, k + 0.5) * grid.voxel;
+        bool expected = solid.contains(centre);
+        EXPECT_EQ(read.pages[k][j * grid.width + i], expected ? 255 : 0)
+          << "voxel " << i << ", " << j << ", " << k;
+        inside += expected;
+      }
+    }
+  }
+  EXPECT_GT(inside, 0u) << "nothing was rendered.";
+}
+
+TEST(Render, test_grid_covering) {
+  gbox box = {gvec(0.0, 1.0, 2.0), gvec(1.0, 1.5, 2.0)};
+  voxel_grid grid = grid_covering(box, 0.3);
+  EXPECT_EQ(grid.origin[1], 1.0);
+  EXPECT_EQ(grid.width, 4u);
+  EXPECT_EQ(grid.height, 2u);
+  EXPECT_EQ(grid.layers, 1u) << "a flat box still needs a layer.";
+
+  EXPECT_THROW(grid_covering(box, 0.0), invalid_argument);
+  box.low[0] = 2.0;
+  EXPECT_THROW(grid_covering(box, 0.1), invalid_argument);
+}
+
+TEST(Render, test_render_atom) {
+  shared_ptr<Tetrahedron> t = corner(0.0, 0.0, 0.0);
+  gbox box = t->get_aabb();
+  // (with a margin, so that some voxels lie beyond the atom's box.)
+  box.low = box.low - gvec(0.2, 0.2, 0.2);
+  voxel_grid grid = grid_covering(box, 0.05);
+  render_tiff("test_render.tiff", *t, grid, tiff_uncompressed);
+  expect_pages_match(*t, grid, read_tiff("test_render.tiff"));
+  remove("test_render.tiff");
+}
+
+TEST(Render, test_render_solid_in_parallel) {
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(corner(0.0, 0.0, 0.0));
+  u->add(corner(0.8, 0.3, 0.0));
+  Difference d(u);
+  d.add(corner(0.1, 0.1, 0.1));
+
+  voxel_grid grid = grid_covering(d.get_aabb(), 0.04);
+  render_tiff("test_render.tiff", d, grid, tiff_packbits, 4);
+  tiff_pages parallel = read_tiff("test_render.tiff");
+  expect_pages_match(d, grid, parallel);
+
+  render_tiff("test_render.tiff", d, grid, tiff_packbits, 1);
+  EXPECT_EQ(read_tiff("test_render.tiff").pages, parallel.pages);
+  remove("test_render.tiff");
+
+  vector<unsigned char> slice(grid.width * grid.height);
+  render_slice(d, grid, grid.layers / 2, &slice[0]);
+  EXPECT_EQ(slice, parallel.pages[grid.layers / 2]);
+}
+
+// renders every layer both ways, which should agree exactly.
+template <typename S>
+static void expect_methods_agree(const S& solid, const voxel_grid& grid) {
+  vector<unsigned char> sampled(grid.width * grid.height),
+                        spans(grid.width * grid.height);
+  unsigned k, inside = 0;
+  for (k = 0; k < grid.layers; ++k) {
+    render_slice(solid, grid, k, &sampled[0], render_sampled);
+    render_slice(solid, grid, k, &spans[0], render_spans);
+    EXPECT_EQ(spans, sampled) << "layer " << k;
+    inside += count(sampled.begin(), sampled.end(), 255);
+  }
+  EXPECT_GT(inside, 0u) << "nothing was rendered.";
+}
+
+TEST(Render, test_spans_agree_with_sampling) {
+  array<gvec32, 4> points = {{
+    gvec32(0.0f, 0.0f, 0.0f),
+    gvec32(1.0f, 0.1f, 0.0f),
+    gvec32(0.2f, 1.0f, 0.1f),
+    gvec32(0.1f, 0.3f, 1.0f)
+  }};
+  Tetrahedron32 t(points);
+  expect_methods_agree(t, grid_covering(t.get_aabb(), 0.02));
+
+  // (far from the origin, where contains() rounds to float more coarsely
+  // than a ten-thousandth of a voxel; alone, and as a solid.)
+  array<gvec32, 4> far_points = {{
+    gvec32(200.0f, 150.0f, 100.0f),
+    gvec32(201.0f, 150.13f, 100.0f),
+    gvec32(200.2f, 151.0f, 100.19f),
+    gvec32(200.31f, 150.3f, 101.0f)
+  }};
+  shared_ptr<Tetrahedron32> far = make_shared<Tetrahedron32>(far_points);
+  expect_methods_agree(*far, grid_covering(far->get_aabb(), 0.05));
+  Union far_union;
+  far_union.add(far);
+  expect_methods_agree(far_union, grid_covering(far->get_aabb(), 0.05));
+
+  // (enough children for the union and difference to use their Bvh, and
+  // voxels which fall exactly on some of the facets.)
+  shared_ptr<Union> u = make_shared<Union>();
+  unsigned i, j;
+  for (i = 0; i < 5; ++i) {
+    for (j = 0; j < 5; ++j) {
+      u->add(corner(0.4 * i, 0.4 * j, 0.3 * ((i + j) % 2)));
+    }
+  }
+  voxel_grid grid = grid_covering(u->get_aabb(), 0.05);
+  expect_methods_agree(*u, grid);
+
+  Difference d(u);
+  d.add(corner(0.5, 0.5, 0.0));
+  d.add(corner(1.2, 0.1, 0.2));
+  expect_methods_agree(d, grid);
+
+  Intersection n;
+  n.add(u);
+  n.add(corner(0.2, 0.2, -0.5));
+  expect_methods_agree(n, grid);
+}
+
+TEST(Render, test_render_errors) {
+  shared_ptr<Tetrahedron> t = corner(0.0, 0.0, 0.0);
+  voxel_grid grid = grid_covering(t->get_aabb(), 0.1);
+  EXPECT_THROW(render_tiff("/nonexistent/test.tiff", *t, grid),
+               runtime_error);
+  grid.voxel = -1.0;
+  EXPECT_THROW(render_tiff("test_render.tiff", *t, grid), invalid_argument);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,266 @@
+/* layermesh/test/test_slice.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <slice.hpp>
+#include <tetrahedron.hpp>
+#include "solid_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+// the area of a layer, counting holes (which run clockwise) against it.
+static double area_of(const layer_contours& layer) {
+  double twice = 0.0;
+  size_t i, j;
+  for (i = 0; i < layer.loops.size(); ++i) {
+    const gvec_list& loop = layer.loops[i];
+    for (j = 0; j < loop.size(); ++j) {
+      const gvec& a = loop[j];
+      const gvec& b = loop[(j + 1) % loop.size()];
+      twice += a[0] * b[1] - a[1] * b[0];
+    }
+  }
+  return 0.5 * twice;
+}
+
+static double loop_area(const gvec_list& loop) {
+  layer_contours layer;
+  layer.loops.push_back(loop);
+  return area_of(layer);
+}
+
+// how many times the loops wind around (x, y), anticlockwise.
+static int winding(const layer_contours& layer, double x, double y) {
+  int w = 0;
+  size_t i, j;
+  for (i = 0; i < layer.loops.size(); ++i) {
+    const gvec_list& loop = layer.loops[i];
+    for (j = 0; j < loop.size(); ++j) {
+      const gvec& a = loop[j];
+      const gvec& b = loop[(j + 1) % loop.size()];
+      double side = (b[0] - a[0]) * (y - a[1]) - (x - a[0]) * (b[1] - a[1]);
+      if (a[1] <= y && b[1] > y && side > 0.0) ++w;
+      if (a[1] > y && b[1] <= y && side < 0.0) --w;
+    }
+  }
+  return w;
+}
+
+// a union of small corners, some of them cut by others.
+static shared_ptr<Difference> scene(unsigned count, unsigned seed) {
+  mt19937 random(seed);
+  uniform_real_distribution<double> place(0.0, 2.0), size(0.2, 0.8);
+  shared_ptr<Union> u = make_shared<Union>();
+  unsigned i;
+  for (i = 0; i < count; ++i) {
+    double x = place(random), y = place(random), z = place(random);
+    u->add(corner(x, y, z, size(random)));
+  }
+  shared_ptr<Difference> d = make_shared<Difference>(u);
+  for (i = 0; i < count / 4; ++i) {
+    double x = place(random), y = place(random), z = place(random);
+    d->add(corner(x, y, z, size(random)));
+  }
+  return d;
+}
+
+TEST(Slice, test_single_atom) {
+  Leaf leaf(corner(0.0, 0.0, 0.0));
+  vector<layer_contours> layers = slice_layers(leaf, {0.5, -0.5, 1.5});
+  ASSERT_EQ(layers.size(), 3u);
+  EXPECT_EQ(layers[0].height, 0.5);
+  ASSERT_EQ(layers[0].loops.size(), 1u);
+  ASSERT_EQ(layers[0].loops[0].size(), 3u);
+  EXPECT_NEAR(area_of(layers[0]), 0.125, 1e-12);
+  size_t j;
+  for (j = 0; j < 3; ++j) EXPECT_EQ(layers[0].loops[0][j][2], 0.5);
+  // (heights the atom doesn't span have nothing.)
+  EXPECT_TRUE(layers[1].loops.empty());
+  EXPECT_TRUE(layers[2].loops.empty());
+}
+
+TEST(Slice, test_corners_along_edges_are_dropped) {
+  shared_ptr<Intersection> c = cube(0.0, 0.0, 0.0);
+  vector<layer_contours> layers = slice_layers(*c, {0.25, 0.5, 0.75});
+  size_t k, j;
+  for (k = 0; k < layers.size(); ++k) {
+    ASSERT_EQ(layers[k].loops.size(), 1u);
+    ASSERT_EQ(layers[k].loops[0].size(), 4u);
+    EXPECT_NEAR(area_of(layers[k]), 1.0, 1e-12);
+    for (j = 0; j < 4; ++j) {
+      const gvec& p = layers[k].loops[0][j];
+      EXPECT_NEAR(fabs(p[0] - 0.5), 0.5, 1e-12);
+      EXPECT_NEAR(fabs(p[1] - 0.5), 0.5, 1e-12);
+    }
+  }
+}
+
+TEST(Slice, test_union_and_holes) {
+  // (two overlapping cubes, less a small one from the middle of both.)
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(cube(0.0, 0.0, 0.0));
+  u->add(cube(0.5, 0.5, 0.0));
+  shared_ptr<Difference> d = make_shared<Difference>(u);
+  d->add(cube(0.6, 0.6, 0.4, 0.2));
+  vector<layer_contours> layers = slice_layers(*d, {-0.25, 0.5});
+  EXPECT_TRUE(layers[0].loops.empty());
+  const layer_contours& layer = layers[1];
+  ASSERT_EQ(layer.loops.size(), 2u);
+  EXPECT_NEAR(area_of(layer), 1.75 - 0.04, 1e-12);
+  // (the outline of the union runs anticlockwise, the hole clockwise.)
+  size_t outline = loop_area(layer.loops[0]) > 0.0 ? 0 : 1;
+  EXPECT_EQ(layer.loops[outline].size(), 8u);
+  EXPECT_NEAR(loop_area(layer.loops[outline]), 1.75, 1e-12);
+  EXPECT_EQ(layer.loops[1 - outline].size(), 4u);
+  EXPECT_NEAR(loop_area(layer.loops[1 - outline]), -0.04, 1e-12);
+}
+
+TEST(Slice, test_shared_and_touching_edges) {
+  // (side by side, sharing a face, and a third touching at an edge.)
+  shared_ptr<Union> u = make_shared<Union>();
+  u->add(cube(0.0, 0.0, 0.0));
+  u->add(cube(1.0, 0.0, 0.0));
+  u->add(cube(2.0, 1.0, 0.0));
+  layer_contours layer = slice_layers(*u, {0.5})[0];
+  ASSERT_EQ(layer.loops.size(), 2u);
+  EXPECT_NEAR(area_of(layer), 3.0, 1e-12);
+  size_t i;
+  for (i = 0; i < 2; ++i) {
+    EXPECT_EQ(layer.loops[i].size(), 4u);
+    EXPECT_GT(loop_area(layer.loops[i]), 0.0);
+  }
+}
+
+TEST(Slice, test_loops_agree_with_contains) {
+  shared_ptr<Difference> d = scene(60, 7);
+  gbox box = d->get_aabb();
+  vector<double> heights = layer_heights(box, 0.25);
+  vector<layer_contours> layers = slice_layers(*d, heights);
+  mt19937 random(11);
+  uniform_real_distribution<double> x(box.low[0], box.high[0]);
+  uniform_real_distribution<double> y(box.low[1], box.high[1]);
+  size_t k, wrong = 0, inside = 0;
+  int s;
+  for (k = 0; k < layers.size(); ++k) {
+    for (s = 0; s < 2000; ++s) {
+      double px = x(random), py = y(random);
+      bool contained = d->contains(gvec(px, py, heights[k]));
+      int w = winding(layers[k], px, py);
+      if (contained) ++inside;
+      if (w != (contained ? 1 : 0)) ++wrong;
+    }
+  }
+  EXPECT_GT(inside, 0u);
+  EXPECT_EQ(wrong, 0u);
+}
+
+TEST(Slice, test_same_on_any_number_of_threads) {
+  shared_ptr<Difference> d = scene(60, 3);
+  vector<double> heights = layer_heights(d->get_aabb(), 0.1);
+  vector<layer_contours> one = slice_layers(*d, heights, 1);
+  vector<layer_contours> many = slice_layers(*d, heights, 5);
+  ASSERT_EQ(one.size(), many.size());
+  size_t k, i, j;
+  for (k = 0; k < one.size(); ++k) {
+    ASSERT_EQ(one[k].loops.size(), many[k].loops.size());
+    for (i = 0; i < one[k].loops.size(); ++i) {
+      ASSERT_EQ(one[k].loops[i].size(), many[k].loops[i].size());
+      for (j = 0; j < one[k].loops[i].size(); ++j) {
+        EXPECT_EQ(layermesh::modulus(one[k].loops[i][j] -
+                                     many[k].loops[i][j]), 0.0);
+      }
+    }
+  }
+}
+
+TEST(Slice, test_layer_heights) {
+  gbox box{gvec(0.0, 0.0, 1.0), gvec(1.0, 1.0, 2.0)};
+  vector<double> heights = layer_heights(box, 0.3);
+  ASSERT_EQ(heights.size(), 4u);
+  EXPECT_DOUBLE_EQ(heights[0], 1.15);
+  EXPECT_DOUBLE_EQ(heights[3], 2.05);
+  EXPECT_THROW(layer_heights(box, 0.0), invalid_argument);
+  gbox empty{gvec(0.0, 0.0, 1.0), gvec(1.0, 1.0, 0.0)};
+  EXPECT_THROW(layer_heights(empty, 0.1), invalid_argument);
+}
+
+TEST(Slice, test_encoding_round_trip) {
+  shared_ptr<Difference> d = scene(30, 5);
+  vector<layer_contours> layers =
+    slice_layers(*d, layer_heights(d->get_aabb(), 0.2));
+  vector<unsigned char> data;
+  encode_layers(layers, data);
+  vector<layer_contours> back = decode_layers(&data[0], data.size());
+  ASSERT_EQ(back.size(), layers.size());
+  size_t k, i, j;
+  for (k = 0; k < layers.size(); ++k) {
+    EXPECT_EQ(back[k].height, layers[k].height);
+    ASSERT_EQ(back[k].loops.size(), layers[k].loops.size());
+    for (i = 0; i < layers[k].loops.size(); ++i) {
+      ASSERT_EQ(back[k].loops[i].size(), layers[k].loops[i].size());
+      for (j = 0; j < layers[k].loops[i].size(); ++j) {
+        const gvec& a = back[k].loops[i][j];
+        const gvec& b = layers[k].loops[i][j];
+        EXPECT_EQ(a[0], float(b[0]));
+        EXPECT_EQ(a[1], float(b[1]));
+        EXPECT_EQ(a[2], layers[k].height);
+      }
+    }
+  }
+
+  save_layers("test_slice.lmsl", layers);
+  vector<layer_contours> loaded = load_layers("test_slice.lmsl");
+  vector<unsigned char> again;
+  encode_layers(loaded, again);
+  EXPECT_EQ(again, data);
+  remove("test_slice.lmsl");
+
+  EXPECT_THROW(decode_layers(&data[0], 8), invalid_argument);
+  EXPECT_THROW(decode_layers(&data[0], data.size() - 1), invalid_argument);
+  data[0] = 'X';
+  EXPECT_THROW(decode_layers(&data[0], data.size()), invalid_argument);
+  EXPECT_THROW(load_layers("no/such/file.lmsl"), runtime_error);
+}
+
+TEST(Slice, test_write_svg) {
+  shared_ptr<Intersection> c = cube(0.0, 0.0, 0.0);
+  write_svg("test_slice.svg", slice_layers(*c, {0.5})[0]);
+  ifstream in("test_slice.svg");
+  stringstream svg;
+  svg << in.rdbuf();
+  EXPECT_EQ(svg.str().find("<?xml"), 0u);
+  EXPECT_NE(svg.str().find("<path"), string::npos);
+  EXPECT_NE(svg.str().find(" Z"), string::npos);
+  remove("test_slice.svg");
+  EXPECT_THROW(write_svg("no/such/dir/x.svg", layer_contours()),
+               runtime_error);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,133 @@
+/* layermesh/test/test_stats.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The recording macros are enabled here whatever the library was built with,
+// so that the stats layer itself is always tested; the library's own
+// instrumentation is only checked in a `make STATS=1` build.
+#ifndef LAYERMESH_STATS
+#define LAYERMESH_STATS
+#endif
+
+#include <stdlib.h>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+#include <stats.hpp>
+#include <stl.hpp>
+#include <tetrahedron.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+static uint64_t hits_of(const stats_snapshot& stats, const Atom* atom) {
+  vector<atom_stats>::const_iterator it = stats.atoms.begin();
+  for (; it != stats.atoms.end(); ++it) {
+    if (it->atom == atom) return it->hits;
+  }
+  return 0;
+}
+
+TEST(Stats, test_counts_from_all_threads) {
+  reset_stats();
+  const Atom* atom = reinterpret_cast<const Atom*>(0x1000);
+
+  vector<thread> workers;
+  unsigned t;
+  for (t = 0; t < 4; ++t) {
+    workers.push_back(thread([atom]() {
+      unsigned i;
+      for (i = 0; i < 100; ++i) {
+        LAYERMESH_COUNT(STAT_FACETS_ENCODED, 2);
+        LAYERMESH_COUNT_CONTAINS(atom, i % 4 == 0, i % 4 != 0);
+      }
+    }));
+  }
+  for (t = 0; t < 4; ++t) {
+    workers[t].join();
+  }
+  // and from this thread, which is still running:
+  LAYERMESH_COUNT(STAT_FACETS_ENCODED, 1);
+  {
+    LAYERMESH_TIME_SCOPE(STAT_TIME_IO);
+  }
+
+  stats_snapshot stats = get_stats();
+  EXPECT_EQ(stats.counters[STAT_FACETS_ENCODED], 801u);
+  EXPECT_EQ(stats.counters[STAT_CONTAINS_CALLS], 400u);
+  EXPECT_EQ(stats.counters[STAT_CONTAINS_HITS], 100u);
+  EXPECT_EQ(hits_of(stats, atom), 100u);
+
+  reset_stats();
+  stats = get_stats();
+  EXPECT_EQ(stats.counters[STAT_FACETS_ENCODED], 0u);
+  EXPECT_EQ(stats.nanoseconds[STAT_TIME_IO], 0u);
+  EXPECT_TRUE(stats.atoms.empty());
+}
+
+TEST(Stats, test_contains_batch_counts) {
+  reset_stats();
+  const Atom* atom = reinterpret_cast<const Atom*>(0x2000);
+  unsigned char mask[] = {1, 0, 0, 1, 1};
+  LAYERMESH_COUNT_CONTAINS_BATCH(atom, mask, 5);
+
+  stats_snapshot stats = get_stats();
+  ASSERT_EQ(stats.atoms.size(), 1u);
+  EXPECT_EQ(stats.atoms[0].hits, 3u);
+  EXPECT_EQ(stats.atoms[0].rejects, 2u);
+
+  ostringstream out;
+  write_stats(out, stats);
+  EXPECT_NE(out.str().find("contains_hits 3\n"), string::npos) << out.str();
+  EXPECT_NE(out.str().find("hit_ratio 0.6"), string::npos) << out.str();
+}
+
+TEST(Stats, test_library_instrumentation) {
+  if (!stats_enabled()) {
+    return;
+  }
+  reset_stats();
+  gvec_list points;
+  points.push_back(gvec(0.0, 0.0, 0.0));
+  points.push_back(gvec(1.0, 0.0, 0.0));
+  points.push_back(gvec(0.0, 1.0, 0.0));
+  points.push_back(gvec(0.0, 0.0, 1.0));
+  Tetrahedron t(points);
+  t.contains(gvec(0.1, 0.1, 0.1));
+  t.contains(gvec(1.0, 1.0, 1.0));
+  IndexedMesh mesh(points, *t.hull_facets());
+  mesh.save_stl("stats.stl", true);
+
+  stats_snapshot stats = get_stats();
+  EXPECT_EQ(hits_of(stats, &t), 1u);
+  EXPECT_EQ(stats.counters[STAT_CONTAINS_CALLS], 2u);
+  EXPECT_EQ(stats.counters[STAT_FACETS_ENCODED], 4u);
+  EXPECT_EQ(stats.counters[STAT_BYTES_WRITTEN], binary_stl_size(4));
+  EXPECT_GT(stats.nanoseconds[STAT_TIME_SAVE_STL], 0u);
+  EXPECT_GE(stats.nanoseconds[STAT_TIME_SAVE_STL],
+            stats.nanoseconds[STAT_TIME_NORMALS] +
+            stats.nanoseconds[STAT_TIME_IO]);
+
+  system("rm stats.stl");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,257 @@
+/* layermesh/test/test_stl.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <stl.hpp>
+#include <normals.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+#define FILENAME "foo.stl"
+
+namespace {
+
+  // a strip of triangles, long enough to need several streamed chunks:
+  void generate_strip(size_t num_facets,
+                      gvec_list& points,
+                      facet_triples& facets) {
+    size_t i;
+    for (i = 0; i < num_facets / 2 + 2; ++i) {
+      points.push_back(gvec(0.5 * i, 0.0, 0.0));
+      points.push_back(gvec(0.5 * i, 1.0, 0.25 * i));
+    }
+    for (i = 0; i < num_facets; ++i) {
+      unsigned base = 2 * (i / 2);
+      if (i % 2 == 0) {
+        facets.push_back({{base, base + 2, base + 1}});
+      } else {
+        facets.push_back({{base + 1, base + 2, base + 3}});
+      }
+    }
+  }
+
+  string read_file(const char* filename) {
+    ifstream f(filename, ios::binary);
+    return string(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+  }
+
+}
+
+TEST(stl, test_binary_layout) {
+  gvec_list points;
+  points.push_back(gvec(0.0, 0.0, 0.0));
+  points.push_back(gvec(1.0, 0.0, 0.0));
+  points.push_back(gvec(0.0, 2.0, 0.0));
+  facet_triples facets(1, {{0, 1, 2}});
+
+  write_binary_stl(FILENAME, points, facets, stl_buffered);
+  string contents = read_file(FILENAME);
+
+  ASSERT_EQ(contents.size(), binary_stl_size(1)) << "wrong file size.";
+  EXPECT_EQ(contents.compare(0, 9, "layermesh"), 0) << "wrong header.";
+
+  uint32_t num_facets;
+  memcpy(&num_facets, &contents[80], 4);
+  EXPECT_EQ(num_facets, 1u) << "wrong facet count.";
+
+  float record[12];
+  memcpy(record, &contents[84], 48);
+  EXPECT_EQ(record[2], 1.0f) << "wrong normal.";
+  EXPECT_EQ(record[6], 1.0f) << "wrong second vertex.";
+  EXPECT_EQ(record[10], 2.0f) << "wrong third vertex.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl, test_write_modes_agree) {
+  gvec_list points;
+  facet_triples facets;
+  generate_strip(100001, points, facets);
+
+  write_binary_stl(FILENAME, points, facets, stl_buffered);
+  string buffered = read_file(FILENAME);
+  EXPECT_EQ(buffered.size(), binary_stl_size(facets.size()))
+    << "wrong file size.";
+
+  write_binary_stl(FILENAME, points, facets, stl_mapped);
+  EXPECT_TRUE(read_file(FILENAME) == buffered)
+    << "mapped file differs from buffered file.";
+
+  write_binary_stl(FILENAME, points, facets, stl_streamed);
+  EXPECT_TRUE(read_file(FILENAME) == buffered)
+    << "streamed file differs from buffered file.";
+
+  write_binary_stl(FILENAME, points, facets, stl_mapped, 4);
+  EXPECT_TRUE(read_file(FILENAME) == buffered)
+    << "file encoded by several threads differs from buffered file.";
+
+  write_binary_stl(FILENAME, points, facets, stl_streamed, 3);
+  EXPECT_TRUE(read_file(FILENAME) == buffered)
+    << "streamed file encoded by several threads differs from buffered file.";
+
+  gvec32_list points32;
+  gvec_list::const_iterator it = points.begin();
+  for (; it != points.end(); ++it) {
+    points32.push_back(gvec32(*it));
+  }
+  write_binary_stl(FILENAME, points32, facets, stl_auto);
+  EXPECT_TRUE(read_file(FILENAME) == buffered)
+    << "single precision file differs from double precision file.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl, test_supplied_normals_are_used) {
+  gvec_list points;
+  facet_triples facets;
+  generate_strip(1001, points, facets);
+
+  vector<double> x(facets.size()), y(facets.size()), z(facets.size());
+  facet_normals_batch(points, facets, 0, facets.size(), &x[0], &y[0], &z[0]);
+  gvec_list normals;
+  size_t i;
+  for (i = 0; i < facets.size(); ++i) {
+    normals.push_back(gvec(x[i], y[i], z[i]));
+  }
+
+  write_binary_stl(FILENAME, points, facets, stl_buffered);
+  string computed = read_file(FILENAME);
+  write_binary_stl(FILENAME, points, facets, stl_buffered, 1, &normals);
+  EXPECT_TRUE(read_file(FILENAME) == computed)
+    << "file with supplied normals differs from file with computed normals.";
+
+  write_ascii_stl(FILENAME, points, facets);
+  computed = read_file(FILENAME);
+  write_ascii_stl(FILENAME, points, facets, &normals);
+  EXPECT_TRUE(read_file(FILENAME) == computed)
+    << "ascii file with supplied normals differs.";
+
+  // and they really are taken from the list, rather than recomputed:
+  normals[0] = gvec(0.0, 0.0, -1.0);
+  write_binary_stl(FILENAME, points, facets, stl_buffered, 1, &normals);
+  string supplied = read_file(FILENAME);
+  float record[3];
+  memcpy(record, supplied.data() + STL_HEADER_BYTES, sizeof(record));
+  EXPECT_EQ(record[2], -1.0f) << "supplied normal wasn't written.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl, test_empty_mesh) {
+  gvec_list points;
+  facet_triples facets;
+
+  write_binary_stl(FILENAME, points, facets, stl_streamed);
+  EXPECT_EQ(read_file(FILENAME).size(), STL_HEADER_BYTES)
+    << "empty mesh should be just a header.";
+
+  system("rm " FILENAME);
+}
+
+namespace {
+
+  string ostream_float(float v) {
+    ostringstream s;
+    s << v;
+    return s.str();
+  }
+
+  string formatted_float(float v) {
+    char buffer[STL_FLOAT_CHARS];
+    size_t length = format_stl_float(buffer, v);
+    EXPECT_LE(length, STL_FLOAT_CHARS) << "formatted float too long.";
+    return string(buffer, length);
+  }
+
+}
+
+TEST(stl, test_float_format_matches_ostream) {
+  float values[] = {
+    0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 0.1f, 0.25f, 3.14159f, -2.5f, 10.0f,
+    100.0f, 12345.0f, 123456.0f, 1e6f, 1.5e6f, 1234560.0f, 1e7f, 0.001f,
+    0.0001f, 0.00012f, 1e-5f, 1.5e-5f, 2.5e-10f, 3e38f, 1e-38f,
+    0.57735f, -0.707107f, 1e20f, 65536.0f
+  };
+  unsigned i;
+  for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+    EXPECT_EQ(formatted_float(values[i]), ostream_float(values[i]))
+      << "doesn't match the ostream for value " << i;
+  }
+}
+
+TEST(stl, test_float_format_round_trips) {
+  srand(3);
+  unsigned i;
+  for (i = 0; i < 200000; ++i) {
+    uint32_t bits = (static_cast<uint32_t>(rand()) << 16) ^ rand();
+    float v;
+    memcpy(&v, &bits, 4);
+    if (v != v) continue;
+    string s = formatted_float(v);
+    float back = strtof(s.c_str(), NULL);
+    ASSERT_EQ(memcmp(&back, &v, 4), 0)
+      << s << " doesn't read back as the float it was written from.";
+  }
+}
+
+TEST(stl, test_ascii_file) {
+  gvec_list points;
+  points.push_back(gvec(0.0, 0.0, 0.0));
+  points.push_back(gvec(1.0, 0.0, 0.0));
+  points.push_back(gvec(0.0, 2.5, 0.0));
+  facet_triples facets(1, {{0, 1, 2}});
+
+  write_ascii_stl(FILENAME, points, facets);
+
+  EXPECT_EQ(read_file(FILENAME),
+            "solid layermesh\n"
+            "  facet normal 0 0 1\n"
+            "    outer loop\n"
+            "      vertex 0 0 0\n"
+            "      vertex 1 0 0\n"
+            "      vertex 0 2.5 0\n"
+            "    endloop\n"
+            "  endfacet\n"
+            "endsolid layermesh\n") << "unexpected ASCII STL contents.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl, test_unwritable_file_throws) {
+  gvec_list points;
+  facet_triples facets;
+
+  EXPECT_THROW(write_binary_stl("no/such/directory.stl", points, facets),
+               runtime_error) << "failed write wasn't reported.";
+  EXPECT_THROW(write_ascii_stl("no/such/directory.stl", points, facets),
+               runtime_error) << "failed write wasn't reported.";
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,195 @@
+/* layermesh/test/test_stl_reader.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <gtest/gtest.h>
+#include <fstream>
+#include <stdexcept>
+#include <stl.hpp>
+#include <stl_reader.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+#define FILENAME "foo.stl"
+
+namespace {
+
+  // a strip of triangles, long enough to be split between several threads:
+  void generate_strip(size_t num_facets,
+                      gvec_list& points,
+                      facet_triples& facets) {
+    size_t i;
+    for (i = 0; i < num_facets / 2 + 2; ++i) {
+      points.push_back(gvec(0.5 * i, 0.0, 0.0));
+      points.push_back(gvec(0.5 * i, 1.0, 0.25 * i));
+    }
+    for (i = 0; i < num_facets; ++i) {
+      unsigned base = 2 * (i / 2);
+      if (i % 2 == 0) {
+        facets.push_back({{base, base + 2, base + 1}});
+      } else {
+        facets.push_back({{base + 1, base + 2, base + 3}});
+      }
+    }
+  }
+
+  void write_file(const char* filename, const string& contents) {
+    ofstream f(filename, ios::binary);
+    f << contents;
+  }
+
+  // true if the two meshes have the same facets, vertex for vertex.
+  // the number of points the facets actually use:
+  size_t used_points(const gvec_list& points, const facet_triples& facets) {
+    vector<bool> used(points.size(), false);
+    size_t f, count = 0;
+    unsigned k;
+    for (f = 0; f < facets.size(); ++f) {
+      for (k = 0; k < 3; ++k) {
+        if (!used[facets[f][k]]) ++count;
+        used[facets[f][k]] = true;
+      }
+    }
+    return count;
+  }
+
+  bool same_facets(const gvec_list& points_a, const facet_triples& facets_a,
+                   const gvec_list& points_b, const facet_triples& facets_b) {
+    if (facets_a.size() != facets_b.size()) {
+      return false;
+    }
+    size_t f;
+    unsigned k;
+    for (f = 0; f < facets_a.size(); ++f) {
+      for (k = 0; k < 3; ++k) {
+        const gvec& a = points_a[facets_a[f][k]];
+        const gvec& b = points_b[facets_b[f][k]];
+        if (a[0] != b[0] || a[1] != b[1] || a[2] != b[2]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+}
+
+TEST(stl_reader, test_binary_round_trip) {
+  IndexedMesh original;
+  generate_strip(100001, original.points, original.facets);
+  original.save_stl(FILENAME);
+
+  IndexedMesh loaded;
+  read_stl(FILENAME, loaded.points, loaded.facets);
+  EXPECT_EQ(loaded.points.size(),
+            used_points(original.points, original.facets))
+    << "vertices weren't welded back into the original points.";
+  EXPECT_TRUE(same_facets(loaded.points, loaded.facets,
+                          original.points, original.facets))
+    << "loaded facets differ from the saved ones.";
+  facet_triple first_facet = {{0, 1, 2}};
+  EXPECT_TRUE(loaded.facets[0] == first_facet)
+    << "points should be numbered in order of first appearance.";
+
+  gvec_list points;
+  facet_triples facets;
+  read_stl(FILENAME, points, facets, 4);
+  EXPECT_TRUE(points.size() == loaded.points.size() &&
+              facets == loaded.facets &&
+              same_facets(points, facets, loaded.points, loaded.facets))
+    << "reading on several threads gave a different mesh.";
+
+  gvec32_list points32;
+  read_stl(FILENAME, points32, facets);
+  EXPECT_EQ(points32.size(), loaded.points.size())
+    << "single precision points differ.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl_reader, test_ascii_round_trip) {
+  IndexedMesh original;
+  generate_strip(1001, original.points, original.facets);
+  original.save_stl(FILENAME, false);
+
+  gvec_list points;
+  facet_triples facets;
+  read_stl(FILENAME, points, facets, 4);
+  EXPECT_EQ(points.size(), used_points(original.points, original.facets))
+    << "vertices weren't welded back into the original points.";
+  EXPECT_TRUE(same_facets(points, facets, original.points, original.facets))
+    << "loaded facets differ from the saved ones.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl_reader, test_welds_negative_zero) {
+  write_file(FILENAME,
+    "solid square\n"
+    "facet normal 0 0 1\n outer loop\n"
+    "  vertex 0 0 0\n  vertex 1 0 0\n  vertex 1 1 0\n"
+    " endloop\nendfacet\n"
+    "facet normal 0 0 1\n outer loop\n"
+    "  vertex -0 0 0\n  vertex 1 1 -0\n  vertex 0 1 0\n"
+    " endloop\nendfacet\n"
+    "endsolid square\n");
+
+  gvec_list points;
+  facet_triples facets;
+  read_stl(FILENAME, points, facets);
+  EXPECT_EQ(points.size(), 4u) << "shared vertices weren't welded.";
+  ASSERT_EQ(facets.size(), 2u) << "wrong number of facets.";
+  EXPECT_EQ(facets[1][0], 0u) << "-0 wasn't welded with 0.";
+  EXPECT_EQ(facets[1][1], 2u) << "shared vertex has the wrong index.";
+
+  system("rm " FILENAME);
+}
+
+TEST(stl_reader, test_bad_files_throw) {
+  gvec_list points;
+  facet_triples facets;
+
+  EXPECT_THROW(read_stl("no/such/file.stl", points, facets), runtime_error)
+    << "missing file wasn't reported.";
+
+  write_file(FILENAME, "");
+  EXPECT_THROW(read_stl(FILENAME, points, facets), runtime_error)
+    << "empty file wasn't reported.";
+
+  write_file(FILENAME, "not an stl file at all");
+  EXPECT_THROW(read_stl(FILENAME, points, facets), runtime_error)
+    << "file that isn't STL wasn't reported.";
+
+  write_file(FILENAME, "solid x\nfacet normal 0 0 1\nouter loop\nvertex 0 0");
+  EXPECT_THROW(read_stl(FILENAME, points, facets), runtime_error)
+    << "truncated ASCII file wasn't reported.";
+
+  write_file(FILENAME, "solid x\nfacet normal 0 0 1\nouter loop\n"
+                       "vertex 0 0 zero\n");
+  EXPECT_THROW(read_stl(FILENAME, points, facets), runtime_error)
+    << "malformed number wasn't reported.";
+
+  system("rm " FILENAME);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
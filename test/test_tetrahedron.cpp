@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <cmath>
 #include <gtest/gtest.h>
 #include <tetrahedron.hpp>
 #include "stl_helper.hpp"
@@ -47,7 +48,13 @@ TEST(Tetrahedron, test_point_retrieval_doesnt_leak_memory) {
   memsafe_gvec_list point_cloud = t.point_cloud();
 
   EXPECT_EQ(point_cloud->size(), 4) << "unexpected point_cloud length.";
+  EXPECT_TRUE(point_cloud == t.point_cloud()) << "point_cloud wasn't cached.";
 
+  gvec_view view = t.point_cloud_view();
+  ASSERT_EQ(view.size(), 4u) << "unexpected point_cloud_view length.";
+  EXPECT_EQ(view.data(), t.point_cloud_view().data())
+    << "point_cloud_view should not copy the points.";
+  EXPECT_EQ(view[1][1], 13.4) << "point_cloud_view doesn't match the points.";
 }
 
 TEST(Tetrahedron, test_boundary_retrieval_doesnt_leak_memory) {
@@ -61,10 +68,16 @@ TEST(Tetrahedron, test_boundary_retrieval_doesnt_leak_memory) {
 
   gsphere boundary = t.get_boundary();
 
-  EXPECT_EQ(boundary.centre[0], 0.25) << "incorrect centroid";
-  EXPECT_EQ(boundary.centre[1], 0.25) << "incorrect centroid";
-  EXPECT_EQ(boundary.centre[2], 0.25) << "incorrect centroid";
+  // (the minimal sphere is that of the facet opposite the origin, which is
+  // smaller than the one about the centroid.)
+  EXPECT_NEAR(boundary.centre[0], 1.0 / 3.0, 1e-12) << "incorrect centre";
+  EXPECT_NEAR(boundary.centre[1], 1.0 / 3.0, 1e-12) << "incorrect centre";
+  EXPECT_NEAR(boundary.centre[2], 1.0 / 3.0, 1e-12) << "incorrect centre";
+  EXPECT_NEAR(boundary.radius, sqrt(2.0 / 3.0), 1e-9) << "incorrect radius";
 
+  gbox box = t.get_aabb();
+  EXPECT_EQ(box.low[0], 0.0);
+  EXPECT_EQ(box.high[2], 1.0);
 }
 
 TEST(Tetrahedron, test_contains) {
@@ -82,6 +95,66 @@ TEST(Tetrahedron, test_contains) {
 
 }
 
+TEST(Tetrahedron, test_contains_batch) {
+  vector<gvec> points;
+  points.push_back(gvec(1.2, 3.4, 5.6));
+  points.push_back(gvec(-0.2, 13.4, -6.5));
+  points.push_back(gvec(7.7, 4.4, 9.2));
+  points.push_back(gvec(-3.4, -5.6, -1.2));
+
+  Tetrahedron t(points);
+
+  const size_t count = 257;
+  vector<double> x(count), y(count), z(count);
+  vector<unsigned char> mask(count);
+
+  srand(42);
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    x[i] = 12.0 * rand() / RAND_MAX - 4.0;
+    y[i] = 20.0 * rand() / RAND_MAX - 6.0;
+    z[i] = 16.0 * rand() / RAND_MAX - 7.0;
+  }
+
+  t.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+
+  for (i = 0; i < count; ++i) {
+    EXPECT_EQ(mask[i] == 1, t.contains(gvec(x[i], y[i], z[i])))
+      << "contains_batch disagrees with contains at point " << i;
+  }
+}
+
+TEST(Tetrahedron, test_single_precision_contains) {
+  gvec32_list points;
+  points.push_back(gvec32(0.0f, 0.0f, 0.0f));
+  points.push_back(gvec32(1.0f, 0.0f, 0.0f));
+  points.push_back(gvec32(0.0f, 1.0f, 0.0f));
+  points.push_back(gvec32(0.0f, 0.0f, 1.0f));
+
+  Tetrahedron32 t(points);
+
+  EXPECT_TRUE(t.contains(gvec(0.1, 0.1, 0.1))) << "can't detect point contained";
+  EXPECT_FALSE(t.contains(gvec(-0.1, 0.1, 0.1))) << "doesn't reject point not contained";
+
+  const size_t count = 101;
+  vector<float> x(count), y(count), z(count);
+  vector<unsigned char> mask(count);
+
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    x[i] = 0.01f * i - 0.2f;
+    y[i] = 0.2f;
+    z[i] = 0.3f;
+  }
+
+  t.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+
+  for (i = 0; i < count; ++i) {
+    EXPECT_EQ(mask[i] == 1, t.contains(gvec(x[i], y[i], z[i])))
+      << "float contains_batch disagrees with contains at point " << i;
+  }
+}
+
 TEST(Tetrahedron, test_can_generate_valid_stl) {
   vector<gvec> points;
   points.push_back(gvec(0.0, 0.0, 0.0));
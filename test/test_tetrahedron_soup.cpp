@@ -0,0 +1,147 @@
+/* layermesh/test/test_tetrahedron_soup.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <tetrahedron_soup.hpp>
+#include <tetrahedron.hpp>
+#include <stl.hpp>
+
+using namespace std;
+using namespace layermesh;
+
+static double uniform(double low, double high) {
+  return low + (high - low) * rand() / RAND_MAX;
+}
+
+// count small tetrahedra scattered through the unit cube (more than the
+// soup's initial capacity, so that it has to grow.)
+template <typename T>
+static vector<basic_gvec_list<T> > random_tetrahedra(unsigned count) {
+  vector<basic_gvec_list<T> > tetrahedra;
+  srand(7);
+  unsigned i, v;
+  for (i = 0; i < count; ++i) {
+    basic_gvec<T> centre(uniform(0.0, 1.0), uniform(0.0, 1.0),
+                         uniform(0.0, 1.0));
+    basic_gvec_list<T> points;
+    for (v = 0; v < 4; ++v) {
+      points.push_back(centre + basic_gvec<T>(uniform(-0.1, 0.1),
+                                              uniform(-0.1, 0.1),
+                                              uniform(-0.1, 0.1)));
+    }
+    tetrahedra.push_back(points);
+  }
+  return tetrahedra;
+}
+
+TEST(TetrahedronSoup, test_push_back_keeps_vertices) {
+  vector<gvec_list> tetrahedra = random_tetrahedra<double>(200);
+  TetrahedronSoup soup;
+  size_t i;
+  for (i = 0; i < tetrahedra.size(); ++i) {
+    soup.push_back(tetrahedra[i]);
+  }
+
+  ASSERT_EQ(soup.size(), 200u);
+  EXPECT_EQ(soup.vertex(0, 0)[0], tetrahedra[0][0][0]);
+  EXPECT_EQ(soup.vertex(199, 3)[2], tetrahedra[199][3][2]);
+  EXPECT_EQ(soup.vertex(100, 2)[1], tetrahedra[100][2][1]);
+
+  EXPECT_THROW(soup.push_back(gvec_list(3)), invalid_argument);
+}
+
+template <typename T>
+static void check_contains_matches_tetrahedra() {
+  vector<basic_gvec_list<T> > tetrahedra = random_tetrahedra<T>(150);
+  BasicTetrahedronSoup<T> soup;
+  vector<BasicTetrahedron<T> > atoms;
+  size_t i, j;
+  for (i = 0; i < tetrahedra.size(); ++i) {
+    soup.push_back(tetrahedra[i]);
+    atoms.push_back(BasicTetrahedron<T>(tetrahedra[i]));
+  }
+
+  const size_t count = 1000;
+  vector<double> x(count), y(count), z(count);
+  vector<unsigned char> mask(count);
+  for (i = 0; i < count; ++i) {
+    x[i] = uniform(0.0, 1.0);
+    y[i] = uniform(0.0, 1.0);
+    z[i] = uniform(0.0, 1.0);
+  }
+  soup.contains_batch(&x[0], &y[0], &z[0], count, &mask[0]);
+
+  size_t contained = 0;
+  for (i = 0; i < count; ++i) {
+    gvec p(x[i], y[i], z[i]);
+    bool any = false;
+    for (j = 0; j < atoms.size(); ++j) {
+      bool inside = atoms[j].contains(p);
+      ASSERT_EQ(soup.contains(j, p), inside) << "tetrahedron " << j;
+      any = any || inside;
+    }
+    EXPECT_EQ(soup.contains(p), any) << "point " << i;
+    EXPECT_EQ(mask[i] == 1, any) << "point " << i;
+    contained += any;
+  }
+  EXPECT_GT(contained, 0u) << "the test points should hit some tetrahedra.";
+}
+
+TEST(TetrahedronSoup, test_contains_matches_tetrahedra) {
+  check_contains_matches_tetrahedra<double>();
+}
+
+TEST(TetrahedronSoup, test_single_precision_contains_matches_tetrahedra) {
+  check_contains_matches_tetrahedra<float>();
+}
+
+TEST(TetrahedronSoup, test_empty_soup_contains_nothing) {
+  TetrahedronSoup soup;
+  float x = 0.5f, y = 0.5f, z = 0.5f;
+  unsigned char mask = 1;
+  soup.contains_batch(&x, &y, &z, 1, &mask);
+
+  EXPECT_FALSE(soup.contains(gvec(0.5, 0.5, 0.5)));
+  EXPECT_EQ(mask, 0);
+}
+
+TEST(TetrahedronSoup, test_save_stl) {
+  vector<gvec_list> tetrahedra = random_tetrahedra<double>(100);
+  TetrahedronSoup soup;
+  size_t i;
+  for (i = 0; i < tetrahedra.size(); ++i) {
+    soup.push_back(tetrahedra[i]);
+  }
+  soup.save_stl("soup.stl", true);
+
+  struct stat st;
+  ASSERT_EQ(stat("soup.stl", &st), 0) << "no file was written.";
+  EXPECT_EQ((size_t)st.st_size, binary_stl_size(400))
+    << "each tetrahedron should have four facets.";
+
+  system("rm soup.stl");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,128 @@
+/* layermesh/test/test_tiff.cpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+#include <tiff.hpp>
+#include "tiff_helper.hpp"
+
+using namespace std;
+using namespace layermesh;
+
+static void expect_round_trip(const vector<unsigned char>& data) {
+  vector<unsigned char> encoded;
+  packbits_encode(data.empty() ? NULL : &data[0], data.size(), encoded);
+  vector<unsigned char> decoded(data.size());
+  size_t used = packbits_decode(encoded.empty() ? NULL : &encoded[0],
+                                encoded.size(),
+                                decoded.empty() ? NULL : &decoded[0],
+                                decoded.size());
+  EXPECT_EQ(used, encoded.size());
+  EXPECT_EQ(decoded, data);
+  // (PackBits never grows data by more than a byte in 128.)
+  EXPECT_LE(encoded.size(), data.size() + (data.size() + 127) / 128);
+}
+
+TEST(Tiff, test_packbits_round_trip) {
+  expect_round_trip(vector<unsigned char>());
+  expect_round_trip(vector<unsigned char>(1, 7));
+  expect_round_trip(vector<unsigned char>(1000, 255));
+
+  srand(4);
+  vector<unsigned char> noise(1000), mixed;
+  size_t i;
+  for (i = 0; i < noise.size(); ++i) {
+    noise[i] = rand() % 256;
+  }
+  expect_round_trip(noise);
+  // runs of every length, between literals:
+  for (i = 1; i < 300; ++i) {
+    mixed.insert(mixed.end(), i, static_cast<unsigned char>(i));
+    mixed.push_back(0);
+    mixed.push_back(1);
+  }
+  expect_round_trip(mixed);
+
+  vector<unsigned char> encoded;
+  vector<unsigned char> slice(512, 0);
+  fill(slice.begin() + 100, slice.begin() + 300, 255);
+  packbits_encode(&slice[0], slice.size(), encoded);
+  EXPECT_LE(encoded.size(), 12u) << "long runs should compress well.";
+}
+
+TEST(Tiff, test_packbits_refuses_bad_input) {
+  // (a literal of 4 bytes with only 2 given, and a repeat with no byte.)
+  unsigned char literal[] = {3, 1, 2};
+  unsigned char repeat[] = {0xFE};
+  unsigned char out[8];
+  EXPECT_THROW(packbits_decode(literal, 3, out, 4), invalid_argument);
+  EXPECT_THROW(packbits_decode(repeat, 1, out, 3), invalid_argument);
+  EXPECT_THROW(packbits_decode(literal, 3, out, 1), invalid_argument);
+}
+
+static void write_and_read(tiff_compression compression) {
+  const unsigned width = 37, height = 11, pages = 5;
+  vector<vector<unsigned char> > written;
+  {
+    TiffWriter out("test.tiff", width, height, compression);
+    unsigned p;
+    size_t i;
+    for (p = 0; p < pages; ++p) {
+      vector<unsigned char> page(width * height);
+      for (i = 0; i < page.size(); ++i) {
+        page[i] = (i / 7 + p) % 3 == 0 ? 255 : (i % 5) * p;
+      }
+      out.write_page(&page[0]);
+      written.push_back(page);
+    }
+    EXPECT_EQ(out.pages(), pages);
+    out.close();
+  }
+  tiff_pages read = read_tiff("test.tiff");
+  EXPECT_EQ(read.width, width);
+  EXPECT_EQ(read.height, height);
+  EXPECT_EQ(read.compression, unsigned(compression));
+  EXPECT_EQ(read.pages, written);
+  remove("test.tiff");
+}
+
+TEST(Tiff, test_multi_page_uncompressed) {
+  write_and_read(tiff_uncompressed);
+}
+
+TEST(Tiff, test_multi_page_packbits) {
+  write_and_read(tiff_packbits);
+}
+
+TEST(Tiff, test_writer_errors) {
+  EXPECT_THROW(TiffWriter("/nonexistent/test.tiff", 4, 4), runtime_error);
+  EXPECT_THROW(TiffWriter("test.tiff", 0, 4), invalid_argument);
+  TiffWriter empty("test.tiff", 4, 4);
+  EXPECT_THROW(empty.close(), runtime_error)
+    << "a TIFF must have at least one page.";
+  remove("test.tiff");
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,111 @@
+/* layermesh/test/tiff_helper.hpp
+ * Copyright Joe Jordan <joe@joe-jordan.co.uk> 2017.
+ *
+ * This file is part of Layermesh.
+ *
+ * Layermesh is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Layermesh is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Layermesh.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <tiff.hpp>
+
+// A TIFF as read back by read_tiff(): just what TiffWriter writes.
+struct tiff_pages {
+  unsigned width, height;
+  unsigned compression;
+  std::vector<std::vector<unsigned char> > pages;
+};
+
+inline uint32_t tiff_read(const std::vector<unsigned char>& file,
+                          std::size_t offset, unsigned bytes) {
+  if (offset + bytes > file.size()) {
+    throw std::runtime_error("TIFF offset past the end of the file.");
+  }
+  uint32_t v = 0;
+  unsigned i;
+  for (i = 0; i < bytes; ++i) {
+    v |= uint32_t(file[offset + i]) << (8 * i);
+  }
+  return v;
+}
+
+// Reads every page of an 8 bit greyscale, single strip, little-endian TIFF,
+// throwing std::runtime_error if it isn't one.
+inline tiff_pages read_tiff(const std::string& filename) {
+  std::ifstream in(filename.c_str(), std::ios::binary);
+  std::vector<unsigned char> file((std::istreambuf_iterator<char>(in)),
+                                  std::istreambuf_iterator<char>());
+  if (file.size() < 8 || file[0] != 'I' || file[1] != 'I' ||
+      tiff_read(file, 2, 2) != 42) {
+    throw std::runtime_error("not a little-endian TIFF.");
+  }
+  tiff_pages ret;
+  ret.width = ret.height = ret.compression = 0;
+  uint32_t ifd = tiff_read(file, 4, 4);
+  while (ifd != 0) {
+    if (ifd % 2 != 0) throw std::runtime_error("directory not word aligned.");
+    unsigned entries = tiff_read(file, ifd, 2), e;
+    uint32_t width = 0, height = 0, bits = 0, compression = 1, offset = 0,
+             bytes = 0, previous_tag = 0;
+    for (e = 0; e < entries; ++e) {
+      std::size_t entry = ifd + 2 + 12 * e;
+      uint32_t tag = tiff_read(file, entry, 2);
+      uint32_t type = tiff_read(file, entry + 2, 2);
+      uint32_t value = tiff_read(file, entry + 8, type == 3 ? 2 : 4);
+      if (tag <= previous_tag) throw std::runtime_error("tags out of order.");
+      previous_tag = tag;
+      switch (tag) {
+        case 256: width = value; break;
+        case 257: height = value; break;
+        case 258: bits = value; break;
+        case 259: compression = value; break;
+        case 273: offset = value; break;
+        case 279: bytes = value; break;
+      }
+    }
+    if (bits != 8 || width == 0 || height == 0) {
+      throw std::runtime_error("not an 8 bit image.");
+    }
+    if (offset + std::size_t(bytes) > file.size()) {
+      throw std::runtime_error("strip past the end of the file.");
+    }
+    ret.width = width;
+    ret.height = height;
+    ret.compression = compression;
+    std::vector<unsigned char> page(std::size_t(width) * height);
+    if (compression == layermesh::tiff_packbits) {
+      std::size_t used = 0;
+      unsigned row;
+      for (row = 0; row < height; ++row) {
+        used += layermesh::packbits_decode(&file[offset + used],
+                                           bytes - used,
+                                           &page[std::size_t(row) * width],
+                                           width);
+      }
+      if (used != bytes) throw std::runtime_error("strip has extra bytes.");
+    } else {
+      if (bytes != page.size()) throw std::runtime_error("wrong strip size.");
+      std::copy(file.begin() + offset, file.begin() + offset + bytes,
+                page.begin());
+    }
+    ret.pages.push_back(page);
+    ifd = tiff_read(file, ifd + 2 + 12 * entries, 4);
+  }
+  return ret;
+}